@@ -45,7 +45,7 @@ void Renderer::RenderScene() {
             Matrix4::Rotation(rotation, Vector3(0, 1, 0)) *
             Matrix4::Scale(Vector3(scale, scale, scale));
 
-        glUniformMatrix4fv(glGetUniformLocation(matrixShader->GetProgram(), "modelMatrix"), 1, false, modelMatrix.values);
+        matrixShader->SetUniform("modelMatrix", modelMatrix);
         triangle->Draw();
     }
 }
@@ -54,8 +54,7 @@ void Renderer::RenderScene() {
     glActiveTexture(GL_TEXTURE0);
 
     for (unsigned int i = 0; i < 2; ++i) {
-        glUniformMatrix4fv(glGetUniformLocation(shader->GetProgram(), "modelMatrix"), 1, GL_FALSE,
-            (float*)&Matrix4::Translation(positions[i]));
+        shader->SetUniform("modelMatrix", Matrix4::Translation(positions[i]));
         glBindTexture(GL_TEXTURE_2D, textures[i]);
         meshes[i]->Draw();
     }
@@ -50,7 +50,7 @@ void Renderer::DrawNode(SceneNode* n) {
     if (n->GetMesh()) {
         Matrix4 model = n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale());
 
-        glUniformMatrix4fv(glGetUniformLocation(shader->GetProgram(), "modelMatrix"), 1, GL_FALSE, model.values);
+        shader->SetUniform("modelMatrix", model);
         glUniform4fv(glGetUniformLocation(shader->GetProgram(), "nodeColour"), 1, (float*)&n->GetColour());
         glUniform1i(glGetUniformLocation(shader->GetProgram(), "useTexture"), 0); // Next tutorial ;)
 
@@ -97,8 +97,7 @@ void Renderer::DrawNodes() {
 void Renderer::DrawNode(SceneNode* n) {
     if (n->GetMesh()) {
         Matrix4 model = n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale());
-        glUniformMatrix4fv(glGetUniformLocation(shader->GetProgram(), "modelMatrix"),
-            1, false, model.values);
+        shader->SetUniform("modelMatrix", model);
 
         glUniform4fv(glGetUniformLocation(shader->GetProgram(), "nodeColour"),
             1, (float*)&n->GetColour());
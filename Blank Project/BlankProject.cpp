@@ -1,5 +1,6 @@
 #include "../nclgl/window.h"
 #include "Renderer.h"
+#include "../nclgl/AllocationCounterHooks.h"
 
 int main() {
 	Window w("Coursework!", 1280, 720, false);
@@ -20,7 +21,7 @@ int main() {
 		renderer.UpdateScene(timestep);
 		renderer.RenderScene();
 		renderer.SwapBuffers();
-		if (Window::GetKeyboard()->KeyDown(KEYBOARD_F5)) {
+		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F5)) {
 			Shader::ReloadAllShaders();
 		}
 		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F1)) {
@@ -32,6 +33,15 @@ int main() {
 		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F3)) {
 			renderer.TogglePostProcess();
 		}
+		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F4)) {
+			renderer.PrintDrawStats();
+		}
+		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F6)) {
+			renderer.ToggleGPUCulling();
+		}
+		if (Window::GetKeyboard()->KeyTriggered(KEYBOARD_F7)) {
+			renderer.BenchmarkShaderStartup();
+		}
 	}
 	return 0;
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #include "Renderer.h"
+#include "../nclgl/AllocationCounter.h"
 #include "../nclgl/Camera.h"
+#include "../nclgl/UniformRing.h"
 #include "../nclgl/HeightMap.h"
 #include "../nclgl/MeshAnimation.h"
 #include "../nclgl/MeshMaterial.h"
+#include "../nclgl/AssetLoader.h"
+#include "../nclgl/JobSystem.h"
+#include "../nclgl/ProgramCache.h"
+#include "../nclgl/GameTimer.h"
 #include <algorithm>
 
 Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
@@ -10,6 +16,7 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
 
     heightMap = new HeightMap(TEXTUREDIR "valleyTex.png");
     heightMap->SetPrimitiveType(GL_PATCHES);
+    heightMap->GenerateOccluder(TERRAIN_OCCLUDER_STEP, terrainOccluderPositions, terrainOccluderIndices);
     camera = new Camera(-40, 270, Vector3());
 
     Vector3 dimensions = heightMap->GetHeightmapSize();
@@ -42,10 +49,21 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
             GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     }
 
+    batchInstances = new InstanceBuffer();
+    indirectCuller = new IndirectCuller();
+    if (!indirectCuller->LoadSuccess()) {
+        std::cerr << "Instance culling shader failed! Drawing instances without culling instead." << std::endl;
+        gpuCulling = false;
+    }
+    drawBatcher.SetBatchShader(SCENE_SHADER);
+    transparentNodeList.SetArena(frameArena);
+    nodeList.SetArena(frameArena);
+    culledNodes.SetArena(frameArena);
+
     glGenFramebuffers(1, &bufferFBO);     // We'll render the scene into this
     glGenFramebuffers(1, &processFBO);    // And do post processing in this
 
-    glBindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, bufferDepthTex, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, bufferDepthTex, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[0], 0);
@@ -56,21 +74,21 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
         return;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
     projMatrix = Matrix4::Perspective(1.0f, 80000.0f,
         static_cast<float>(width) / static_cast<float>(height),
         45.0f);
 
-    glEnable(GL_DEPTH_TEST);
+    glState.Enable(GL_DEPTH_TEST);
     glClipControl(GL_LOWER_LEFT,
         GL_ZERO_TO_ONE);
 
-    glEnable(GL_CULL_FACE);
+    glState.Enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glState.Enable(GL_BLEND);
+    glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     waterRotate = 0.0f;
     waterCycle = 0.0f;
@@ -82,6 +100,9 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
 
     root1 = new SceneNode();
     root2 = new SceneNode();
+    assetLoader = new AssetLoader();
+    assetLoader->SetVertexLayout(VERTEX_LAYOUT_PACKED);
+    assetLoader->SetMeshLoadFlags(MESH_LOAD_TANGENT_FRAMES | MESH_LOAD_GENERATE_LODS);
     SetMeshes();
 
     light = new Light(dimensions * Vector3(0.2f, 15.0f, 0.5f),
@@ -100,6 +121,9 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
     snow->SetInstances(particles, PARTICLE_NUM);
     snow->SetPrimitiveType(GL_POINTS);
 
+    // The setup above binds textures and buffers directly, not through glState
+    glState.Invalidate();
+
     init = true;
 }
 
@@ -109,13 +133,16 @@ Renderer::~Renderer(void) {
     delete root1;
     delete root2;
     delete quad;
-    delete anim;
     delete light;
+    delete assetLoader;
+    ResourceCache::GetSharedCache().Clear();
 
     glDeleteTextures(2, bufferColourTex);
     glDeleteTextures(1, &bufferDepthTex);
     glDeleteFramebuffers(1, &bufferFBO);
     glDeleteFramebuffers(1, &processFBO);
+    delete batchInstances;
+    delete indirectCuller;
 
     for (Shader* shader : shaderVec) {
         delete shader;
@@ -124,6 +151,23 @@ Renderer::~Renderer(void) {
 }
 
 void Renderer::UpdateScene(float dt) {
+    size_t allocations = AllocationCounter::GetAllocationCount();
+    frameAllocations = allocations - allocationsAtFrameStart;
+    allocationsAtFrameStart = allocations;
+
+    // Once everything has loaded and the first frames have grown the arenas,
+    // pools and buffers they need, a frame shouldn't touch the heap at all
+    if (!pendingNodes.empty() || !assetLoader->IsIdle()) {
+        steadyFrames = 0;
+    }
+    else if (++steadyFrames > STEADY_FRAME_WARMUP && frameAllocations != 0) {
+        std::cerr << "Warning: " << frameAllocations << " heap allocations in a steady frame!" << std::endl;
+        steadyFrames = 0; // Not again until another warm-up, rather than every frame
+    }
+
+    assetLoader->ProcessUploads();
+    AttachLoadedAssets();
+
     camera->UpdateCamera(dt);
     viewMatrix = camera->BuildViewMatrix();
     projMatrix = Matrix4::Perspective(1.0f, 80000.0f,
@@ -139,8 +183,22 @@ void Renderer::UpdateScene(float dt) {
     windTranslate += dt * (0.015f + cos(dt * 0.01f) * 0.01f);
     windStrength = 0.3f * sin(dt * 0.05f) * 0.29;
 
-    frameFrustum.FromMatrix(projMatrix * viewMatrix);
-    (activeScene ? root1 : root2)->Update(dt);
+    frameViewProj = projMatrix * viewMatrix;
+    frameFrustum.FromMatrix(frameViewProj);
+    lodPixelScale = projMatrix.values[5] * height * 0.5f;
+
+    // The scene is updated and then culled on the job system, while this thread
+    // gets on with the rest - and then helps out with whatever's left
+    SceneNode* root = activeScene ? root1 : root2;
+    JobSystem& jobs = JobSystem::GetSharedJobSystem();
+    JobCounter nodesUpdated;
+    JobCounter nodesCulled;
+
+    jobs.Run([=]() { root->Update(dt); }, nodesUpdated);
+    jobs.RunAfter(nodesUpdated, [=]() {
+        BuildNodeLists(root);
+        SortNodeLists();
+    }, nodesCulled);
 
     if (activeScene) {
     lightParam += dt * 0.005f;
@@ -148,26 +206,32 @@ void Renderer::UpdateScene(float dt) {
     light->SetColour(lerp(Vector4(1.0f, 1.0f, 1.0f, 1.0f), Vector4(1.0f, 0.5f, 0.0f, 1.0f), lightParam));
     }
     postTex = 0;
+
+    jobs.Wait(nodesUpdated);
+    jobs.Wait(nodesCulled);
 }
 
 void Renderer::RenderScene() {
     DrawScene();
     if (postProcess) { DrawPostProcess(); }
     PresentScene();
+
+    frameUniformStats = Shader::GetUniformStats();
+    Shader::ResetUniformStats();
+    frameStateStats = glState.GetStats();
+    glState.ResetStats();
 }
 
 void Renderer::DrawScene() {
-    glBindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
-    glEnable(GL_STENCIL_TEST);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
+    glState.Enable(GL_STENCIL_TEST);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
     
     glStencilFunc(GL_ALWAYS, 2, ~0);
     glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 
+    // The node lists were built and sorted in UpdateScene
     if (activeScene) {
-        BuildNodeLists(activeScene ? root1 : root2);
-        SortNodeLists();
-
         DrawGround();
 
         DrawNodes();
@@ -176,9 +240,6 @@ void Renderer::DrawScene() {
         DrawWater();
     }
     else {
-        BuildNodeLists(root2);
-        SortNodeLists();
-
         BindShader(shaderVec[SCENE_SHADER]);
         DrawGround();
         DrawNodes();
@@ -189,12 +250,12 @@ void Renderer::DrawScene() {
     }
 
     DrawSkybox();
-    glDisable(GL_STENCIL_TEST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.Disable(GL_STENCIL_TEST);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 void Renderer::DrawPostProcess() {
    
-    glBindFramebuffer(GL_FRAMEBUFFER, processFBO);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, processFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[1], 0);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
@@ -206,26 +267,25 @@ void Renderer::DrawPostProcess() {
     textureMatrix.ToIdentity();
     UpdateShaderMatrices();
 
-    glDisable(GL_DEPTH_TEST);
+    glState.Disable(GL_DEPTH_TEST);
 
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "sceneTex"), 0);
+    shader->SetUniform("sceneTex", 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[1], 0);
-    glBindTexture(GL_TEXTURE_2D, bufferColourTex[0]);
+    glState.BindTexture(0, GL_TEXTURE_2D, bufferColourTex[0]);
     quad->Draw();
 
     postTex = !postTex;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glEnable(GL_DEPTH_TEST);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.Enable(GL_DEPTH_TEST);
 }
 
 void Renderer::changeScene() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glDepthMask(GL_FALSE);
-    glDisable(GL_STENCIL_TEST);
+    glState.DepthMask(GL_FALSE);
+    glState.Disable(GL_STENCIL_TEST);
     shader = shaderVec[SKYBOX_SHADER];
     BindShader(shader);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "useColour"), GL_TRUE);
+    shader->SetUniform("useColour", GL_TRUE);
     auto freezeFrame = [this]() {
         quad->Draw();
         SwapBuffers();
@@ -241,25 +301,26 @@ void Renderer::changeScene() {
         SwapBuffers();
     };
    
-    glUniform4f(glGetUniformLocation(shader->GetProgram(), "colour"), 0.0f, 0.0f, 0.0f, 1.0f);
+    shader->SetUniform("colour", Vector4(0.0f, 0.0f, 0.0f, 1.0f));
     freezeFrame();
     
 
-    glUniform4f(glGetUniformLocation(shader->GetProgram(), "colour"), 1.0f, 1.0f, 1.0f, 1.0f);
+    shader->SetUniform("colour", Vector4(1.0f, 1.0f, 1.0f, 1.0f));
     freezeFrame();
 
-    glUniform4f(glGetUniformLocation(shader->GetProgram(), "colour"), 0.0f, 0.0f, 0.0f, 1.0f);
+    shader->SetUniform("colour", Vector4(0.0f, 0.0f, 0.0f, 1.0f));
     freezeFrame();
     
     
-    glUniform4f(glGetUniformLocation(shader->GetProgram(), "colour"), 1.0f, 1.0f, 1.0f, 1.0f);
+    shader->SetUniform("colour", Vector4(1.0f, 1.0f, 1.0f, 1.0f));
     freezeFrame();
 
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "useColour"), GL_FALSE);
-    glEnable(GL_STENCIL_TEST);
-    glDepthMask(GL_TRUE);
+    shader->SetUniform("useColour", GL_FALSE);
+    glState.Enable(GL_STENCIL_TEST);
+    glState.DepthMask(GL_TRUE);
 
     activeScene = !activeScene;
+    steadyFrames = 0; // The new scene's BVH is built from scratch
     lightParam = 0;
     gravity = 0;
     light->SetPosition(heightMap->GetHeightmapSize() * Vector3(0.2, 10, 0.5));
@@ -277,54 +338,44 @@ void Renderer::DrawGround() {
         shader = shaderVec[GROUND_SHADER];
         BindShader(shader);
         
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, terrainTex);
+        shader->SetUniform("diffuseTex", 0);
+        glState.BindTexture(0, GL_TEXTURE_2D, terrainTex);
 
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "windMap"), 2);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, windTex);
+        shader->SetUniform("windMap", 2);
+        glState.BindTexture(2, GL_TEXTURE_2D, windTex);
 
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "dispFactor"), 0.0f);
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "grassHeight"), 25.0f);
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "bladeWidth"), 5.0f);
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "dispFactor"), 0.0f);
+        shader->SetUniform("dispFactor", 0.0f);
+        shader->SetUniform("grassHeight", 25.0f);
+        shader->SetUniform("bladeWidth", 5.0f);
+        shader->SetUniform("dispFactor", 0.0f);
 
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "windTraslate"), windTranslate);
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "windStrength"), windStrength);
+        shader->SetUniform("windTraslate", windTranslate);
+        shader->SetUniform("windStrength", windStrength);
 
-        glUniform3fv(glGetUniformLocation(shader->GetProgram(), "cameraPosition"), 1, (float*)&camera->GetPosition());
-        glUniform4f(glGetUniformLocation(shader->GetProgram(), "colourBase"), 0.0f, 0.8f, 0.0f, 1.0f);  // Green
-        glUniform4f(glGetUniformLocation(shader->GetProgram(), "colourTop"), 1.0f, 1.0f, 0.0f, 1.0f);  // Yellow
+        shader->SetUniform("colourBase", Vector4(0.0f, 0.8f, 0.0f, 1.0f));  // Green
+        shader->SetUniform("colourTop", Vector4(1.0f, 1.0f, 0.0f, 1.0f));  // Yellow
     }
 
     else {
         shader = shaderVec[SNOW_SHADER];
         BindShader(shader);
 
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, snowDiff);
-
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "DisplacementMap"), 1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, dispTex);
-
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "bumpTex"), 2);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, snowBump);
+        shader->SetUniform("diffuseTex", 0);
+        glState.BindTexture(0, GL_TEXTURE_2D, snowDiff);
 
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "windMap"), 3);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, windTex);
+        shader->SetUniform("DisplacementMap", 1);
+        glState.BindTexture(1, GL_TEXTURE_2D, dispTex);
 
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "dispFactor"), 0.5f);
+        shader->SetUniform("bumpTex", 2);
+        glState.BindTexture(2, GL_TEXTURE_2D, snowBump);
 
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "windTraslate"), windTranslate);
-        glUniform1f(glGetUniformLocation(shader->GetProgram(), "windStrength"), windStrength);
+        shader->SetUniform("windMap", 3);
+        glState.BindTexture(3, GL_TEXTURE_2D, windTex);
 
-        glUniform3fv(glGetUniformLocation(shader->GetProgram(), "cameraPosition"), 1, (float*)&camera->GetPosition());
+        shader->SetUniform("dispFactor", 0.5f);
 
+        shader->SetUniform("windTraslate", windTranslate);
+        shader->SetUniform("windStrength", windStrength);
     }
     
     UpdateShaderMatrices();
@@ -333,45 +384,42 @@ void Renderer::DrawGround() {
 }
 
 void Renderer::DrawSkybox() {
-    glDepthMask(GL_FALSE);
+    glState.DepthMask(GL_FALSE);
 
     glStencilFunc(GL_EQUAL, 0, ~0);
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
     shader = shaderVec[SKYBOX_SHADER];
     BindShader(shader);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "cubeTex"), 2);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "useColour"), GL_FALSE);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, activeScene ? cubeMap1 : cubeMap2);
+    shader->SetUniform("cubeTex", 2);
+    shader->SetUniform("useColour", GL_FALSE);
+    glState.BindTexture(2, GL_TEXTURE_CUBE_MAP, activeScene ? cubeMap1 : cubeMap2);
     UpdateShaderMatrices();
     quad->Draw();
 
-    glDepthMask(GL_TRUE);
+    glState.DepthMask(GL_TRUE);
 }
 
 void Renderer::DrawSnow() {
-    glEnable(GL_PROGRAM_POINT_SIZE);
+    glState.Enable(GL_PROGRAM_POINT_SIZE);
 
     shader = shaderVec[SNOWFALL_SHADER];
     BindShader(shader);
-    glUniform1f(glGetUniformLocation(shader->GetProgram(), "windTraslate"), windTranslate);
-    glUniform1f(glGetUniformLocation(shader->GetProgram(), "windStrength"), windStrength);
-    glUniform1f(glGetUniformLocation(shader->GetProgram(), "gravity"), gravity);
-    glUniform3fv(glGetUniformLocation(shader->GetProgram(), "heightmapSize"), 1, (float*)&heightMap->GetHeightmapSize());    
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "snowFlake"), 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, snowFlake);
-
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "windMap"), 1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, windTex);
+    shader->SetUniform("windTraslate", windTranslate);
+    shader->SetUniform("windStrength", windStrength);
+    shader->SetUniform("gravity", gravity);
+    shader->SetUniform("heightmapSize", heightMap->GetHeightmapSize());    
+    shader->SetUniform("snowFlake", 0);
+    glState.BindTexture(0, GL_TEXTURE_2D, snowFlake);
+
+    shader->SetUniform("windMap", 1);
+    glState.BindTexture(1, GL_TEXTURE_2D, windTex);
 
     modelMatrix.ToIdentity();
     textureMatrix.ToIdentity();
     UpdateShaderMatrices();
     snow->Draw();
 
-    glDisable(GL_PROGRAM_POINT_SIZE);
+    glState.Disable(GL_PROGRAM_POINT_SIZE);
 }
 
 void Renderer::updateParticles(float dt) {
@@ -393,20 +441,18 @@ void Renderer::DrawWater() {
     shader = shaderVec[REFLECT_SHADER];
     BindShader(shader);
 
-    glUniform3fv(glGetUniformLocation(shader->GetProgram(), "cameraPosition"), 1, (float*)&camera->GetPosition());
+    // The reflect shaders are shared with the Cube Mapping tutorial, so they
+    // don't read the frame block, and still need the camera set by hand
+    shader->SetUniform("cameraPosition", camera->GetPosition());
 
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "bumpTex"), 1);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "cubeTex"), 2);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "useIce"), activeScene ? GL_TRUE : GL_FALSE);
+    shader->SetUniform("diffuseTex", 0);
+    shader->SetUniform("bumpTex", 1);
+    shader->SetUniform("cubeTex", 2);
+    shader->SetUniform("useIce", activeScene ? GL_TRUE : GL_FALSE);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, waterTex);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, waterTex);
+    glState.BindTexture(0, GL_TEXTURE_2D, waterTex);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, activeScene ? cubeMap1 : cubeMap2);
+    glState.BindTexture(2, GL_TEXTURE_CUBE_MAP, activeScene ? cubeMap1 : cubeMap2);
 
     Vector3 hSize = heightMap->GetHeightmapSize();
 
@@ -434,7 +480,6 @@ void Renderer::DrawNode(SceneNode* n) {
     if (shader != shaderVec[n->GetShader()]) {
         shader = shaderVec[n->GetShader()];
         BindShader(shader);
-        glUniform3fv(glGetUniformLocation(shader->GetProgram(), "cameraPosition"), 1, (float*)&camera->GetPosition());
     }
     if (shader == shaderVec[SKINNING_SHADER]){ DrawAnim(n); }
     else if (shader == shaderVec[REFLECT_SHADER]) { DrawReflect(n); }
@@ -443,51 +488,93 @@ void Renderer::DrawNode(SceneNode* n) {
         UpdateShaderMatrices();
         SetShaderLight(*light);
 
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "bumpTex"), 1);
-        glUniform1i(glGetUniformLocation(shader->GetProgram(), "metallicRoughTex"), 2);
-        glUniform4fv(glGetUniformLocation(shader->GetProgram(), "nodeColour"), 1, (float*)&n->GetColour());
-
-        if (n->GetMaterial()) {
-            for (int i = 0; i < n->GetMesh()->GetSubMeshCount(); ++i) {
-                MeshMaterialEntry* matEntry = n->GetMaterial()->GetMaterialForLayer(i);
-                
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, matEntry->textures["Bump"]);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, matEntry->textures["Metallic"]);
-                n->GetMesh()->DrawSubMesh(i);
+        shader->SetUniform("diffuseTex", 0);
+        shader->SetUniform("bumpTex", 1);
+        shader->SetUniform("metallicRoughTex", 2);
+        shader->SetUniform("nodeColour", n->GetColour());
+
+        Mesh* mesh = n->GetMesh();
+        if (gpuCulling && mesh->GetInstanceCount() > 0 && indirectCuller->Cull(*mesh, n->GetLod(), modelMatrix)) {
+            BindShader(shader); // Culling left its compute shader bound
+            if (n->GetMaterial()) {
+                for (int i = 0; i < mesh->GetSubMeshCount(); ++i) {
+                    BindNodeTextures(n, i);
+                    indirectCuller->Draw(*mesh, i, 1);
+                }
             }
-        }
-        else {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, n->GetTexture());
-            for (int i = 0; i < n->GetMesh()->GetSubMeshCount(); ++i) {
-                n->GetMesh()->DrawSubMesh(i);
+            else {
+                BindNodeTextures(n, 0);
+                indirectCuller->Draw(*mesh, 0, mesh->GetSubMeshCount());
             }
+            return;
+        }
+        for (int i = 0; i < mesh->GetSubMeshCount(); ++i) {
+            BindNodeTextures(n, i);
+            mesh->DrawSubMesh(i, n->GetLod());
         }
-        
     }
 
 }
 
+/*
+A batch of one is drawn as it always was. Anything bigger gets the batched
+version of the scene shader, which takes the model matrix and colour of each
+node from the instance buffer DrawNodes filled.
+*/
+void Renderer::DrawBatch(const DrawBatcher::Batch& b) {
+    SceneNode* n = b.node;
+    if (b.instanceCount < 2) {
+        DrawNode(n);
+        return;
+    }
+    if (shader != shaderVec[SCENE_BATCHED_SHADER]) {
+        shader = shaderVec[SCENE_BATCHED_SHADER];
+        BindShader(shader);
+        shader->SetUniform("useInstanceColour", GL_TRUE);
+    }
+    modelMatrix.ToIdentity();
+    UpdateShaderMatrices();
+    SetShaderLight(*light);
+
+    shader->SetUniform("diffuseTex", 0);
+    shader->SetUniform("bumpTex", 1);
+    shader->SetUniform("metallicRoughTex", 2);
+
+    for (int i = 0; i < n->GetMesh()->GetSubMeshCount(); ++i) {
+        BindNodeTextures(n, i);
+        n->GetMesh()->DrawSubMeshBatched(i, n->GetLod(), batchInstances->GetBuffer(),
+            batchInstances->GetFirstInstance() + b.firstInstance, b.instanceCount);
+    }
+}
+
+void Renderer::BindNodeTextures(SceneNode* n, int layer) {
+    if (n->GetMaterial()) {
+        MeshMaterialEntry* matEntry = n->GetMaterial()->GetMaterialForLayer(layer);
+
+        glState.BindTexture(0, GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
+        glState.BindTexture(1, GL_TEXTURE_2D, matEntry->textures["Bump"]);
+        glState.BindTexture(2, GL_TEXTURE_2D, matEntry->textures["Metallic"]);
+    }
+    else {
+        glState.BindTexture(0, GL_TEXTURE_2D, n->GetTexture());
+    }
+}
+
 void Renderer::DrawAnim(SceneNode* n) {
     modelMatrix = n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale()) * n->GetRotation();
     UpdateShaderMatrices();
     SetShaderLight(*light);
 
-    glUniform1i(glGetUniformLocation(shaderVec[SKINNING_SHADER]->GetProgram(), "diffuseTex"), 0);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "bumpTex"), 1);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "metallicRoughTex"), 2);
+    shaderVec[SKINNING_SHADER]->SetUniform("diffuseTex", 0);
+    shader->SetUniform("bumpTex", 1);
+    shader->SetUniform("metallicRoughTex", 2);
 
     while (frameTime < 0.0f) {
         currentFrame = (currentFrame + 1) % n->GetAnim()->GetFrameCount();
         frameTime += 1.0f / n->GetAnim()->GetFrameRate();
     }
 
-    std::vector<Matrix4> frameMatrices;
+    frameMatrices.clear();
 
     const Matrix4* invBindPose = n->GetMesh()->GetInverseBindPose();
     const Matrix4* frameData = n->GetAnim()->GetJointData(currentFrame);
@@ -496,33 +583,28 @@ void Renderer::DrawAnim(SceneNode* n) {
         frameMatrices.emplace_back(frameData[i] * invBindPose[i]);
     }
 
-    int j = glGetUniformLocation(shaderVec[SKINNING_SHADER]->GetProgram(), "joints");
-    glUniformMatrix4fv(j, frameMatrices.size(), GL_FALSE, (float*)frameMatrices.data());
+    shaderVec[SKINNING_SHADER]->SetUniform("joints", frameMatrices.data(), (int)frameMatrices.size());
 
     for (int i = 0; i < n->GetMesh()->GetSubMeshCount(); ++i) {
         MeshMaterialEntry* matEntry = n->GetMaterial()->GetMaterialForLayer(i);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, matEntry->textures["Bump"]);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, matEntry->textures["Metallic"]);
-        n->GetMesh()->DrawSubMesh(i);
+        glState.BindTexture(0, GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
+        glState.BindTexture(1, GL_TEXTURE_2D, matEntry->textures["Bump"]);
+        glState.BindTexture(2, GL_TEXTURE_2D, matEntry->textures["Metallic"]);
+        n->GetMesh()->DrawSubMesh(i, n->GetLod());
     }
 }
 
 void Renderer::DrawReflect(SceneNode* n) {
-    glUniform3fv(glGetUniformLocation(shader->GetProgram(), "cameraPosition"), 1, (float*)&camera->GetPosition());
+    shader->SetUniform("cameraPosition", camera->GetPosition()); // As in DrawWater
 
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "bumpTex"), 1);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "useIce"), GL_FALSE);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "cubeTex"), 2);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "metallicRoughTex"), 3);
+    shader->SetUniform("diffuseTex", 0);
+    shader->SetUniform("bumpTex", 1);
+    shader->SetUniform("useIce", GL_FALSE);
+    shader->SetUniform("cubeTex", 2);
+    shader->SetUniform("metallicRoughTex", 3);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, n->GetTexture());
+    glState.BindTexture(2, GL_TEXTURE_CUBE_MAP, n->GetTexture());
 
     modelMatrix = n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale()) * n->GetRotation();
     UpdateShaderMatrices();
@@ -532,13 +614,10 @@ void Renderer::DrawReflect(SceneNode* n) {
         for (int i = 0; i < n->GetMesh()->GetSubMeshCount(); ++i) {
             MeshMaterialEntry* matEntry = n->GetMaterial()->GetMaterialForLayer(i);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, matEntry->textures["Bump"]);
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, matEntry->textures["Metallic"]);
-            n->GetMesh()->DrawSubMesh(i);
+            glState.BindTexture(0, GL_TEXTURE_2D, matEntry->textures["Diffuse"]);
+            glState.BindTexture(1, GL_TEXTURE_2D, matEntry->textures["Bump"]);
+            glState.BindTexture(3, GL_TEXTURE_2D, matEntry->textures["Metallic"]);
+            n->GetMesh()->DrawSubMesh(i, n->GetLod());
         }
     }
     
@@ -549,17 +628,22 @@ void Renderer::DrawReflect(SceneNode* n) {
 }
 
 void Renderer::SetShaders() {
+    GameTimer timer;
+    ProgramCache& programCache = ProgramCache::GetSharedCache();
+    programCache.ResetStats();
+
     shaderVec = {
     new Shader("HeightmapVertex.glsl", "HeightmapFragment.glsl", "heightmapGeometry.glsl", "groundTCS.glsl", "groundTES.glsl"),
     new Shader("skyboxVertex.glsl", "skyboxFragment.glsl"),
     new Shader("reflectVertex.glsl", "reflectFragment.glsl"),
-    new Shader("bumpVertex.glsl", "bumpfragment.glsl"),
-    new Shader("TexturedColouredVertexInstanced.glsl", "bumpfragment.glsl"),
-    new Shader("SkinningVertex.glsl", "bumpfragment.glsl"),
-    new Shader("HeightmapVertex.glsl", "bumpfragment.glsl", "", "groundTCS.glsl", "groundTES.glsl"),
+    new Shader("sceneBumpVertex.glsl", "sceneBumpFragment.glsl"),
+    new Shader("TexturedColouredVertexInstanced.glsl", "sceneBumpFragment.glsl"),
+    new Shader("SkinningVertex.glsl", "sceneBumpFragment.glsl"),
+    new Shader("HeightmapVertex.glsl", "sceneBumpFragment.glsl", "", "groundTCS.glsl", "groundTES.glsl"),
     new Shader("snowVertex.glsl", "snowFragment.glsl"),
     new Shader("TexturedVertex.glsl", "fxaa.glsl"),
-    new Shader("TexturedVertex.glsl", "TexturedFragment.glsl")
+    new Shader("TexturedVertex.glsl", "TexturedFragment.glsl"),
+    new Shader("bumpVertexBatched.glsl", "sceneBumpFragment.glsl")
     };
 
     for (Shader* shader : shaderVec) {
@@ -568,6 +652,43 @@ void Renderer::SetShaders() {
             std::exit(EXIT_FAILURE);
         }
     }
+    timer.Tick();
+    std::cout << shaderVec.size() << " shader programs ready in " << timer.GetTimeDeltaMSec() << "ms, "
+        << programCache.GetStats().hits << " of them from the program cache" << std::endl;
+}
+
+/*
+The first reload has the cache turned off, so every program is compiled from
+source, as on a first run - all at once, if the driver can. The cache then
+gets a reload to save anything it hasn't got yet, so that the last one loads
+every program from it, as a run after that would.
+*/
+void Renderer::BenchmarkShaderStartup() {
+    ProgramCache& programCache = ProgramCache::GetSharedCache();
+    GameTimer timer;
+
+    programCache.SetEnabled(false);
+    timer.Tick();
+    Shader::ReloadAllShaders();
+    Shader::FinishAllReloads();
+    timer.Tick();
+    float coldTime = timer.GetTimeDeltaMSec();
+
+    programCache.SetEnabled(true);
+    Shader::ReloadAllShaders();
+    Shader::FinishAllReloads();
+    programCache.ResetStats();
+    timer.Tick();
+    Shader::ReloadAllShaders();
+    Shader::FinishAllReloads();
+    timer.Tick();
+    float warmTime = timer.GetTimeDeltaMSec();
+
+    const ProgramCache::Stats& stats = programCache.GetStats();
+    std::cout << "Shader startup: " << coldTime << "ms compiling from source, " << warmTime
+        << "ms from the program cache (" << stats.hits << " loaded, " << stats.misses + stats.rejected
+        << " compiled anyway)" << std::endl;
+    shader = nullptr; // Reloading reset every uniform, so DrawNode has to set them again
 }
 
 void Renderer::SetTextures() {
@@ -636,56 +757,51 @@ void Renderer::SetTextures() {
 }
 
 void Renderer::SetMeshes() {
-    anim = new MeshAnimation("Role_T.anm");
-
-    SceneNode* s = loadMeshAndMaterial("Role_T.msh", "Role_T.mat");
+    SceneNode* s = loadMeshAndMaterial("Role_T.msh", "Role_T.mat", "Role_T.anm");
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.5, 0.5, 0.55)));
     s->SetModelScale(Vector3(500.0f, 500.0f, 500.0f));
     s->SetBoundingRadius(350.0f);
-    s->SetAnim(anim);
     s->SetShader(SKINNING_SHADER);
     root2->AddChild(s);
 
-    std::shared_ptr<Mesh> sharedMesh = std::shared_ptr<Mesh>(Mesh::LoadFromMeshFile("new/persona_4_-_television.prefab.msh"));
-    material = new MeshMaterial("new/persona_4_-_television.prefab.mat");
-    sharedMesh->GenerateNormals();
-    sharedMesh->GenerateTangents();
-    s = new SceneNode();
+    s = loadMeshAndMaterial("new/persona_4_-_television.prefab.msh", "new/persona_4_-_television.prefab.mat");
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.45, 0.82, 0.45)));
     s->SetModelScale(Vector3(2.0f, 2.0f, 2.0f));
     s->SetBoundingRadius(150.0f);
-    s->SetMesh(sharedMesh);
     s->SetShader(SCENE_SHADER);
-    s->SetMaterial(material, true);
     root1->AddChild(s);
 
-    sharedMesh = std::shared_ptr<Mesh>(Mesh::LoadFromMeshFile("new/persona_4_-_television.prefab.msh"));
-    material = new MeshMaterial("new/persona_4_-_television.prefab_trans.mat");
-    s = new SceneNode();
+    s = loadMeshAndMaterial("new/persona_4_-_television.prefab.msh", "new/persona_4_-_television.prefab_trans.mat");
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.3, 1.1, 0.24)));
     s->SetModelScale(Vector3(4.0f, 4.0f, 4.0f));
     s->SetRotation(Matrix4::Rotation(-90.0f, Vector3(0, 1, 0)));
     s->SetBoundingRadius(300.0f);
-    s->SetMesh(sharedMesh);
     s->SetShader(REFLECT_SHADER);
-    s->SetMaterial(material, true);
     s->SetTexture(cubeMap1);
     root1->AddChild(s);
 
-    material = new MeshMaterial("new/persona_4_-_television.prefab_trans.mat");
-    s = new SceneNode();
+    s = loadMeshAndMaterial("new/persona_4_-_television.prefab.msh", "new/persona_4_-_television.prefab_trans.mat");
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.8, 1.7, 0.125)));
     s->SetModelScale(Vector3(10.0f, 10.0f, 10.0f));
     s->SetRotation(Matrix4::Rotation(-100.0f, Vector3(0, 1, 0)));
     s->SetBoundingRadius(1050.0f);
-    s->SetMesh(sharedMesh);
     s->SetShader(REFLECT_SHADER);
-    s->SetMaterial(material, true);
     s->SetTexture(cubeMap2);
+    s->SetOccluder(true);
     root1->AddChild(s);
 
-    mesh = Mesh::LoadFromMeshFile("new/lunar_tear.msh");
-    s = new SceneNode();
+    // Each flower gets turned a golden angle further round than the last, and
+    // a slightly different size, so the ring doesn't look stamped out
+    // Instances are set on the loading thread, so they're handed over by value
+    std::vector<InstanceData> flowers(100);
+    for (int i = 0; i < 100; ++i) {
+        flowers[i].modelMatrix = Matrix4::Translation(flowerPos[i]) *
+            Matrix4::Rotation(i * 137.5f, Vector3(0, 1, 0)) * Matrix4::Scale(Vector3(1, 1, 1) * (0.85f + (i % 7) * 0.05f));
+        flowers[i].colour = Vector4(1, 1, 1, 1);
+    }
+    s = loadMeshAndMaterial("new/lunar_tear.msh", "", "", [flowers](Mesh& m) {
+        m.SetInstances(flowers.data(), (int)flowers.size());
+    });
     root1->AddChild(s);
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.725f, 0.28, 0.20f)));
     s->SetBoundingRadius(1500.0f);
@@ -693,16 +809,16 @@ void Renderer::SetMeshes() {
     s->SetRotation(Matrix4::Rotation(-60.0f, Vector3(0, 1, 0)));
     s->SetColour(Vector4(1.0f, 1.0f, 1.0f, 1.0f));
     s->SetShader(SCENE_INSTANCED_SHADER);
-    mesh->SetInstances(flowerPos, 100);
-    s->SetMesh(mesh);
 
-    s = loadMeshAndMaterial("new/headstone.msh", "new/headstone.mat");
+    std::vector<Vector3> headstones(headstonePos, headstonePos + 21);
+    s = loadMeshAndMaterial("new/headstone.msh", "new/headstone.mat", "", [headstones](Mesh& m) {
+        m.SetInstances(headstones.data(), (int)headstones.size());
+    });
     root2->AddChild(s);
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.48f, 0.5, 0.75)));
     s->SetBoundingRadius(6500.0f);
     s->SetModelScale(Vector3(5.0f, 5.0f, 5.0f));
     s->SetShader(SCENE_INSTANCED_SHADER);
-    s->GetMesh()->SetInstances(headstonePos, 21);
 
     s = loadMeshAndMaterial("Sphere.msh", "");
     root2->AddChild(s);
@@ -717,6 +833,7 @@ void Renderer::SetMeshes() {
     s->SetModelScale(Vector3(3.0f, 3.0f, 3.0f));
     s->SetShader(SCENE_SHADER);
     s->SetBoundingRadius(1300.0f);
+    s->SetOccluder(true);
     root1->AddChild(s);
 
     s = loadMeshAndMaterial("new/door (1).msh", "new/door (1).mat");
@@ -725,102 +842,268 @@ void Renderer::SetMeshes() {
     s->SetModelScale(Vector3(3.0f, 3.0f, 3.0f));
     s->SetBoundingRadius(250.0f);
     s->SetShader(SCENE_SHADER);
+    s->SetOccluder(true);
     root1->AddChild(s);
 
-    anim = new MeshAnimation("new/terminal_nier_automata_fan-art.anm");
-    s = loadMeshAndMaterial("new/terminal_nier_automata_fan-art.msh", "new/terminal_nier_automata_fan-art.mat");
+    s = loadMeshAndMaterial("new/terminal_nier_automata_fan-art.msh", "new/terminal_nier_automata_fan-art.mat", "new/terminal_nier_automata_fan-art.anm");
     s->SetTransform(Matrix4::Translation(heightMap->GetHeightmapSize() * Vector3(0.15, 0.3, 0.1)));
     s->SetRotation(Matrix4::Rotation(150.0f, Vector3(0, 1, 0)));
     s->SetModelScale(Vector3(200.0f, 200.0f, 200.0f));
     s->SetBoundingRadius(200.0f);
-    s->SetAnim(anim);
     s->SetShader(SKINNING_SHADER);
     root1->AddChild(s);
 
 }
 
+/*
+Culling goes through the scene's BVH rather than testing every node, and then
+whatever's left is tested against the occluders it found. Only the nodes that
+survive both have their distance and LOD worked out - which is spread across
+the job system, as each node only touches itself.
+*/
 void Renderer::BuildNodeLists(SceneNode* from) {
-    if (frameFrustum.InsideFrustum(*from)) {
-        Vector3 dir = from->GetWorldTransform().GetPositionVector() - camera->GetPosition();
-        from->SetCameraDistance(Vector3::Dot(dir, dir));
+    ClearNodeLists();
+    UpdateSceneBvh(from);
+
+    culledNodes.Resize(sceneBvh.GetCount());
+    culledNodes.Resize(sceneBvh.Cull(frameFrustum, culledNodes.Data()));
+    DrawOccluders();
+
+    Vector3 cameraPosition = camera->GetPosition();
+    JobSystem::GetSharedJobSystem().ParallelFor(culledNodes.Size(), [&](size_t i) {
+        SceneNode* n = static_cast<SceneNode*>(culledNodes[i]);
+        Vector3 position = n->GetWorldTransform().GetPositionVector();
+        // An occluder can't hide itself
+        if (!n->IsOccluder() && !occlusionCuller.IsVisible(position, n->GetBoundingRadius())) {
+            culledNodes[i] = nullptr;
+            return;
+        }
+        Vector3 dir = position - cameraPosition;
+        n->SetCameraDistance(Vector3::Dot(dir, dir));
+        n->SelectLod(cameraPosition, lodPixelScale);
+    }, 64);
+
+    for (size_t i = 0; i < culledNodes.Size(); ++i) {
+        SceneNode* n = static_cast<SceneNode*>(culledNodes[i]);
+        if (!n) {
+            continue;
+        }
+        RenderQueue::Pass pass = n->GetColour().w < 1.0f ? RenderQueue::PASS_TRANSPARENT : RenderQueue::PASS_OPAQUE;
+        renderQueue.Add(RenderQueue::MakeKey(pass, n->GetShader(), n->GetMaterial(), n->GetMesh(), n->GetCameraDistance()),
+            (unsigned int)i);
+    }
+}
 
-        if (from->GetColour().w < 1.0f) {
-            transparentNodeList.push_back(from);
+/*
+The terrain is always drawn, as a coarse copy that stays under the real one,
+along with any occluder nodes that got past the frustum. Each of those uses the
+LOD it would have if the screen were only as big as the occlusion buffer.
+*/
+void Renderer::DrawOccluders() {
+    occlusionCuller.BeginFrame(frameViewProj);
+    occlusionCuller.AddOccluder(Matrix4(), terrainOccluderPositions.data(), terrainOccluderPositions.size(),
+        terrainOccluderIndices.data(), terrainOccluderIndices.size());
+
+    Vector3 cameraPosition = camera->GetPosition();
+    float pixelScale = lodPixelScale * occlusionCuller.GetHeight() / height;
+
+    for (void* c : culledNodes) {
+        SceneNode* n = static_cast<SceneNode*>(c);
+        Mesh* mesh = n->GetMesh();
+        if (!n->IsOccluder() || !mesh) {
+            continue;
         }
-        else {
-            nodeList.push_back(from);
+        float distance = (n->GetWorldTransform().GetPositionVector() - cameraPosition).Length();
+        int lod = distance > n->GetBoundingRadius() ?
+            mesh->SelectLod(n->GetBoundingRadius() * pixelScale / distance, 1.0f) : 0;
+
+        unsigned int indexCount = 0;
+        const unsigned int* indices = mesh->GetLodIndexData(lod, indexCount);
+        if (indices) {
+            occlusionCuller.AddOccluder(n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale()) * n->GetRotation(),
+                mesh->GetPositionData(), mesh->GetVertexCount(), indices, indexCount);
         }
     }
+    occlusionCuller.EndFrame();
+}
 
-    for (std::vector<SceneNode*>::const_iterator i = from->GetChildIteratorStart();
-        i != from->GetChildIteratorEnd(); ++i) {
-        BuildNodeLists(*i);
+/*
+Nodes are only added or removed while loading, so then the whole BVH is just
+built again. The rest of the time only the nodes the last transform update
+touched need moving - which can include nodes from the other scene, as both
+share the one hierarchy, and those aren't in here.
+*/
+void Renderer::UpdateSceneBvh(SceneNode* root) {
+    TransformHierarchy& hierarchy = TransformHierarchy::GetSharedHierarchy();
+
+    if (root != bvhRoot || hierarchy.GetStructureVersion() != bvhStructureVersion) {
+        sceneBvh.Clear();
+        bvhProxies.assign(bvhProxies.size(), BoundingVolumeHierarchy::NULL_PROXY);
+        AddToSceneBvh(root);
+        sceneBvh.Rebuild();
+
+        bvhRoot = root;
+        bvhStructureVersion = hierarchy.GetStructureVersion();
+        return;
+    }
+    for (TransformHierarchy::Handle h : hierarchy.GetLastUpdated()) {
+        if (h >= bvhProxies.size() || bvhProxies[h] == BoundingVolumeHierarchy::NULL_PROXY) {
+            continue;
+        }
+        SceneNode* n = static_cast<SceneNode*>(sceneBvh.GetUserData(bvhProxies[h]));
+        sceneBvh.Move(bvhProxies[h], n->GetWorldTransform().GetPositionVector(), n->GetBoundingRadius());
     }
 }
 
-void Renderer::SortNodeLists() {
-    std::sort(transparentNodeList.rbegin(), transparentNodeList.rend(),
-        [](const SceneNode* a, const SceneNode* b) {
-            if (a->GetShader() != b->GetShader()) {
-                return a->GetShader() < b->GetShader(); 
-            }
-            return SceneNode::CompareByCameraDistance(a, b);
-        });
+void Renderer::AddToSceneBvh(SceneNode* n) {
+    TransformHierarchy::Handle h = n->GetTransformHandle();
+    if (h >= bvhProxies.size()) {
+        bvhProxies.resize(h + 1, BoundingVolumeHierarchy::NULL_PROXY);
+    }
+    bvhProxies[h] = sceneBvh.Insert(n->GetWorldTransform().GetPositionVector(), n->GetBoundingRadius(), n, true);
 
-    std::sort(nodeList.begin(), nodeList.end(),
-        [](const SceneNode* a, const SceneNode* b) {
-            if (a->GetShader() != b->GetShader()) {
-                return a->GetShader() < b->GetShader();  
-            }
-            return SceneNode::CompareByCameraDistance(a, b);
-        });
+    for (std::vector<SceneNode*>::const_iterator i = n->GetChildIteratorStart();
+        i != n->GetChildIteratorEnd(); ++i) {
+        AddToSceneBvh(*i);
+    }
+}
+
+/*
+Opaque nodes come out grouped by shader, material and mesh, and front to back
+within those, while transparent ones come out back to front within each shader.
+*/
+void Renderer::SortNodeLists() {
+    renderQueue.Sort();
+    drawBatcher.Clear();
+
+    for (size_t i = 0; i < renderQueue.GetCount(); ++i) {
+        const RenderQueue::Item& item = renderQueue[i];
+        SceneNode* n = static_cast<SceneNode*>(culledNodes[item.index]);
+        if (RenderQueue::GetPass(item.key) == RenderQueue::PASS_TRANSPARENT) {
+            transparentNodeList.PushBack(n);
+        }
+        else {
+            nodeList.PushBack(n);
+        }
+    }
+    drawBatcher.Add(nodeList.Data(), nodeList.Size());
+    drawBatcher.Add(transparentNodeList.Data(), transparentNodeList.Size());
 }
 
 
 void Renderer::DrawNodes() {
-    for (const auto& i : nodeList) {
-        DrawNode(i);
+    indirectCuller->BeginFrame(frameFrustum, &occlusionCuller);
+
+    const std::vector<InstanceData>& instances = drawBatcher.GetInstances();
+    if (!instances.empty()) {
+        batchInstances->Write(instances.data(), (GLuint)instances.size());
     }
-    for (const auto& i : transparentNodeList) {
-        DrawNode(i);
+    for (const DrawBatcher::Batch& b : drawBatcher.GetBatches()) {
+        DrawBatch(b);
     }
 }
 
-void Renderer::ClearNodeLists() {
-    transparentNodeList.clear();
-    nodeList.clear();
+void Renderer::PrintDrawStats() {
+    const DrawBatcher::Stats& stats = drawBatcher.GetStats();
+    std::cout << stats.nodes << " nodes drawn with " << stats.drawsAfter << " draw calls, down from "
+        << stats.drawsBefore << " - " << stats.batches << " batches" << std::endl;
+    std::cout << (gpuCulling ? "Instances culled on the GPU" : "Instances drawn without culling") << std::endl;
+    std::cout << frameAllocations << " heap allocations last frame, " << frameArena.GetHighWater() << " of "
+        << frameArena.GetCapacity() << " frame arena bytes used at most, " << SceneNode::GetPool().GetCount()
+        << " scene nodes in a pool of " << SceneNode::GetPool().GetCapacity() << std::endl;
+    // Every uniform set by name used to ask GL for its location
+    std::cout << frameUniformStats.lookups << " uniforms set by name last frame, with "
+        << frameUniformStats.glLookups << " locations asked of GL - " << frameUniformStats.uploads
+        << " uploaded, " << frameUniformStats.skipped << " skipped as unchanged" << std::endl;
+    if (uniformRing) {
+        std::cout << uniformRing->GetLastFrameWrites() << " uniform blocks written last frame, "
+            << uniformRing->GetStalls() << " stalls in all" << std::endl;
+    }
+    std::cout << frameStateStats.TotalIssued() << " state changes made last frame, "
+        << frameStateStats.TotalSkipped() << " skipped as redundant (";
+    static const char* stateNames[GLStateCache::STATE_MAX] = {
+        "programs", "vertex arrays", "textures", "framebuffers", "toggles", "blend funcs", "depth masks"
+    };
+    for (int i = 0; i < GLStateCache::STATE_MAX; ++i) {
+        std::cout << (i > 0 ? ", " : "") << stateNames[i] << " " << frameStateStats.issued[i] << "/" << frameStateStats.skipped[i];
+    }
+    std::cout << ")" << std::endl;
+    indirectCuller->SetVerify(gpuCulling);
 }
 
-SceneNode* Renderer::loadMeshAndMaterial(const std::string& meshFile, const std::string& materialFile) {
-    std::shared_ptr<Mesh> mesh = std::shared_ptr<Mesh>(Mesh::LoadFromMeshFile(meshFile));
-    if (!mesh) {
-        std::cerr << "Failed to load mesh: " << meshFile << std::endl;
-    }
+void Renderer::ClearNodeLists() {
+    frameArena.Reset();
+    renderQueue.Clear();
+}
 
+/*
+Nodes are returned straight away, but without a mesh, so they aren't drawn
+until AttachLoadedAssets has given them everything they asked for. Repeated
+files are only loaded once, and shared between nodes through the cache - apart
+from meshes with a prepare function, which each get a copy of their own.
+*/
+SceneNode* Renderer::loadMeshAndMaterial(const std::string& meshFile, const std::string& materialFile,
+    const std::string& animFile, AssetLoader::MeshPrepareFunction prepare) {
     SceneNode* node = new SceneNode();
     node->SetBoundingRadius(100.0f);
-    node->SetMesh(mesh);
-    mesh->GenerateNormals();
-    mesh->GenerateTangents();
     node->SetShader(SCENE_SHADER);
 
-    if (materialFile == "") {  
-        std::cerr << "Failed to load material: " << materialFile << std::endl;
+    PendingNode pending;
+    pending.node        = node;
+    pending.mesh        = assetLoader->LoadMesh(meshFile, prepare);
+
+    // No material file just means a node drawn with its own texture instead
+    if (materialFile != "") {
+        pending.material = assetLoader->LoadMaterial(materialFile);
     }
-    else
-    {
-        MeshMaterial* material = new MeshMaterial(materialFile);
-        node->SetMaterial(material, true);
+    if (animFile != "") {
+        pending.anim = assetLoader->LoadAnimation(animFile);
     }
+    pendingNodes.push_back(pending);
     return node;
 }
 
+void Renderer::AttachLoadedAssets() {
+    if (pendingNodes.empty()) {
+        return;
+    }
+    for (auto i = pendingNodes.begin(); i != pendingNodes.end();) {
+        bool ready = AssetLoader::IsReady(i->mesh) &&
+            (!i->material.valid() || AssetLoader::IsReady(i->material)) &&
+            (!i->anim.valid() || AssetLoader::IsReady(i->anim));
+
+        if (!ready) {
+            ++i;
+            continue;
+        }
+        std::shared_ptr<Mesh> mesh = i->mesh.get();
+
+        if (mesh) {
+            if (i->material.valid()) {
+                i->node->SetMaterial(i->material.get());
+            }
+            if (i->anim.valid() && i->anim.get()) {
+                animations.push_back(i->anim.get());
+                i->node->SetAnim(animations.back().get());
+            }
+            else if (i->anim.valid()) {
+                i->node->SetShader(SCENE_SHADER); // Drawn in its bind pose, with nothing to skin it
+            }
+            i->node->SetMesh(mesh);
+        }
+        i = pendingNodes.erase(i);
+    }
+    if (pendingNodes.empty()) {
+        assetLoader->GetCache().PrintStats();
+    }
+}
+
 void Renderer::LockCamera() {
     camera->LockCamera();
 }
 
 void Renderer::PresentScene() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     shader = shaderVec[RENDER_SHADER];
@@ -831,9 +1114,8 @@ void Renderer::PresentScene() {
     textureMatrix.ToIdentity();
     UpdateShaderMatrices();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, bufferColourTex[postTex]);
-    glUniform1i(glGetUniformLocation(shader->GetProgram(), "diffuseTex"), 0);
+    glState.BindTexture(0, GL_TEXTURE_2D, bufferColourTex[postTex]);
+    shader->SetUniform("diffuseTex", 0);
 
     quad->Draw();
 }
\ No newline at end of file
@@ -1,9 +1,18 @@
 #pragma once
 #include "../nclgl/OGLRenderer.h"
 #include "../nclgl/Frustum.h"
+#include "../nclgl/BoundingVolumeHierarchy.h"
+#include "../nclgl/OcclusionCuller.h"
+#include "../nclgl/RenderQueue.h"
+#include "../nclgl/DrawBatcher.h"
+#include "../nclgl/InstanceBuffer.h"
+#include "../nclgl/IndirectCuller.h"
+#include "../nclgl/FrameArena.h"
 #include "../nclgl/SceneNode.h"
 #include "../nclgl/light.h"
+#include "../nclgl/AssetLoader.h"
 #include <memory>
+#include <functional>
 
 class Mesh;
 class MeshAnimation;
@@ -21,7 +30,8 @@ enum ShaderIndices{
         SNOW_SHADER,
         SNOWFALL_SHADER,
         POST_PROCESS_SHADER,
-        RENDER_SHADER
+        RENDER_SHADER,
+        SCENE_BATCHED_SHADER
 };
 
 class Renderer : public OGLRenderer {
@@ -47,16 +57,39 @@ public:
     void changeScene();
     void LockCamera();
     void TogglePostProcess() { this->postProcess = !this->postProcess; }
+    void ToggleGPUCulling() { this->gpuCulling = !this->gpuCulling; }
+    // Also checks the next instances culled on the GPU against the CPU
+    void PrintDrawStats();
+    // Times reloading every shader from source, and then from the program cache
+    void BenchmarkShaderStartup();
 
     void BuildNodeLists(SceneNode* from);
+    void UpdateSceneBvh(SceneNode* root);
+    void AddToSceneBvh(SceneNode* n);
+    void DrawOccluders();
     void SortNodeLists();
     void ClearNodeLists();
     void DrawNodes();
     void DrawNode(SceneNode* n);
+    void DrawBatch(const DrawBatcher::Batch& b);
+    void BindNodeTextures(SceneNode* n, int layer);
 
-    SceneNode* loadMeshAndMaterial(const std::string& meshFile, const std::string& materialFile = "");
+    SceneNode* loadMeshAndMaterial(const std::string& meshFile, const std::string& materialFile = "",
+        const std::string& animFile = "", AssetLoader::MeshPrepareFunction prepare = nullptr);
+    void AttachLoadedAssets();
 
 protected:
+    //A node whose assets are still loading - it isn't drawn until they're all ready
+    struct PendingNode {
+        SceneNode*                      node;
+        AssetLoader::MeshFuture         mesh;
+        AssetLoader::MaterialFuture     material;
+        AssetLoader::AnimationFuture    anim;
+    };
+    AssetLoader* assetLoader;
+    std::vector<PendingNode> pendingNodes;
+    std::vector<std::shared_ptr<MeshAnimation>> animations;
+
     SceneNode* root1;
     SceneNode* root2;
     int activeScene = 1;
@@ -85,23 +118,59 @@ protected:
     GLuint bufferColourTex[2];
     GLuint bufferDepthTex;
 
+    Matrix4 frameViewProj;
     Frustum frameFrustum;
-    std::vector<SceneNode*> transparentNodeList;
-    std::vector<SceneNode*> nodeList;
+    float lodPixelScale = 1.0f; // Pixels covered by one unit, one unit from the camera
+    // Everything that only lasts a frame - the node lists and culling results -
+    // lives in here, and goes when ClearNodeLists resets it
+    FrameArena frameArena;
+    FrameVector<SceneNode*> transparentNodeList;
+    FrameVector<SceneNode*> nodeList;
+    RenderQueue renderQueue; // Indices into culledNodes, until they're sorted into the node lists
+
+    // Runs of SCENE_SHADER nodes in the node lists with the same mesh, material
+    // and LOD are drawn together, from one instance buffer for the whole frame
+    DrawBatcher drawBatcher;
+    InstanceBuffer* batchInstances;
+
+    // Nodes with instances of their own have them culled on the GPU, and drawn
+    // from the commands it writes
+    IndirectCuller* indirectCuller;
+    bool gpuCulling = true;
+
+    // Every node under bvhRoot, kept up to date from what the transform hierarchy
+    // says has moved, and rebuilt from scratch if nodes come or go
+    BoundingVolumeHierarchy sceneBvh;
+    SceneNode* bvhRoot = nullptr;
+    unsigned int bvhStructureVersion = 0;
+    std::vector<BoundingVolumeHierarchy::Proxy> bvhProxies; // By transform handle
+    FrameVector<void*> culledNodes;
+    // Heap allocations made over the whole of the last frame
+    size_t frameAllocations = 0;
+    size_t allocationsAtFrameStart = 0;
+    // Frames since loading finished - after the warm-up, any allocation is reported
+    static const int STEADY_FRAME_WARMUP = 60;
+    int steadyFrames = 0;
+    Shader::UniformStats frameUniformStats = {};
+    GLStateCache::Stats frameStateStats = {};
+
+    // Nodes that get past the frustum are then tested against the terrain and
+    // any occluder nodes, drawn into a small depth buffer on the CPU
+    static const int TERRAIN_OCCLUDER_STEP = 8;
+    OcclusionCuller occlusionCuller;
+    std::vector<Vector3> terrainOccluderPositions;
+    std::vector<unsigned int> terrainOccluderIndices;
 
     Mesh* quad;
-    Mesh* mesh;
     Mesh* snow;
     Light* light;
 
-    MeshAnimation* anim;
-    MeshMaterial* material;
-
     bool postProcess = false;
     int postTex = 0;
     float lightParam = 0;
     int currentFrame;
     float frameTime;
+    std::vector<Matrix4> frameMatrices; // Kept between frames so it only grows once
 
     float waterRotate;
     float waterCycle;
@@ -11,10 +11,7 @@ in Vertex {
 } IN;
 
 out vec4 fragColour;
-uniform vec3 cameraPosition;
-uniform vec4 lightColour;
-uniform vec3 lightPos;
-uniform float lightRadius;
+#include "UniformBlocks.glsl"
 
 void main(void) {
 	vec3 incident = normalize(lightPos - IN.worldPos);
@@ -1,8 +1,6 @@
 #version 330 core
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+#include "UniformBlocks.glsl"
 
 in vec3 position; 
 in vec2 texCoord; 
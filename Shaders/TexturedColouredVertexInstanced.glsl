@@ -1,15 +1,14 @@
 #version 330 core
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+#include "UniformBlocks.glsl"
 
 in vec3 position; 
 in vec2 texCoord; 
 in vec4 colour;    
 in vec3 normal;
 in vec4 tangent; 
-in vec3 instanceOffset;
+in mat4 instanceModel;
+in vec4 instanceColour;
 
 out Vertex {
     vec2 texCoord;
@@ -21,15 +20,16 @@ out Vertex {
 } OUT;
 
 void main(void) {
-    mat3 normalMatrix = transpose(inverse(mat3(modelMatrix)));
+    mat4 model = modelMatrix * instanceModel;
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
     vec3 wNormal = normalize(normalMatrix * normalize(normal));
     vec3 wTangent = normalize(normalMatrix * normalize(tangent.xyz));
 
     OUT.normal = wNormal;
     OUT.tangent = wTangent;
     OUT.binormal = cross(wTangent, wNormal) * tangent.w;
-	mat4 mvp = projMatrix * viewMatrix * modelMatrix; 
-    gl_Position = mvp * vec4(position + instanceOffset, 1.0);
+	mat4 mvp = projMatrix * viewMatrix * model; 
+    gl_Position = mvp * vec4(position, 1.0);
     OUT.texCoord = texCoord;
-    OUT.colour = colour;
+    OUT.colour = colour * instanceColour;
 }
@@ -0,0 +1,17 @@
+// Filled in by OGLRenderer - FrameUniforms whenever the camera or light
+// changes, ObjectUniforms for every draw. #include this in place of declaring
+// these as uniforms of their own, and use them by the same names as before.
+layout(std140) uniform FrameUniforms {
+    mat4  viewMatrix;
+    mat4  projMatrix;
+    mat4  shadowMatrix;
+    vec3  cameraPosition;
+    float lightRadius;
+    vec3  lightPos;
+    vec4  lightColour;
+};
+
+layout(std140) uniform ObjectUniforms {
+    mat4 modelMatrix;
+    mat4 textureMatrix;
+};
@@ -0,0 +1,39 @@
+#version 330 core
+
+#include "UniformBlocks.glsl"
+
+in vec3 position; 
+in vec2 texCoord; 
+in vec4 colour;    
+in vec3 normal;
+in vec4 tangent;
+in mat4 instanceModel;
+in vec4 instanceColour;
+
+out Vertex {
+    vec2 texCoord;
+    vec4 colour;
+	vec3 normal;
+    vec3 tangent; 
+    vec3 binormal;
+	vec3 worldPos;
+} OUT;
+
+// sceneBumpVertex, with the model matrix and node colour coming from each instance
+void main(void) {
+    OUT.colour = instanceColour;
+    OUT.texCoord = texCoord;
+
+    mat3 normalMatrix = transpose(inverse(mat3(instanceModel)));
+
+    vec3 wNormal = normalize(normalMatrix * normalize(normal));
+    vec3 wTangent = normalize(normalMatrix * normalize(tangent.xyz));
+
+    OUT.normal = wNormal;
+    OUT.tangent = wTangent;
+    OUT.binormal = cross(wTangent, wNormal) * tangent.w;
+
+    vec4 worldPos = instanceModel * vec4(position, 1.0);
+    OUT.worldPos = worldPos.xyz;
+    gl_Position = projMatrix * viewMatrix * worldPos;
+}
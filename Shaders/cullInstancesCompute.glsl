@@ -0,0 +1,125 @@
+#version 430 core
+
+layout(local_size_x = 64) in;
+
+struct InstanceData {
+    mat4 modelMatrix;
+    vec4 colour;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+layout(std430, binding = 1) writeonly buffer Visible {
+    InstanceData visible[];
+};
+
+layout(std430, binding = 2) buffer Commands {
+    DrawCommand commands[];
+};
+
+layout(std430, binding = 3) readonly buffer HiZ {
+    float hiZ[];
+};
+
+const int MAX_LEVELS = 16;
+
+uniform mat4 modelMatrix;
+uniform vec4 bounds;            // Centre and radius of the mesh
+uniform vec4 planes[6];         // Normal and distance
+uniform uint firstInstance;
+uniform uint instanceCount;
+uniform uint drawCount;
+
+uniform bool useHiZ;
+uniform mat4 hiZViewProj;
+uniform ivec2 hiZSize;
+uniform int hiZLevelCount;
+uniform int hiZOffsets[MAX_LEVELS];
+uniform ivec2 hiZLevelSizes[MAX_LEVELS];
+
+// The same test as OcclusionCuller::IsVisible, on its own depths
+bool HiZVisible(vec3 centre, float radius) {
+    mat4 m = hiZViewProj;
+    vec3 nearNormal = vec3(m[0][2] + m[0][3], m[1][2] + m[1][3], m[2][2] + m[2][3]);
+    if (dot(nearNormal, centre) + m[3][2] + m[3][3] - radius * length(nearNormal) <= 0.0) {
+        return true;
+    }
+    vec3 wNormal = vec3(m[0][3], m[1][3], m[2][3]);
+    float nearestW = dot(wNormal, centre) + m[3][3] - radius * length(wNormal);
+    if (nearestW <= 0.0) {
+        return true;
+    }
+    float nearestDepth = 1.0 / nearestW;
+
+    vec2 minScreen = vec2(hiZSize);
+    vec2 maxScreen = vec2(0.0);
+    vec4 clipCentre = m * vec4(centre, 1.0);
+    for (int i = 0; i < 8; ++i) {
+        vec4 clip = clipCentre;
+        for (int a = 0; a < 3; ++a) {
+            clip = ((i & (1 << a)) != 0) ? clip + m[a] * radius : clip - m[a] * radius;
+        }
+        if (clip.w <= 0.0) {
+            return true;
+        }
+        vec2 s = (clip.xy * (1.0 / clip.w) * 0.5 + 0.5) * vec2(hiZSize);
+        minScreen = min(minScreen, s);
+        maxScreen = max(maxScreen, s);
+    }
+    if (maxScreen.x < 0.0 || maxScreen.y < 0.0 || minScreen.x >= float(hiZSize.x) || minScreen.y >= float(hiZSize.y)) {
+        return true;
+    }
+    ivec2 p0 = ivec2(max(minScreen, vec2(0.0)));
+    ivec2 p1 = ivec2(min(maxScreen, vec2(hiZSize - 1)));
+
+    int l = 0;
+    while (l + 1 < hiZLevelCount && ((p1.x >> l) - (p0.x >> l) > 1 || (p1.y >> l) - (p0.y >> l) > 1)) {
+        l++;
+    }
+    for (int y = p0.y >> l; y <= p1.y >> l; ++y) {
+        for (int x = p0.x >> l; x <= p1.x >> l; ++x) {
+            if (hiZ[hiZOffsets[l] + y * hiZLevelSizes[l].x + x] <= nearestDepth) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void main(void) {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instanceCount) {
+        return;
+    }
+    InstanceData instance = instances[firstInstance + i];
+    mat4 world = modelMatrix * instance.modelMatrix;
+
+    vec3 centre = (world * vec4(bounds.xyz, 1.0)).xyz;
+    float scale = max(length(world[0].xyz), max(length(world[1].xyz), length(world[2].xyz)));
+    float radius = bounds.w * scale;
+
+    for (int p = 0; p < 6; ++p) {
+        if (dot(centre, planes[p].xyz) + planes[p].w <= -radius) {
+            return;
+        }
+    }
+    if (useHiZ && !HiZVisible(centre, radius)) {
+        return;
+    }
+    // Every submesh draws the same instances, so they all count this one
+    uint slot = atomicAdd(commands[0].instanceCount, 1u);
+    for (uint d = 1u; d < drawCount; ++d) {
+        atomicAdd(commands[d].instanceCount, 1u);
+    }
+    visible[slot] = instance;
+}
@@ -20,8 +20,7 @@ out Vertex {
 	vec3 worldPos;
 } OUT[];
 
-uniform mat4 viewMatrix;
-uniform vec3 cameraPosition;
+#include "UniformBlocks.glsl"
 uniform vec3 hSize;
 
 float GetTessLevel(float distance0, float distance1)
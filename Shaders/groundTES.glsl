@@ -2,9 +2,7 @@
 
 layout(triangles, equal_spacing, ccw) in;
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+#include "UniformBlocks.glsl"
 
 in Vertex {
     vec2 texCoord;
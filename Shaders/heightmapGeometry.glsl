@@ -21,9 +21,7 @@ out Vertex {
     vec3 worldPos;
 } OUT;
 
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
-uniform vec3 cameraPosition;
+#include "UniformBlocks.glsl"
 
 uniform float grassHeight;        // Height of the grass blades
 uniform float bladeWidth;         // Width of each grass blade
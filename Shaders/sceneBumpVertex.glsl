@@ -0,0 +1,38 @@
+#version 330 core
+
+// bumpvertex.glsl as the Blank Project draws it, with its matrices in the
+// uniform blocks - the tutorials still use the original, setting them one by one
+#include "UniformBlocks.glsl"
+
+in vec3 position; 
+in vec2 texCoord; 
+in vec4 colour;    
+in vec3 normal;
+in vec4 tangent;
+
+out Vertex {
+    vec2 texCoord;
+    vec4 colour;
+	vec3 normal;
+    vec3 tangent; 
+    vec3 binormal;
+	vec3 worldPos;
+} OUT;
+
+void main(void) {
+    OUT.colour = colour;
+    OUT.texCoord = texCoord;
+
+    mat3 normalMatrix = transpose(inverse(mat3(modelMatrix)));
+
+    vec3 wNormal = normalize(normalMatrix * normalize(normal));
+    vec3 wTangent = normalize(normalMatrix * normalize(tangent.xyz));
+
+    OUT.normal = wNormal;
+    OUT.tangent = wTangent;
+    OUT.binormal = cross(wTangent, wNormal) * tangent.w;
+
+    vec4 worldPos = modelMatrix * vec4(position, 1.0);
+    OUT.worldPos = worldPos.xyz;
+    gl_Position = projMatrix * viewMatrix * worldPos;
+}
@@ -2,19 +2,18 @@
 
 in vec3 position;
 in vec2 TexCoord;
-in vec3 instanceOffset;
+in mat4 instanceModel;
 uniform float gravity; 
 uniform vec3 heightmapSize;
 uniform sampler2D windMap;
 uniform float windTranslate;
 uniform float windStrength;
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+#include "UniformBlocks.glsl"
 
 out vec2 vTexCoord;
 void main()
 {
+	vec3 instanceOffset = instanceModel[3].xyz;
 	vec3 particlePos = position + instanceOffset;
 	float particleSize = instanceOffset.y; 
 	float startHeight = heightmapSize.y * 5.0; 
@@ -0,0 +1,141 @@
+#include "Tools.h"
+#include "../nclgl/BoundingVolumeHierarchy.h"
+#include "../nclgl/Frustum.h"
+#include "../nclgl/Matrix4.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+/*
+Culls a large number of bounding spheres, scattered evenly through a cube, by
+testing each against the frustum in turn the way the Renderer used to, and with
+a BoundingVolumeHierarchy. The camera sits at the middle of one face of the cube
+looking in, so most of the spheres are behind it or out of range, as in a big
+level. Some of the spheres are then nudged along, and some moved clean across
+the cube, to time keeping the hierarchy up to date - every cull has to find
+exactly the same spheres as testing each one would.
+*/
+
+static const float	SPHERE_SPACING		= 10.0f;	//Average distance between neighbours
+static const float	MOVING_FRACTION		= 0.01f;
+
+int BenchmarkBvh(const ToolArgs& args) {
+	std::vector<int> counts;
+	for (const std::string& a : args) {
+		counts.push_back(atoi(a.c_str()));
+	}
+	if (counts.empty()) {
+		counts = { 10000, 100000, 1000000 };
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::right << std::setw(10) << "Spheres" << std::setw(10) << "Visible" << std::setw(8) << "Height"
+		<< std::setw(10) << "Build" << std::setw(10) << "Linear" << std::setw(10) << "BVH" << std::setw(10) << "Speedup"
+		<< std::setw(10) << "Nudge" << std::setw(10) << "Teleport" << std::endl;
+
+	bool matched = true;
+
+	for (int count : counts) {
+		if (count < 1) {
+			std::cout << "Need at least one sphere!" << std::endl;
+			return -1;
+		}
+		std::mt19937 random(1234);
+
+		float size = SPHERE_SPACING * cbrtf((float)count);
+		std::uniform_real_distribution<float> position(0.0f, size);
+		std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+		std::uniform_real_distribution<float> nudge(-1.0f, 1.0f);
+
+		std::vector<Vector3>	centres(count);
+		std::vector<float>		radii(count);
+		for (int i = 0; i < count; ++i) {
+			centres[i]	= Vector3(position(random), position(random), position(random));
+			radii[i]	= radius(random);
+		}
+
+		Frustum frustum;
+		frustum.FromMatrix(Matrix4::Perspective(1.0f, size * 0.5f, 16.0f / 9.0f, 45.0f) *
+			Matrix4::BuildViewMatrix(Vector3(size * 0.5f, size * 0.5f, 0.0f), Vector3(size * 0.5f, size * 0.5f, size)));
+
+		auto LinearCull = [&](std::vector<int>& visible) {
+			visible.clear();
+			for (int i = 0; i < count; ++i) {
+				if (frustum.InsideFrustum(centres[i], radii[i])) {
+					visible.push_back(i);
+				}
+			}
+		};
+
+		BoundingVolumeHierarchy bvh;
+		std::vector<BoundingVolumeHierarchy::Proxy> proxies(count);
+
+		float buildTime = TimeBest([&]() { bvh.Clear(); }, [&]() {
+			for (int i = 0; i < count; ++i) {
+				proxies[i] = bvh.Insert(centres[i], radii[i], &centres[i], true);
+			}
+			bvh.Rebuild();
+		});
+
+		std::vector<void*>	bvhVisible;
+		std::vector<int>	bvhIndices;
+		std::vector<int>	linearVisible;
+
+		auto BvhCull = [&]() {
+			bvhVisible.clear();
+			bvh.Cull(frustum, bvhVisible);
+		};
+		auto Matches = [&]() {
+			LinearCull(linearVisible);
+			bvhIndices.clear();
+			for (void* v : bvhVisible) {
+				bvhIndices.push_back((int)((Vector3*)v - centres.data()));
+			}
+			std::sort(bvhIndices.begin(), bvhIndices.end());
+			return bvhIndices == linearVisible;
+		};
+
+		float linearTime	= TimeBest(nullptr, [&]() { LinearCull(linearVisible); });
+		float bvhTime		= TimeBest(nullptr, BvhCull);
+		size_t visibleCount	= linearVisible.size();
+		matched = matched && Matches();
+
+		int moving = std::max(1, (int)(count * MOVING_FRACTION));
+		std::vector<int> movers(moving);
+
+		auto PickMovers = [&](const std::function<Vector3(const Vector3&)>& move) {
+			for (int& m : movers) {
+				m = (int)(random() % count);
+				centres[m] = move(centres[m]);
+			}
+		};
+		auto MoveProxies = [&]() {
+			for (int m : movers) {
+				bvh.Move(proxies[m], centres[m], radii[m]);
+			}
+		};
+		float nudgeTime = TimeBest([&]() {
+			PickMovers([&](const Vector3& c) { return c + Vector3(nudge(random), nudge(random), nudge(random)); });
+		}, MoveProxies);
+		BvhCull();
+		matched = matched && Matches();
+
+		float teleportTime = TimeBest([&]() {
+			PickMovers([&](const Vector3&) { return Vector3(position(random), position(random), position(random)); });
+		}, MoveProxies);
+		BvhCull();
+		matched = matched && Matches();
+
+		std::cout << std::setw(10) << count << std::setw(10) << visibleCount << std::setw(8) << bvh.GetHeight()
+			<< std::setw(10) << buildTime << std::setw(10) << linearTime << std::setw(10) << bvhTime
+			<< std::setw(9) << linearTime / std::max(bvhTime, 0.001f) << "x"
+			<< std::setw(10) << nudgeTime << std::setw(10) << teleportTime << std::endl;
+	}
+	std::cout << "Times in ms. Nudge and teleport move " << MOVING_FRACTION * 100.0f << "% of the spheres. "
+		<< (matched ? "The BVH always found the same spheres." : "The BVH found DIFFERENT spheres!") << std::endl;
+
+	return matched ? 0 : -1;
+}
@@ -0,0 +1,176 @@
+#include "Tools.h"
+#include "../nclgl/Frustum.h"
+#include "../nclgl/Matrix4.h"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+/*
+Checks Frustum's batch culling against testing each object with InsideFrustum
+and ClassifyBox, then times them. The checks use a perspective frustum with
+objects scattered at random, and the cube an identity matrix makes, with
+objects on a coarse grid - so plenty of them touch a plane exactly, which is
+where any difference in rounding would show. Odd counts make sure the last
+few objects, left over after the SIMD loop, are done right too.
+*/
+
+static const float	GRID_STEP		= 0.25f;
+
+struct CullObjects {
+	std::vector<float> x, y, z, radius;
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	void Resize(size_t count) {
+		for (std::vector<float>* v : { &x, &y, &z, &radius, &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+			v->resize(count);
+		}
+	}
+	size_t Count() const { return x.size(); }
+};
+
+static void RandomObjects(CullObjects& o, size_t count, float range, std::mt19937& random) {
+	std::uniform_real_distribution<float> position(-range, range);
+	std::uniform_real_distribution<float> size(0.0f, range * 0.05f);
+
+	o.Resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		o.x[i]		= position(random);
+		o.y[i]		= position(random);
+		o.z[i]		= position(random);
+		o.radius[i]	= size(random);
+		o.minX[i]	= o.x[i] - size(random);	o.maxX[i] = o.x[i] + size(random);
+		o.minY[i]	= o.y[i] - size(random);	o.maxY[i] = o.y[i] + size(random);
+		o.minZ[i]	= o.z[i] - size(random);	o.maxZ[i] = o.z[i] + size(random);
+	}
+}
+
+static void GridObjects(CullObjects& o, size_t count, std::mt19937& random) {
+	auto Step = [&](int steps) { return GRID_STEP * (float)((int)(random() % (steps * 2 + 1)) - steps); };
+
+	o.Resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		o.x[i]		= Step(8);
+		o.y[i]		= Step(8);
+		o.z[i]		= Step(8);
+		o.radius[i]	= GRID_STEP * (float)(random() % 5);
+		o.minX[i]	= o.x[i] - GRID_STEP * (float)(random() % 4);	o.maxX[i] = o.minX[i] + GRID_STEP * (float)(random() % 4);
+		o.minY[i]	= o.y[i] - GRID_STEP * (float)(random() % 4);	o.maxY[i] = o.minY[i] + GRID_STEP * (float)(random() % 4);
+		o.minZ[i]	= o.z[i] - GRID_STEP * (float)(random() % 4);	o.maxZ[i] = o.minZ[i] + GRID_STEP * (float)(random() % 4);
+	}
+}
+
+//Every way of culling has to agree with testing the objects one by one
+static bool CheckCulling(const Frustum& f, const CullObjects& o) {
+	size_t count = o.Count();
+	std::vector<uint32_t> expectedSpheres((count + 31) / 32, 0);
+	std::vector<uint32_t> expectedBoxes((count + 31) / 32, 0);
+
+	for (size_t i = 0; i < count; ++i) {
+		if (f.InsideFrustum(Vector3(o.x[i], o.y[i], o.z[i]), o.radius[i])) {
+			expectedSpheres[i / 32] |= 1u << (i % 32);
+		}
+		if (f.ClassifyBox(Vector3(o.minX[i], o.minY[i], o.minZ[i]), Vector3(o.maxX[i], o.maxY[i], o.maxZ[i])) != Frustum::OUTSIDE) {
+			expectedBoxes[i / 32] |= 1u << (i % 32);
+		}
+	}
+	std::vector<uint32_t>		visible(expectedSpheres.size());
+	std::vector<unsigned int>	indices(count);
+	bool ok = true;
+
+	auto Check = [&](const char* what, size_t visibleCount, const std::vector<uint32_t>& expected) {
+		size_t compacted = Frustum::CompactVisible(visible.data(), count, indices.data());
+		bool same = visible == expected && compacted == visibleCount;
+		for (size_t i = 0; i < compacted && same; ++i) {
+			same = (expected[indices[i] / 32] >> (indices[i] % 32)) & 1;
+		}
+		if (!same) {
+			std::cout << what << " differs from testing one at a time, for " << count << " objects" << std::endl;
+		}
+		ok = ok && same;
+	};
+	Check("CullSpheres", f.CullSpheres(o.x.data(), o.y.data(), o.z.data(), o.radius.data(), count, visible.data()), expectedSpheres);
+	Check("CullSpheresScalar", f.CullSpheresScalar(o.x.data(), o.y.data(), o.z.data(), o.radius.data(), count, visible.data()), expectedSpheres);
+	Check("CullBoxes", f.CullBoxes(o.minX.data(), o.minY.data(), o.minZ.data(),
+		o.maxX.data(), o.maxY.data(), o.maxZ.data(), count, visible.data()), expectedBoxes);
+	Check("CullBoxesScalar", f.CullBoxesScalar(o.minX.data(), o.minY.data(), o.minZ.data(),
+		o.maxX.data(), o.maxY.data(), o.maxZ.data(), count, visible.data()), expectedBoxes);
+	return ok;
+}
+
+int BenchmarkCulling(const ToolArgs& args) {
+	size_t count = args.empty() ? 1000000 : (size_t)atoi(args[0].c_str());
+	if (count < 1) {
+		std::cout << "Need at least one object!" << std::endl;
+		return -1;
+	}
+	std::mt19937 random(1234);
+
+	Frustum perspective;
+	perspective.FromMatrix(Matrix4::Perspective(1.0f, 1000.0f, 16.0f / 9.0f, 45.0f) *
+		Matrix4::BuildViewMatrix(Vector3(0, 0, 0), Vector3(300, 0, 500)));
+	Frustum cube;
+	cube.FromMatrix(Matrix4());
+
+	bool ok = true;
+	CullObjects o;
+	for (size_t checkCount : { (size_t)1, (size_t)3, (size_t)7, (size_t)33, (size_t)1001, (size_t)65537 }) {
+		RandomObjects(o, checkCount, 1000.0f, random);
+		ok = CheckCulling(perspective, o) && ok;
+		GridObjects(o, checkCount, random);
+		ok = CheckCulling(cube, o) && ok;
+	}
+	std::cout << (ok ? "Batch culling matches InsideFrustum and ClassifyBox exactly" : "Batch culling is WRONG") << std::endl;
+
+	RandomObjects(o, count, 1000.0f, random);
+	std::vector<Vector3>		positions(count);
+	std::vector<uint32_t>		visible((count + 31) / 32);
+	std::vector<unsigned int>	indices(count);
+	for (size_t i = 0; i < count; ++i) {
+		positions[i] = Vector3(o.x[i], o.y[i], o.z[i]);
+	}
+	size_t visibleCount = 0;
+
+	float oneByOneTime = TimeBest(nullptr, [&]() {
+		visibleCount = 0;
+		for (size_t i = 0; i < count; ++i) {
+			visibleCount += perspective.InsideFrustum(positions[i], o.radius[i]) ? 1 : 0;
+		}
+	});
+	float scalarTime = TimeBest(nullptr, [&]() {
+		perspective.CullSpheresScalar(o.x.data(), o.y.data(), o.z.data(), o.radius.data(), count, visible.data());
+	});
+	float sphereTime = TimeBest(nullptr, [&]() {
+		perspective.CullSpheres(o.x.data(), o.y.data(), o.z.data(), o.radius.data(), count, visible.data());
+	});
+	float compactTime = TimeBest(nullptr, [&]() {
+		Frustum::CompactVisible(visible.data(), count, indices.data());
+	});
+	float boxTime = TimeBest(nullptr, [&]() {
+		perspective.CullBoxes(o.minX.data(), o.minY.data(), o.minZ.data(), o.maxX.data(), o.maxY.data(), o.maxZ.data(), count, visible.data());
+	});
+	float boxScalarTime = TimeBest(nullptr, [&]() {
+		perspective.CullBoxesScalar(o.minX.data(), o.minY.data(), o.minZ.data(), o.maxX.data(), o.maxY.data(), o.maxZ.data(), count, visible.data());
+	});
+
+#ifdef __AVX__
+	const char* width = "AVX, 8 at a time";
+#else
+	const char* width = "SSE, 4 at a time";
+#endif
+	std::cout << count << " objects, " << visibleCount << " spheres visible, batches use " << width << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	auto Row = [&](const char* name, float time) {
+		std::cout << std::left << std::setw(36) << name << std::right << std::setw(10) << time << "ms"
+			<< std::setw(10) << std::setprecision(2) << time * 1000000.0f / count << "ns each" << std::setprecision(3) << std::endl;
+	};
+	Row("Spheres, InsideFrustum each",	oneByOneTime);
+	Row("Spheres, batch scalar",		scalarTime);
+	Row("Spheres, batch SIMD",			sphereTime);
+	Row("Compacting the visible mask",	compactTime);
+	Row("Boxes, batch scalar",			boxScalarTime);
+	Row("Boxes, batch SIMD",			boxTime);
+
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,231 @@
+#include "Tools.h"
+#include "../nclgl/SceneNode.h"
+#include "../nclgl/JobSystem.h"
+#include "../nclgl/BoundingVolumeHierarchy.h"
+#include "../nclgl/Frustum.h"
+#include "../nclgl/RenderQueue.h"
+#include "../nclgl/DrawBatcher.h"
+#include "../nclgl/FrameArena.h"
+#include "../nclgl/AllocationCounter.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+
+/*
+Runs the pieces the Renderer builds its frames from, over a scene of pooled
+SceneNodes - updating it on the job system, keeping a BVH up to date and culling
+it into the frame arena, working out distances in parallel, and building,
+sorting and batching the draw lists - while some of the nodes move about. Once
+a few frames have gone by for everything to grow to size, no frame may go to
+the heap at all. This is a model of the frame, without GL, occlusion culling or
+LODs: the Renderer checks its own frames the same way once its assets have
+loaded, and warns about any that allocate.
+
+It also checks the node pool's handles: every live node has to be found from
+its handle, and a deleted node's handle has to find nothing, even after its
+block has gone to a new node.
+*/
+
+static const int	WARMUP_FRAMES		= 10;
+static const int	MEASURED_FRAMES		= 100;
+static const int	NODES_PER_GROUP		= 100;
+static const float	MOVING_FRACTION		= 0.05f;
+static const int	SHADER_COUNT		= 4;
+
+class FrameScene {
+public:
+	FrameScene(int nodeCount) : random(1234) {
+		root = new SceneNode();
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		SceneNode* group = nullptr;
+
+		for (int i = 0; i < nodeCount; ++i) {
+			if (i % NODES_PER_GROUP == 0) {
+				group = new SceneNode();
+				root->AddChild(group);
+			}
+			SceneNode* n = new SceneNode();
+			n->SetTransform(Matrix4::Translation(Vector3(position(random), position(random), position(random))));
+			n->SetBoundingRadius(5.0f);
+			n->SetShader((int)(random() % SHADER_COUNT));
+			n->SetColour(Vector4(1, 1, 1, random() % 10 == 0 ? 0.5f : 1.0f));
+			group->AddChild(n);
+			nodes.push_back(n);
+		}
+		frustum.FromMatrix(Matrix4::Perspective(1.0f, 1000.0f, 16.0f / 9.0f, 45.0f) *
+			Matrix4::BuildViewMatrix(Vector3(0, 0, 600), Vector3(0, 0, 0)));
+
+		culledNodes.SetArena(arena);
+		nodeList.SetArena(arena);
+		transparentNodeList.SetArena(arena);
+	}
+
+	~FrameScene() {
+		delete root;
+	}
+
+	//Moves a few nodes, as animation would, then runs a frame
+	void RunFrame(float dt) {
+		std::uniform_real_distribution<float> nudge(-2.0f, 2.0f);
+		for (size_t i = 0; i < nodes.size() * MOVING_FRACTION; ++i) {
+			SceneNode* n = nodes[random() % nodes.size()];
+			n->SetTransform(n->GetTransform() * Matrix4::Translation(Vector3(nudge(random), nudge(random), nudge(random))));
+		}
+		JobSystem& jobs = JobSystem::GetSharedJobSystem();
+		JobCounter updated;
+		JobCounter culled;
+		SceneNode* r = root;
+		jobs.Run([=]() { r->Update(dt); }, updated);
+		jobs.RunAfter(updated, [this]() { BuildNodeLists(); SortNodeLists(); }, culled);
+		jobs.Wait(updated);
+		jobs.Wait(culled);
+	}
+
+	size_t GetVisibleCount() const { return batcher.GetStats().nodes; }
+	const FrameArena& GetArena() const { return arena; }
+
+protected:
+	void UpdateBvh() {
+		TransformHierarchy& hierarchy = TransformHierarchy::GetSharedHierarchy();
+		if (bvhStructureVersion != hierarchy.GetStructureVersion()) {
+			bvh.Clear();
+			for (SceneNode* n : nodes) {
+				if (n->GetTransformHandle() >= proxies.size()) {
+					proxies.resize(n->GetTransformHandle() + 1, BoundingVolumeHierarchy::NULL_PROXY);
+				}
+				proxies[n->GetTransformHandle()] = bvh.Insert(n->GetWorldTransform().GetPositionVector(), n->GetBoundingRadius(), n, true);
+			}
+			bvh.Rebuild();
+			bvhStructureVersion = hierarchy.GetStructureVersion();
+			return;
+		}
+		for (TransformHierarchy::Handle h : hierarchy.GetLastUpdated()) {
+			if (h < proxies.size() && proxies[h] != BoundingVolumeHierarchy::NULL_PROXY) {
+				SceneNode* n = static_cast<SceneNode*>(bvh.GetUserData(proxies[h]));
+				bvh.Move(proxies[h], n->GetWorldTransform().GetPositionVector(), n->GetBoundingRadius());
+			}
+		}
+	}
+
+	void BuildNodeLists() {
+		arena.Reset();
+		queue.Clear();
+		UpdateBvh();
+
+		culledNodes.Resize(bvh.GetCount());
+		culledNodes.Resize(bvh.Cull(frustum, culledNodes.Data()));
+
+		Vector3 cameraPosition(0, 0, 600);
+		JobSystem::GetSharedJobSystem().ParallelFor(culledNodes.Size(), [&](size_t i) {
+			SceneNode* n = static_cast<SceneNode*>(culledNodes[i]);
+			Vector3 dir = n->GetWorldTransform().GetPositionVector() - cameraPosition;
+			n->SetCameraDistance(Vector3::Dot(dir, dir));
+		}, 64);
+
+		for (size_t i = 0; i < culledNodes.Size(); ++i) {
+			SceneNode* n = static_cast<SceneNode*>(culledNodes[i]);
+			RenderQueue::Pass pass = n->GetColour().w < 1.0f ? RenderQueue::PASS_TRANSPARENT : RenderQueue::PASS_OPAQUE;
+			queue.Add(RenderQueue::MakeKey(pass, n->GetShader(), n->GetMaterial(), n->GetMesh(), n->GetCameraDistance()),
+				(unsigned int)i);
+		}
+	}
+
+	void SortNodeLists() {
+		queue.Sort();
+		batcher.Clear();
+		for (size_t i = 0; i < queue.GetCount(); ++i) {
+			SceneNode* n = static_cast<SceneNode*>(culledNodes[queue[i].index]);
+			(RenderQueue::GetPass(queue[i].key) == RenderQueue::PASS_TRANSPARENT ? transparentNodeList : nodeList).PushBack(n);
+		}
+		batcher.Add(nodeList.Data(), nodeList.Size());
+		batcher.Add(transparentNodeList.Data(), transparentNodeList.Size());
+	}
+
+	std::mt19937				random;
+	SceneNode*					root;
+	std::vector<SceneNode*>		nodes;
+	Frustum						frustum;
+	BoundingVolumeHierarchy		bvh;
+	std::vector<BoundingVolumeHierarchy::Proxy> proxies;
+	unsigned int				bvhStructureVersion = 0xFFFFFFFF;
+	RenderQueue					queue;
+	DrawBatcher					batcher;
+	FrameArena					arena;
+	FrameVector<void*>			culledNodes;
+	FrameVector<SceneNode*>		nodeList;
+	FrameVector<SceneNode*>		transparentNodeList;
+};
+
+//Handles of live nodes find them, and handles of deleted ones find nothing
+static bool CheckHandles() {
+	std::vector<SceneNode*>			nodes;
+	std::vector<NodePool::Handle>	handles;
+	for (int i = 0; i < 1000; ++i) {
+		nodes.push_back(new SceneNode());
+		handles.push_back(nodes.back()->GetHandle());
+	}
+	bool ok = true;
+	for (size_t i = 0; i < nodes.size(); i += 2) {
+		delete nodes[i];
+		nodes[i] = nullptr;
+	}
+	//These should take the blocks just freed
+	std::vector<SceneNode*> reused;
+	for (int i = 0; i < 500; ++i) {
+		reused.push_back(new SceneNode());
+		ok = ok && SceneNode::FromHandle(reused.back()->GetHandle()) == reused.back();
+	}
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		ok = ok && SceneNode::FromHandle(handles[i]) == nodes[i];
+	}
+	for (SceneNode* n : nodes) {
+		delete n;
+	}
+	for (SceneNode* n : reused) {
+		delete n;
+	}
+	return ok;
+}
+
+int BenchmarkFrames(const ToolArgs& args) {
+	int nodeCount = args.size() > 0 ? atoi(args[0].c_str()) : 20000;
+	if (nodeCount < 1) {
+		std::cout << "Need at least one node!" << std::endl;
+		return -1;
+	}
+	bool handlesWork = CheckHandles();
+
+	FrameScene scene(nodeCount);
+	GameTimer timer;
+	float dt = 1.0f / 60.0f;
+
+	for (int i = 0; i < WARMUP_FRAMES; ++i) {
+		scene.RunFrame(dt);
+	}
+	size_t	allocations	= AllocationCounter::GetAllocationCount();
+	size_t	worstFrame	= 0;
+	float	totalTime	= 0.0f;
+	for (int i = 0; i < MEASURED_FRAMES; ++i) {
+		size_t before = AllocationCounter::GetAllocationCount();
+		timer.Tick();
+		scene.RunFrame(dt);
+		timer.Tick();
+		totalTime	+= timer.GetTimeDeltaMSec();
+		worstFrame	= std::max(worstFrame, AllocationCounter::GetAllocationCount() - before);
+	}
+	allocations = AllocationCounter::GetAllocationCount() - allocations;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << nodeCount << " nodes in a pool of " << SceneNode::GetPool().GetCapacity() << " ("
+		<< SceneNode::GetPool().GetChunkCount() << " chunks), " << scene.GetVisibleCount() << " visible" << std::endl;
+	std::cout << "Frame arena: " << scene.GetArena().GetHighWater() << " of " << scene.GetArena().GetCapacity()
+		<< " bytes used at most" << std::endl;
+	std::cout << MEASURED_FRAMES << " frames after " << WARMUP_FRAMES << " to warm up: " << totalTime / MEASURED_FRAMES
+		<< "ms each, " << allocations << " heap allocations in all, " << worstFrame << " in the worst frame" << std::endl;
+	std::cout << (handlesWork ? "Node handles found every live node, and no deleted ones." : "Node handles are BROKEN!") << std::endl;
+
+	return allocations == 0 && handlesWork ? 0 : -1;
+}
@@ -0,0 +1,156 @@
+#include "Tools.h"
+#include "../nclgl/JobSystem.h"
+#include "../nclgl/TransformHierarchy.h"
+#include "../nclgl/Frustum.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+
+/*
+Runs the parts of a frame the Renderer hands to the job system - updating the
+transforms of a large hierarchy, then culling it, with a particle simulation
+going on alongside both - on a job system with one thread, then two, and so on,
+to see how well each of them scales. Every thread count has to get the same
+world transforms and cull the same nodes as a single thread does.
+*/
+
+static const size_t	CULL_GRAIN			= 1024;
+static const size_t	PARTICLE_COUNT		= 250000;
+static const size_t	PARTICLE_GRAIN		= 4096;
+static const float	PARTICLE_TIMESTEP	= 1.0f / 60.0f;
+
+int BenchmarkJobs(const ToolArgs& args) {
+	unsigned int	hardwareThreads	= std::max(std::thread::hardware_concurrency(), 1u);
+	int				maxThreads		= args.size() > 0 ? atoi(args[0].c_str()) : (int)hardwareThreads;
+	int				nodeCount		= args.size() > 1 ? atoi(args[1].c_str()) : 200000;
+	if (maxThreads < 1 || nodeCount < 1) {
+		std::cout << "Need at least one thread and one node!" << std::endl;
+		return -1;
+	}
+	std::mt19937 random(1234);
+
+	//Each node's parent is any node made before it, as in transformbench
+	std::vector<int>		parents(nodeCount, -1);
+	std::vector<Matrix4>	transforms(nodeCount);
+
+	std::uniform_real_distribution<float> angle(-45.0f, 45.0f);
+	std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+
+	for (int i = 0; i < nodeCount; ++i) {
+		parents[i]		= i > 0 ? (int)(random() % i) : -1;
+		transforms[i]	= Matrix4::Translation(Vector3(offset(random), offset(random), offset(random))) *
+			Matrix4::Rotation(angle(random), Vector3(0, 1, 0));
+	}
+	TransformHierarchy hierarchy;
+	std::vector<TransformHierarchy::Handle> handles(nodeCount);
+	for (int i = 0; i < nodeCount; ++i) {
+		handles[i] = hierarchy.Create(i > 0 ? handles[parents[i]] : TransformHierarchy::INVALID_HANDLE);
+		hierarchy.SetLocalTransform(handles[i], transforms[i]);
+	}
+	hierarchy.Update();
+
+	std::vector<Matrix4> expectedWorld(nodeCount);
+	for (int i = 0; i < nodeCount; ++i) {
+		expectedWorld[i] = hierarchy.GetWorldTransform(handles[i]);
+	}
+
+	Frustum frustum;
+	frustum.FromMatrix(Matrix4::Perspective(1.0f, 1000.0f, 16.0f / 9.0f, 45.0f) *
+		Matrix4::BuildViewMatrix(Vector3(0, 20, 60), Vector3(0, 0, 0)));
+
+	std::vector<uint8_t>	visible(nodeCount);
+	std::vector<size_t>		blockVisible((nodeCount + CULL_GRAIN - 1) / CULL_GRAIN);
+
+	auto CullBlock = [&](size_t b) {
+		size_t count = 0;
+		for (size_t i = b * CULL_GRAIN; i < std::min((size_t)nodeCount, (b + 1) * CULL_GRAIN); ++i) {
+			visible[i] = frustum.InsideFrustum(hierarchy.GetWorldTransform(handles[i]).GetPositionVector(), 1.0f) ? 1 : 0;
+			count += visible[i];
+		}
+		blockVisible[b] = count;
+	};
+	auto CountVisible = [&]() {
+		size_t total = 0;
+		for (size_t c : blockVisible) {
+			total += c;
+		}
+		return total;
+	};
+	for (size_t b = 0; b < blockVisible.size(); ++b) {
+		CullBlock(b);
+	}
+	size_t				expectedVisible = CountVisible();
+	std::vector<uint8_t> expectedVisibility = visible;
+
+	std::vector<Vector3> particles(PARTICLE_COUNT);
+	std::vector<Vector3> velocities(PARTICLE_COUNT);
+	for (size_t i = 0; i < PARTICLE_COUNT; ++i) {
+		particles[i]	= Vector3(offset(random), offset(random) + 10.0f, offset(random));
+		velocities[i]	= Vector3(offset(random), offset(random), offset(random)) * 0.1f;
+	}
+	auto SimulateParticle = [&](size_t i) {
+		velocities[i] = velocities[i] + Vector3(0, -9.81f, 0) * PARTICLE_TIMESTEP;
+		particles[i] = particles[i] + velocities[i] * PARTICLE_TIMESTEP;
+		if (particles[i].y < 0.0f) {
+			particles[i].y = -particles[i].y;
+			velocities[i] = Vector3(velocities[i].x * 0.9f, -velocities[i].y * 0.5f, velocities[i].z * 0.9f);
+		}
+	};
+
+	std::cout << nodeCount << " nodes, " << PARTICLE_COUNT << " particles, "
+		<< hardwareThreads << " hardware threads" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::left << std::setw(10) << "Threads" << std::right
+		<< std::setw(12) << "Update" << std::setw(12) << "Cull" << std::setw(12) << "Particles"
+		<< std::setw(12) << "Frame" << std::setw(12) << "Speedup" << std::endl;
+
+	float	singleFrame	= 0.0f;
+	bool	matched		= true;
+
+	for (int threads = 1; threads <= maxThreads; ++threads) {
+		JobSystem jobs(threads - 1);
+
+		auto MoveRoot = [&]() { hierarchy.SetLocalTransform(handles[0], transforms[0]); };
+		auto Cull = [&]() { jobs.ParallelFor(blockVisible.size(), CullBlock); };
+		auto Simulate = [&]() { jobs.ParallelFor(PARTICLE_COUNT, SimulateParticle, PARTICLE_GRAIN); };
+
+		float updateTime	= TimeBest(MoveRoot, [&]() { hierarchy.Update(jobs); });
+		float cullTime		= TimeBest(nullptr, Cull);
+		float particleTime	= TimeBest(nullptr, Simulate);
+
+		//As the Renderer does it - the cull waits for the update, while the
+		//particles just get on with it
+		float frameTime = TimeBest(MoveRoot, [&]() {
+			JobCounter updated;
+			JobCounter culled;
+			JobCounter simulated;
+			jobs.Run([&]() { hierarchy.Update(jobs); }, updated);
+			jobs.RunAfter(updated, Cull, culled);
+			jobs.Run(Simulate, simulated);
+			jobs.Wait(updated);
+			jobs.Wait(culled);
+			jobs.Wait(simulated);
+		});
+
+		for (int i = 0; i < nodeCount && matched; ++i) {
+			const Matrix4& m = hierarchy.GetWorldTransform(handles[i]);
+			for (int j = 0; j < 16; ++j) {
+				matched = matched && m.values[j] == expectedWorld[i].values[j];
+			}
+		}
+		matched = matched && CountVisible() == expectedVisible && visible == expectedVisibility;
+
+		if (threads == 1) {
+			singleFrame = frameTime;
+		}
+		std::cout << std::left << std::setw(10) << threads << std::right
+			<< std::setw(12) << updateTime << std::setw(12) << cullTime << std::setw(12) << particleTime
+			<< std::setw(12) << frameTime << std::setw(11) << singleFrame / frameTime << "x" << std::endl;
+	}
+	std::cout << "Times in ms. " << expectedVisible << " nodes visible. "
+		<< (matched ? "Every thread count matched one thread." : "Results DIFFER between thread counts!") << std::endl;
+
+	return matched ? 0 : -1;
+}
@@ -0,0 +1,247 @@
+#include "LegacyTextMesh.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+enum class GeometryChunkTypes {
+	VPositions		= 1,
+	VNormals		= 2,
+	VTangents		= 4,
+	VColors			= 8,
+	VTex0			= 16,
+	VTex1			= 32,
+	VWeightValues	= 64,
+	VWeightIndices	= 128,
+	Indices			= 256,
+	JointNames		= 512,
+	JointParents	= 1024,
+	BindPose		= 2048,
+	BindPoseInv		= 4096,
+	Material		= 65536,
+	SubMeshes		= 1 << 14,
+	SubMeshNames	= 1 << 15
+};
+
+static void ReadTextFloats(std::ifstream& file, vector<Vector2>& element, int numVertices) {
+	for (int i = 0; i < numVertices; ++i) {
+		Vector2 temp;
+		file >> temp.x;
+		file >> temp.y;
+		element.emplace_back(temp);
+	}
+}
+
+static void ReadTextFloats(std::ifstream& file, vector<Vector3>& element, int numVertices) {
+	for (int i = 0; i < numVertices; ++i) {
+		Vector3 temp;
+		file >> temp.x;
+		file >> temp.y;
+		file >> temp.z;
+		element.emplace_back(temp);
+	}
+}
+
+static void ReadTextFloats(std::ifstream& file, vector<Vector4>& element, int numVertices) {
+	for (int i = 0; i < numVertices; ++i) {
+		Vector4 temp;
+		file >> temp.x;
+		file >> temp.y;
+		file >> temp.z;
+		file >> temp.w;
+		element.emplace_back(temp);
+	}
+}
+
+static void ReadTextVertexIndices(std::ifstream& file, vector<int>& element, int numVertices) {
+	for (int i = 0; i < numVertices; ++i) {
+		int indices[4];
+		file >> indices[0];
+		file >> indices[1];
+		file >> indices[2];
+		file >> indices[3];
+		element.emplace_back(indices[0]);
+		element.emplace_back(indices[1]);
+		element.emplace_back(indices[2]);
+		element.emplace_back(indices[3]);
+	}
+}
+
+static void ReadIndices(std::ifstream& file, vector<unsigned int>& elements, int numIndices) {
+	for (int i = 0; i < numIndices; ++i) {
+		unsigned int temp;
+		file >> temp;
+		elements.emplace_back(temp);
+	}
+}
+
+static void ReadJointParents(std::ifstream& file, vector<int>& dest) {
+	int jointCount = 0;
+	file >> jointCount;
+
+	for (int i = 0; i < jointCount; ++i) {
+		int id = -1;
+		file >> id;
+		dest.emplace_back(id);
+	}
+}
+
+static void ReadJointNames(std::ifstream& file, vector<string>& dest) {
+	int jointCount = 0;
+	file >> jointCount;
+	for (int i = 0; i < jointCount; ++i) {
+		std::string jointName;
+		file >> jointName;
+		dest.emplace_back(jointName);
+	}
+}
+
+static void ReadRigPose(std::ifstream& file, Matrix4** into) {
+	int matCount = 0;
+	file >> matCount;
+
+	*into = new Matrix4[matCount];
+
+	for (int i = 0; i < matCount; ++i) {
+		Matrix4 mat;
+		for (int i = 0; i < 16; ++i) {
+			file >> mat.values[i];
+		}
+		(*into)[i] = mat;
+	}
+}
+
+static void ReadSubMeshes(std::ifstream& file, int count, vector<Mesh::SubMesh> & subMeshes) {
+	for (int i = 0; i < count; ++i) {
+		Mesh::SubMesh m;
+		file >> m.start;
+		file >> m.count;
+		subMeshes.emplace_back(m);
+	}
+}
+
+static void ReadSubMeshNames(std::ifstream& file, int count, vector<string>& names) {
+	std::string scrap;
+	std::getline(file, scrap);
+
+	for (int i = 0; i < count; ++i) {
+		std::string meshName;
+		std::getline(file, meshName);
+		names.emplace_back(meshName);
+	}
+}
+
+LegacyTextMesh* LegacyTextMesh::Load(const string& name) {
+	LegacyTextMesh* mesh = new LegacyTextMesh();
+
+	std::ifstream file(MESHDIR + name);
+
+	std::string filetype;
+	int fileVersion;
+
+	file >> filetype;
+
+	if (filetype != "MeshGeometry") {
+		std::cout << "File is not a MeshGeometry file!" << std::endl;
+		return nullptr;
+	}
+
+	file >> fileVersion;
+
+	if (fileVersion != 1) {
+		std::cout << "MeshGeometry file has incompatible version!" << std::endl;
+		return nullptr;
+	}
+
+	int numMeshes	= 0; //read
+	int numVertices = 0; //read
+	int numIndices	= 0; //read
+	int numChunks	= 0; //read
+
+	file >> numMeshes;
+	file >> numVertices;
+	file >> numIndices;
+	file >> numChunks;
+
+	vector<Vector3> readPositions;
+	vector<Vector4> readColours;
+	vector<Vector3> readNormals;
+	vector<Vector4> readTangents;
+	vector<Vector2> readUVs;
+	vector<Vector4> readWeights;
+	vector<int> readWeightIndices;
+
+	vector<unsigned int>		readIndices;
+
+	for (int i = 0; i < numChunks; ++i) {
+		int chunkType = (int)GeometryChunkTypes::VPositions;
+
+		file >> chunkType;
+
+		switch ((GeometryChunkTypes)chunkType) {
+		case GeometryChunkTypes::VPositions:ReadTextFloats(file, readPositions, numVertices);  break;
+		case GeometryChunkTypes::VColors:	ReadTextFloats(file, readColours, numVertices);  break;
+		case GeometryChunkTypes::VNormals:	ReadTextFloats(file, readNormals, numVertices);  break;
+		case GeometryChunkTypes::VTangents:	ReadTextFloats(file, readTangents, numVertices);  break;
+		case GeometryChunkTypes::VTex0:		ReadTextFloats(file, readUVs, numVertices);  break;
+		case GeometryChunkTypes::Indices:	ReadIndices(file, readIndices, numIndices); break;
+
+		case GeometryChunkTypes::VWeightValues:		ReadTextFloats(file, readWeights, numVertices);  break;
+		case GeometryChunkTypes::VWeightIndices:	ReadTextVertexIndices(file, readWeightIndices, numVertices);  break;
+		case GeometryChunkTypes::JointNames:		ReadJointNames(file, mesh->jointNames);  break;
+		case GeometryChunkTypes::JointParents:		ReadJointParents(file, mesh->jointParents);  break;
+		case GeometryChunkTypes::BindPose:			ReadRigPose(file, &mesh->bindPose);  break;
+		case GeometryChunkTypes::BindPoseInv:		ReadRigPose(file, &mesh->inverseBindPose);  break;
+		case GeometryChunkTypes::SubMeshes: 		ReadSubMeshes(file, numMeshes, mesh->meshLayers); break;
+		case GeometryChunkTypes::SubMeshNames: 		ReadSubMeshNames(file, numMeshes, mesh->layerNames); break;
+		}
+	}
+	//Now that the data has been read, we can shove it into the actual Mesh object
+
+	mesh->numVertices	= numVertices;
+	mesh->numIndices	= numIndices;
+
+	if (!readPositions.empty()) {
+		mesh->vertices = new Vector3[numVertices];
+		memcpy(mesh->vertices, readPositions.data(), numVertices * sizeof(Vector3));
+	}
+
+	if (!readColours.empty()) {
+		mesh->colours = new Vector4[numVertices];
+		memcpy(mesh->colours, readColours.data(), numVertices * sizeof(Vector4));
+	}
+
+	if (!readNormals.empty()) {
+		mesh->normals = new Vector3[numVertices];
+		memcpy(mesh->normals, readNormals.data(), numVertices * sizeof(Vector3));
+	}
+
+	if (!readTangents.empty()) {
+		mesh->tangents = new Vector4[numVertices];
+		memcpy(mesh->tangents, readTangents.data(), numVertices * sizeof(Vector4));
+	}
+
+	if (!readUVs.empty()) {
+		mesh->textureCoords = new Vector2[numVertices];
+		memcpy(mesh->textureCoords, readUVs.data(), numVertices * sizeof(Vector2));
+	}
+	if (!readIndices.empty()) {
+		mesh->indices = new unsigned int[numIndices];
+		memcpy(mesh->indices, readIndices.data(), numIndices * sizeof(unsigned int));
+	}
+
+	if (!readWeights.empty()) {
+		mesh->weights = new Vector4[numVertices];
+		memcpy(mesh->weights, readWeights.data(), numVertices * sizeof(Vector4));
+	}
+
+	if (!readWeightIndices.empty()) {
+		mesh->weightIndices = new int[numVertices * 4];
+		memcpy(mesh->weightIndices, readWeightIndices.data(), numVertices * sizeof(int) * 4);
+	}
+	return mesh;
+}
+
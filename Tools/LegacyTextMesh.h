@@ -0,0 +1,15 @@
+/******************************************************************************
+Class:LegacyTextMesh
+Implements:Mesh
+Description:The original std::ifstream based .msh parser, kept as a reference
+to benchmark and validate Mesh::LoadTextMeshData against. It only exists to
+fill in the protected Mesh members, so always delete it as a LegacyTextMesh.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../nclgl/Mesh.h"
+
+class LegacyTextMesh : public Mesh {
+public:
+	static LegacyTextMesh* Load(const std::string& name);
+};
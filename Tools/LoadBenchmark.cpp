@@ -0,0 +1,91 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+
+/*
+Compares parsing a text .msh file against mapping its binary copy. Neither
+path touches OpenGL, so this measures everything up to the point BufferData
+would be called. Mapped pages aren't read from disk until something touches
+them, so both paths are charged for reading every position and index, just as
+the upload to the GPU would.
+*/
+
+typedef std::function<Mesh*(const std::string& name)> MeshLoadFunction;
+
+static unsigned int TouchMeshData(const Mesh* m) {
+	unsigned int sum = 0;
+	const unsigned int* positions = (const unsigned int*)m->GetPositionData();
+
+	for (unsigned int i = 0; positions && i < m->GetVertexCount() * 3; ++i) {
+		sum += positions[i];
+	}
+	for (unsigned int i = 0; m->GetIndexData() && i < m->GetIndexCount(); ++i) {
+		sum += m->GetIndexData()[i];
+	}
+	return sum;
+}
+
+//Fastest of BENCHMARK_RUNS loads, in milliseconds
+static float TimeLoad(MeshLoadFunction load, const std::string& name) {
+	float best = FLT_MAX;
+	GameTimer timer;
+
+	for (int i = 0; i < BENCHMARK_RUNS; ++i) {
+		timer.Tick();
+		Mesh* m = load(name);
+		if (!m) {
+			return -1.0f;
+		}
+		volatile unsigned int sum = TouchMeshData(m);
+		(void)sum;
+		timer.Tick();
+		best = std::min(best, timer.GetTimeDeltaMSec());
+		delete m;
+	}
+	return best;
+}
+
+int BenchmarkMeshLoading(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	float totalText		= 0.0f;
+	float totalBinary	= 0.0f;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(56) << "Mesh" << std::right << std::setw(12) << "Text (ms)" << std::setw(14) << "Binary (ms)" << std::setw(10) << "Speedup" << std::endl;
+
+	for (const std::string& name : files) {
+		std::string binaryName = Mesh::GetBinaryFileName(name);
+
+		Mesh* text		= Mesh::LoadTextMeshData(name);
+		Mesh* binary	= Mesh::LoadBinaryMeshData(binaryName);
+
+		if (!text || !binary) {
+			std::cout << std::left << std::setw(56) << name << " skipped - run 'convert' first" << std::endl;
+			delete text;
+			delete binary;
+			continue;
+		}
+		bool matches = binary->HasSameData(*text);
+		delete text;
+		delete binary;
+
+		float textTime		= TimeLoad([](const std::string& n) { return Mesh::LoadTextMeshData(n); }, name);
+		float binaryTime	= TimeLoad(Mesh::LoadBinaryMeshData, binaryName);
+
+		totalText	+= textTime;
+		totalBinary += binaryTime;
+
+		std::cout << std::left << std::setw(56) << name << std::right << std::setw(12) << textTime << std::setw(14) << binaryTime
+			<< std::setw(9) << (textTime / std::max(binaryTime, 0.001f)) << "x" << (matches ? "" : "  MISMATCH") << std::endl;
+	}
+	std::cout << std::left << std::setw(56) << "Total" << std::right << std::setw(12) << totalText << std::setw(14) << totalBinary
+		<< std::setw(9) << (totalText / std::max(totalBinary, 0.001f)) << "x" << std::endl;
+	return 0;
+}
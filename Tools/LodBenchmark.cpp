@@ -0,0 +1,104 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/SceneNode.h"
+#include "../nclgl/MeshMaterial.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+/*
+Builds each mesh's LOD chain, then flies a camera away from it, picking a LOD
+at every step the way the Renderer does, to see how many triangles that saves.
+The path runs from just outside the mesh's bounding sphere out to a few hundred
+times its radius, spaced so that every doubling of distance gets as many steps,
+with the same projection as the Renderer at 1080p.
+*/
+
+static const int	PATH_STEPS			= 256;
+static const float	PATH_NEAREST		= 1.5f;		//In bounding radii
+static const float	PATH_FURTHEST		= 400.0f;
+static const float	PATH_FOV			= 45.0f;
+static const float	PATH_SCREEN_HEIGHT	= 1080.0f;
+
+static float GetMeshRadius(const Mesh& m) {
+	const Vector3* v = m.GetPositionData();
+	if (!v || m.GetVertexCount() == 0) {
+		return 0.0f;
+	}
+	Vector3 minBounds = v[0];
+	Vector3 maxBounds = v[0];
+	for (unsigned int i = 1; i < m.GetVertexCount(); ++i) {
+		minBounds = Vector3(std::min(minBounds.x, v[i].x), std::min(minBounds.y, v[i].y), std::min(minBounds.z, v[i].z));
+		maxBounds = Vector3(std::max(maxBounds.x, v[i].x), std::max(maxBounds.y, v[i].y), std::max(maxBounds.z, v[i].z));
+	}
+	return (maxBounds - minBounds).Length() * 0.5f;
+}
+
+int BenchmarkLods(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	float pixelScale = PATH_SCREEN_HEIGHT * 0.5f / tanf(PATH_FOV * PI_OVER_360);
+
+	size_t	totalFull		= 0;
+	size_t	totalDrawn		= 0;
+	float	totalBuildTime	= 0.0f;
+	float	totalSelectTime	= 0.0f;
+
+	GameTimer timer;
+
+	for (const std::string& name : files) {
+		std::shared_ptr<Mesh> mesh(Mesh::LoadMeshData(name));
+		if (!mesh) {
+			std::cout << name << " failed to load" << std::endl;
+			continue;
+		}
+		mesh->Optimise();
+
+		timer.Tick();
+		mesh->GenerateLods();
+		timer.Tick();
+		float buildTime = timer.GetTimeDeltaMSec();
+
+		std::cout << name << " (" << std::fixed << std::setprecision(2) << buildTime << "ms to build)" << std::endl;
+		for (int i = 0; i < mesh->GetLodCount(); ++i) {
+			std::cout << "  LOD " << i << std::setw(10) << mesh->GetLodTriCount(i) << " tris, error "
+				<< std::setprecision(3) << mesh->GetLodError(i) * 100.0f << "% of radius" << std::endl;
+		}
+
+		SceneNode node;
+		node.SetMesh(mesh);
+		node.SetBoundingRadius(GetMeshRadius(*mesh));
+		node.Update(0.0f);
+
+		size_t	full		= 0;
+		size_t	drawn		= 0;
+		float	selectTime	= 0.0f;
+
+		for (int step = 0; step < PATH_STEPS; ++step) {
+			float distance = node.GetBoundingRadius() * PATH_NEAREST * powf(PATH_FURTHEST / PATH_NEAREST, step / (float)(PATH_STEPS - 1));
+
+			timer.Tick();
+			node.SelectLod(Vector3(0, 0, distance), pixelScale);
+			timer.Tick();
+			selectTime += timer.GetTimeDeltaMSec();
+
+			full	+= mesh->GetLodTriCount(0);
+			drawn	+= mesh->GetLodTriCount(node.GetLod());
+		}
+		std::cout << "  Camera path: " << drawn / PATH_STEPS << " tris drawn on average, "
+			<< std::setprecision(1) << 100.0f * drawn / std::max<size_t>(full, 1) << "% of full detail, "
+			<< std::setprecision(3) << selectTime * 1000000.0f / PATH_STEPS << "ns per selection" << std::endl;
+
+		totalFull		+= full;
+		totalDrawn		+= drawn;
+		totalBuildTime	+= buildTime;
+		totalSelectTime	+= selectTime;
+	}
+	std::cout << std::fixed << std::setprecision(1) << "Total: " << totalBuildTime << "ms building, "
+		<< 100.0f * totalDrawn / std::max<size_t>(totalFull, 1) << "% of full detail triangles drawn, "
+		<< std::setprecision(3) << totalSelectTime << "ms selecting" << std::endl;
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+
+#include <iostream>
+
+/*
+Converts text .msh files into the binary MeshGeometry format read by
+Mesh::LoadBinaryMeshData. The binary copy sits next to the original, so
+Mesh::LoadFromMeshFile picks it up automatically.
+*/
+int ConvertMeshes(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	int failures = 0;
+
+	for (const std::string& name : files) {
+		Mesh* mesh = Mesh::LoadTextMeshData(name);
+
+		if (!mesh) {
+			std::cout << "Failed to load " << name << std::endl;
+			++failures;
+			continue;
+		}
+		std::string binaryName = Mesh::GetBinaryFileName(name);
+
+		if (mesh->SaveToBinaryFile(binaryName)) {
+			std::cout << name << ": " << GetFileSizeOnDisk(MESHDIR + name) << " bytes -> "
+				<< binaryName << ": " << GetFileSizeOnDisk(MESHDIR + binaryName) << " bytes" << std::endl;
+		}
+		else {
+			++failures;
+		}
+		delete mesh;
+	}
+	std::cout << "Converted " << (files.size() - failures) << " of " << files.size() << " meshes" << std::endl;
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,156 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/ThreadPool.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/*
+Times Mesh::GenerateNormals and GenerateTangents against the scalar loops they
+replaced, on a heightmap sized grid, and checks both give the same results.
+The heights come from a few sine waves rather than a texture, so any size of
+grid can be tested without needing an image to match.
+*/
+
+static const int NORMAL_RUNS = 3;
+
+class GridMesh : public Mesh {
+public:
+	GridMesh(int width, int height) {
+		numVertices		= width * height;
+		numIndices		= (width - 1) * (height - 1) * 6;
+		vertices		= new Vector3[numVertices];
+		textureCoords	= new Vector2[numVertices];
+		indices			= new GLuint[numIndices];
+
+		for (int z = 0; z < height; ++z) {
+			for (int x = 0; x < width; ++x) {
+				float y = 128.0f + 60.0f * sinf(x * 0.05f) * cosf(z * 0.037f) + 20.0f * sinf((x + z) * 0.21f);
+				vertices[(z * width) + x]		= Vector3((float)x, y, (float)z) * Vector3(50.0f, 3.5f, 50.0f);
+				textureCoords[(z * width) + x]	= Vector2((float)x, (float)z) * Vector2(1 / 50.0f, 1.0f / 50.0f);
+			}
+		}
+		int i = 0;
+		for (int z = 0; z < height - 1; ++z) {
+			for (int x = 0; x < width - 1; ++x) {
+				int a = (z * width) + x;
+				int b = (z * width) + (x + 1);
+				int c = ((z + 1) * width) + (x + 1);
+				int d = ((z + 1) * width) + x;
+
+				indices[i++] = a;
+				indices[i++] = c;
+				indices[i++] = b;
+
+				indices[i++] = c;
+				indices[i++] = a;
+				indices[i++] = d;
+			}
+		}
+	}
+
+	//The original single threaded versions, kept as a reference
+	void GenerateNormalsScalar(Vector3* out) {
+		for (GLuint i = 0; i < numVertices; ++i) {
+			out[i] = Vector3();
+		}
+		for (unsigned int i = 0; i < GetTriCount(); ++i) {
+			unsigned int a = 0;
+			unsigned int b = 0;
+			unsigned int c = 0;
+			GetVertexIndicesForTri(i, a, b, c);
+
+			Vector3 normal = Vector3::Cross((vertices[b] - vertices[a]), (vertices[c] - vertices[a]));
+
+			out[a] += normal;
+			out[b] += normal;
+			out[c] += normal;
+		}
+		for (GLuint i = 0; i < numVertices; ++i) {
+			out[i].Normalise();
+		}
+	}
+
+	void GenerateTangentsScalar(Vector4* out) {
+		for (GLuint i = 0; i < numVertices; ++i) {
+			out[i] = Vector4(0, 0, 0, 0);
+		}
+		for (unsigned int i = 0; i < GetTriCount(); ++i) {
+			unsigned int a = 0;
+			unsigned int b = 0;
+			unsigned int c = 0;
+			GetVertexIndicesForTri(i, a, b, c);
+
+			Vector4 tangent = GenerateTangent(a, b, c);
+
+			out[a] += tangent;
+			out[b] += tangent;
+			out[c] += tangent;
+		}
+		for (GLuint i = 0; i < numVertices; ++i) {
+			float handedness = out[i].w > 0.0f ? 1.0f : -1.0f;
+			out[i].w = 0.0f;
+			out[i].Normalise();
+			out[i].w = handedness;
+		}
+	}
+
+	const Vector3* GetNormals() const	{ return normals; }
+	const Vector4* GetTangents() const	{ return tangents; }
+};
+
+struct Comparison {
+	size_t	differentBits	= 0;
+	float	largestError	= 0.0f;
+};
+
+static Comparison Compare(const float* a, const float* b, size_t count) {
+	Comparison result;
+	for (size_t i = 0; i < count; ++i) {
+		if (memcmp(&a[i], &b[i], sizeof(float)) != 0) {
+			result.differentBits++;
+			result.largestError = std::max(result.largestError, fabsf(a[i] - b[i]));
+		}
+	}
+	return result;
+}
+
+int BenchmarkNormalGeneration(const ToolArgs& args) {
+	int size = args.empty() ? 2048 : atoi(args[0].c_str());
+	if (size < 2) {
+		std::cout << "Grid size must be at least 2!" << std::endl;
+		return -1;
+	}
+	std::cout << "Generating a " << size << " x " << size << " grid on " << ThreadPool::GetSharedPool().GetThreadCount() + 1 << " threads" << std::endl;
+
+	GridMesh grid(size, size);
+	unsigned int vertexCount = grid.GetVertexCount();
+
+	std::vector<Vector3> scalarNormals(vertexCount);
+	std::vector<Vector4> scalarTangents(vertexCount);
+
+	float scalarNormalTime	= TimeBest(nullptr, [&]() { grid.GenerateNormalsScalar(scalarNormals.data()); }, NORMAL_RUNS);
+	float scalarTangentTime	= TimeBest(nullptr, [&]() { grid.GenerateTangentsScalar(scalarTangents.data()); }, NORMAL_RUNS);
+	float normalTime		= TimeBest(nullptr, [&]() { grid.GenerateNormals(); }, NORMAL_RUNS);
+	float tangentTime		= TimeBest(nullptr, [&]() { grid.GenerateTangents(); }, NORMAL_RUNS);
+
+	Comparison normals	= Compare(&scalarNormals[0].x, &grid.GetNormals()[0].x, vertexCount * 3);
+	Comparison tangents	= Compare(&scalarTangents[0].x, &grid.GetTangents()[0].x, vertexCount * 4);
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(12) << "" << std::right << std::setw(14) << "Scalar (ms)" << std::setw(16) << "Parallel (ms)"
+		<< std::setw(10) << "Speedup" << std::setw(16) << "Differences" << std::setw(14) << "Max error" << std::endl;
+
+	std::cout << std::left << std::setw(12) << "Normals" << std::right << std::setw(14) << scalarNormalTime << std::setw(16) << normalTime
+		<< std::setw(9) << scalarNormalTime / std::max(normalTime, 0.001f) << "x" << std::setw(16) << normals.differentBits
+		<< std::setw(14) << std::scientific << normals.largestError << std::fixed << std::endl;
+
+	std::cout << std::left << std::setw(12) << "Tangents" << std::right << std::setw(14) << scalarTangentTime << std::setw(16) << tangentTime
+		<< std::setw(9) << scalarTangentTime / std::max(tangentTime, 0.001f) << "x" << std::setw(16) << tangents.differentBits
+		<< std::setw(14) << std::scientific << tangents.largestError << std::fixed << std::endl;
+
+	return (normals.largestError < 1e-5f && tangents.largestError < 1e-5f) ? 0 : -1;
+}
@@ -0,0 +1,282 @@
+#include "Tools.h"
+#include "../nclgl/OcclusionCuller.h"
+#include "../nclgl/Frustum.h"
+#include "../nclgl/Matrix4.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+/*
+Checks the OcclusionCuller, then times it on a hilly terrain like the one in
+the Blank Project. The checks are:
+- a wall in front of the camera hides what's behind it, and nothing else
+- the rasterizer's depth buffer matches casting a ray through every pixel
+  centre at a pile of random triangles, some of them crossing the near plane
+- no sphere said to be hidden has any point on it in front of the depth buffer
+*/
+
+static const int	TERRAIN_SIZE		= 129;
+static const float	TERRAIN_SPACING		= 50.0f;
+static const int	SURFACE_SAMPLES		= 64;
+
+static Matrix4 CameraMatrix(const Vector3& from, const Vector3& to, float aspect) {
+	return Matrix4::Perspective(1.0f, 20000.0f, aspect, 45.0f) * Matrix4::BuildViewMatrix(from, to);
+}
+
+static bool CheckWall() {
+	OcclusionCuller culler;
+	culler.BeginFrame(CameraMatrix(Vector3(0, 0, 0), Vector3(0, 0, -1), 2.0f));
+
+	//A 100 unit square, 100 units away, facing the camera - and the same
+	//again off to one side, facing away, which shouldn't be drawn
+	Vector3 wall[8] = {
+		Vector3(-50, -50, -100), Vector3(50, -50, -100), Vector3(50, 50, -100), Vector3(-50, 50, -100),
+		Vector3(150, -50, -100), Vector3(250, -50, -100), Vector3(250, 50, -100), Vector3(150, 50, -100)
+	};
+	unsigned int indices[12] = { 0, 1, 2, 2, 3, 0, 4, 6, 5, 6, 4, 7 };
+	culler.AddOccluder(Matrix4(), wall, 8, indices, 12);
+	culler.EndFrame();
+
+	struct Case {
+		const char*	what;
+		Vector3		centre;
+		float		radius;
+		bool		visible;
+	};
+	Case cases[] = {
+		{ "behind the wall",					Vector3(0, 0, -200),	10.0f,	false },
+		{ "far behind the wall",				Vector3(10, -10, -5000),100.0f,	false },
+		{ "in front of the wall",				Vector3(0, 0, -50),		10.0f,	true },
+		{ "through the wall",					Vector3(0, 0, -100),	10.0f,	true },
+		{ "behind the wall but peeking out",	Vector3(95, 0, -200),	10.0f,	true },
+		{ "beside the wall",					Vector3(0, 120, -200),	10.0f,	true },
+		{ "behind a wall facing away",			Vector3(400, 0, -400),	10.0f,	true },
+		{ "around the camera",					Vector3(0, 0, 0),		5.0f,	true },
+		{ "behind the camera",					Vector3(0, 0, 200),		10.0f,	true },
+	};
+	bool ok = true;
+	for (const Case& c : cases) {
+		if (culler.IsVisible(c.centre, c.radius) != c.visible) {
+			std::cout << "A sphere " << c.what << " should be " << (c.visible ? "visible" : "hidden") << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/*
+Works out where the ray through a pixel centre meets a triangle by solving for
+the weights of its corners in clip space, which needs no clipping at all - a
+point with weights all positive, and in front of the near plane, is on it.
+Pixels that come too close to an edge to call are left out of the comparison.
+*/
+static bool CheckRasterizer(std::mt19937& random) {
+	const int	WIDTH		= 128;
+	const int	HEIGHT		= 64;
+	const int	TRIANGLES	= 200;
+	const double EDGE_TOLERANCE = 1e-4;
+
+	Matrix4 viewProj = CameraMatrix(Vector3(0, 0, 0), Vector3(0, 0, -1), 2.0f);
+	std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> depth(-150.0f, 5.0f);
+
+	std::vector<Vector3>		positions;
+	std::vector<unsigned int>	indices;
+	for (int i = 0; i < TRIANGLES * 3; ++i) {
+		positions.push_back(Vector3(position(random), position(random), depth(random)));
+		indices.push_back(i);
+	}
+	OcclusionCuller culler(WIDTH, HEIGHT);
+	culler.BeginFrame(viewProj);
+	culler.AddOccluder(Matrix4(), positions.data(), positions.size(), indices.data(), indices.size());
+	culler.EndFrame();
+
+	std::vector<Vector4> clip(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i) {
+		clip[i] = viewProj * Vector4(positions[i].x, positions[i].y, positions[i].z, 1.0f);
+	}
+	int compared	= 0;
+	int wrong		= 0;
+	for (int py = 0; py < HEIGHT; ++py) {
+		for (int px = 0; px < WIDTH; ++px) {
+			double nx = ((px + 0.5) / WIDTH) * 2.0 - 1.0;
+			double ny = ((py + 0.5) / HEIGHT) * 2.0 - 1.0;
+			double nearest		= 0.0;
+			bool ambiguous		= false;
+
+			for (int t = 0; t < TRIANGLES; ++t) {
+				const Vector4* v[3] = { &clip[t * 3], &clip[t * 3 + 1], &clip[t * 3 + 2] };
+				//Rows: x - nx * w = 0, y - ny * w = 0, and the weights add up to 1
+				double m[3][3];
+				for (int k = 0; k < 3; ++k) {
+					m[0][k] = v[k]->x - nx * v[k]->w;
+					m[1][k] = v[k]->y - ny * v[k]->w;
+					m[2][k] = 1.0;
+				}
+				double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+					m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+				if (fabs(det) < 1e-12) {
+					continue;
+				}
+				//Cramer's rule, with the right hand side (0, 0, 1)
+				double weight[3] = {
+					(m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det,
+					(m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det,
+					(m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det,
+				};
+				double w = 0.0, nearDistance = 0.0;
+				for (int k = 0; k < 3; ++k) {
+					w				+= weight[k] * v[k]->w;
+					nearDistance	+= weight[k] * (v[k]->z + v[k]->w);
+				}
+				//Front facing when the corners go anticlockwise round the screen
+				double ax = v[0]->x / v[0]->w, ay = v[0]->y / v[0]->w;
+				double facing = (double)v[0]->w * v[1]->w * v[2]->w *
+					((v[1]->x / v[1]->w - ax) * (v[2]->y / v[2]->w - ay) - (v[1]->y / v[1]->w - ay) * (v[2]->x / v[2]->w - ax));
+				if (facing <= 0.0 || w <= 0.0 || nearDistance < 0.0) {
+					continue;
+				}
+				double lowest = std::min(weight[0], std::min(weight[1], weight[2]));
+				if (fabs(lowest) < EDGE_TOLERANCE || fabs(nearDistance) < EDGE_TOLERANCE) {
+					ambiguous = true;
+				}
+				else if (lowest > 0.0) {
+					nearest = std::max(nearest, 1.0 / w);
+				}
+			}
+			if (ambiguous) {
+				continue;
+			}
+			double got = culler.GetDepths(0)[py * culler.GetLevelWidth(0) + px];
+			compared++;
+			if (fabs(got - nearest) > 1e-4 * std::max(nearest, 1e-3)) {
+				wrong++;
+			}
+		}
+	}
+	if (wrong) {
+		std::cout << wrong << " of " << compared << " pixels differ from casting rays at the triangles" << std::endl;
+	}
+	return wrong == 0;
+}
+
+//A heightmap's worth of rolling hills, wound like HeightMap's
+static void MakeTerrain(std::vector<Vector3>& positions, std::vector<unsigned int>& indices) {
+	for (int z = 0; z < TERRAIN_SIZE; ++z) {
+		for (int x = 0; x < TERRAIN_SIZE; ++x) {
+			float height = 400.0f * (sinf(x * 0.11f) * cosf(z * 0.07f) + 1.0f) + 150.0f * sinf(x * 0.31f + z * 0.23f);
+			positions.push_back(Vector3(x * TERRAIN_SPACING, height, z * TERRAIN_SPACING));
+		}
+	}
+	for (int z = 0; z < TERRAIN_SIZE - 1; ++z) {
+		for (int x = 0; x < TERRAIN_SIZE - 1; ++x) {
+			unsigned int a = (z * TERRAIN_SIZE) + x;
+			unsigned int b = (z * TERRAIN_SIZE) + (x + 1);
+			unsigned int c = ((z + 1) * TERRAIN_SIZE) + (x + 1);
+			unsigned int d = ((z + 1) * TERRAIN_SIZE) + x;
+			indices.insert(indices.end(), { a, c, b, c, a, d });
+		}
+	}
+}
+
+//Every point tried on a hidden sphere has to be behind the depth buffer
+static bool IsReallyHidden(const OcclusionCuller& culler, const Matrix4& viewProj, const Vector3& centre, float radius,
+	std::mt19937& random) {
+	std::normal_distribution<float> direction(0.0f, 1.0f);
+	const float* depths = culler.GetDepths(0);
+
+	for (int i = 0; i <= SURFACE_SAMPLES; ++i) {
+		Vector3 d(direction(random), direction(random), direction(random));
+		Vector3 p = i == 0 ? centre : centre + d * (radius / std::max(d.Length(), 1e-6f));
+		Vector4 clip = viewProj * Vector4(p.x, p.y, p.z, 1.0f);
+		if (clip.w <= 0.0f) {
+			return false;
+		}
+		int x = (int)floorf((clip.x / clip.w * 0.5f + 0.5f) * culler.GetWidth());
+		int y = (int)floorf((clip.y / clip.w * 0.5f + 0.5f) * culler.GetHeight());
+		if (x < 0 || y < 0 || x >= culler.GetWidth() || y >= culler.GetHeight()) {
+			continue;
+		}
+		if (depths[y * culler.GetWidth() + x] <= 1.0f / clip.w) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int BenchmarkOcclusion(const ToolArgs& args) {
+	int count = args.empty() ? 100000 : atoi(args[0].c_str());
+	if (count < 1) {
+		std::cout << "Need at least one sphere!" << std::endl;
+		return -1;
+	}
+	std::mt19937 random(1234);
+
+	bool wallOk			= CheckWall();
+	bool rasterizerOk	= CheckRasterizer(random);
+
+	std::vector<Vector3>		terrain;
+	std::vector<unsigned int>	terrainIndices;
+	MakeTerrain(terrain, terrainIndices);
+
+	//Low down in a valley, looking along it
+	float size = (TERRAIN_SIZE - 1) * TERRAIN_SPACING;
+	Matrix4 viewProj = CameraMatrix(Vector3(size * 0.1f, 500.0f, size * 0.5f), Vector3(size, 300.0f, size * 0.5f), 16.0f / 9.0f);
+	Frustum frustum;
+	frustum.FromMatrix(viewProj);
+
+	std::uniform_real_distribution<float> across(0.0f, size);
+	std::uniform_real_distribution<float> up(0.0f, 1000.0f);
+	std::uniform_real_distribution<float> radius(5.0f, 50.0f);
+
+	std::vector<Vector3>	centres;
+	std::vector<float>		radii;
+	while ((int)centres.size() < count) {
+		Vector3 c(across(random), up(random), across(random));
+		float r = radius(random);
+		if (frustum.InsideFrustum(c, r)) {
+			centres.push_back(c);
+			radii.push_back(r);
+		}
+	}
+	OcclusionCuller culler;
+	float drawTime = TimeBest(nullptr, [&]() {
+		culler.BeginFrame(viewProj);
+		culler.AddOccluder(Matrix4(), terrain.data(), terrain.size(), terrainIndices.data(), terrainIndices.size());
+	});
+	float pyramidTime = TimeBest(nullptr, [&]() { culler.EndFrame(); });
+
+	std::vector<uint8_t> visible(count);
+	float testTime = TimeBest(nullptr, [&]() {
+		for (int i = 0; i < count; ++i) {
+			visible[i] = culler.IsVisible(centres[i], radii[i]) ? 1 : 0;
+		}
+	});
+	int hidden			= 0;
+	int wronglyHidden	= 0;
+	for (int i = 0; i < count; ++i) {
+		if (!visible[i]) {
+			hidden++;
+			wronglyHidden += IsReallyHidden(culler, viewProj, centres[i], radii[i], random) ? 0 : 1;
+		}
+	}
+	if (wronglyHidden) {
+		std::cout << wronglyHidden << " hidden spheres have points in front of the depth buffer" << std::endl;
+	}
+	bool ok = wallOk && rasterizerOk && wronglyHidden == 0;
+	std::cout << (ok ? "Occlusion culling passed every check" : "Occlusion culling is WRONG") << std::endl;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << culler.GetWidth() << "x" << culler.GetHeight() << " depth buffer, " << culler.GetLevelCount() << " levels. "
+		<< culler.GetTrianglesDrawn() << " of " << terrainIndices.size() / 3 << " terrain triangles drawn." << std::endl;
+	std::cout << hidden << " of " << count << " spheres inside the frustum were hidden by the terrain." << std::endl;
+	std::cout << std::left << std::setw(28) << "Drawing the terrain" << std::right << std::setw(10) << drawTime << "ms" << std::endl;
+	std::cout << std::left << std::setw(28) << "Building the pyramid" << std::right << std::setw(10) << pyramidTime << "ms" << std::endl;
+	std::cout << std::left << std::setw(28) << "Testing the spheres" << std::right << std::setw(10) << testTime << "ms"
+		<< std::setw(10) << std::setprecision(2) << testTime * 1000000.0f / count << "ns each" << std::endl;
+
+	return ok ? 0 : -1;
+}
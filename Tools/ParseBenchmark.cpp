@@ -0,0 +1,83 @@
+#include "Tools.h"
+#include "LegacyTextMesh.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cfloat>
+
+/*
+Compares Mesh::LoadTextMeshData, decoding its chunks both serially and on the
+thread pool, against the original iostream parser it replaced, checking that
+all of them produce identical meshes.
+*/
+
+template<typename LoadFunction> static float TimeParse(LoadFunction load, const std::string& name) {
+	float best = FLT_MAX;
+	GameTimer timer;
+
+	for (int i = 0; i < BENCHMARK_RUNS; ++i) {
+		timer.Tick();
+		auto m = load(name);
+		timer.Tick();
+		best = std::min(best, timer.GetTimeDeltaMSec());
+		delete m;
+	}
+	return best;
+}
+
+static Mesh* LoadSerial(const std::string& name) {
+	return Mesh::LoadTextMeshData(name, false);
+}
+
+static Mesh* LoadParallel(const std::string& name) {
+	return Mesh::LoadTextMeshData(name, true);
+}
+
+int BenchmarkMeshParsing(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	float totalLegacy	= 0.0f;
+	float totalSerial	= 0.0f;
+	float totalParallel = 0.0f;
+	int	  mismatches	= 0;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(56) << "Mesh" << std::right << std::setw(14) << "iostream (ms)" << std::setw(13) << "Serial (ms)"
+		<< std::setw(15) << "Parallel (ms)" << std::setw(10) << "Speedup" << std::endl;
+
+	for (const std::string& name : files) {
+		LegacyTextMesh* legacy		= LegacyTextMesh::Load(name);
+		Mesh*			serial		= LoadSerial(name);
+		Mesh*			parallel	= LoadParallel(name);
+
+		bool loaded		= legacy && serial && parallel;
+		bool matches	= loaded && serial->HasSameData(*legacy) && parallel->HasSameData(*legacy);
+		delete legacy;
+		delete serial;
+		delete parallel;
+
+		if (!loaded) {
+			std::cout << std::left << std::setw(56) << name << " failed to load" << std::endl;
+			++mismatches;
+			continue;
+		}
+
+		float legacyTime	= TimeParse(LegacyTextMesh::Load, name);
+		float serialTime	= TimeParse(LoadSerial, name);
+		float parallelTime	= TimeParse(LoadParallel, name);
+
+		totalLegacy		+= legacyTime;
+		totalSerial		+= serialTime;
+		totalParallel	+= parallelTime;
+		mismatches		+= matches ? 0 : 1;
+
+		std::cout << std::left << std::setw(56) << name << std::right << std::setw(14) << legacyTime << std::setw(13) << serialTime << std::setw(15) << parallelTime
+			<< std::setw(9) << (legacyTime / std::max(parallelTime, 0.001f)) << "x" << (matches ? "" : "  MISMATCH") << std::endl;
+	}
+	std::cout << std::left << std::setw(56) << "Total" << std::right << std::setw(14) << totalLegacy << std::setw(13) << totalSerial << std::setw(15) << totalParallel
+		<< std::setw(9) << (totalLegacy / std::max(totalParallel, 0.001f)) << "x" << std::endl;
+
+	return mismatches ? -1 : 0;
+}
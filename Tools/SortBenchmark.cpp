@@ -0,0 +1,146 @@
+#include "Tools.h"
+#include "../nclgl/RenderQueue.h"
+#include "../nclgl/SceneNode.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <memory>
+
+/*
+Sorts a list of scene nodes for drawing the way the Renderer used to - std::sort
+on the node pointers, comparing shaders and then distances from the camera -
+and with a RenderQueue, which makes a key for each node and radix sorts those.
+Each node has a random shader and distance, and one in ten is transparent. The
+radix sort has to come out the same as a stable std::sort of the same keys, and
+in the order the old comparison asked for, as far as the keys' depth precision
+allows.
+*/
+
+static const int	SHADER_COUNT		= 10;
+static const float	TRANSPARENT_FRACTION = 0.1f;
+static const float	DEPTH_PRECISION		= 1.0f / 65536.0f;	//Keys keep 16 bits of mantissa
+
+static bool CompareByShaderAndDistance(const SceneNode* a, const SceneNode* b) {
+	if (a->GetShader() != b->GetShader()) {
+		return a->GetShader() < b->GetShader();
+	}
+	return SceneNode::CompareByCameraDistance(a, b);
+}
+
+static bool IsTransparent(const SceneNode* n) {
+	return n->GetColour().w < 1.0f;
+}
+
+//Checks a sorted list against the old ordering, which sorted transparent nodes
+//the same way but then drew them backwards
+static bool InOldOrder(const std::vector<const SceneNode*>& list, bool backToFront) {
+	for (size_t i = 1; i < list.size(); ++i) {
+		const SceneNode* a = list[i - 1];
+		const SceneNode* b = list[i];
+		if (a->GetShader() != b->GetShader()) {
+			if (a->GetShader() > b->GetShader()) {
+				return false;
+			}
+			continue;
+		}
+		float from	= backToFront ? b->GetCameraDistance() : a->GetCameraDistance();
+		float to	= backToFront ? a->GetCameraDistance() : b->GetCameraDistance();
+		if (from > to * (1.0f + DEPTH_PRECISION)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int BenchmarkSorting(const ToolArgs& args) {
+	std::vector<int> counts;
+	for (const std::string& a : args) {
+		counts.push_back(atoi(a.c_str()));
+	}
+	if (counts.empty()) {
+		counts = { 1000, 10000, 100000, 1000000 };
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::right << std::setw(10) << "Nodes" << std::setw(12) << "std::sort"
+		<< std::setw(12) << "Make keys" << std::setw(12) << "Radix sort" << std::setw(12) << "Total" << std::setw(10) << "Speedup" << std::endl;
+
+	bool matched = true;
+
+	for (int count : counts) {
+		if (count < 1) {
+			std::cout << "Need at least one node!" << std::endl;
+			return -1;
+		}
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> distance(1.0f, 100000.0f);
+		std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+		std::vector<std::unique_ptr<SceneNode>> nodes;
+		std::vector<SceneNode*> culled;
+		for (int i = 0; i < count; ++i) {
+			SceneNode* n = new SceneNode();
+			n->SetShader((int)(random() % SHADER_COUNT));
+			n->SetCameraDistance(distance(random) * distance(random));
+			n->SetColour(Vector4(1, 1, 1, chance(random) < TRANSPARENT_FRACTION ? 0.5f : 1.0f));
+			nodes.emplace_back(n);
+			culled.push_back(n);
+		}
+		//Nodes come out of culling in no particular order
+		std::shuffle(culled.begin(), culled.end(), random);
+
+		std::vector<SceneNode*> opaque;
+		std::vector<SceneNode*> transparent;
+		auto SplitLists = [&]() {
+			opaque.clear();
+			transparent.clear();
+			for (SceneNode* n : culled) {
+				(IsTransparent(n) ? transparent : opaque).push_back(n);
+			}
+		};
+		float oldTime = TimeBest(SplitLists, [&]() {
+			std::sort(transparent.rbegin(), transparent.rend(), CompareByShaderAndDistance);
+			std::sort(opaque.begin(), opaque.end(), CompareByShaderAndDistance);
+		});
+
+		RenderQueue queue;
+		auto MakeKeys = [&]() {
+			queue.Clear();
+			for (size_t i = 0; i < culled.size(); ++i) {
+				const SceneNode* n = culled[i];
+				RenderQueue::Pass pass = IsTransparent(n) ? RenderQueue::PASS_TRANSPARENT : RenderQueue::PASS_OPAQUE;
+				queue.Add(RenderQueue::MakeKey(pass, n->GetShader(), n->GetMaterial(), n->GetMesh(), n->GetCameraDistance()),
+					(unsigned int)i);
+			}
+		};
+		float keyTime	= TimeBest(nullptr, MakeKeys);
+		float sortTime	= TimeBest(MakeKeys, [&]() { queue.Sort(); });
+
+		MakeKeys();
+		std::vector<RenderQueue::Item> expected(queue.GetItems(), queue.GetItems() + queue.GetCount());
+		std::stable_sort(expected.begin(), expected.end(),
+			[](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key < b.key; });
+		queue.Sort();
+
+		std::vector<const SceneNode*> sortedOpaque;
+		std::vector<const SceneNode*> sortedTransparent;
+		for (size_t i = 0; i < queue.GetCount(); ++i) {
+			const RenderQueue::Item& item = queue[i];
+			matched = matched && item.key == expected[i].key && item.index == expected[i].index;
+			(RenderQueue::GetPass(item.key) == RenderQueue::PASS_TRANSPARENT ? sortedTransparent : sortedOpaque).push_back(culled[item.index]);
+		}
+		matched = matched && sortedOpaque.size() == opaque.size() && sortedTransparent.size() == transparent.size() &&
+			InOldOrder(sortedOpaque, false) && InOldOrder(sortedTransparent, true);
+
+		float newTime = keyTime + sortTime;
+		std::cout << std::setw(10) << count << std::setw(12) << oldTime << std::setw(12) << keyTime
+			<< std::setw(12) << sortTime << std::setw(12) << newTime << std::setw(9) << oldTime / std::max(newTime, 0.001f) << "x" << std::endl;
+	}
+	std::cout << "Times in ms. "
+		<< (matched ? "The radix sort always matched std::stable_sort of the keys, and the old order." : "The radix sort got the order WRONG!") << std::endl;
+
+	return matched ? 0 : -1;
+}
@@ -0,0 +1,108 @@
+#include "Tools.h"
+#include "../nclgl/common.h"
+#include "../nclgl/GameTimer.h"
+#include "../nclgl/AllocationCounterHooks.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <windows.h>
+
+struct ToolCommand {
+	const char* name;
+	const char* usage;
+	int (*function)(const ToolArgs& args);
+};
+
+static const ToolCommand commands[] = {
+	{ "convert",	"convert [mesh.msh ...]         - write .mshb copies of meshes (default all)",	ConvertMeshes },
+	{ "loadbench",	"loadbench [mesh.msh ...]       - compare text and binary mesh load times",	BenchmarkMeshLoading },
+	{ "parsebench",	"parsebench [mesh.msh ...]      - compare the text mesh parser with iostreams",	BenchmarkMeshParsing },
+	{ "layout",		"layout [mesh.msh ...]          - bytes per vertex in the separate and packed layouts",	ReportVertexLayouts },
+	{ "vcache",		"vcache [mesh.msh ...]          - simulated vertex cache ACMR/ATVR before and after optimising",	ReportVertexCache },
+	{ "normalbench",	"normalbench [grid size]        - time normal and tangent generation on a heightmap grid",	BenchmarkNormalGeneration },
+	{ "lodbench",	"lodbench [mesh.msh ...]        - build LOD chains and count triangles drawn along a camera path",	BenchmarkLods },
+	{ "transformbench",	"transformbench [node count]    - update world transforms of a large hierarchy, recursively and flat",	BenchmarkTransforms },
+	{ "jobbench",	"jobbench [threads] [nodes]     - time scene update, culling and particles on 1 to N job threads",	BenchmarkJobs },
+	{ "bvhbench",	"bvhbench [sphere count ...]    - frustum cull spheres one by one and with a BVH",	BenchmarkBvh },
+	{ "cullbench",	"cullbench [object count]       - check SIMD batch frustum culling matches, and time it",	BenchmarkCulling },
+	{ "occlusionbench",	"occlusionbench [sphere count]  - check CPU occlusion culling, and time it on a terrain",	BenchmarkOcclusion },
+	{ "sortbench",	"sortbench [node count ...]     - sort nodes for drawing with std::sort and a radix sorted RenderQueue",	BenchmarkSorting },
+	{ "framebench",	"framebench [node count]        - run the CPU side of frames, counting heap allocations once warmed up",	BenchmarkFrames },
+};
+
+static void FindMeshFiles(const std::string& folder, std::vector<std::string>& into) {
+	WIN32_FIND_DATAA findData;
+	HANDLE search = FindFirstFileA((MESHDIR + folder + "*").c_str(), &findData);
+
+	if (search == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	do {
+		std::string name = findData.cFileName;
+
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			if (name != "." && name != "..") {
+				FindMeshFiles(folder + name + "/", into);
+			}
+		}
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".msh") == 0) {
+			into.push_back(folder + name);
+		}
+	} while (FindNextFileA(search, &findData));
+
+	FindClose(search);
+}
+
+std::vector<std::string> FindMeshFiles() {
+	std::vector<std::string> files;
+	FindMeshFiles("", files);
+	return files;
+}
+
+size_t GetFileSizeOnDisk(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	return file ? (size_t)file.tellg() : 0;
+}
+
+float TimeBest(const std::function<void()>& setup, const std::function<void()>& function, int runs) {
+	float best = FLT_MAX;
+	GameTimer timer;
+
+	for (int i = 0; i < runs; ++i) {
+		if (setup) {
+			setup();
+		}
+		timer.Tick();
+		function();
+		timer.Tick();
+		best = std::min(best, timer.GetTimeDeltaMSec());
+	}
+	return best;
+}
+
+static void PrintUsage() {
+	std::cout << "Usage: Tools <command> [arguments]" << std::endl;
+	for (const ToolCommand& c : commands) {
+		std::cout << "\t" << c.usage << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		PrintUsage();
+		return -1;
+	}
+	std::string command = argv[1];
+	ToolArgs	args(argv + 2, argv + argc);
+
+	for (const ToolCommand& c : commands) {
+		if (command == c.name) {
+			return c.function(args);
+		}
+	}
+	std::cout << "Unknown command " << command << "!" << std::endl;
+	PrintUsage();
+	return -1;
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+Description:Offline tools for the coursework assets - file conversion and
+benchmarks that don't need a window or an OpenGL context. Each tool is a
+command in Tools.cpp, taking the remaining command line arguments.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+typedef std::vector<std::string> ToolArgs;
+
+//Every .msh file under MESHDIR, as names relative to MESHDIR
+std::vector<std::string> FindMeshFiles();
+
+//Size of a file on disk in bytes, or 0 if it does not exist
+size_t GetFileSizeOnDisk(const std::string& filename);
+
+static const int BENCHMARK_RUNS = 5;
+
+//Fastest of a few runs of function in milliseconds, so the first run's page
+//faults on freshly allocated arrays don't count. Setup, which may be null, is
+//called before each run and isn't timed.
+float TimeBest(const std::function<void()>& setup, const std::function<void()>& function, int runs = BENCHMARK_RUNS);
+
+int ConvertMeshes(const ToolArgs& args);
+int BenchmarkMeshLoading(const ToolArgs& args);
+int BenchmarkMeshParsing(const ToolArgs& args);
+int ReportVertexLayouts(const ToolArgs& args);
+int ReportVertexCache(const ToolArgs& args);
+int BenchmarkNormalGeneration(const ToolArgs& args);
+int BenchmarkLods(const ToolArgs& args);
+int BenchmarkTransforms(const ToolArgs& args);
+int BenchmarkJobs(const ToolArgs& args);
+int BenchmarkBvh(const ToolArgs& args);
+int BenchmarkCulling(const ToolArgs& args);
+int BenchmarkOcclusion(const ToolArgs& args);
+int BenchmarkSorting(const ToolArgs& args);
+int BenchmarkFrames(const ToolArgs& args);
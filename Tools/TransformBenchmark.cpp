@@ -0,0 +1,148 @@
+#include "Tools.h"
+#include "../nclgl/TransformHierarchy.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+/*
+Updates the world transforms of a large random hierarchy, the way SceneNode used
+to - recursing through separately allocated nodes, with the scalar matrix
+multiply - and with a TransformHierarchy. The hierarchy is timed with every node
+moving, with a few moving, and with nothing moving, and both are checked to give
+the same world transforms.
+*/
+
+static const float	MOVING_FRACTION	= 0.01f;
+
+struct ReferenceNode {
+	Matrix4						transform;
+	Matrix4						worldTransform;
+	std::vector<ReferenceNode*>	children;
+};
+
+static Matrix4 ScalarMultiply(const Matrix4& a, const Matrix4& b) {
+	Matrix4 out;
+	for (unsigned int r = 0; r < 4; ++r) {
+		for (unsigned int c = 0; c < 4; ++c) {
+			out.values[c + (r * 4)] = 0.0f;
+			for (unsigned int i = 0; i < 4; ++i) {
+				out.values[c + (r * 4)] += a.values[c + (i * 4)] * b.values[(r * 4) + i];
+			}
+		}
+	}
+	return out;
+}
+
+static void UpdateReference(ReferenceNode* n, const ReferenceNode* parent) {
+	n->worldTransform = parent ? ScalarMultiply(parent->worldTransform, n->transform) : n->transform;
+
+	for (ReferenceNode* c : n->children) {
+		UpdateReference(c, n);
+	}
+}
+
+int BenchmarkTransforms(const ToolArgs& args) {
+	int nodeCount = args.empty() ? 100000 : atoi(args[0].c_str());
+	if (nodeCount < 1) {
+		std::cout << "Need at least one node!" << std::endl;
+		return -1;
+	}
+	std::mt19937 random(1234);
+
+	//Each node's parent is any node made before it, which comes out at a
+	//depth of about ln(nodeCount)
+	std::vector<int>		parents(nodeCount, -1);
+	std::vector<Matrix4>	transforms(nodeCount);
+
+	std::uniform_real_distribution<float> angle(-45.0f, 45.0f);
+	std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+
+	for (int i = 0; i < nodeCount; ++i) {
+		parents[i]		= i > 0 ? (int)(random() % i) : -1;
+		transforms[i]	= Matrix4::Translation(Vector3(offset(random), offset(random), offset(random))) *
+			Matrix4::Rotation(angle(random), Vector3(0, 1, 0)) * Matrix4::Scale(Vector3(0.99f, 0.99f, 0.99f));
+	}
+
+	//Allocated in a random order, so they're scattered about the heap like
+	//scene nodes made at different times
+	std::vector<int> allocationOrder(nodeCount);
+	for (int i = 0; i < nodeCount; ++i) {
+		allocationOrder[i] = i;
+	}
+	std::shuffle(allocationOrder.begin(), allocationOrder.end(), random);
+
+	std::vector<ReferenceNode*> referenceNodes(nodeCount);
+	for (int i : allocationOrder) {
+		referenceNodes[i] = new ReferenceNode();
+		referenceNodes[i]->transform = transforms[i];
+	}
+	for (int i = 1; i < nodeCount; ++i) {
+		referenceNodes[parents[i]]->children.push_back(referenceNodes[i]);
+	}
+
+	//Created the same way, then parented, so the first update has to sort them
+	TransformHierarchy hierarchy;
+	std::vector<TransformHierarchy::Handle> handles(nodeCount);
+	for (int i : allocationOrder) {
+		handles[i] = hierarchy.Create();
+		hierarchy.SetLocalTransform(handles[i], transforms[i]);
+	}
+	for (int i = 1; i < nodeCount; ++i) {
+		hierarchy.SetParent(handles[i], handles[parents[i]]);
+	}
+
+	GameTimer timer;
+	timer.Tick();
+	hierarchy.Update();
+	timer.Tick();
+	float firstTime = timer.GetTimeDeltaMSec();
+
+	float referenceTime = TimeBest(nullptr, [&]() { UpdateReference(referenceNodes[0], nullptr); });
+
+	float allTime = TimeBest([&]() { hierarchy.SetLocalTransform(handles[0], transforms[0]); }, [&]() { hierarchy.Update(); });
+	size_t allCount = hierarchy.GetLastUpdateCount();
+
+	int movingCount = std::max(1, (int)(nodeCount * MOVING_FRACTION));
+	float someTime = TimeBest([&]() {
+		for (int i = 0; i < movingCount; ++i) {
+			int n = nodeCount > 1 ? 1 + (int)(random() % (nodeCount - 1)) : 0;
+			hierarchy.SetLocalTransform(handles[n], transforms[n]);
+		}
+	}, [&]() { hierarchy.Update(); });
+	size_t someCount = hierarchy.GetLastUpdateCount();
+
+	float noneTime = TimeBest(nullptr, [&]() { hierarchy.Update(); });
+	size_t noneCount = hierarchy.GetLastUpdateCount();
+
+	float largestError = 0.0f;
+	for (int i = 0; i < nodeCount; ++i) {
+		const Matrix4& a = referenceNodes[i]->worldTransform;
+		const Matrix4& b = hierarchy.GetWorldTransform(handles[i]);
+		for (int j = 0; j < 16; ++j) {
+			largestError = std::max(largestError, fabsf(a.values[j] - b.values[j]));
+		}
+	}
+	for (ReferenceNode* n : referenceNodes) {
+		delete n;
+	}
+
+	std::cout << nodeCount << " nodes" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::left << std::setw(36) << "" << std::right << std::setw(12) << "Time (ms)" << std::setw(12) << "Updated" << std::endl;
+
+	auto Row = [](const char* name, float time, size_t updated) {
+		std::cout << std::left << std::setw(36) << name << std::right << std::setw(12) << time << std::setw(12) << updated << std::endl;
+	};
+	Row("Recursive scene nodes",				referenceTime,	(size_t)nodeCount);
+	Row("Hierarchy, first update and sort",		firstTime,		(size_t)nodeCount);
+	Row("Hierarchy, everything moving",			allTime,		allCount);
+	Row("Hierarchy, 1% of nodes moving",		someTime,		someCount);
+	Row("Hierarchy, nothing moving",			noneTime,		noneCount);
+	std::cout << "Largest difference from the recursive update: " << std::scientific << largestError << std::endl;
+
+	return largestError == 0.0f ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/MeshOptimiser.h"
+#include "../nclgl/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+
+/*
+Simulates the post-transform vertex cache on each mesh as exported, and again
+after Mesh::Optimise, along with how long the optimisation took.
+*/
+
+static MeshOptimiser::CacheStats SimulateMesh(const Mesh* m) {
+	return MeshOptimiser::SimulateVertexCache(m->GetIndexData(), m->GetIndexCount(), m->GetVertexCount());
+}
+
+int ReportVertexCache(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::left << std::setw(56) << "Mesh" << std::right << std::setw(10) << "ACMR" << std::setw(10) << "(after)"
+		<< std::setw(10) << "ATVR" << std::setw(10) << "(after)" << std::setw(10) << "Indices" << std::setw(10) << "ms" << std::endl;
+
+	for (const std::string& name : files) {
+		Mesh* m = Mesh::LoadMeshData(name);
+		if (!m || !m->GetIndexData()) {
+			std::cout << std::left << std::setw(56) << name << (m ? " not indexed" : " failed to load") << std::endl;
+			delete m;
+			continue;
+		}
+		MeshOptimiser::CacheStats before = SimulateMesh(m);
+
+		GameTimer timer;
+		timer.Tick();
+		m->Optimise();
+		timer.Tick();
+
+		MeshOptimiser::CacheStats after = SimulateMesh(m);
+
+		std::cout << std::left << std::setw(56) << name << std::right
+			<< std::setw(10) << before.acmr << std::setw(10) << after.acmr
+			<< std::setw(10) << before.atvr << std::setw(10) << after.atvr
+			<< std::setw(7) << m->GetIndexSize() * 8 << "bit" << std::setw(10) << timer.GetTimeDeltaMSec() << std::endl;
+		delete m;
+	}
+	return 0;
+}
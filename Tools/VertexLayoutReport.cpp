@@ -0,0 +1,45 @@
+#include "Tools.h"
+#include "../nclgl/Mesh.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+/*
+Lists how many bytes of GPU memory each mesh's vertices would take up in the
+separate and packed vertex layouts. Index buffers are the same size in both,
+so are left out.
+*/
+
+int ReportVertexLayouts(const ToolArgs& args) {
+	std::vector<std::string> files = args.empty() ? FindMeshFiles() : args;
+
+	size_t totalSeparate	= 0;
+	size_t totalPacked		= 0;
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << std::left << std::setw(56) << "Mesh" << std::right << std::setw(10) << "Vertices"
+		<< std::setw(12) << "Separate" << std::setw(10) << "Packed" << std::setw(10) << "Saving" << std::endl;
+
+	for (const std::string& name : files) {
+		Mesh* m = Mesh::LoadMeshData(name);
+		if (!m) {
+			std::cout << std::left << std::setw(56) << name << " failed to load" << std::endl;
+			continue;
+		}
+		unsigned int separate	= m->GetVertexSize(VERTEX_LAYOUT_SEPARATE);
+		unsigned int packed		= m->GetVertexSize(VERTEX_LAYOUT_PACKED);
+
+		totalSeparate	+= (size_t)separate * m->GetVertexCount();
+		totalPacked		+= (size_t)packed * m->GetVertexCount();
+
+		std::cout << std::left << std::setw(56) << name << std::right << std::setw(10) << m->GetVertexCount()
+			<< std::setw(10) << separate << " B" << std::setw(8) << packed << " B"
+			<< std::setw(9) << (100.0f - 100.0f * packed / separate) << "%" << std::endl;
+		delete m;
+	}
+	std::cout << std::left << std::setw(66) << "Total" << std::right
+		<< std::setw(9) << totalSeparate / 1024 << "KB" << std::setw(8) << totalPacked / 1024 << "KB"
+		<< std::setw(9) << (100.0f - 100.0f * totalPacked / std::max<size_t>(totalSeparate, 1)) << "%" << std::endl;
+	return 0;
+}
@@ -0,0 +1,27 @@
+#include "AllocationCounter.h"
+#include <atomic>
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> frees(0);
+static std::atomic<size_t> bytes(0);
+
+size_t AllocationCounter::GetAllocationCount() {
+	return allocations;
+}
+
+size_t AllocationCounter::GetFreeCount() {
+	return frees;
+}
+
+size_t AllocationCounter::GetBytesAllocated() {
+	return bytes;
+}
+
+void AllocationCounter::CountAllocation(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void AllocationCounter::CountFree() {
+	frees.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,26 @@
+/******************************************************************************
+Class:AllocationCounter
+Implements:
+Description:Counts every allocation made through operator new, on any thread,
+so a program can check how often it goes to the heap. Take the count before and
+after whatever's being looked at; the difference is how many allocations it
+made.
+
+Nothing is counted unless the program replaces the global operator new and
+delete with the ones in AllocationCounterHooks.h - which only programs that
+want the counts do, so the rest don't pay for them on every allocation.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <cstddef>
+
+class AllocationCounter {
+public:
+	static size_t GetAllocationCount();
+	static size_t GetFreeCount();
+	static size_t GetBytesAllocated();
+
+	//Called by the replacement operators
+	static void	CountAllocation(size_t size);
+	static void	CountFree();
+};
@@ -0,0 +1,44 @@
+/******************************************************************************
+Description:Replaces the global operator new and delete with ones that tell
+AllocationCounter about every allocation. Include this in exactly one .cpp file
+of a program that wants the counts - it defines the operators rather than just
+declaring them, so a second copy won't link.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+//The array, nothrow and sized forms all come through these by default
+void* operator new(size_t size) {
+	AllocationCounter::CountAllocation(size);
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	if (p) {
+		AllocationCounter::CountFree();
+		free(p);
+	}
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete[](void* p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	operator delete(p);
+}
@@ -0,0 +1,263 @@
+#include "AssetLoader.h"
+#include "ThreadPool.h"
+#include "Mesh.h"
+#include "MeshMaterial.h"
+#include "MeshAnimation.h"
+#include "GLStateCache.h"
+
+#include <iostream>
+
+AssetLoader::AssetLoader(size_t uploadBudget, ResourceCache& cache) {
+	this->state			= std::make_shared<LoadState>();
+	this->state->cache	= &cache;
+	this->uploadBudget	= uploadBudget;
+	this->vertexLayout	= VERTEX_LAYOUT_SEPARATE;
+	this->meshLoadFlags	= MESH_LOAD_DEFAULT;
+}
+
+AssetLoader::~AssetLoader(void) {
+	std::deque<Upload> abandoned;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->closed = true;
+		abandoned.swap(state->uploads);
+	}
+	//Anything still waiting for the GPU is dropped here, breaking its promise
+}
+
+void AssetLoader::LoadState::QueueUpload(size_t bytes, std::function<void()> perform) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!closed) {
+		uploads.push_back({ bytes, std::move(perform) });
+	}
+}
+
+template<typename T>
+void AssetLoader::ForgetFinished(std::map<std::string, std::shared_future<T>>& requests) {
+	for (auto i = requests.begin(); i != requests.end();) {
+		if (IsReady(i->second)) {
+			i = requests.erase(i);	//Either in the cache now, or failed
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+template<typename T>
+static std::shared_future<std::shared_ptr<T>> MakeReadyFuture(std::shared_ptr<T> value) {
+	std::promise<std::shared_ptr<T>> promise;
+	promise.set_value(value);
+	return promise.get_future().share();
+}
+
+void AssetLoader::ProcessUploads() {
+	ForgetFinished(meshRequests);
+	ForgetFinished(materialRequests);
+	ForgetFinished(animationRequests);
+
+	size_t	spent		= 0;
+	bool	uploaded	= false;
+
+	while (true) {
+		Upload upload;
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (state->uploads.empty()) {
+				break;
+			}
+			if (spent > 0 && spent + state->uploads.front().bytes > uploadBudget) {
+				break;
+			}
+			upload = std::move(state->uploads.front());
+			state->uploads.pop_front();
+		}
+		upload.perform();
+		spent		+= upload.bytes;
+		uploaded	= true;
+	}
+	//SOIL binds the textures it makes without going through the state cache
+	if (uploaded) {
+		GLStateCache::GetSharedCache().Invalidate();
+	}
+}
+
+AssetLoader::MeshFuture AssetLoader::LoadMesh(const std::string& name, MeshPrepareFunction prepare) {
+	std::string key = ResourceCache::CanonicalPath(name);
+
+	if (!prepare) {
+		if (std::shared_ptr<Mesh> cached = state->cache->FindMesh(key)) {
+			return MakeReadyFuture(cached);
+		}
+		auto inFlight = meshRequests.find(key);
+		if (inFlight != meshRequests.end()) {
+			return inFlight->second;
+		}
+	}
+	auto promise = std::make_shared<std::promise<std::shared_ptr<Mesh>>>();
+	MeshFuture result = promise->get_future().share();
+
+	if (!prepare) {
+		meshRequests[key] = result;
+	}
+	std::shared_ptr<LoadState> state = this->state;
+	++state->pending;
+
+	VertexLayout	layout		= vertexLayout;
+	int				loadFlags	= meshLoadFlags;
+
+	ThreadPool::GetSharedPool().Submit([name, key, prepare, layout, loadFlags, promise, state]() {
+		std::shared_ptr<Mesh> mesh(Mesh::LoadMeshData(name, loadFlags));
+
+		if (!mesh) {
+			std::cerr << "Failed to load mesh: " << name << std::endl;
+			promise->set_value(nullptr);
+			--state->pending;
+			return;
+		}
+		if (prepare) {
+			prepare(*mesh);
+		}
+		mesh->Optimise();
+		if (loadFlags & MESH_LOAD_GENERATE_LODS) {
+			mesh->GenerateLods();
+		}
+		mesh->SetVertexLayout(layout);
+		if (layout == VERTEX_LAYOUT_PACKED) {
+			mesh->PackVertexData();
+		}
+		state->QueueUpload(mesh->GetBufferDataSize(), [mesh, key, prepare, promise, state]() {
+			mesh->BufferData();
+			promise->set_value(prepare ? mesh : state->cache->AddMesh(key, mesh));
+			--state->pending;
+		});
+	});
+	return result;
+}
+
+/*
+Textures are decoded on the loading thread, and each one is then uploaded as
+its own item in the queue. The material is ready once the last of them has
+been created. Textures already in the cache are neither decoded nor uploaded
+again - and as two materials may both decode a texture neither found cached,
+the cache is checked once more before uploading it.
+*/
+AssetLoader::MaterialFuture AssetLoader::LoadMaterial(const std::string& name) {
+	std::string key = ResourceCache::CanonicalPath(name);
+
+	if (std::shared_ptr<MeshMaterial> cached = state->cache->FindMaterial(key)) {
+		return MakeReadyFuture(cached);
+	}
+	auto inFlight = materialRequests.find(key);
+	if (inFlight != materialRequests.end()) {
+		return inFlight->second;
+	}
+	auto promise = std::make_shared<std::promise<std::shared_ptr<MeshMaterial>>>();
+	MaterialFuture result = promise->get_future().share();
+	materialRequests[key] = result;
+
+	std::shared_ptr<LoadState> state = this->state;
+	++state->pending;
+
+	ThreadPool::GetSharedPool().Submit([name, key, promise, state]() {
+		std::shared_ptr<MeshMaterial> material = std::make_shared<MeshMaterial>(name);
+
+		struct DecodedTexture {
+			MeshMaterialEntry*				entry;
+			std::string						channel;
+			std::string						path;
+			std::shared_ptr<unsigned char>	data;
+			int								width;
+			int								height;
+			int								channels;
+		};
+		std::vector<DecodedTexture> textures;
+
+		for (MeshMaterialEntry& entry : material->materialLayers) {
+			for (const auto& file : entry.entries) {
+				std::string texturePath = TEXTUREDIR + file.second;
+
+				if (std::shared_ptr<CachedTexture> cached = state->cache->FindTexture(texturePath)) {
+					entry.textures[file.first] = cached->GetID();
+					material->cachedTextures.push_back(cached);
+					continue;
+				}
+				DecodedTexture t = { &entry, file.first, texturePath, nullptr, 0, 0, 0 };
+
+				t.data = std::shared_ptr<unsigned char>(SOIL_load_image(texturePath.c_str(), &t.width, &t.height, &t.channels, SOIL_LOAD_AUTO), SOIL_free_image_data);
+
+				if (t.data) {
+					textures.push_back(t);
+				}
+				else {
+					std::cerr << "Failed to load texture: " << texturePath << std::endl;
+				}
+			}
+		}
+
+		if (textures.empty()) {
+			state->QueueUpload(0, [key, material, promise, state]() {
+				promise->set_value(state->cache->AddMaterial(key, material));
+				--state->pending;
+			});
+			return;
+		}
+		auto remaining = std::make_shared<size_t>(textures.size());
+
+		for (const DecodedTexture& t : textures) {
+			size_t bytes = (size_t)t.width * t.height * t.channels * 4 / 3;	//Mipmaps add a third
+
+			state->QueueUpload(bytes, [t, key, material, promise, remaining, state]() {
+				std::shared_ptr<CachedTexture> texture = state->cache->FindTexture(t.path);
+
+				if (!texture) {
+					GLuint texID = SOIL_create_OGL_texture(t.data.get(), t.width, t.height, t.channels,
+						SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
+
+					if (texID != 0) {
+						texture = state->cache->AddTexture(t.path,
+							std::make_shared<CachedTexture>(texID, CachedTexture::EstimateBytes(t.width, t.height)));
+					}
+				}
+				if (texture) {
+					t.entry->textures[t.channel] = texture->GetID();
+					material->cachedTextures.push_back(texture);
+				}
+				if (--(*remaining) == 0) {	//Only ever touched on the render thread
+					promise->set_value(state->cache->AddMaterial(key, material));
+					--state->pending;
+				}
+			});
+		}
+	});
+	return result;
+}
+
+//Animations never go near the GPU, so are ready as soon as they're parsed
+AssetLoader::AnimationFuture AssetLoader::LoadAnimation(const std::string& name) {
+	std::string key = ResourceCache::CanonicalPath(name);
+
+	if (std::shared_ptr<MeshAnimation> cached = state->cache->FindAnimation(key)) {
+		return MakeReadyFuture(cached);
+	}
+	auto inFlight = animationRequests.find(key);
+	if (inFlight != animationRequests.end()) {
+		return inFlight->second;
+	}
+	std::shared_ptr<LoadState> state = this->state;
+	++state->pending;
+
+	AnimationFuture result = ThreadPool::GetSharedPool().Submit([name, key, state]() {
+		std::shared_ptr<MeshAnimation> anim = std::make_shared<MeshAnimation>(name);
+		if (anim->GetFrameCount() == 0 || anim->GetJointCount() == 0) {
+			std::cerr << "Failed to load animation: " << name << std::endl;
+			anim = nullptr;
+		}
+		anim = state->cache->AddAnimation(key, anim);
+		--state->pending;
+		return anim;
+	}).share();
+
+	animationRequests[key] = result;
+	return result;
+}
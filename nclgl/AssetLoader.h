@@ -0,0 +1,108 @@
+/******************************************************************************
+Class:AssetLoader
+Implements:
+Description:Loads meshes, materials and animations in the background. Files
+are read and parsed on the shared ThreadPool, and anything that needs OpenGL
+(buffer and texture uploads) is queued up for the render thread, which works
+through the queue in ProcessUploads - once per frame, up to a byte budget, so
+big scenes stream in over several frames rather than stalling one.
+
+Each load returns a shared_future, which becomes ready once the asset is
+completely usable, GPU data included. A load that fails gives a nullptr.
+Finished assets go into a ResourceCache, and asking for a file that is already
+cached or still loading hands back the same asset rather than a second copy.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <string>
+#include <memory>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <map>
+
+#include "ResourceCache.h"
+#include "Mesh.h"
+
+class Mesh;
+class MeshMaterial;
+class MeshAnimation;
+
+class AssetLoader {
+public:
+	//Runs on the loading thread, after parsing but before the upload
+	typedef std::function<void(Mesh&)> MeshPrepareFunction;
+
+	typedef std::shared_future<std::shared_ptr<Mesh>>			MeshFuture;
+	typedef std::shared_future<std::shared_ptr<MeshMaterial>>	MaterialFuture;
+	typedef std::shared_future<std::shared_ptr<MeshAnimation>>	AnimationFuture;
+
+	static const size_t DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+	AssetLoader(size_t uploadBudget = DEFAULT_UPLOAD_BUDGET, ResourceCache& cache = ResourceCache::GetSharedCache());
+	~AssetLoader(void);
+
+	//A mesh with a prepare function is changed by it, so always gets its own copy
+	MeshFuture		LoadMesh(const std::string& name, MeshPrepareFunction prepare = nullptr);
+	MaterialFuture	LoadMaterial(const std::string& name);
+	AnimationFuture	LoadAnimation(const std::string& name);
+
+	//Render thread only. At least one upload is always made, even if it's
+	//bigger than the whole budget, so nothing can get stuck in the queue.
+	void	ProcessUploads();
+
+	ResourceCache&	GetCache() const	{ return *state->cache; }
+
+	//Layout given to meshes loaded from now on, packed on the loading thread
+	void			SetVertexLayout(VertexLayout l)	{ vertexLayout = l; }
+	VertexLayout	GetVertexLayout() const			{ return vertexLayout; }
+
+	//MeshLoadFlags given to meshes loaded from now on
+	void	SetMeshLoadFlags(int flags)		{ meshLoadFlags = flags; }
+	int		GetMeshLoadFlags() const		{ return meshLoadFlags; }
+
+	void	SetUploadBudget(size_t bytes)	{ uploadBudget = bytes; }
+	size_t	GetUploadBudget() const			{ return uploadBudget; }
+
+	//Loads that have been requested but aren't ready yet
+	int		GetPendingCount() const			{ return state->pending; }
+	bool	IsIdle() const					{ return state->pending == 0; }
+
+	template<typename T>
+	static bool IsReady(const std::shared_future<T>& f) {
+		return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+protected:
+	struct Upload {
+		size_t					bytes;
+		std::function<void()>	perform;
+	};
+
+	//Shared with the loading tasks, which may outlive the AssetLoader itself
+	struct LoadState {
+		std::mutex			mutex;
+		std::deque<Upload>	uploads;
+		ResourceCache*		cache;
+		bool				closed = false;
+		std::atomic<int>	pending{ 0 };
+
+		void QueueUpload(size_t bytes, std::function<void()> perform);
+	};
+
+	template<typename T>
+	static void	ForgetFinished(std::map<std::string, std::shared_future<T>>& requests);
+
+	std::shared_ptr<LoadState>	state;
+	size_t						uploadBudget;
+	VertexLayout				vertexLayout;
+	int							meshLoadFlags;
+
+	//Loads still in flight, by canonical path. Render thread only.
+	std::map<std::string, MeshFuture>		meshRequests;
+	std::map<std::string, MaterialFuture>	materialRequests;
+	std::map<std::string, AnimationFuture>	animationRequests;
+};
@@ -0,0 +1,386 @@
+#include "BoundingVolumeHierarchy.h"
+#include "Frustum.h"
+#include <algorithm>
+
+const BoundingVolumeHierarchy::Proxy BoundingVolumeHierarchy::NULL_PROXY;
+const BoundingVolumeHierarchy::Proxy BoundingVolumeHierarchy::FREE_NODE;
+
+//How much bigger than its sphere a leaf's box is made, as a fraction of the
+//radius - the further a sphere can move without the tree changing
+static const float FAT_MARGIN = 0.1f;
+
+static Vector3 MinVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static Vector3 MaxVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+//Half the surface area really, but only the ratios matter
+static float SurfaceArea(const Vector3& minBounds, const Vector3& maxBounds) {
+	Vector3 size = maxBounds - minBounds;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+static bool Contains(const Vector3& outerMin, const Vector3& outerMax, const Vector3& innerMin, const Vector3& innerMax) {
+	return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+		outerMax.x >= innerMax.x && outerMax.y >= innerMax.y && outerMax.z >= innerMax.z;
+}
+
+static bool Overlaps(const Vector3& aMin, const Vector3& aMax, const Vector3& bMin, const Vector3& bMax) {
+	return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z &&
+		aMax.x >= bMin.x && aMax.y >= bMin.y && aMax.z >= bMin.z;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(void) {
+	root		= NULL_PROXY;
+	freeList	= NULL_PROXY;
+	leafCount	= 0;
+}
+
+BoundingVolumeHierarchy::Proxy BoundingVolumeHierarchy::AllocateNode() {
+	Proxy p;
+	if (freeList != NULL_PROXY) {
+		p = freeList;
+		freeList = nodes[p].parent;
+	}
+	else {
+		p = (Proxy)nodes.size();
+		nodes.push_back(Node());
+	}
+	Node& n		= nodes[p];
+	n.radius	= 0.0f;
+	n.userData	= nullptr;
+	n.parent	= NULL_PROXY;
+	n.left		= NULL_PROXY;
+	n.right		= NULL_PROXY;
+	return p;
+}
+
+void BoundingVolumeHierarchy::FreeNode(Proxy p) {
+	nodes[p].parent	= freeList;
+	nodes[p].left	= FREE_NODE;
+	freeList		= p;
+}
+
+void BoundingVolumeHierarchy::SetLeafBounds(Node& n) {
+	float	margin	= n.radius * (1.0f + FAT_MARGIN);
+	Vector3	extent	= Vector3(margin, margin, margin);
+	n.minBounds = n.centre - extent;
+	n.maxBounds = n.centre + extent;
+}
+
+BoundingVolumeHierarchy::Proxy BoundingVolumeHierarchy::Insert(const Vector3& centre, float radius, void* userData, bool leaveOutOfTree) {
+	Proxy p = AllocateNode();
+	Node& n		= nodes[p];
+	n.centre	= centre;
+	n.radius	= radius;
+	n.userData	= userData;
+	SetLeafBounds(n);
+
+	if (!leaveOutOfTree) {
+		InsertLeaf(p);
+	}
+	leafCount++;
+	return p;
+}
+
+void BoundingVolumeHierarchy::Remove(Proxy p) {
+	if (IsInTree(p)) {
+		RemoveLeaf(p);
+	}
+	FreeNode(p);
+	leafCount--;
+}
+
+/*
+A sphere still inside its leaf's box needs nothing more doing. One that has
+moved out of it, but not clean away, has its box moved and the boxes above
+refitted around it - which is quick, but leaves those boxes bigger than they'd
+ideally be, so one that has left its old box behind entirely is reinserted.
+*/
+void BoundingVolumeHierarchy::Move(Proxy p, const Vector3& centre, float radius) {
+	Node& n		= nodes[p];
+	n.centre	= centre;
+	n.radius	= radius;
+
+	Vector3 extent		= Vector3(radius, radius, radius);
+	Vector3 minBounds	= centre - extent;
+	Vector3 maxBounds	= centre + extent;
+
+	if (Contains(n.minBounds, n.maxBounds, minBounds, maxBounds)) {
+		return;
+	}
+	bool nearby = Overlaps(n.minBounds, n.maxBounds, minBounds, maxBounds);
+	SetLeafBounds(n);
+
+	if (!IsInTree(p)) {
+		return;
+	}
+	if (nearby) {
+		RefitFrom(n.parent);
+	}
+	else {
+		RemoveLeaf(p);
+		InsertLeaf(p);
+	}
+}
+
+void BoundingVolumeHierarchy::Clear() {
+	nodes.clear();
+	root		= NULL_PROXY;
+	freeList	= NULL_PROXY;
+	leafCount	= 0;
+}
+
+void BoundingVolumeHierarchy::RefitFrom(Proxy p) {
+	while (p != NULL_PROXY) {
+		Node&		n		= nodes[p];
+		const Node&	left	= nodes[n.left];
+		const Node&	right	= nodes[n.right];
+
+		Vector3 minBounds = MinVector(left.minBounds, right.minBounds);
+		Vector3 maxBounds = MaxVector(left.maxBounds, right.maxBounds);
+
+		if (minBounds == n.minBounds && maxBounds == n.maxBounds) {
+			return;	//So nothing above it will change either
+		}
+		n.minBounds = minBounds;
+		n.maxBounds = maxBounds;
+		p = n.parent;
+	}
+}
+
+/*
+Walks down from the root towards whichever child would grow the least in
+surface area by taking the new leaf, and pairs it up with the node where
+doing that would cost more than just pairing it there - the surface area
+heuristic, as used by Box2D's dynamic tree.
+*/
+void BoundingVolumeHierarchy::InsertLeaf(Proxy leaf) {
+	if (root == NULL_PROXY) {
+		root = leaf;
+		nodes[leaf].parent = NULL_PROXY;
+		return;
+	}
+	Vector3 leafMin = nodes[leaf].minBounds;
+	Vector3 leafMax = nodes[leaf].maxBounds;
+
+	Proxy sibling = root;
+	while (!nodes[sibling].IsLeaf()) {
+		const Node& n = nodes[sibling];
+
+		float area			= SurfaceArea(n.minBounds, n.maxBounds);
+		float combinedArea	= SurfaceArea(MinVector(n.minBounds, leafMin), MaxVector(n.maxBounds, leafMax));
+
+		float pairCost		= 2.0f * combinedArea;			//Of a new parent for this node and the leaf
+		float inheritedCost	= 2.0f * (combinedArea - area);	//Of this node growing to take the leaf
+
+		auto DescendCost = [&](Proxy c) {
+			const Node& child = nodes[c];
+			float grown = SurfaceArea(MinVector(child.minBounds, leafMin), MaxVector(child.maxBounds, leafMax));
+			return (child.IsLeaf() ? grown : grown - SurfaceArea(child.minBounds, child.maxBounds)) + inheritedCost;
+		};
+		float leftCost	= DescendCost(n.left);
+		float rightCost	= DescendCost(n.right);
+
+		if (pairCost < leftCost && pairCost < rightCost) {
+			break;
+		}
+		sibling = leftCost < rightCost ? n.left : n.right;
+	}
+
+	Proxy oldParent = nodes[sibling].parent;
+	Proxy newParent = AllocateNode();
+
+	Node& p		= nodes[newParent];
+	p.parent	= oldParent;
+	p.left		= sibling;
+	p.right		= leaf;
+	p.minBounds	= MinVector(nodes[sibling].minBounds, leafMin);
+	p.maxBounds	= MaxVector(nodes[sibling].maxBounds, leafMax);
+
+	nodes[sibling].parent	= newParent;
+	nodes[leaf].parent		= newParent;
+
+	if (oldParent == NULL_PROXY) {
+		root = newParent;
+		return;
+	}
+	if (nodes[oldParent].left == sibling) {
+		nodes[oldParent].left = newParent;
+	}
+	else {
+		nodes[oldParent].right = newParent;
+	}
+	RefitFrom(oldParent);
+}
+
+/*
+The leaf's parent goes with it, and its sibling takes the parent's place.
+*/
+void BoundingVolumeHierarchy::RemoveLeaf(Proxy leaf) {
+	if (leaf == root) {
+		root = NULL_PROXY;
+		return;
+	}
+	Proxy parent		= nodes[leaf].parent;
+	Proxy grandparent	= nodes[parent].parent;
+	Proxy sibling		= nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	nodes[sibling].parent = grandparent;
+	FreeNode(parent);
+
+	if (grandparent == NULL_PROXY) {
+		root = sibling;
+		return;
+	}
+	if (nodes[grandparent].left == parent) {
+		nodes[grandparent].left = sibling;
+	}
+	else {
+		nodes[grandparent].right = sibling;
+	}
+	RefitFrom(grandparent);
+}
+
+/*
+The leaves' centres are copied out first, so the splitting works through one
+small array rather than hopping about the whole tree.
+*/
+void BoundingVolumeHierarchy::Rebuild() {
+	std::vector<BuildLeaf> leaves;
+	leaves.reserve(leafCount);
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		if (nodes[i].left == FREE_NODE) {
+			continue;
+		}
+		if (nodes[i].IsLeaf()) {
+			leaves.push_back({ nodes[i].centre, (Proxy)i });
+		}
+		else {
+			FreeNode((Proxy)i);
+		}
+	}
+	root = leaves.empty() ? NULL_PROXY : BuildRange(leaves.data(), leaves.size());
+	if (root != NULL_PROXY) {
+		nodes[root].parent = NULL_PROXY;
+	}
+}
+
+BoundingVolumeHierarchy::Proxy BoundingVolumeHierarchy::BuildRange(BuildLeaf* leaves, size_t count) {
+	if (count == 1) {
+		return leaves[0].proxy;
+	}
+	Vector3 centreMin = leaves[0].centre;
+	Vector3 centreMax = centreMin;
+	for (size_t i = 1; i < count; ++i) {
+		centreMin = MinVector(centreMin, leaves[i].centre);
+		centreMax = MaxVector(centreMax, leaves[i].centre);
+	}
+	Vector3 size = centreMax - centreMin;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	size_t half = count / 2;
+	std::nth_element(leaves, leaves + half, leaves + count, [axis](const BuildLeaf& a, const BuildLeaf& b) {
+		return axis == 0 ? a.centre.x < b.centre.x : (axis == 1 ? a.centre.y < b.centre.y : a.centre.z < b.centre.z);
+	});
+	Proxy left	= BuildRange(leaves, half);
+	Proxy right	= BuildRange(leaves + half, count - half);
+	Proxy p		= AllocateNode();
+
+	Node& n		= nodes[p];
+	n.left		= left;
+	n.right		= right;
+	n.minBounds	= MinVector(nodes[left].minBounds, nodes[right].minBounds);
+	n.maxBounds	= MaxVector(nodes[left].maxBounds, nodes[right].maxBounds);
+
+	nodes[left].parent	= p;
+	nodes[right].parent	= p;
+	return p;
+}
+
+int BoundingVolumeHierarchy::GetHeight() const {
+	if (root == NULL_PROXY) {
+		return 0;
+	}
+	int height = 0;
+	std::vector<std::pair<Proxy, int>> stack(1, std::make_pair(root, 1));
+
+	while (!stack.empty()) {
+		Proxy	p		= stack.back().first;
+		int		depth	= stack.back().second;
+		stack.pop_back();
+
+		height = std::max(height, depth);
+		if (!nodes[p].IsLeaf()) {
+			stack.push_back(std::make_pair(nodes[p].left, depth + 1));
+			stack.push_back(std::make_pair(nodes[p].right, depth + 1));
+		}
+	}
+	return height;
+}
+
+/*
+Each node is only tested against the planes its parent's box crossed; once a
+box is inside all of them, everything beneath it is visible. Leaves test their
+spheres rather than their boxes, against whatever planes are left.
+*/
+void BoundingVolumeHierarchy::Cull(const Frustum& frustum, std::vector<void*>& visible) const {
+	size_t first = visible.size();
+	visible.resize(first + leafCount);
+	visible.resize(first + Cull(frustum, visible.data() + first));
+}
+
+/*
+The stack only needs to be as deep as the tree, which for any tree that's
+anywhere near balanced fits on the real stack - deeper ones fall back on
+the heap.
+*/
+size_t BoundingVolumeHierarchy::Cull(const Frustum& frustum, void** visible) const {
+	if (root == NULL_PROXY) {
+		return 0;
+	}
+	typedef std::pair<Proxy, int> Entry;
+	Entry		localStack[CULL_STACK_SIZE];
+	std::vector<Entry> heapStack;
+	Entry*		stack		= localStack;
+	size_t		stackSize	= 0;
+	size_t		capacity	= CULL_STACK_SIZE;
+	size_t		visibleCount = 0;
+
+	stack[stackSize++] = std::make_pair(root, Frustum::ALL_PLANES);
+
+	while (stackSize > 0) {
+		Proxy	p		= stack[stackSize - 1].first;
+		int		planes	= stack[stackSize - 1].second;
+		stackSize--;
+
+		const Node& n = nodes[p];
+		if (n.IsLeaf()) {
+			if (planes == 0 || frustum.InsideFrustum(n.centre, n.radius, planes)) {
+				visible[visibleCount++] = n.userData;
+			}
+			continue;
+		}
+		if (planes != 0) {
+			planes = frustum.ClassifyBox(n.minBounds, n.maxBounds, planes);
+			if (planes == Frustum::OUTSIDE) {
+				continue;
+			}
+		}
+		if (stackSize + 2 > capacity) {
+			if (heapStack.empty()) {
+				heapStack.assign(stack, stack + stackSize);
+			}
+			heapStack.resize(capacity * 2);
+			stack		= heapStack.data();
+			capacity	= heapStack.size();
+		}
+		stack[stackSize++] = std::make_pair(n.right, planes);
+		stack[stackSize++] = std::make_pair(n.left, planes);
+	}
+	return visibleCount;
+}
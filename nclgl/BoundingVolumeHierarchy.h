@@ -0,0 +1,94 @@
+/******************************************************************************
+Class:BoundingVolumeHierarchy
+Implements:
+Description:A tree of axis aligned boxes around bounding spheres, for culling
+large numbers of them against a Frustum without testing each one. A box that's
+outside the frustum takes everything beneath it with it, and one that's inside
+brings everything beneath it in without another test - so the cost goes with
+how much of the tree the edges of the frustum pass through, rather than with
+how many spheres there are.
+
+Each sphere is a leaf, referred to by the Proxy Insert hands back. Leaf boxes
+are made a little bigger than their spheres, so a sphere that moves a little
+doesn't have to touch the rest of the tree; one that moves further has the
+boxes above it refitted, and one that has moved right away is taken out and
+put back in where it now belongs.
+
+Inserting spheres one at a time is slower, and builds a worse tree, than
+building it all at once - so anything adding a lot of them should leave them
+out of the tree until a Rebuild puts them all in together.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Vector3.h"
+#include <vector>
+
+class Frustum;
+
+class BoundingVolumeHierarchy {
+public:
+	typedef int Proxy;
+
+	static const Proxy NULL_PROXY = -1;
+
+	BoundingVolumeHierarchy(void);
+	~BoundingVolumeHierarchy(void) {}
+
+	//A sphere left out of the tree isn't culled until the next Rebuild
+	Proxy	Insert(const Vector3& centre, float radius, void* userData, bool leaveOutOfTree = false);
+	void	Remove(Proxy p);
+	void	Move(Proxy p, const Vector3& centre, float radius);
+	void	Clear();
+
+	//Rebuilds the whole tree from the top down, splitting each set of spheres
+	//in half along its longest axis. Proxies stay the same.
+	void	Rebuild();
+
+	void*	GetUserData(Proxy p) const { return nodes[p].userData; }
+	size_t	GetCount() const { return leafCount; }
+	int		GetHeight() const;
+
+	//Adds the user data of every sphere that Frustum::InsideFrustum would
+	//say is inside the frustum to visible
+	void	Cull(const Frustum& frustum, std::vector<void*>& visible) const;
+	//The same, but into an array with room for GetCount entries, returning
+	//how many of them it filled
+	size_t	Cull(const Frustum& frustum, void** visible) const;
+
+protected:
+	static const Proxy FREE_NODE = -2;
+	static const size_t CULL_STACK_SIZE = 128;
+
+	struct Node {
+		Vector3	minBounds;
+		Vector3	maxBounds;
+		Vector3	centre;		//Leaves only
+		float	radius;
+		void*	userData;
+		Proxy	parent;		//Or the next free node, if this one's free
+		Proxy	left;		//NULL_PROXY for leaves, FREE_NODE for free nodes
+		Proxy	right;
+
+		bool IsLeaf() const { return left == NULL_PROXY; }
+	};
+
+	Proxy	AllocateNode();
+	void	FreeNode(Proxy p);
+	void	InsertLeaf(Proxy leaf);
+	void	RemoveLeaf(Proxy leaf);
+	//Recomputes the boxes from p up to the root, until one doesn't change
+	void	RefitFrom(Proxy p);
+	void	SetLeafBounds(Node& n);
+	bool	IsInTree(Proxy leaf) const { return nodes[leaf].parent != NULL_PROXY || root == leaf; }
+
+	struct BuildLeaf {
+		Vector3	centre;
+		Proxy	proxy;
+	};
+	Proxy	BuildRange(BuildLeaf* leaves, size_t count);
+
+	std::vector<Node>	nodes;
+	Proxy				root;
+	Proxy				freeList;
+	size_t				leafCount;
+};
@@ -8,6 +8,11 @@ using std::ifstream;
 using std::cout;
 
 ComputeShader::ComputeShader(const std::string& filename) {
+	programID		= 0;
+	shaderID		= 0;
+	programValid	= GL_FALSE;
+	threadsInGroup[0] = threadsInGroup[1] = threadsInGroup[2] = 0;
+
 	ifstream	file(SHADERDIR + filename);
 
 	cout << "Loading compute shader text from " << filename << "\n\n";
@@ -43,6 +48,7 @@ ComputeShader::ComputeShader(const std::string& filename) {
 ComputeShader::~ComputeShader(void) {
 	glDetachShader(programID, shaderID);
 	glDeleteShader(shaderID);
+	GLStateCache::GetSharedCache().Forget(GL_PROGRAM, programID);
 	glDeleteProgram(programID);
 }
 
@@ -50,10 +56,16 @@ void ComputeShader::Dispatch(unsigned int x, unsigned int y, unsigned int z) con
 	glDispatchCompute(x, y, z);
 }
 
+void ComputeShader::GetThreadsInGroup(int& x, int& y, int& z) const {
+	x = threadsInGroup[0];
+	y = threadsInGroup[1];
+	z = threadsInGroup[2];
+}
+
 void ComputeShader::Bind()		const {
-	glUseProgram(programID);
+	GLStateCache::GetSharedCache().UseProgram(programID);
 }
 
 void ComputeShader::Unbind()	const {
-	glUseProgram(0);
+	GLStateCache::GetSharedCache().UseProgram(0);
 }
\ No newline at end of file
@@ -7,10 +7,11 @@ public:
 	ComputeShader(const std::string& filename);
 	~ComputeShader(void);
 	GLuint  GetProgram() { return programID; }
+	bool	LoadSuccess() const { return programValid == GL_TRUE; }
 
 	void Bind()		const;
 	void Unbind()	const;
-	void Dispatch(unsigned int x, unsigned int y = 0, unsigned int z = 0) const;
+	void Dispatch(unsigned int x, unsigned int y = 1, unsigned int z = 1) const;
 
 	void GetThreadsInGroup(int& x, int& y, int& z) const;
 
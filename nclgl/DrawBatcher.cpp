@@ -0,0 +1,60 @@
+#include "DrawBatcher.h"
+#include "SceneNode.h"
+
+void DrawBatcher::Clear() {
+	batches.clear();
+	instances.clear();
+	stats = Stats{ 0, 0, 0, 0 };
+}
+
+bool DrawBatcher::CanBatch(const SceneNode* n) const {
+	const Mesh* mesh = n->GetMesh();
+	return mesh && n->GetShader() == batchShader && !n->GetAnim() && mesh->GetInstanceCount() == 0;
+}
+
+bool DrawBatcher::SameBatch(const SceneNode* a, const SceneNode* b) {
+	return a->GetMesh() == b->GetMesh() && a->GetMaterial() == b->GetMaterial() &&
+		a->GetLod() == b->GetLod() && a->GetShader() == b->GetShader();
+}
+
+/*
+The render queue sorts by shader, material and then mesh, so nodes that could
+share a batch are already next to each other - apart from differing LODs, but
+as those go with distance, which is the next thing sorted by, nodes with the
+same LOD still end up together.
+*/
+void DrawBatcher::Add(SceneNode* const* nodes, size_t nodeCount) {
+	size_t i = 0;
+	while (i < nodeCount) {
+		SceneNode* first = nodes[i];
+		size_t end = i + 1;
+		if (CanBatch(first)) {
+			while (end < nodeCount && CanBatch(nodes[end]) && SameBatch(first, nodes[end])) {
+				end++;
+			}
+		}
+		unsigned int count		= (unsigned int)(end - i);
+		size_t submeshes		= first->GetMesh() ? first->GetMesh()->GetSubMeshCount() : 0;
+
+		Batch b;
+		b.node			= first;
+		b.firstInstance	= (unsigned int)instances.size();
+		b.instanceCount	= count;
+		batches.push_back(b);
+
+		if (count > 1) {
+			for (size_t j = i; j < end; ++j) {
+				SceneNode* n = nodes[j];
+				InstanceData instance;
+				instance.modelMatrix	= n->GetWorldTransform() * Matrix4::Scale(n->GetModelScale()) * n->GetRotation();
+				instance.colour			= n->GetColour();
+				instances.push_back(instance);
+			}
+			stats.batches++;
+		}
+		stats.nodes			+= count;
+		stats.drawsBefore	+= submeshes * count;
+		stats.drawsAfter	+= submeshes;
+		i = end;
+	}
+}
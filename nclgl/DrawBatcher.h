@@ -0,0 +1,59 @@
+/******************************************************************************
+Class:DrawBatcher
+Implements:
+Description:Finds the runs of nodes in a sorted list that can all be drawn by
+one instanced draw per submesh - those with the same mesh, material, LOD and
+shader - and gathers each of their model matrices and colours into an array of
+InstanceData, ready to upload as a single instance buffer for the frame.
+
+Only nodes using the shader the batches will be drawn with are batched, and
+not animated ones, or ones whose mesh already has instances of its own. Runs
+of just one node are left for the caller to draw as it always has.
+
+Keeps count of how many draw calls the nodes would have taken one at a time,
+and how many they take batched.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Mesh.h"
+#include <vector>
+
+class SceneNode;
+
+class DrawBatcher {
+public:
+	struct Batch {
+		SceneNode*		node;			//The first node - its mesh, material and LOD go for them all
+		unsigned int	firstInstance;	//In GetInstances, if there's more than one
+		unsigned int	instanceCount;
+	};
+
+	struct Stats {
+		size_t nodes;
+		size_t batches;		//Of more than one node
+		size_t drawsBefore;	//One per submesh per node
+		size_t drawsAfter;	//One per submesh per batch, or node left on its own
+	};
+
+	DrawBatcher(int batchShader = 0) : batchShader(batchShader) { Clear(); }
+	~DrawBatcher(void) {}
+
+	void	SetBatchShader(int shader) { batchShader = shader; }
+
+	void	Clear();
+	//Batches up a list of nodes, in order, after any already added
+	void	Add(SceneNode* const* nodes, size_t count);
+
+	const std::vector<Batch>&			GetBatches() const		{ return batches; }
+	const std::vector<InstanceData>&	GetInstances() const	{ return instances; }
+	const Stats&						GetStats() const		{ return stats; }
+
+	bool	CanBatch(const SceneNode* n) const;
+	static bool	SameBatch(const SceneNode* a, const SceneNode* b);
+
+protected:
+	int							batchShader;
+	std::vector<Batch>			batches;
+	std::vector<InstanceData>	instances;
+	Stats						stats;
+};
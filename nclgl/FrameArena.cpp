@@ -0,0 +1,52 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <new>
+
+FrameArena::FrameArena(size_t capacity) {
+	this->capacity	= std::max(capacity, (size_t)1);
+	block			= (char*)::operator new(this->capacity);
+	used			= 0;
+	overflowUsed	= 0;
+	highWater		= 0;
+	resets			= 0;
+}
+
+FrameArena::~FrameArena(void) {
+	Reset();
+	::operator delete(block);
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+	size_t start = (used + alignment - 1) / alignment * alignment;
+	if (start + size <= capacity) {
+		used = start + size;
+		return block + start;
+	}
+	//::operator new's alignment is good enough for anything but overaligned types
+	void* p = ::operator new(std::max(size, (size_t)1));
+	overflow.push_back(p);
+	overflowUsed += size + alignment;
+	return p;
+}
+
+/*
+The block is only grown once nothing is using it, and with some room to spare,
+so a frame that's a little busier than the last doesn't mean growing it again.
+*/
+void FrameArena::Reset() {
+	highWater = std::max(highWater, used + overflowUsed);
+
+	if (!overflow.empty()) {
+		for (void* p : overflow) {
+			::operator delete(p);
+		}
+		overflow.clear();
+
+		::operator delete(block);
+		capacity	= highWater + highWater / 2;
+		block		= (char*)::operator new(capacity);
+	}
+	used			= 0;
+	overflowUsed	= 0;
+	resets++;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+Class:FrameArena
+Implements:
+Description:Memory for things that only last a frame - lists of culled nodes,
+draw lists and the like. Allocating just moves an offset along one big block,
+and Reset moves it back to the start, freeing everything at once.
+
+If a frame needs more than the block holds, the rest comes from the heap, and
+the next Reset grows the block to fit what the busiest frame so far needed - so
+once the frames settle down, none of them touch the heap at all.
+
+Only one thread may allocate from an arena at a time.
+
+FrameVector is a growable array in an arena, for lists of plain data. Like
+everything else in the arena, it's gone after a Reset - it starts out empty
+again the first time it's touched after one.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+class FrameArena {
+public:
+	static const size_t DEFAULT_CAPACITY = 256 * 1024;
+
+	FrameArena(size_t capacity = DEFAULT_CAPACITY);
+	~FrameArena(void);
+
+	void*	Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template <typename T>
+	T*		Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	void	Reset();
+
+	size_t	GetCapacity() const		{ return capacity; }
+	size_t	GetUsed() const			{ return used + overflowUsed; }
+	size_t	GetHighWater() const	{ return highWater; }
+	//Goes up by one every Reset, so anything in the arena can tell it's gone
+	size_t	GetResetCount() const	{ return resets; }
+
+protected:
+	char*				block;
+	size_t				capacity;
+	size_t				used;
+	size_t				overflowUsed;
+	size_t				highWater;
+	size_t				resets;
+	std::vector<void*>	overflow;
+};
+
+template <typename T>
+class FrameVector {
+	static_assert(std::is_trivially_copyable<T>::value, "FrameVectors are copied about with memcpy");
+public:
+	FrameVector(void) : arena(nullptr), items(nullptr), count(0), capacity(0), resetCount(0) {}
+	explicit FrameVector(FrameArena& a) : FrameVector() { arena = &a; }
+
+	void	SetArena(FrameArena& a) { arena = &a; Clear(); }
+
+	void	Clear() { items = nullptr; count = 0; capacity = 0; resetCount = arena ? arena->GetResetCount() : 0; }
+
+	void	Reserve(size_t n) {
+		Refresh();
+		if (n > capacity) {
+			T* grown = arena->Allocate<T>(n);
+			if (count > 0) {
+				memcpy(grown, items, count * sizeof(T));
+			}
+			items		= grown;
+			capacity	= n;
+		}
+	}
+	void	Resize(size_t n) { Reserve(n); count = n; }
+
+	void	PushBack(const T& t) {
+		Refresh();
+		if (count == capacity) {
+			Reserve(capacity < 16 ? 16 : capacity * 2);
+		}
+		items[count++] = t;
+	}
+
+	size_t	Size() const	{ return IsCurrent() ? count : 0; }
+	bool	Empty() const	{ return Size() == 0; }
+	T*		Data()			{ return IsCurrent() ? items : nullptr; }
+	const T* Data() const	{ return IsCurrent() ? items : nullptr; }
+
+	T&			operator[](size_t i)		{ return items[i]; }
+	const T&	operator[](size_t i) const	{ return items[i]; }
+
+	T*			begin()			{ return Data(); }
+	T*			end()			{ return Data() + Size(); }
+	const T*	begin() const	{ return Data(); }
+	const T*	end() const		{ return Data() + Size(); }
+
+protected:
+	bool	IsCurrent() const { return arena && resetCount == arena->GetResetCount(); }
+	//Forgets anything allocated before the arena's last Reset
+	void	Refresh() {
+		if (!IsCurrent()) {
+			Clear();
+		}
+	}
+
+	FrameArena*	arena;
+	T*			items;
+	size_t		count;
+	size_t		capacity;
+	size_t		resetCount;
+};
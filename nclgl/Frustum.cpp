@@ -1,14 +1,271 @@
 #include "Frustum.h"
 #include "SceneNode.h" // To use the classes, we do need the header
 #include "Matrix4.h"   // Eventually, but now no header leaking!
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+const int Frustum::ALL_PLANES;
+const int Frustum::OUTSIDE;
 
 bool Frustum::InsideFrustum(SceneNode& n) {
+    return InsideFrustum(n.GetWorldTransform().GetPositionVector(), n.GetBoundingRadius());
+}
+
+bool Frustum::InsideFrustum(const Vector3& position, float radius, int planeMask) const {
     for (int p = 0; p < 6; ++p) {
-        if (!planes[p].SphereInPlane(n.GetWorldTransform().GetPositionVector(), n.GetBoundingRadius())) {
-            return false; // SceneNode is outside this plane!
+        if ((planeMask & (1 << p)) && !planes[p].SphereInPlane(position, radius)) {
+            return false; // Sphere is outside this plane!
+        }
+    }
+    return true; // Sphere is inside every plane...
+}
+
+// Same rule as SphereInPlane - touching a plane from outside counts as outside it
+int Frustum::ClassifyBox(const Vector3& minBounds, const Vector3& maxBounds, int planeMask) const {
+    Vector3 centre = (minBounds + maxBounds) * 0.5f;
+    Vector3 halfSize = (maxBounds - minBounds) * 0.5f;
+    int crossed = 0;
+
+    for (int p = 0; p < 6; ++p) {
+        if (!(planeMask & (1 << p))) {
+            continue;
+        }
+        const Vector3& n = planes[p].GetNormal();
+        float distance = Vector3::Dot(centre, n) + planes[p].GetDistance();
+        float extent = halfSize.x * fabs(n.x) + halfSize.y * fabs(n.y) + halfSize.z * fabs(n.z);
+
+        if (distance <= -extent) {
+            return OUTSIDE;
+        }
+        if (distance <= extent) {
+            crossed |= 1 << p;
+        }
+    }
+    return crossed;
+}
+
+/*
+The batch tests do the same sums in the same order as SphereInPlane and
+ClassifyBox, just on several objects at once, so they round the same way and
+agree with them exactly - right down to objects just touching a plane.
+*/
+static size_t VisibleWords(size_t count) {
+    return (count + 31) / 32;
+}
+
+size_t Frustum::CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible, size_t first) const {
+    size_t visibleCount = 0;
+    if (first == 0) {
+        memset(visible, 0, VisibleWords(count) * sizeof(uint32_t));
+    }
+    for (size_t i = first; i < count; ++i) {
+        if (InsideFrustum(Vector3(x[i], y[i], z[i]), radius[i])) {
+            visible[i / 32] |= 1u << (i % 32);
+            visibleCount++;
+        }
+    }
+    return visibleCount;
+}
+
+size_t Frustum::CullBoxesScalar(const float* minX, const float* minY, const float* minZ,
+    const float* maxX, const float* maxY, const float* maxZ, size_t count, uint32_t* visible, size_t first) const {
+    size_t visibleCount = 0;
+    if (first == 0) {
+        memset(visible, 0, VisibleWords(count) * sizeof(uint32_t));
+    }
+    for (size_t i = first; i < count; ++i) {
+        if (ClassifyBox(Vector3(minX[i], minY[i], minZ[i]), Vector3(maxX[i], maxY[i], maxZ[i])) != OUTSIDE) {
+            visible[i / 32] |= 1u << (i % 32);
+            visibleCount++;
+        }
+    }
+    return visibleCount;
+}
+
+static size_t CountBits(uint32_t bits) {
+    size_t count = 0;
+    for (; bits; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+}
+
+static unsigned int LowestBit(uint32_t bits) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, bits);
+    return bit;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+size_t Frustum::CullSpheres(const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible) const {
+    memset(visible, 0, VisibleWords(count) * sizeof(uint32_t));
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#ifdef __AVX__
+    {
+        __m256 nx[6], ny[6], nz[6], d[6];
+        for (int p = 0; p < 6; ++p) {
+            Vector3 n = planes[p].GetNormal();
+            nx[p] = _mm256_set1_ps(n.x);
+            ny[p] = _mm256_set1_ps(n.y);
+            nz[p] = _mm256_set1_ps(n.z);
+            d[p] = _mm256_set1_ps(planes[p].GetDistance());
+        }
+        for (; i + 8 <= count; i += 8) {
+            __m256 px = _mm256_loadu_ps(x + i);
+            __m256 py = _mm256_loadu_ps(y + i);
+            __m256 pz = _mm256_loadu_ps(z + i);
+            __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+            __m256 outside = _mm256_setzero_ps();
+
+            for (int p = 0; p < 6; ++p) {
+                __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, nx[p]), _mm256_mul_ps(py, ny[p])), _mm256_mul_ps(pz, nz[p]));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dot, d[p]), negRadius, _CMP_LE_OQ));
+            }
+            uint32_t bits = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+            visible[i / 32] |= bits << (i % 32);
+            visibleCount += CountBits(bits);
+        }
+    }
+#endif
+    __m128 nx[6], ny[6], nz[6], d[6];
+    for (int p = 0; p < 6; ++p) {
+        Vector3 n = planes[p].GetNormal();
+        nx[p] = _mm_set1_ps(n.x);
+        ny[p] = _mm_set1_ps(n.y);
+        nz[p] = _mm_set1_ps(n.z);
+        d[p] = _mm_set1_ps(planes[p].GetDistance());
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        __m128 outside = _mm_setzero_ps();
+
+        for (int p = 0; p < 6; ++p) {
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx[p]), _mm_mul_ps(py, ny[p])), _mm_mul_ps(pz, nz[p]));
+            outside = _mm_or_ps(outside, _mm_cmple_ps(_mm_add_ps(dot, d[p]), negRadius));
+        }
+        uint32_t bits = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+        visible[i / 32] |= bits << (i % 32);
+        visibleCount += CountBits(bits);
+    }
+    if (i < count) {
+        visibleCount += CullSpheresScalar(x, y, z, radius, count, visible, i);
+    }
+    return visibleCount;
+}
+
+size_t Frustum::CullBoxes(const float* minX, const float* minY, const float* minZ,
+    const float* maxX, const float* maxY, const float* maxZ, size_t count, uint32_t* visible) const {
+    memset(visible, 0, VisibleWords(count) * sizeof(uint32_t));
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#ifdef __AVX__
+    {
+        __m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+        __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+        __m256 half = _mm256_set1_ps(0.5f);
+        for (int p = 0; p < 6; ++p) {
+            Vector3 n = planes[p].GetNormal();
+            nx[p] = _mm256_set1_ps(n.x);
+            ny[p] = _mm256_set1_ps(n.y);
+            nz[p] = _mm256_set1_ps(n.z);
+            ax[p] = _mm256_and_ps(nx[p], absMask);
+            ay[p] = _mm256_and_ps(ny[p], absMask);
+            az[p] = _mm256_and_ps(nz[p], absMask);
+            d[p] = _mm256_set1_ps(planes[p].GetDistance());
+        }
+        for (; i + 8 <= count; i += 8) {
+            __m256 lx = _mm256_loadu_ps(minX + i), hx = _mm256_loadu_ps(maxX + i);
+            __m256 ly = _mm256_loadu_ps(minY + i), hy = _mm256_loadu_ps(maxY + i);
+            __m256 lz = _mm256_loadu_ps(minZ + i), hz = _mm256_loadu_ps(maxZ + i);
+            __m256 cx = _mm256_mul_ps(_mm256_add_ps(lx, hx), half);
+            __m256 cy = _mm256_mul_ps(_mm256_add_ps(ly, hy), half);
+            __m256 cz = _mm256_mul_ps(_mm256_add_ps(lz, hz), half);
+            __m256 sx = _mm256_mul_ps(_mm256_sub_ps(hx, lx), half);
+            __m256 sy = _mm256_mul_ps(_mm256_sub_ps(hy, ly), half);
+            __m256 sz = _mm256_mul_ps(_mm256_sub_ps(hz, lz), half);
+            __m256 outside = _mm256_setzero_ps();
+
+            for (int p = 0; p < 6; ++p) {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(cx, nx[p]), _mm256_mul_ps(cy, ny[p])), _mm256_mul_ps(cz, nz[p])), d[p]);
+                __m256 extent = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(sx, ax[p]), _mm256_mul_ps(sy, ay[p])), _mm256_mul_ps(sz, az[p]));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), extent), _CMP_LE_OQ));
+            }
+            uint32_t bits = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+            visible[i / 32] |= bits << (i % 32);
+            visibleCount += CountBits(bits);
+        }
+    }
+#endif
+    __m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 half = _mm_set1_ps(0.5f);
+    for (int p = 0; p < 6; ++p) {
+        Vector3 n = planes[p].GetNormal();
+        nx[p] = _mm_set1_ps(n.x);
+        ny[p] = _mm_set1_ps(n.y);
+        nz[p] = _mm_set1_ps(n.z);
+        ax[p] = _mm_and_ps(nx[p], absMask);
+        ay[p] = _mm_and_ps(ny[p], absMask);
+        az[p] = _mm_and_ps(nz[p], absMask);
+        d[p] = _mm_set1_ps(planes[p].GetDistance());
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128 lx = _mm_loadu_ps(minX + i), hx = _mm_loadu_ps(maxX + i);
+        __m128 ly = _mm_loadu_ps(minY + i), hy = _mm_loadu_ps(maxY + i);
+        __m128 lz = _mm_loadu_ps(minZ + i), hz = _mm_loadu_ps(maxZ + i);
+        __m128 cx = _mm_mul_ps(_mm_add_ps(lx, hx), half);
+        __m128 cy = _mm_mul_ps(_mm_add_ps(ly, hy), half);
+        __m128 cz = _mm_mul_ps(_mm_add_ps(lz, hz), half);
+        __m128 sx = _mm_mul_ps(_mm_sub_ps(hx, lx), half);
+        __m128 sy = _mm_mul_ps(_mm_sub_ps(hy, ly), half);
+        __m128 sz = _mm_mul_ps(_mm_sub_ps(hz, lz), half);
+        __m128 outside = _mm_setzero_ps();
+
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(cx, nx[p]), _mm_mul_ps(cy, ny[p])), _mm_mul_ps(cz, nz[p])), d[p]);
+            __m128 extent = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(sx, ax[p]), _mm_mul_ps(sy, ay[p])), _mm_mul_ps(sz, az[p]));
+            outside = _mm_or_ps(outside, _mm_cmple_ps(distance, _mm_sub_ps(_mm_setzero_ps(), extent)));
+        }
+        uint32_t bits = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+        visible[i / 32] |= bits << (i % 32);
+        visibleCount += CountBits(bits);
+    }
+    if (i < count) {
+        visibleCount += CullBoxesScalar(minX, minY, minZ, maxX, maxY, maxZ, count, visible, i);
+    }
+    return visibleCount;
+}
+
+size_t Frustum::CompactVisible(const uint32_t* visible, size_t count, unsigned int* indices) {
+    size_t written = 0;
+    for (size_t w = 0; w < VisibleWords(count); ++w) {
+        for (uint32_t bits = visible[w]; bits; bits &= bits - 1) {
+            indices[written++] = (unsigned int)(w * 32 + LowestBit(bits));
         }
     }
-    return true; // SceneNode is inside every plane...
+    return written;
 }
 
 void Frustum::FromMatrix(const Matrix4& mat) {
@@ -1,16 +1,47 @@
 #pragma once
 #include "Plane.h"
+#include <cstdint>
+#include <cstddef>
 
 class SceneNode; // Forward declaration
 class Matrix4;  // Forward declaration
 
 class Frustum {
 public:
+    static const int ALL_PLANES = 0x3F; // One bit per plane
+    static const int OUTSIDE = -1;
+
     Frustum() {}
     ~Frustum() {}
 
     void FromMatrix(const Matrix4& mvp);
+
+    const Plane& GetPlane(int p) const { return planes[p]; }
     bool InsideFrustum(SceneNode& n);
+    bool InsideFrustum(const Vector3& position, float radius, int planeMask = ALL_PLANES) const;
+
+    // Tests a box against the planes in planeMask. Returns OUTSIDE if it's entirely
+    // outside any of them, or else just the planes it crosses - anything inside the
+    // box is inside all of the others, so they needn't be tested again.
+    int ClassifyBox(const Vector3& minBounds, const Vector3& maxBounds, int planeMask = ALL_PLANES) const;
+
+    // Batch tests of many spheres or boxes at once, with each coordinate in an array
+    // of its own. Sets one bit of visible per object - 32 objects to a word, lowest
+    // bit first - for those InsideFrustum (or ClassifyBox) would say aren't outside,
+    // and returns how many that is. Works through 8 objects at a time with AVX, or
+    // 4 with SSE; the scalar versions give the same answers one at a time.
+    size_t CullSpheres(const float* x, const float* y, const float* z, const float* radius,
+        size_t count, uint32_t* visible) const;
+    size_t CullBoxes(const float* minX, const float* minY, const float* minZ,
+        const float* maxX, const float* maxY, const float* maxZ, size_t count, uint32_t* visible) const;
+
+    size_t CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius,
+        size_t count, uint32_t* visible, size_t first = 0) const;
+    size_t CullBoxesScalar(const float* minX, const float* minY, const float* minZ,
+        const float* maxX, const float* maxY, const float* maxZ, size_t count, uint32_t* visible, size_t first = 0) const;
+
+    // Writes the index of every set bit of a visibility mask, in order
+    static size_t CompactVisible(const uint32_t* visible, size_t count, unsigned int* indices);
 
 protected:
     Plane planes[6];
@@ -0,0 +1,191 @@
+#include "GLStateCache.h"
+#include <cstring>
+
+size_t GLStateCache::Stats::TotalIssued() const {
+	size_t total = 0;
+	for (int i = 0; i < STATE_MAX; ++i) {
+		total += issued[i];
+	}
+	return total;
+}
+
+size_t GLStateCache::Stats::TotalSkipped() const {
+	size_t total = 0;
+	for (int i = 0; i < STATE_MAX; ++i) {
+		total += skipped[i];
+	}
+	return total;
+}
+
+GLStateCache& GLStateCache::GetSharedCache() {
+	static GLStateCache sharedCache;
+	return sharedCache;
+}
+
+GLStateCache::GLStateCache(void) {
+	Invalidate();
+	ResetStats();
+}
+
+int GLStateCache::ToggleIndex(GLenum cap) {
+	switch (cap) {
+		case GL_DEPTH_TEST:					return TOGGLE_DEPTH_TEST;
+		case GL_STENCIL_TEST:				return TOGGLE_STENCIL_TEST;
+		case GL_BLEND:						return TOGGLE_BLEND;
+		case GL_CULL_FACE:					return TOGGLE_CULL_FACE;
+		case GL_SCISSOR_TEST:				return TOGGLE_SCISSOR_TEST;
+		case GL_PROGRAM_POINT_SIZE:			return TOGGLE_PROGRAM_POINT_SIZE;
+		case GL_TEXTURE_CUBE_MAP_SEAMLESS:	return TOGGLE_TEXTURE_CUBE_MAP_SEAMLESS;
+	}
+	return -1;
+}
+
+int GLStateCache::TargetIndex(GLenum target) {
+	switch (target) {
+		case GL_TEXTURE_2D:			return TARGET_2D;
+		case GL_TEXTURE_CUBE_MAP:	return TARGET_CUBE_MAP;
+	}
+	return -1;
+}
+
+//Counts the call either way, and keeps the new value if it's going to GL
+bool GLStateCache::Changes(StateType type, GLuint& current, GLuint value) {
+	if (current == value && value != UNKNOWN) {
+		stats.skipped[type]++;
+		return false;
+	}
+	current = value;
+	stats.issued[type]++;
+	return true;
+}
+
+void GLStateCache::UseProgram(GLuint p) {
+	if (Changes(STATE_PROGRAM, program, p)) {
+		glUseProgram(p);
+	}
+}
+
+void GLStateCache::BindVertexArray(GLuint vao) {
+	if (Changes(STATE_VERTEX_ARRAY, vertexArray, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+//Only counted when it's issued - a skipped bind skips this along with it
+void GLStateCache::ActiveTexture(GLuint unit) {
+	if (activeUnit != unit) {
+		activeUnit = unit;
+		stats.issued[STATE_TEXTURE]++;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+	int t = TargetIndex(target);
+	if (t < 0 || unit >= MAX_TEXTURE_UNITS) {
+		ActiveTexture(unit);
+		glBindTexture(target, texture);
+		stats.issued[STATE_TEXTURE]++;
+		return;
+	}
+	if (textures[unit][t] == texture) {
+		stats.skipped[STATE_TEXTURE]++;
+		return;
+	}
+	ActiveTexture(unit);
+	textures[unit][t] = texture;
+	stats.issued[STATE_TEXTURE]++;
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer) {
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer)) {
+		stats.skipped[STATE_FRAMEBUFFER]++;
+		return;
+	}
+	if (draw) {
+		drawFramebuffer = framebuffer;
+	}
+	if (read) {
+		readFramebuffer = framebuffer;
+	}
+	stats.issued[STATE_FRAMEBUFFER]++;
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLStateCache::SetEnabled(GLenum cap, bool enabled) {
+	int		i			= ToggleIndex(cap);
+	GLuint	untracked	= UNKNOWN;
+	if (Changes(STATE_TOGGLE, i < 0 ? untracked : toggles[i], enabled ? 1 : 0)) {
+		if (enabled) {
+			glEnable(cap);
+		}
+		else {
+			glDisable(cap);
+		}
+	}
+}
+
+void GLStateCache::BlendFunc(GLenum source, GLenum destination) {
+	if (blendSource == source && blendDestination == destination) {
+		stats.skipped[STATE_BLEND_FUNC]++;
+		return;
+	}
+	blendSource			= source;
+	blendDestination	= destination;
+	stats.issued[STATE_BLEND_FUNC]++;
+	glBlendFunc(source, destination);
+}
+
+void GLStateCache::DepthMask(GLboolean write) {
+	if (Changes(STATE_DEPTH_MASK, depthMask, write ? 1 : 0)) {
+		glDepthMask(write);
+	}
+}
+
+void GLStateCache::Invalidate() {
+	program				= UNKNOWN;
+	vertexArray			= UNKNOWN;
+	drawFramebuffer		= UNKNOWN;
+	readFramebuffer		= UNKNOWN;
+	activeUnit			= UNKNOWN;
+	blendSource			= UNKNOWN;
+	blendDestination	= UNKNOWN;
+	depthMask			= UNKNOWN;
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+		for (int t = 0; t < TARGET_MAX; ++t) {
+			textures[i][t] = UNKNOWN;
+		}
+	}
+	for (int i = 0; i < TOGGLE_MAX; ++i) {
+		toggles[i] = UNKNOWN;
+	}
+}
+
+void GLStateCache::Forget(GLenum identifier, GLuint name) {
+	switch (identifier) {
+		case GL_PROGRAM:
+			program = program == name ? UNKNOWN : program;
+			break;
+		case GL_VERTEX_ARRAY:
+			vertexArray = vertexArray == name ? UNKNOWN : vertexArray;
+			break;
+		case GL_FRAMEBUFFER:
+			drawFramebuffer = drawFramebuffer == name ? UNKNOWN : drawFramebuffer;
+			readFramebuffer = readFramebuffer == name ? UNKNOWN : readFramebuffer;
+			break;
+		case GL_TEXTURE:
+			for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+				for (int t = 0; t < TARGET_MAX; ++t) {
+					textures[i][t] = textures[i][t] == name ? UNKNOWN : textures[i][t];
+				}
+			}
+			break;
+	}
+}
+
+void GLStateCache::ResetStats() {
+	memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+Class:GLStateCache
+Implements:
+Description:A copy of the GL state the renderers keep changing - the bound
+program, vertex array, framebuffers, textures on each unit, and the fixed
+function toggles, blend function and depth mask - so a call that would set
+something to what it already is can be left out. Drawing a mesh no longer means
+binding its VAO and then unbinding it again, and binding a material's textures
+costs nothing when the last draw used the same ones.
+
+Anything changed without going through the cache leaves it out of date, so code
+that binds things itself (SOIL, texture and framebuffer setup and the like)
+should be followed by an Invalidate, which makes the next call for everything
+go through to GL again. Objects that get deleted should be passed to Forget, so
+their names don't look bound if GL hands them out again.
+
+Every call is counted as issued or skipped, until ResetStats - so a renderer
+can show how many calls each frame really made.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+class GLStateCache {
+public:
+	enum StateType {
+		STATE_PROGRAM,
+		STATE_VERTEX_ARRAY,
+		STATE_TEXTURE,
+		STATE_FRAMEBUFFER,
+		STATE_TOGGLE,		//glEnable and glDisable
+		STATE_BLEND_FUNC,
+		STATE_DEPTH_MASK,
+		STATE_MAX
+	};
+
+	struct Stats {
+		size_t issued[STATE_MAX];
+		size_t skipped[STATE_MAX];
+
+		size_t TotalIssued() const;
+		size_t TotalSkipped() const;
+	};
+
+	static const int	MAX_TEXTURE_UNITS = 16;
+
+	static GLStateCache& GetSharedCache();
+
+	GLStateCache(void);
+
+	void	UseProgram(GLuint program);
+	void	BindVertexArray(GLuint vao);
+	//Other targets and units past MAX_TEXTURE_UNITS are always bound
+	void	BindTexture(GLuint unit, GLenum target, GLuint texture);
+	//GL_FRAMEBUFFER sets both the draw and read framebuffer, as it does in GL
+	void	BindFramebuffer(GLenum target, GLuint framebuffer);
+
+	void	Enable(GLenum cap)	{ SetEnabled(cap, true); }
+	void	Disable(GLenum cap)	{ SetEnabled(cap, false); }
+	void	SetEnabled(GLenum cap, bool enabled);
+	void	BlendFunc(GLenum source, GLenum destination);
+	void	DepthMask(GLboolean write);
+
+	//Forgets everything, so the next call of each kind reaches GL
+	void	Invalidate();
+	//For a program, vertex array, texture or framebuffer about to be deleted -
+	//identifier is GL_PROGRAM, GL_VERTEX_ARRAY, GL_TEXTURE or GL_FRAMEBUFFER
+	void	Forget(GLenum identifier, GLuint name);
+
+	const Stats&	GetStats() const { return stats; }
+	void			ResetStats();
+
+protected:
+	static const GLuint	UNKNOWN	= 0xFFFFFFFF;
+
+	enum Toggle {
+		TOGGLE_DEPTH_TEST,
+		TOGGLE_STENCIL_TEST,
+		TOGGLE_BLEND,
+		TOGGLE_CULL_FACE,
+		TOGGLE_SCISSOR_TEST,
+		TOGGLE_PROGRAM_POINT_SIZE,
+		TOGGLE_TEXTURE_CUBE_MAP_SEAMLESS,
+		TOGGLE_MAX
+	};
+
+	enum TextureTarget {
+		TARGET_2D,
+		TARGET_CUBE_MAP,
+		TARGET_MAX
+	};
+
+	//Which of the tracked toggles or texture targets it is, or -1 for none
+	static int	ToggleIndex(GLenum cap);
+	static int	TargetIndex(GLenum target);
+
+	void	ActiveTexture(GLuint unit);
+	bool	Changes(StateType type, GLuint& current, GLuint value);
+
+	GLuint	program;
+	GLuint	vertexArray;
+	GLuint	drawFramebuffer;
+	GLuint	readFramebuffer;
+	GLuint	activeUnit;
+	GLuint	textures[MAX_TEXTURE_UNITS][TARGET_MAX];
+	GLuint	toggles[TOGGLE_MAX];	//0 or 1 once known
+	GLuint	blendSource;
+	GLuint	blendDestination;
+	GLuint	depthMask;
+
+	Stats	stats;
+};
@@ -3,6 +3,8 @@
 #include <algorithm>
 
 HeightMap::HeightMap(const std::string& name) {
+    gridWidth = 0;
+    gridDepth = 0;
     int iWidth, iHeight, iChans;
     unsigned char* data = SOIL_load_image(name.c_str(), &iWidth, &iHeight, &iChans, 1);
 
@@ -57,6 +59,8 @@ HeightMap::HeightMap(const std::string& name) {
     heightmapSize.x = vertexScale.x * (iWidth - 1);
     heightmapSize.y = vertexScale.y * 255.0f; // each height is a byte!
     heightmapSize.z = vertexScale.z * (iHeight - 1);
+    gridWidth = iWidth;
+    gridDepth = iHeight;
 }
 
 HeightMap::~HeightMap() {
@@ -89,3 +93,54 @@ Vector3 HeightMap::GetWorldCoordinatesFromTextureCoords(float u, float v) {
 
     return worldPosition;
 }
+
+/*
+Each coarse vertex takes the lowest height of every cell of the real terrain
+that it's a corner of a coarse cell around. Anywhere in a coarse triangle is
+then a blend of heights no higher than any of the real terrain beneath it.
+Triangles wind the same way as the real terrain's, so the same side faces up.
+*/
+void HeightMap::GenerateOccluder(int step, std::vector<Vector3>& positions, std::vector<unsigned int>& occluderIndices) const {
+    positions.clear();
+    occluderIndices.clear();
+    if (gridWidth < 2 || gridDepth < 2 || step < 1) {
+        return;
+    }
+    // The last row and column always make it in, so the edges line up
+    std::vector<int> xs, zs;
+    for (int x = 0; x < gridWidth - 1; x += step) { xs.push_back(x); }
+    for (int z = 0; z < gridDepth - 1; z += step) { zs.push_back(z); }
+    xs.push_back(gridWidth - 1);
+    zs.push_back(gridDepth - 1);
+
+    int width = (int)xs.size();
+    int depth = (int)zs.size();
+
+    for (int j = 0; j < depth; ++j) {
+        int fromZ = zs[std::max(j - 1, 0)];
+        int toZ = zs[std::min(j + 1, depth - 1)];
+        for (int i = 0; i < width; ++i) {
+            int fromX = xs[std::max(i - 1, 0)];
+            int toX = xs[std::min(i + 1, width - 1)];
+
+            float lowest = vertices[zs[j] * gridWidth + xs[i]].y;
+            for (int z = fromZ; z <= toZ; ++z) {
+                for (int x = fromX; x <= toX; ++x) {
+                    lowest = std::min(lowest, vertices[z * gridWidth + x].y);
+                }
+            }
+            Vector3 v = vertices[zs[j] * gridWidth + xs[i]];
+            positions.emplace_back(v.x, lowest, v.z);
+        }
+    }
+    for (int j = 0; j < depth - 1; ++j) {
+        for (int i = 0; i < width - 1; ++i) {
+            unsigned int a = (j * width) + i;
+            unsigned int b = (j * width) + (i + 1);
+            unsigned int c = ((j + 1) * width) + (i + 1);
+            unsigned int d = ((j + 1) * width) + i;
+
+            occluderIndices.insert(occluderIndices.end(), { a, c, b, c, a, d });
+        }
+    }
+}
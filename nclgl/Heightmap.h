@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "mesh.h"
 
 class HeightMap : public Mesh {
@@ -11,6 +12,13 @@ public:
     Vector3 GetHeightmapSize() const { return heightmapSize; }
     Vector3 GetWorldCoordinatesFromTextureCoords(float u, float v);
 
+    // A coarser copy of the terrain for occlusion culling, with a vertex every
+    // step vertices of this one. It never rises above the real terrain, so it
+    // can't hide anything the real terrain wouldn't.
+    void GenerateOccluder(int step, std::vector<Vector3>& positions, std::vector<unsigned int>& occluderIndices) const;
+
 protected:
     Vector3 heightmapSize;
+    int gridWidth;
+    int gridDepth;
 };
@@ -0,0 +1,249 @@
+#include "IndirectCuller.h"
+#include "ComputeShader.h"
+#include "InstanceBuffer.h"
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+static const int MAX_HIZ_LEVELS = 16;	//As in cullInstancesCompute.glsl
+
+//In the order of IndirectCuller::Uniform
+static const char* UNIFORM_NAMES[] = {
+	"modelMatrix", "bounds", "planes", "firstInstance", "instanceCount", "drawCount", "useHiZ",
+	"hiZViewProj", "hiZSize", "hiZLevelCount", "hiZOffsets", "hiZLevelSizes"
+};
+
+//How much a matrix can stretch a sphere, going by its longest axis
+static float MaxScale(const Matrix4& m) {
+	float scale = 0.0f;
+	for (int a = 0; a < 3; ++a) {
+		scale = std::max(scale, Vector3(m.values[a * 4], m.values[a * 4 + 1], m.values[a * 4 + 2]).Length());
+	}
+	return scale;
+}
+
+IndirectCuller::IndirectCuller(void) {
+	shader = new ComputeShader("cullInstancesCompute.glsl");
+
+	//The program's linked by now, and never changes, so its locations don't either
+	static_assert(sizeof(UNIFORM_NAMES) / sizeof(UNIFORM_NAMES[0]) == UNIFORM_MAX, "A name for every uniform");
+	GLuint program = shader->GetProgram();
+	for (int u = 0; u < UNIFORM_MAX; ++u) {
+		uniforms[u] = LoadSuccess() ? glGetUniformLocation(program, UNIFORM_NAMES[u]) : -1;
+	}
+
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &visibleBuffer);
+	glGenBuffers(1, &hiZBuffer);
+	commandCapacity	= 0;
+	visibleCapacity	= 0;
+	hiZCapacity		= 0;
+	drawCount		= 0;
+	occlusion		= nullptr;
+	verify			= false;
+	mismatches		= 0;
+}
+
+IndirectCuller::~IndirectCuller(void) {
+	delete shader;
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &visibleBuffer);
+	glDeleteBuffers(1, &hiZBuffer);
+}
+
+bool IndirectCuller::LoadSuccess() const {
+	return shader->LoadSuccess();
+}
+
+void IndirectCuller::BeginFrame(const Frustum& f, const OcclusionCuller* o) {
+	frustum		= f;
+	occlusion	= o;
+	if (occlusion) {
+		UploadHiZ(*occlusion);
+	}
+}
+
+//Every level goes into the one buffer, one after another
+void IndirectCuller::UploadHiZ(const OcclusionCuller& o) {
+	int levels = std::min(o.GetLevelCount(), MAX_HIZ_LEVELS);
+	GLuint total = 0;
+	for (int l = 0; l < levels; ++l) {
+		total += o.GetLevelWidth(l) * o.GetLevelHeight(l);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, hiZBuffer);
+	if (total > hiZCapacity) {
+		glBufferData(GL_SHADER_STORAGE_BUFFER, total * sizeof(float), nullptr, GL_STREAM_DRAW);
+		hiZCapacity = total;
+	}
+	GLuint offset = 0;
+	for (int l = 0; l < levels; ++l) {
+		GLuint size = o.GetLevelWidth(l) * o.GetLevelHeight(l);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset * sizeof(float), size * sizeof(float), o.GetDepths(l));
+		offset += size;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void IndirectCuller::MakeCommands(const Mesh& mesh, int lod, GLuint instanceCount, std::vector<DrawElementsIndirectCommand>& commands) {
+	commands.clear();
+	for (int i = 0; i < mesh.GetSubMeshCount(); ++i) {
+		const Mesh::SubMesh* range = mesh.GetDrawRange(i, lod);
+		DrawElementsIndirectCommand c;
+		c.count			= range ? range->count : 0;
+		c.instanceCount	= instanceCount;
+		c.firstIndex	= range ? range->start : 0;
+		c.baseVertex	= 0;
+		c.baseInstance	= 0;
+		commands.push_back(c);
+	}
+}
+
+/*
+The command counts start at 0, and each visible instance adds itself to them
+all - the count it got from the first is where it goes in the visible buffer.
+*/
+bool IndirectCuller::Cull(const Mesh& mesh, int lod, const Matrix4& modelMatrix) {
+	const InstanceBuffer* instances = mesh.GetInstanceBuffer();
+	GLuint instanceCount = mesh.GetInstanceCount();
+	if (!instances || instanceCount == 0 || !mesh.HasIndexBuffer() || mesh.GetSubMeshCount() == 0 || !LoadSuccess()) {
+		return false;
+	}
+	MakeCommands(mesh, lod, 0, commands);
+	drawCount = (GLuint)commands.size();
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	if (drawCount > commandCapacity) {
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCount * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+		commandCapacity = drawCount;
+	}
+	else {
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, drawCount * sizeof(DrawElementsIndirectCommand), commands.data());
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (instanceCount > visibleCapacity) {
+		glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(InstanceData), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		visibleCapacity = instanceCount;
+	}
+
+	shader->Bind();
+
+	Vector4 bounds(mesh.GetBoundingCentre().x, mesh.GetBoundingCentre().y, mesh.GetBoundingCentre().z, mesh.GetBoundingRadius());
+	Vector4 planes[6];
+	for (int p = 0; p < 6; ++p) {
+		const Plane& plane = frustum.GetPlane(p);
+		planes[p] = Vector4(plane.GetNormal().x, plane.GetNormal().y, plane.GetNormal().z, plane.GetDistance());
+	}
+	glUniformMatrix4fv(uniforms[UNIFORM_MODEL_MATRIX], 1, false, modelMatrix.values);
+	glUniform4fv(uniforms[UNIFORM_BOUNDS], 1, (float*)&bounds);
+	glUniform4fv(uniforms[UNIFORM_PLANES], 6, (float*)planes);
+	glUniform1ui(uniforms[UNIFORM_FIRST_INSTANCE], instances->GetFirstInstance());
+	glUniform1ui(uniforms[UNIFORM_INSTANCE_COUNT], instanceCount);
+	glUniform1ui(uniforms[UNIFORM_DRAW_COUNT], drawCount);
+	glUniform1i(uniforms[UNIFORM_USE_HIZ], occlusion != nullptr);
+
+	if (occlusion) {
+		int levels = std::min(occlusion->GetLevelCount(), MAX_HIZ_LEVELS);
+		int offsets[MAX_HIZ_LEVELS];
+		int sizes[MAX_HIZ_LEVELS * 2];
+		int offset = 0;
+		for (int l = 0; l < levels; ++l) {
+			offsets[l]			= offset;
+			sizes[l * 2]		= occlusion->GetLevelWidth(l);
+			sizes[l * 2 + 1]	= occlusion->GetLevelHeight(l);
+			offset				+= sizes[l * 2] * sizes[l * 2 + 1];
+		}
+		glUniformMatrix4fv(uniforms[UNIFORM_HIZ_VIEW_PROJ], 1, false, occlusion->GetViewProj().values);
+		glUniform2i(uniforms[UNIFORM_HIZ_SIZE], occlusion->GetWidth(), occlusion->GetHeight());
+		glUniform1i(uniforms[UNIFORM_HIZ_LEVEL_COUNT], levels);
+		glUniform1iv(uniforms[UNIFORM_HIZ_OFFSETS], levels, offsets);
+		glUniform2iv(uniforms[UNIFORM_HIZ_LEVEL_SIZES], levels, sizes);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, hiZBuffer);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instances->GetBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+
+	int threads[3];
+	shader->GetThreadsInGroup(threads[0], threads[1], threads[2]);
+	shader->Dispatch((instanceCount + threads[0] - 1) / threads[0]);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	shader->Unbind();
+
+	if (verify) {
+		mismatches	= Verify(mesh, lod, modelMatrix);
+		verify		= false;
+	}
+	return true;
+}
+
+void IndirectCuller::Draw(Mesh& mesh, int firstSubMesh, int subMeshCount) {
+	subMeshCount = std::min(subMeshCount, (int)drawCount - firstSubMesh);
+	mesh.DrawIndirect(visibleBuffer, commandBuffer, firstSubMesh, subMeshCount);
+}
+
+size_t IndirectCuller::CullOnCPU(const InstanceData* instances, size_t count, const Vector3& boundsCentre, float boundsRadius,
+	const Matrix4& modelMatrix, const Frustum& frustum, const OcclusionCuller* occlusion, InstanceData* visible) {
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < count; ++i) {
+		Matrix4 world	= modelMatrix * instances[i].modelMatrix;
+		Vector4 centre	= world * Vector4(boundsCentre.x, boundsCentre.y, boundsCentre.z, 1.0f);
+		Vector3 c		= Vector3(centre.x, centre.y, centre.z);
+		float radius	= boundsRadius * MaxScale(world);
+
+		if (frustum.InsideFrustum(c, radius) && (!occlusion || occlusion->IsVisible(c, radius))) {
+			visible[visibleCount++] = instances[i];
+		}
+	}
+	return visibleCount;
+}
+
+/*
+Reads back the instances the GPU was given and what it made of them, and
+compares them with what CullOnCPU makes of the same instances. Visible
+instances are straight copies, so they're compared byte for byte.
+*/
+size_t IndirectCuller::Verify(const Mesh& mesh, int lod, const Matrix4& modelMatrix) {
+	const InstanceBuffer* instances = mesh.GetInstanceBuffer();
+	GLuint instanceCount = mesh.GetInstanceCount();
+
+	std::vector<InstanceData> input(instanceCount);
+	glBindBuffer(GL_COPY_READ_BUFFER, instances->GetBuffer());
+	glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)instances->GetFirstInstance() * sizeof(InstanceData),
+		instanceCount * sizeof(InstanceData), input.data());
+
+	std::vector<DrawElementsIndirectCommand> gpuCommands(drawCount);
+	glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, drawCount * sizeof(DrawElementsIndirectCommand), gpuCommands.data());
+
+	GLuint gpuCount = std::min(gpuCommands[0].instanceCount, instanceCount);
+	std::vector<InstanceData> gpuVisible(gpuCount);
+	glBindBuffer(GL_COPY_READ_BUFFER, visibleBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, gpuCount * sizeof(InstanceData), gpuVisible.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	std::vector<InstanceData> cpuVisible(instanceCount);
+	cpuVisible.resize(CullOnCPU(input.data(), instanceCount, mesh.GetBoundingCentre(), mesh.GetBoundingRadius(),
+		modelMatrix, frustum, occlusion, cpuVisible.data()));
+
+	std::vector<DrawElementsIndirectCommand> cpuCommands;
+	MakeCommands(mesh, lod, (GLuint)cpuVisible.size(), cpuCommands);
+	bool commandsMatch = memcmp(cpuCommands.data(), gpuCommands.data(), drawCount * sizeof(DrawElementsIndirectCommand)) == 0;
+
+	auto byBytes = [](const InstanceData& a, const InstanceData& b) { return memcmp(&a, &b, sizeof(InstanceData)) < 0; };
+	std::sort(gpuVisible.begin(), gpuVisible.end(), byBytes);
+	std::sort(cpuVisible.begin(), cpuVisible.end(), byBytes);
+	std::vector<InstanceData> different;
+	std::set_symmetric_difference(gpuVisible.begin(), gpuVisible.end(), cpuVisible.begin(), cpuVisible.end(),
+		std::back_inserter(different), byBytes);
+
+	std::cout << "IndirectCuller: " << instanceCount << " instances, " << gpuCount << " visible on the GPU and "
+		<< cpuVisible.size() << " on the CPU, " << different.size() << " different"
+		<< (commandsMatch ? "" : " - and the draw commands don't match!") << std::endl;
+
+	return different.size() + (commandsMatch ? 0 : 1);
+}
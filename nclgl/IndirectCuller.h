@@ -0,0 +1,100 @@
+/******************************************************************************
+Class:IndirectCuller
+Implements:
+Description:Culls the instances of a mesh on the GPU, so they never have to
+come back to the CPU to be drawn. A compute shader tests each instance's
+bounding sphere against the frustum - and against OcclusionCuller's hierarchical
+depth buffer, if it's given one - and packs the ones that pass into a buffer of
+visible instances, counting them straight into a DrawElementsIndirectCommand
+for each submesh. Those are then drawn with glMultiDrawElementsIndirect.
+
+CullOnCPU does the same job on the CPU, for checking the GPU's answers against:
+with SetVerify on, the next Cull reads back what the GPU wrote and compares
+the two. The GPU packs visible instances in whatever order its threads finish
+in, so it's only the counts, and which instances made it, that are compared.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Mesh.h"
+#include "Frustum.h"
+#include <vector>
+
+class ComputeShader;
+class OcclusionCuller;
+
+//The layout glMultiDrawElementsIndirect reads its draws from
+struct DrawElementsIndirectCommand {
+	GLuint	count;
+	GLuint	instanceCount;
+	GLuint	firstIndex;
+	GLint	baseVertex;
+	GLuint	baseInstance;
+};
+
+class IndirectCuller {
+public:
+	IndirectCuller(void);
+	~IndirectCuller(void);
+
+	bool	LoadSuccess() const;
+
+	//Sets what this frame's Culls test against - the occlusion culler should
+	//have had EndFrame called on it already
+	void	BeginFrame(const Frustum& frustum, const OcclusionCuller* occlusion = nullptr);
+
+	//Culls the mesh's own instances, drawn at the given LOD and model matrix.
+	//Returns false if the mesh can't be drawn indirectly, having no instances
+	//or no indices, in which case it should be drawn as normal.
+	bool	Cull(const Mesh& mesh, int lod, const Matrix4& modelMatrix);
+
+	//Draws the instances the last Cull left visible - submeshes from first to
+	//first + count - 1, which will need the same textures
+	void	Draw(Mesh& mesh, int firstSubMesh, int subMeshCount);
+
+	void	SetVerify(bool v) { verify = v; }
+	//How many instances the GPU and CPU disagreed over, when last verified
+	size_t	GetMismatches() const { return mismatches; }
+
+	//A command per submesh of the mesh at this LOD, each for instanceCount instances
+	static void		MakeCommands(const Mesh& mesh, int lod, GLuint instanceCount, std::vector<DrawElementsIndirectCommand>& commands);
+
+	//Copies each instance that passes to visible, in order, returning how many did
+	static size_t	CullOnCPU(const InstanceData* instances, size_t count, const Vector3& boundsCentre, float boundsRadius,
+						const Matrix4& modelMatrix, const Frustum& frustum, const OcclusionCuller* occlusion, InstanceData* visible);
+
+protected:
+	enum Uniform {
+		UNIFORM_MODEL_MATRIX,
+		UNIFORM_BOUNDS,
+		UNIFORM_PLANES,
+		UNIFORM_FIRST_INSTANCE,
+		UNIFORM_INSTANCE_COUNT,
+		UNIFORM_DRAW_COUNT,
+		UNIFORM_USE_HIZ,
+		UNIFORM_HIZ_VIEW_PROJ,
+		UNIFORM_HIZ_SIZE,
+		UNIFORM_HIZ_LEVEL_COUNT,
+		UNIFORM_HIZ_OFFSETS,
+		UNIFORM_HIZ_LEVEL_SIZES,
+		UNIFORM_MAX
+	};
+
+	void	UploadHiZ(const OcclusionCuller& occlusion);
+	size_t	Verify(const Mesh& mesh, int lod, const Matrix4& modelMatrix);
+
+	ComputeShader*		shader;
+	GLint				uniforms[UNIFORM_MAX];	//Looked up once, as soon as it's linked
+	GLuint				commandBuffer;
+	GLuint				visibleBuffer;
+	GLuint				hiZBuffer;
+	GLuint				commandCapacity;
+	GLuint				visibleCapacity;
+	GLuint				hiZCapacity;
+	GLuint				drawCount;
+	std::vector<DrawElementsIndirectCommand>	commands;	//Reused by every Cull
+
+	Frustum					frustum;
+	const OcclusionCuller*	occlusion;
+	bool					verify;
+	size_t					mismatches;
+};
@@ -0,0 +1,95 @@
+#include "InstanceBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+static const GLuint64 WAIT_TIMEOUT = 1000000;	//1ms, in ns
+
+InstanceBuffer::InstanceBuffer(GLuint capacity) {
+	buffer	= 0;
+	mapped	= nullptr;
+	count	= 0;
+	region	= 0;
+	stalls	= 0;
+	for (int i = 0; i < FRAMES; ++i) {
+		fences[i] = 0;
+	}
+	Allocate(std::max(capacity, 1u));
+}
+
+InstanceBuffer::~InstanceBuffer(void) {
+	Release();
+}
+
+void InstanceBuffer::Allocate(GLuint newCapacity) {
+	Release();
+	capacity = newCapacity;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = (GLsizeiptr)capacity * FRAMES * sizeof(InstanceData);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+	mapped = (InstanceData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glObjectLabel(GL_BUFFER, buffer, -1, "Instances");
+
+	if (!mapped) {
+		std::cout << "InstanceBuffer: Couldn't map " << capacity << " instances!" << std::endl;
+	}
+}
+
+//Any draws still to come from the old buffer keep it alive until they're done
+void InstanceBuffer::Release() {
+	for (int i = 0; i < FRAMES; ++i) {
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	if (buffer) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer	= 0;
+	mapped	= nullptr;
+	count	= 0;
+	region	= 0;
+}
+
+/*
+Whatever was drawn from the region written last time has been submitted by
+now, so that's where its fence goes - and the region about to be written was
+fenced FRAMES - 1 writes ago, which should have long since passed.
+*/
+InstanceData* InstanceBuffer::Write(GLuint newCount) {
+	if (newCount > capacity) {
+		Allocate(std::max(newCount, capacity * 2));
+	}
+	else if (count > 0) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % FRAMES;
+	}
+	if (fences[region]) {
+		GLenum result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			stalls++;
+			do {
+				result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fences[region]);
+		fences[region] = 0;
+	}
+	count = newCount;
+	return mapped ? mapped + (size_t)region * capacity : nullptr;
+}
+
+void InstanceBuffer::Write(const InstanceData* instances, GLuint newCount) {
+	InstanceData* to = Write(newCount);
+	if (to && newCount > 0) {
+		memcpy(to, instances, newCount * sizeof(InstanceData));
+	}
+}
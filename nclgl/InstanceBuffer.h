@@ -0,0 +1,50 @@
+/******************************************************************************
+Class:InstanceBuffer
+Implements:
+Description:A buffer of InstanceData that can be rewritten every frame without
+waiting on the GPU. It's allocated once with glBufferStorage and left mapped,
+split into FRAMES regions - each Write goes into the next region along, so the
+GPU can still be drawing from the last couple while this one is filled in.
+A fence is put down after each region is drawn from, and only waited on when
+Write comes back round to that region again, which it shouldn't have to.
+
+Draws find the instances of the last Write by their base instance, starting
+from GetFirstInstance, so the attribute pointers never have to change - only
+when the buffer has to grow to fit more instances, which makes a new one.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Mesh.h"
+
+class InstanceBuffer {
+public:
+	static const int FRAMES = 3;
+
+	InstanceBuffer(GLuint capacity = 1024);
+	~InstanceBuffer(void);
+
+	//Returns where to write count instances to, which stays valid until the
+	//next Write. The buffer grows if count won't fit.
+	InstanceData*	Write(GLuint count);
+	void			Write(const InstanceData* instances, GLuint count);
+
+	GLuint	GetBuffer() const			{ return buffer; }
+	GLuint	GetCount() const			{ return count; }
+	GLuint	GetCapacity() const			{ return capacity; }
+	//Base instance of the first instance of the last Write
+	GLuint	GetFirstInstance() const	{ return region * capacity; }
+	//How many times Write has had to wait for the GPU to finish with a region
+	GLuint	GetStalls() const			{ return stalls; }
+
+protected:
+	void	Allocate(GLuint newCapacity);
+	void	Release();
+
+	GLuint			buffer;
+	InstanceData*	mapped;
+	GLsync			fences[FRAMES];
+	GLuint			capacity;	//Per region
+	GLuint			count;
+	GLuint			region;
+	GLuint			stalls;
+};
@@ -0,0 +1,227 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+//Which queue is this thread's own, and in which job system
+static thread_local const JobSystem*	currentSystem	= nullptr;
+static thread_local unsigned int		currentQueue	= 0;
+
+//ParallelFor doesn't split a loop into more jobs than this per thread - enough
+//for uneven work to balance out, without drowning in jobs
+static const size_t MAX_JOBS_PER_THREAD = 4;
+
+//Every queue starts with room for this many jobs, so the first frame a worker
+//makes jobs of its own isn't the one that has to allocate for them
+static const size_t INITIAL_QUEUE_SIZE = 64;
+
+JobSystem::JobSystem(int workerCount) {
+	stopping	= false;
+	queuedJobs	= 0;
+
+	if (workerCount < 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? (int)hardwareThreads - 1 : 1;
+	}
+	for (int i = 0; i <= workerCount; ++i) {
+		queues.emplace_back(new WorkQueue());
+		queues.back()->jobs.resize(INITIAL_QUEUE_SIZE);
+	}
+	for (int i = 0; i < workerCount; ++i) {
+		workers.emplace_back(&JobSystem::WorkerThread, this, (unsigned int)i);
+	}
+}
+
+JobSystem::~JobSystem(void) {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+JobSystem& JobSystem::GetSharedJobSystem() {
+	static JobSystem sharedJobSystem;
+	return sharedJobSystem;
+}
+
+//Grows by doubling, unrolling the ring into the start of the new one
+void JobSystem::WorkQueue::PushBack(Job&& job) {
+	if (count == jobs.size()) {
+		std::vector<Job> grown(std::max<size_t>(INITIAL_QUEUE_SIZE, jobs.size() * 2));
+		for (size_t i = 0; i < count; ++i) {
+			grown[i] = std::move(jobs[(front + i) % jobs.size()]);
+		}
+		jobs.swap(grown);
+		front = 0;
+	}
+	jobs[(front + count++) % jobs.size()] = std::move(job);
+}
+
+Job JobSystem::WorkQueue::PopBack() {
+	return std::move(jobs[(front + --count) % jobs.size()]);
+}
+
+Job JobSystem::WorkQueue::PopFront() {
+	Job job = std::move(jobs[front]);
+	front = (front + 1) % jobs.size();
+	count--;
+	return job;
+}
+
+unsigned int JobSystem::GetQueueIndex() const {
+	return currentSystem == this ? currentQueue : (unsigned int)workers.size();
+}
+
+void JobSystem::Push(Job job) {
+	WorkQueue& queue = *queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.PushBack(std::move(job));
+	}
+	queuedJobs++;
+
+	//Taking the lock means a worker can't be between checking for jobs and
+	//going to sleep, so it can't miss this
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	jobReady.notify_one();
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter& counter) {
+	counter.pending++;
+	Push({ std::move(function), &counter });
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, std::function<void()> function, JobCounter& counter) {
+	counter.pending++;
+	Job job = { std::move(function), &counter };
+	{
+		std::lock_guard<std::mutex> lock(dependency.mutex);
+		if (dependency.pending > 0) {
+			if (!dependency.continuation.function) {
+				dependency.continuation = std::move(job);
+			}
+			else {
+				dependency.moreContinuations.push_back(std::move(job));
+			}
+			return;
+		}
+	}
+	Push(std::move(job));
+}
+
+/*
+The count only goes down with the counter's mutex held, and Wait takes the same
+mutex before returning - otherwise the counter could be gone by the time the
+thread that finished it got round to unlocking it. Continuations are queued
+with it held too, which is safe as nothing holding a queue's mutex ever waits
+on a counter's.
+*/
+void JobSystem::Finish(JobCounter& counter) {
+	std::lock_guard<std::mutex> lock(counter.mutex);
+	if (--counter.pending > 0 || !counter.continuation.function) {
+		return;
+	}
+	Push(std::move(counter.continuation));
+	counter.continuation.function = nullptr;
+	for (Job& j : counter.moreContinuations) {
+		Push(std::move(j));
+	}
+	counter.moreContinuations.clear();
+}
+
+/*
+The newest job from our own queue, which is the one most likely to still have
+its data in the cache, or failing that the oldest from anyone else's - usually
+the biggest piece of work they've got left.
+*/
+bool JobSystem::RunOneJob(unsigned int queueIndex) {
+	Job		job;
+	bool	found = false;
+	{
+		WorkQueue& own = *queues[queueIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (own.count > 0) {
+			job = own.PopBack();
+			found = true;
+		}
+	}
+	for (size_t i = 1; i < queues.size() && !found; ++i) {
+		WorkQueue& victim = *queues[(queueIndex + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.count > 0) {
+			job = victim.PopFront();
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+	queuedJobs--;
+	job.function();
+	Finish(*job.counter);
+	return true;
+}
+
+void JobSystem::WorkerThread(unsigned int queueIndex) {
+	currentSystem	= this;
+	currentQueue	= queueIndex;
+
+	while (true) {
+		if (RunOneJob(queueIndex)) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (stopping && queuedJobs == 0) {
+			return;
+		}
+		jobReady.wait(lock, [&]() { return stopping || queuedJobs > 0; });
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+	unsigned int queueIndex = GetQueueIndex();
+
+	while (!counter.IsDone()) {
+		if (!RunOneJob(queueIndex)) {
+			std::this_thread::yield();	//What's left is running elsewhere
+		}
+	}
+	std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t)>& function, size_t grainSize) {
+	if (count == 0) {
+		return;
+	}
+	size_t maxJobs	= (workers.size() + 1) * MAX_JOBS_PER_THREAD;
+	size_t jobSize	= std::max(std::max<size_t>(grainSize, 1), (count + maxJobs - 1) / maxJobs);
+	size_t jobCount	= (count + jobSize - 1) / jobSize;
+
+	//Jobs capture just this and their index, small enough for std::function
+	//to hold without allocating
+	struct Range {
+		const std::function<void(size_t)>&	function;
+		size_t								count;
+		size_t								jobSize;
+
+		void Run(size_t job) const {
+			size_t end = std::min(count, (job + 1) * jobSize);
+			for (size_t i = job * jobSize; i < end; ++i) {
+				function(i);
+			}
+		}
+	} range = { function, count, jobSize };
+
+	const Range* r = &range;
+	JobCounter counter;
+	for (size_t j = 1; j < jobCount; ++j) {
+		Run([r, j]() { r->Run(j); }, counter);
+	}
+	range.Run(0);
+	Wait(counter);
+}
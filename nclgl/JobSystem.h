@@ -0,0 +1,110 @@
+/******************************************************************************
+Class:JobSystem
+Implements:
+Description:Worker threads for the short jobs that make up a frame - updating
+and culling the scene, simulating particles - where the ThreadPool is for
+longer tasks like loading assets.
+
+Every worker has a queue of its own, that the jobs it makes go on to. It takes
+the newest job off the back of its own queue, and when that runs dry, steals
+the oldest job off the front of someone else's, so work spreads itself out
+without every thread fighting over a single queue. Threads that aren't workers
+share one more queue between them.
+
+Each job counts against a JobCounter, which goes back to zero once all of its
+jobs have finished. Wait blocks on a counter, running jobs itself while it
+does, and RunAfter holds a job back until a counter reaches zero - which is how
+one job is made to depend on others.
+
+Queues are rings that only ever grow, so once they're big enough for a frame's
+jobs, running jobs doesn't touch the heap - nor does a job whose function fits
+in std::function's own storage, which a pointer or two of captures does.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class JobCounter;
+
+struct Job {
+	std::function<void()>	function;
+	JobCounter*				counter;
+};
+
+class JobCounter {
+public:
+	JobCounter(void) : pending(0), continuation{ nullptr, nullptr } {}
+	~JobCounter(void) {}
+
+	//A counter can go out of scope once Wait has returned on it, but not just
+	//because this says it's done
+	bool IsDone() const { return pending == 0; }
+
+protected:
+	friend class JobSystem;
+
+	std::atomic<int>	pending;
+	std::mutex			mutex;			//Held while finishing a job
+	//Jobs waiting for this to reach zero. Counters rarely have more than one,
+	//which is kept here rather than in the vector, so it needn't allocate.
+	Job					continuation;
+	std::vector<Job>	moreContinuations;
+};
+
+class JobSystem {
+public:
+	//A negative count means one per hardware thread, less one for the caller.
+	//With no workers at all, every job runs on whichever thread waits for it.
+	JobSystem(int workerCount = -1);
+	~JobSystem(void);
+
+	static JobSystem& GetSharedJobSystem();
+
+	unsigned int GetWorkerCount() const { return (unsigned int)workers.size(); }
+
+	void Run(std::function<void()> function, JobCounter& counter);
+	//Runs function once dependency has reached zero - straight away, if it
+	//already has
+	void RunAfter(JobCounter& dependency, std::function<void()> function, JobCounter& counter);
+
+	//Returns once every job counted against counter has finished, running
+	//jobs on this thread until then. Safe to call from inside a job.
+	void Wait(JobCounter& counter);
+
+	//Calls function(i) for every i in [0, count), in jobs of grainSize or
+	//more indices, returning once they've all finished
+	void ParallelFor(size_t count, const std::function<void(size_t)>& function, size_t grainSize = 1);
+
+protected:
+	//A ring of jobs, taken from either end
+	struct WorkQueue {
+		std::mutex			mutex;
+		std::vector<Job>	jobs;
+		size_t				front = 0;
+		size_t				count = 0;
+
+		void	PushBack(Job&& job);
+		Job		PopBack();
+		Job		PopFront();
+	};
+
+	void			Push(Job job);
+	bool			RunOneJob(unsigned int queueIndex);
+	void			Finish(JobCounter& counter);
+	void			WorkerThread(unsigned int queueIndex);
+	unsigned int	GetQueueIndex() const;
+
+	std::vector<std::thread>				workers;
+	std::vector<std::unique_ptr<WorkQueue>>	queues;	//One per worker, then the shared one
+
+	std::atomic<int>		queuedJobs;
+	std::mutex				sleepMutex;
+	std::condition_variable	jobReady;
+	bool					stopping;
+};
@@ -0,0 +1,41 @@
+/******************************************************************************
+Class:MappedFile
+Implements:
+Description:Read-only view of a file, mapped into memory with the Win32 file
+mapping API rather than read through a stream. Pages are mapped copy-on-write,
+so data inside the view can be modified in place (e.g. regenerating normals on
+a loaded mesh) without ever touching the file on disk.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "common.h"
+
+#include <string>
+#include <cstdint>
+
+#include <windows.h>
+
+class MappedFile {
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile(void);
+
+	bool	IsValid() const { return data != nullptr; }
+
+	char*	GetData() const { return data; }
+	size_t	GetSize() const { return size; }
+
+	bool	Contains(const void* p) const {
+		const char* c = (const char*)p;
+		return data && c >= data && c < data + size;
+	}
+
+	//Last write time of a file, or 0 if it does not exist
+	static uint64_t GetModifiedTime(const std::string& filename);
+
+protected:
+	HANDLE	fileHandle;
+	HANDLE	mappingHandle;
+	char*	data;
+	size_t	size;
+};
@@ -16,6 +16,7 @@ _-_-_-_-_-_-_-""  ""
 #pragma once
 
 #include <iostream>
+#include <xmmintrin.h>
 #include "common.h"
 #include "Vector3.h"
 #include "Vector4.h"
@@ -77,16 +78,23 @@ public:
 	Matrix4 Inverse() const;
 
 	//Multiplies 'this' matrix by matrix 'a'. Performs the multiplication in 'OpenGL' order (ie, backwards)
+	//Each column of the result is this matrix's columns weighted by a column
+	//of a, so it's four multiply-adds of whole columns. The sums are added up
+	//in the same order as a scalar loop would, so the results are identical.
 	inline Matrix4 operator*(const Matrix4 &a) const{	
 		Matrix4 out;
-		//Students! You should be able to think up a really easy way of speeding this up...
+		__m128 c0 = _mm_loadu_ps(&values[0]);
+		__m128 c1 = _mm_loadu_ps(&values[4]);
+		__m128 c2 = _mm_loadu_ps(&values[8]);
+		__m128 c3 = _mm_loadu_ps(&values[12]);
+
 		for(unsigned int r = 0; r < 4; ++r) {
-			for(unsigned int c = 0; c < 4; ++c) {
-				out.values[c + (r*4)] = 0.0f;
-				for(unsigned int i = 0; i < 4; ++i) {
-					out.values[c + (r*4)] += this->values[c+(i*4)] * a.values[(r*4)+i];
-				}
-			}
+			const float* w = &a.values[r * 4];
+			__m128 column = _mm_mul_ps(c0, _mm_set1_ps(w[0]));
+			column = _mm_add_ps(column, _mm_mul_ps(c1, _mm_set1_ps(w[1])));
+			column = _mm_add_ps(column, _mm_mul_ps(c2, _mm_set1_ps(w[2])));
+			column = _mm_add_ps(column, _mm_mul_ps(c3, _mm_set1_ps(w[3])));
+			_mm_storeu_ps(&out.values[r * 4], column);
 		}
 		return out;
 	}
@@ -1,11 +1,28 @@
 #include "Mesh.h"
 #include "Matrix2.h"
+#include "MappedFile.h"
+#include "TextScanner.h"
+#include "ThreadPool.h"
+#include "MeshOptimiser.h"
+#include "MeshSimplifier.h"
+#include "InstanceBuffer.h"
+#include "IndirectCuller.h"
+#include "GLStateCache.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <climits>
+#include <cstdio>
+#include <emmintrin.h>
 
 using std::string;
 
 Mesh::Mesh(void)	{
-	glGenVertexArrays(1, &arrayObject);
-	
+	arrayObject = 0;	//Generated by BufferData, so meshes can be loaded without a context
+
 	for(int i = 0; i < MAX_BUFFER; ++i) {
 		bufferObject[i] = 0;
 	}
@@ -22,85 +39,149 @@ Mesh::Mesh(void)	{
 	colours			= nullptr;
 	weights			= nullptr;
 	weightIndices	= nullptr;
-	numInstances = 0;
-	instanceOffsets = nullptr;
+	numInstances	= 0;
+	instances		= nullptr;
+	instanceFormatSet = false;
+	boundingRadius	= 0.0f;
+	bindPose		= nullptr;
+	inverseBindPose	= nullptr;
+	layout			= VERTEX_LAYOUT_SEPARATE;
 }
 
 Mesh::~Mesh(void)	{
-	glDeleteVertexArrays(1, &arrayObject);			//Delete our VAO
-	glDeleteBuffers(MAX_BUFFER, bufferObject);		//Delete our VBOs
+	if (arrayObject) {
+		GLStateCache::GetSharedCache().Forget(GL_VERTEX_ARRAY, arrayObject);
+		glDeleteVertexArrays(1, &arrayObject);			//Delete our VAO
+		glDeleteBuffers(MAX_BUFFER, bufferObject);		//Delete our VBOs
+	}
+
+	if (OwnsData(vertices))			{ delete[] vertices; }
+	if (OwnsData(indices))			{ delete[] indices; }
+	if (OwnsData(textureCoords))	{ delete[] textureCoords; }
+	if (OwnsData(tangents))			{ delete[] tangents; }
+	if (OwnsData(normals))			{ delete[] normals; }
+	if (OwnsData(colours))			{ delete[] colours; }
+	if (OwnsData(weights))			{ delete[] weights; }
+	if (OwnsData(weightIndices))	{ delete[] weightIndices; }
+	if (OwnsData(bindPose))			{ delete[] bindPose; }
+	if (OwnsData(inverseBindPose))	{ delete[] inverseBindPose; }
+	delete		instances;
+}
+
+bool Mesh::OwnsData(const void* p) const {
+	return !mappedFile || !mappedFile->Contains(p);
+}
+
+template<typename T>
+static void CopyOutOfMapping(T*& data, size_t count, const MappedFile& file) {
+	if (data && file.Contains(data)) {
+		T* copy = new T[count];
+		memcpy(copy, data, count * sizeof(T));
+		data = copy;
+	}
+}
+
+void Mesh::ReleaseMappedFile() {
+	if (!mappedFile) {
+		return;
+	}
+	CopyOutOfMapping(vertices,			numVertices,		*mappedFile);
+	CopyOutOfMapping(colours,			numVertices,		*mappedFile);
+	CopyOutOfMapping(textureCoords,		numVertices,		*mappedFile);
+	CopyOutOfMapping(normals,			numVertices,		*mappedFile);
+	CopyOutOfMapping(tangents,			numVertices,		*mappedFile);
+	CopyOutOfMapping(weights,			numVertices,		*mappedFile);
+	CopyOutOfMapping(weightIndices,		numVertices * 4,	*mappedFile);
+	CopyOutOfMapping(indices,			numIndices,			*mappedFile);
+	CopyOutOfMapping(bindPose,			GetJointCount(),	*mappedFile);
+	CopyOutOfMapping(inverseBindPose,	GetJointCount(),	*mappedFile);
+	mappedFile.reset();
+}
+
+bool Mesh::GenerateMissingFrames(int loadFlags) {
+	bool generated = false;
 
-	delete[]	vertices;
-	delete[]	indices;
-	delete[]	textureCoords;
-	delete[]	tangents;
-	delete[]	normals;
-	delete[]	colours;
-	delete[]	weights;
-	delete[]	weightIndices;
-	delete[]	instanceOffsets;
+	if ((loadFlags & MESH_LOAD_GENERATE_NORMALS) && !normals && vertices) {
+		GenerateNormals();
+		generated = true;
+	}
+	if ((loadFlags & MESH_LOAD_GENERATE_TANGENTS) && !tangents && vertices && textureCoords) {
+		GenerateTangents();
+		generated = true;
+	}
+	return generated;
 }
 
 void Mesh::Draw() {
 	if (numInstances > 0) { DrawInstanced(); }
 	else {
-		glBindVertexArray(arrayObject);
+		GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
 		if (bufferObject[INDEX_BUFFER]) {
-			glDrawElements(type, numIndices, GL_UNSIGNED_INT, 0);
+			glDrawElements(type, numIndices, GetIndexType(), 0);
 		}
 		else {
 			glDrawArrays(type, 0, numVertices);
 		}
-		glBindVertexArray(0);
 	}
 }
 
 void Mesh::DrawInstanced() {
-	glBindVertexArray(arrayObject);
+	GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
+	BindInstances(instances->GetBuffer());
 	if (bufferObject[INDEX_BUFFER]) {
-		glDrawElementsInstanced(type, numIndices, GL_UNSIGNED_INT, 0, numInstances);
+		glDrawElementsInstancedBaseInstance(type, numIndices, GetIndexType(), 0, numInstances, instances->GetFirstInstance());
 	}
 	else {
-		glDrawArraysInstanced(type, 0, numVertices, numInstances);
+		glDrawArraysInstancedBaseInstance(type, 0, numVertices, numInstances, instances->GetFirstInstance());
+	}
+}
+
+const Mesh::SubMesh* Mesh::GetDrawRange(int i, int lod) const {
+	if (i < 0 || i >= (int)meshLayers.size()) {
+		return nullptr;
 	}
-	glBindVertexArray(0);
+	if (lod > 0 && lod < GetLodCount()) {
+		return &lodLevels[lod - 1].layers[i];
+	}
+	return &meshLayers[i];
 }
 
-void Mesh::DrawSubMesh(int i) {
-	if (numInstances > 0) { DrawSubMeshInstanced(i); }
+void Mesh::DrawSubMesh(int i, int lod) {
+	if (numInstances > 0) { DrawSubMeshInstanced(i, lod); }
 	else {
-		if (i < 0 || i >= (int)meshLayers.size()) {
+		const SubMesh* range = GetDrawRange(i, lod);
+		if (!range) {
 			return;
 		}
-		SubMesh m = meshLayers[i];
+		SubMesh m = *range;
 
-		glBindVertexArray(arrayObject);
+		GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
 		if (bufferObject[INDEX_BUFFER]) {
-			const GLvoid* offset = (const GLvoid*)(m.start * sizeof(unsigned int));
-			glDrawElements(type, m.count, GL_UNSIGNED_INT, offset);
+			const GLvoid* offset = (const GLvoid*)(size_t)(m.start * GetIndexSize());
+			glDrawElements(type, m.count, GetIndexType(), offset);
 		}
 		else {
 			glDrawArrays(type, m.start, m.count);	//Draw the triangle!
 		}
-		glBindVertexArray(0);
 	}
 }
 
-void Mesh::DrawSubMeshInstanced(int i) {
-	if (i < 0 || i >= (int)meshLayers.size()) {
+void Mesh::DrawSubMeshInstanced(int i, int lod) {
+	const SubMesh* range = GetDrawRange(i, lod);
+	if (!range) {
 		return;
 	}
-	SubMesh m = meshLayers[i];
+	SubMesh m = *range;
 
-	glBindVertexArray(arrayObject);
+	GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
+	BindInstances(instances->GetBuffer());
 	if (bufferObject[INDEX_BUFFER]) {
-		const GLvoid* offset = (const GLvoid*)(m.start * sizeof(unsigned int));
-		glDrawElementsInstanced(type, m.count, GL_UNSIGNED_INT, offset, numInstances);
+		const GLvoid* offset = (const GLvoid*)(size_t)(m.start * GetIndexSize());
+		glDrawElementsInstancedBaseInstance(type, m.count, GetIndexType(), offset, numInstances, instances->GetFirstInstance());
 	}
 	else {
-		glDrawArraysInstanced(type, m.start, m.count, numInstances);	//Draw the triangle!
+		glDrawArraysInstancedBaseInstance(type, m.start, m.count, numInstances, instances->GetFirstInstance());	//Draw the triangle!
 	}
-	glBindVertexArray(0);
 }
 
 void UploadAttribute(GLuint* id, int numElements, int dataSize, int attribSize, int attribID, void* pointer, const string&debugName) {
@@ -114,54 +195,426 @@ void UploadAttribute(GLuint* id, int numElements, int dataSize, int attribSize,
 	glObjectLabel(GL_BUFFER, *id, -1, debugName.c_str());
 }
 
-void Mesh::BufferData()	{
-	glBindVertexArray(arrayObject);
-
-	////Buffer vertex data
-	UploadAttribute(&bufferObject[VERTEX_BUFFER], numVertices, sizeof(Vector3), 3, VERTEX_BUFFER, vertices, "Positions");
-
-	if(textureCoords) {	//Buffer texture data
-		UploadAttribute(&bufferObject[TEXTURE_BUFFER], numVertices, sizeof(Vector2), 2, TEXTURE_BUFFER, textureCoords, "TexCoords");
+void Mesh::GetBounds(Vector3& minBounds, Vector3& maxBounds) const {
+	minBounds = maxBounds = numVertices > 0 ? vertices[0] : Vector3(0, 0, 0);
+	for (GLuint i = 1; i < numVertices; ++i) {
+		minBounds = Vector3(std::min(minBounds.x, vertices[i].x), std::min(minBounds.y, vertices[i].y), std::min(minBounds.z, vertices[i].z));
+		maxBounds = Vector3(std::max(maxBounds.x, vertices[i].x), std::max(maxBounds.y, vertices[i].y), std::max(maxBounds.z, vertices[i].z));
 	}
+}
 
-	if (colours) {
-		UploadAttribute(&bufferObject[COLOUR_BUFFER], numVertices, sizeof(Vector4), 4, COLOUR_BUFFER, colours, "Colours");
+void Mesh::BufferData()	{
+	if (vertices) {
+		Vector3 minBounds;
+		Vector3 maxBounds;
+		GetBounds(minBounds, maxBounds);
+		boundingCentre = (minBounds + maxBounds) * 0.5f;
+		boundingRadius = (maxBounds - minBounds).Length() * 0.5f;
 	}
-
-	if (normals) {	//Buffer normal data
-		UploadAttribute(&bufferObject[NORMAL_BUFFER], numVertices, sizeof(Vector3), 3, NORMAL_BUFFER, normals, "Normals");
+	if (!arrayObject) {
+		glGenVertexArrays(1, &arrayObject);
 	}
+	GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
 
-	if (tangents) {	//Buffer tangent data
-		UploadAttribute(&bufferObject[TANGENT_BUFFER], numVertices, sizeof(Vector4), 4, TANGENT_BUFFER, tangents, "Tangents");
+	if (layout == VERTEX_LAYOUT_PACKED) {
+		BufferPackedData();
 	}
+	else {
+		////Buffer vertex data
+		UploadAttribute(&bufferObject[VERTEX_BUFFER], numVertices, sizeof(Vector3), 3, VERTEX_BUFFER, vertices, "Positions");
 
-	if (weights) {		//Buffer weights data
-		UploadAttribute(&bufferObject[WEIGHTVALUE_BUFFER], numVertices, sizeof(Vector4), 4, WEIGHTVALUE_BUFFER, weights, "Weights");
-	}
+		if(textureCoords) {	//Buffer texture data
+			UploadAttribute(&bufferObject[TEXTURE_BUFFER], numVertices, sizeof(Vector2), 2, TEXTURE_BUFFER, textureCoords, "TexCoords");
+		}
 
-	//Buffer weight indices data...uses a different function since its integers...
-	if (weightIndices) {
-		glGenBuffers(1, &bufferObject[WEIGHTINDEX_BUFFER]);
-		glBindBuffer(GL_ARRAY_BUFFER, bufferObject[WEIGHTINDEX_BUFFER]);
-		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(int) * 4, weightIndices, GL_STATIC_DRAW);
-		glVertexAttribIPointer(WEIGHTINDEX_BUFFER, 4, GL_INT, 0, 0); //note the new function...
-		glEnableVertexAttribArray(WEIGHTINDEX_BUFFER);
+		if (colours) {
+			UploadAttribute(&bufferObject[COLOUR_BUFFER], numVertices, sizeof(Vector4), 4, COLOUR_BUFFER, colours, "Colours");
+		}
 
-		glObjectLabel(GL_BUFFER, bufferObject[WEIGHTINDEX_BUFFER], -1, "Weight Indices");
+		if (normals) {	//Buffer normal data
+			UploadAttribute(&bufferObject[NORMAL_BUFFER], numVertices, sizeof(Vector3), 3, NORMAL_BUFFER, normals, "Normals");
+		}
+
+		if (tangents) {	//Buffer tangent data
+			UploadAttribute(&bufferObject[TANGENT_BUFFER], numVertices, sizeof(Vector4), 4, TANGENT_BUFFER, tangents, "Tangents");
+		}
+
+		if (weights) {		//Buffer weights data
+			UploadAttribute(&bufferObject[WEIGHTVALUE_BUFFER], numVertices, sizeof(Vector4), 4, WEIGHTVALUE_BUFFER, weights, "Weights");
+		}
+
+		//Buffer weight indices data...uses a different function since its integers...
+		if (weightIndices) {
+			glGenBuffers(1, &bufferObject[WEIGHTINDEX_BUFFER]);
+			glBindBuffer(GL_ARRAY_BUFFER, bufferObject[WEIGHTINDEX_BUFFER]);
+			glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(int) * 4, weightIndices, GL_STATIC_DRAW);
+			glVertexAttribIPointer(WEIGHTINDEX_BUFFER, 4, GL_INT, 0, 0); //note the new function...
+			glEnableVertexAttribArray(WEIGHTINDEX_BUFFER);
+
+			glObjectLabel(GL_BUFFER, bufferObject[WEIGHTINDEX_BUFFER], -1, "Weight Indices");
+		}
 	}
 
 	//buffer index data
 	if(indices) {
 		glGenBuffers(1, &bufferObject[INDEX_BUFFER]);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObject[INDEX_BUFFER]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+		size_t totalIndices = numIndices + lodIndices.size();
+
+		if (UseShortIndices()) {
+			std::vector<GLushort> shortIndices(indices, indices + numIndices);
+			shortIndices.insert(shortIndices.end(), lodIndices.begin(), lodIndices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+		}
+		else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(GLuint), indices);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLuint), lodIndices.size() * sizeof(GLuint), lodIndices.data());
+		}
 
 		glObjectLabel(GL_BUFFER, bufferObject[INDEX_BUFFER], -1, "Indices");
 	}
-	glBindVertexArray(0);	
+	GLStateCache::GetSharedCache().BindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if (!pendingInstances.empty()) {
+		std::vector<InstanceData> set;
+		set.swap(pendingInstances);
+		SetInstances(set.data(), (int)set.size());
+	}
+}
+
+unsigned int Mesh::GetVertexSize(VertexLayout l) const {
+	if (l == VERTEX_LAYOUT_PACKED) {
+		GLuint offsets[MAX_BUFFER];
+		return GetPackedOffsets(offsets);
+	}
+	unsigned int size = sizeof(Vector3);
+
+	if (textureCoords)	{ size += sizeof(Vector2); }
+	if (colours)		{ size += sizeof(Vector4); }
+	if (normals)		{ size += sizeof(Vector3); }
+	if (tangents)		{ size += sizeof(Vector4); }
+	if (weights)		{ size += sizeof(Vector4); }
+	if (weightIndices)	{ size += sizeof(int) * 4; }
+
+	return size;
+}
+
+size_t Mesh::GetBufferDataSize() const {
+	size_t size = (size_t)numVertices * GetVertexSize(layout);
+
+	if (indices) {
+		size += (numIndices + lodIndices.size()) * GetIndexSize();
+	}
+	return size;
+}
+
+/*
+Triangles are only moved around within their own submesh, so submesh ranges
+still draw the same triangles. If the ranges overlap, or don't cover whole
+triangles, moving them could change what another submesh draws, so only the
+vertices are reordered.
+*/
+void Mesh::Optimise() {
+	if (!indices || type != GL_TRIANGLES) {
+		return;
+	}
+	bool reorderTriangles = numIndices % 3 == 0;
+
+	std::vector<SubMesh> ranges = meshLayers;
+	std::sort(ranges.begin(), ranges.end(), [](const SubMesh& a, const SubMesh& b) { return a.start < b.start; });
+
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		const SubMesh& r = ranges[i];
+		if (r.start < 0 || r.count < 0 || r.start % 3 || r.count % 3 || (GLuint)(r.start + r.count) > numIndices ||
+			(i > 0 && r.start < ranges[i - 1].start + ranges[i - 1].count)) {
+			reorderTriangles = false;
+		}
+	}
+	if (reorderTriangles) {
+		if (ranges.empty()) {
+			MeshOptimiser::OptimiseVertexCache(indices, numIndices, numVertices);
+		}
+		for (const SubMesh& r : ranges) {
+			MeshOptimiser::OptimiseVertexCache(indices + r.start, r.count, numVertices);
+		}
+	}
+
+	std::vector<unsigned int> remap;
+	MeshOptimiser::OptimiseVertexFetch(indices, numIndices, numVertices, remap);
+
+	MeshOptimiser::RemapVertices(vertices, remap);
+	MeshOptimiser::RemapVertices(colours, remap);
+	MeshOptimiser::RemapVertices(textureCoords, remap);
+	MeshOptimiser::RemapVertices(normals, remap);
+	MeshOptimiser::RemapVertices(tangents, remap);
+	MeshOptimiser::RemapVertices(weights, remap);
+	MeshOptimiser::RemapVertices(weightIndices, remap, 4);
+
+	for (unsigned int& i : lodIndices) {
+		i = remap[i];
+	}
+	packedVertices.clear();	//Built from the old order
+}
+
+static const float MIN_LOD_REDUCTION = 0.85f;
+
+/*
+Every submesh is simplified on its own, so each LOD still has one range per
+material layer, and each level starts again from the full mesh, so its error is
+measured against what it's standing in for. Vertices on submesh boundaries are
+kept where they are, so neighbouring layers can't pull apart.
+*/
+void Mesh::GenerateLods(int maxLevels, float reduction, float maxError) {
+	lodLevels.clear();
+	lodIndices.clear();
+
+	if (!indices || !vertices || type != GL_TRIANGLES || meshLayers.empty()) {
+		return;
+	}
+	for (const SubMesh& m : meshLayers) {
+		if (m.start < 0 || m.count < 0 || (GLuint)(m.start + m.count) > numIndices) {
+			return;
+		}
+	}
+	Vector3 minBounds;
+	Vector3 maxBounds;
+	GetBounds(minBounds, maxBounds);
+	float radius = (maxBounds - minBounds).Length() * 0.5f;
+	if (radius <= 0.0f) {
+		return;
+	}
+
+	unsigned int previousTris = GetLodTriCount(0);
+	float ratio = 1.0f;
+
+	std::vector<unsigned int> simplified;
+
+	for (int level = 0; level < maxLevels; ++level) {
+		ratio *= reduction;
+
+		LodLevel lod;
+		lod.triCount	= 0;
+		lod.error		= 0.0f;
+
+		size_t firstIndex = lodIndices.size();
+
+		for (const SubMesh& m : meshLayers) {
+			unsigned int target = (unsigned int)(m.count / 3 * ratio) * 3;
+			float error = MeshSimplifier::Simplify(vertices, numVertices, indices + m.start, m.count, target, maxError * radius, simplified);
+			MeshOptimiser::OptimiseVertexCache(simplified.data(), (unsigned int)simplified.size(), numVertices);
+
+			lod.layers.push_back({ (int)(numIndices + lodIndices.size()), (int)simplified.size() });
+			lod.triCount	+= (unsigned int)simplified.size() / 3;
+			lod.error		= std::max(lod.error, error / radius);
+			lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+		}
+		//Not worth the memory if it barely draws any less than the last
+		if (lod.triCount > previousTris * MIN_LOD_REDUCTION) {
+			lodIndices.resize(firstIndex);
+			break;
+		}
+		previousTris = lod.triCount;
+		lodLevels.push_back(lod);
+	}
+}
+
+unsigned int Mesh::GetLodTriCount(int lod) const {
+	if (lod > 0 && lod < GetLodCount()) {
+		return lodLevels[lod - 1].triCount;
+	}
+	unsigned int count = 0;
+	for (const SubMesh& m : meshLayers) {
+		count += m.count / 3;
+	}
+	return meshLayers.empty() ? GetTriCount() : count;
+}
+
+//Each LOD's submeshes are added one after another, so they're all together
+const unsigned int* Mesh::GetLodIndexData(int lod, unsigned int& count) const {
+	if (lod > 0 && lod < GetLodCount() && !lodLevels[lod - 1].layers.empty()) {
+		const LodLevel& level = lodLevels[lod - 1];
+		count = 0;
+		for (const SubMesh& m : level.layers) {
+			count += m.count;
+		}
+		return lodIndices.data() + (level.layers[0].start - numIndices);
+	}
+	count = indices ? numIndices : 0;
+	return indices;
+}
+
+int Mesh::SelectLod(float screenRadius, float maxPixelError) const {
+	int lod = 0;
+	while (lod < (int)lodLevels.size() && lodLevels[lod].error * screenRadius <= maxPixelError) {
+		lod++;
+	}
+	return lod;
+}
+
+/*
+Conversions used by the packed vertex layout. Each rounds to the nearest
+representable value, clamping anything out of range.
+*/
+static uint16_t FloatToHalf(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	uint16_t sign		= (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t magnitude	= bits & 0x7FFFFFFF;
+
+	if (magnitude >= 0x7F800000) {	//Infinity or NaN
+		return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+	}
+	if (magnitude >= 0x477FF000) {	//Rounds up past the largest half
+		return sign | 0x7C00;
+	}
+	if (magnitude < 0x38800000) {		//Half denormal, in units of 2^-24
+		uint32_t exponent = magnitude >> 23;
+		if (exponent < 102) {
+			return sign;
+		}
+		uint32_t mantissa	= (magnitude & 0x7FFFFF) | 0x800000;
+		uint32_t shift		= 126 - exponent;
+		uint32_t half		= mantissa >> shift;
+		uint32_t remainder	= mantissa & ((1u << shift) - 1);
+		uint32_t midpoint	= 1u << (shift - 1);
+
+		if (remainder > midpoint || (remainder == midpoint && (half & 1))) {
+			half++;
+		}
+		return sign | (uint16_t)half;
+	}
+	uint32_t rounded = magnitude + 0xFFF + ((magnitude >> 13) & 1);
+	return sign | (uint16_t)((rounded - 0x38000000) >> 13);
+}
+
+static uint32_t PackSnorm1010102(float x, float y, float z, float w) {
+	auto snorm = [](float f, float scale, uint32_t mask) {
+		f = std::max(-1.0f, std::min(1.0f, f));
+		int32_t i = (int32_t)(f * scale + (f < 0.0f ? -0.5f : 0.5f));
+		return (uint32_t)i & mask;
+	};
+	return snorm(x, 511.0f, 0x3FF) | (snorm(y, 511.0f, 0x3FF) << 10) |
+		(snorm(z, 511.0f, 0x3FF) << 20) | (snorm(w, 1.0f, 0x3) << 30);
+}
+
+static uint8_t PackUnorm8(float f) {
+	return (uint8_t)(std::max(0.0f, std::min(1.0f, f)) * 255.0f + 0.5f);
+}
+
+static uint16_t PackUnorm16(float f) {
+	return (uint16_t)(std::max(0.0f, std::min(1.0f, f)) * 65535.0f + 0.5f);
+}
+
+GLuint Mesh::GetPackedOffsets(GLuint offsets[MAX_BUFFER]) const {
+	GLuint sizes[MAX_BUFFER] = { 0 };
+
+	sizes[VERTEX_BUFFER]		= sizeof(Vector3);
+	sizes[COLOUR_BUFFER]		= colours		? 4 : 0;
+	sizes[TEXTURE_BUFFER]		= textureCoords	? 4 : 0;
+	sizes[NORMAL_BUFFER]		= normals		? 4 : 0;
+	sizes[TANGENT_BUFFER]		= tangents		? 4 : 0;
+	sizes[WEIGHTVALUE_BUFFER]	= weights		? 8 : 0;
+	sizes[WEIGHTINDEX_BUFFER]	= weightIndices	? (UseShortJointIndices() ? 8 : 4) : 0;
+
+	GLuint stride = 0;
+	for (int i = 0; i < MAX_BUFFER; ++i) {
+		offsets[i]	= stride;
+		stride		+= sizes[i];	//Every size is a multiple of 4, keeping each attribute aligned
+	}
+	return stride;
+}
+
+void Mesh::PackVertexData() {
+	GLuint offsets[MAX_BUFFER];
+	GLuint stride = GetPackedOffsets(offsets);
+
+	packedVertices.resize((size_t)stride * numVertices);
+
+	for (GLuint i = 0; i < numVertices; ++i) {
+		unsigned char* v = &packedVertices[(size_t)i * stride];
+
+		memcpy(v + offsets[VERTEX_BUFFER], &vertices[i], sizeof(Vector3));
+
+		if (colours) {
+			uint8_t c[4] = { PackUnorm8(colours[i].x), PackUnorm8(colours[i].y), PackUnorm8(colours[i].z), PackUnorm8(colours[i].w) };
+			memcpy(v + offsets[COLOUR_BUFFER], c, sizeof(c));
+		}
+		if (textureCoords) {
+			uint16_t t[2] = { FloatToHalf(textureCoords[i].x), FloatToHalf(textureCoords[i].y) };
+			memcpy(v + offsets[TEXTURE_BUFFER], t, sizeof(t));
+		}
+		if (normals) {
+			uint32_t n = PackSnorm1010102(normals[i].x, normals[i].y, normals[i].z, 0.0f);
+			memcpy(v + offsets[NORMAL_BUFFER], &n, sizeof(n));
+		}
+		if (tangents) {
+			uint32_t t = PackSnorm1010102(tangents[i].x, tangents[i].y, tangents[i].z, tangents[i].w);
+			memcpy(v + offsets[TANGENT_BUFFER], &t, sizeof(t));
+		}
+		if (weights) {
+			uint16_t w[4] = { PackUnorm16(weights[i].x), PackUnorm16(weights[i].y), PackUnorm16(weights[i].z), PackUnorm16(weights[i].w) };
+			memcpy(v + offsets[WEIGHTVALUE_BUFFER], w, sizeof(w));
+		}
+		if (weightIndices) {
+			const int* j = &weightIndices[i * 4];
+			if (UseShortJointIndices()) {
+				uint16_t s[4] = { (uint16_t)j[0], (uint16_t)j[1], (uint16_t)j[2], (uint16_t)j[3] };
+				memcpy(v + offsets[WEIGHTINDEX_BUFFER], s, sizeof(s));
+			}
+			else {
+				uint8_t b[4] = { (uint8_t)j[0], (uint8_t)j[1], (uint8_t)j[2], (uint8_t)j[3] };
+				memcpy(v + offsets[WEIGHTINDEX_BUFFER], b, sizeof(b));
+			}
+		}
+	}
+}
+
+static void PackedAttribute(GLuint attribID, GLint size, GLenum type, GLboolean normalised, GLuint stride, GLuint offset) {
+	glVertexAttribPointer(attribID, size, type, normalised, stride, (const GLvoid*)(size_t)offset);
+	glEnableVertexAttribArray(attribID);
+}
+
+void Mesh::BufferPackedData() {
+	if (packedVertices.empty()) {
+		PackVertexData();
+	}
+	GLuint offsets[MAX_BUFFER];
+	GLuint stride = GetPackedOffsets(offsets);
+
+	glGenBuffers(1, &bufferObject[VERTEX_BUFFER]);
+	glBindBuffer(GL_ARRAY_BUFFER, bufferObject[VERTEX_BUFFER]);
+	glBufferData(GL_ARRAY_BUFFER, packedVertices.size(), packedVertices.data(), GL_STATIC_DRAW);
+	glObjectLabel(GL_BUFFER, bufferObject[VERTEX_BUFFER], -1, "Packed Vertices");
+
+	PackedAttribute(VERTEX_BUFFER, 3, GL_FLOAT, GL_FALSE, stride, offsets[VERTEX_BUFFER]);
+
+	if (colours) {
+		PackedAttribute(COLOUR_BUFFER, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, offsets[COLOUR_BUFFER]);
+	}
+	if (textureCoords) {
+		PackedAttribute(TEXTURE_BUFFER, 2, GL_HALF_FLOAT, GL_FALSE, stride, offsets[TEXTURE_BUFFER]);
+	}
+	if (normals) {
+		PackedAttribute(NORMAL_BUFFER, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offsets[NORMAL_BUFFER]);
+	}
+	if (tangents) {
+		PackedAttribute(TANGENT_BUFFER, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offsets[TANGENT_BUFFER]);
+	}
+	if (weights) {
+		PackedAttribute(WEIGHTVALUE_BUFFER, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, offsets[WEIGHTVALUE_BUFFER]);
+	}
+	if (weightIndices) {
+		GLenum type = UseShortJointIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+		glVertexAttribIPointer(WEIGHTINDEX_BUFFER, 4, type, stride, (const GLvoid*)(size_t)offsets[WEIGHTINDEX_BUFFER]);
+		glEnableVertexAttribArray(WEIGHTINDEX_BUFFER);
+	}
+	packedVertices.clear();
+	packedVertices.shrink_to_fit();
 }
 
 Mesh* Mesh::GenerateTriangle() {
@@ -202,27 +655,80 @@ Mesh* Mesh::GeneratePoint() {
 	return m;
 }
 
-void Mesh::SetInstances(Vector3* instanceTransforms, int instances) {
-	this->instanceOffsets = new Vector3[instances];
-	numInstances = instances;
-	for (int i = 0; i < instances; i++) {
-		instanceOffsets[i] = instanceTransforms[i];
+//Until BufferData has run there may be no context - such as on a loading
+//thread - so the instances are kept until it can make their buffer
+void Mesh::SetInstances(const InstanceData* data, int count) {
+	if (!arrayObject) {
+		pendingInstances.assign(data, data + count);
+		numInstances = count;
+		return;
 	}
+	if (!instances) {
+		instances = new InstanceBuffer(count);
+	}
+	instances->Write(data, count);
+	numInstances = count;
+}
 
-	glBindVertexArray(arrayObject);
-	glGenBuffers(1, &bufferObject[INSTANCE_TRANSFORM_BUFFER]);
+void Mesh::SetInstances(const Vector3* instanceOffsets, int count) {
+	std::vector<InstanceData> data(count);
+	for (int i = 0; i < count; ++i) {
+		data[i].modelMatrix	= Matrix4::Translation(instanceOffsets[i]);
+		data[i].colour		= Vector4(1, 1, 1, 1);
+	}
+	SetInstances(data.data(), count);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, bufferObject[INSTANCE_TRANSFORM_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(Vector3), this->instanceOffsets, GL_STATIC_DRAW);
+/*
+The instance attributes are told where their data is in an InstanceData once,
+and after that the only thing to change is which buffer the binding they read
+from points at. Expects the VAO to be bound already.
+*/
+void Mesh::BindInstances(GLuint buffer) {
+	if (!instanceFormatSet) {
+		for (GLuint c = 0; c < 4; ++c) {
+			glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + c);
+			glVertexAttribFormat(INSTANCE_MATRIX_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE,
+				(GLuint)(offsetof(InstanceData, modelMatrix) + c * sizeof(Vector4)));
+			glVertexAttribBinding(INSTANCE_MATRIX_ATTRIBUTE + c, INSTANCE_BINDING);
+		}
+		glEnableVertexAttribArray(INSTANCE_COLOUR_ATTRIBUTE);
+		glVertexAttribFormat(INSTANCE_COLOUR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, (GLuint)offsetof(InstanceData, colour));
+		glVertexAttribBinding(INSTANCE_COLOUR_ATTRIBUTE, INSTANCE_BINDING);
+		glVertexBindingDivisor(INSTANCE_BINDING, 1);
+		instanceFormatSet = true;
+	}
+	glBindVertexBuffer(INSTANCE_BINDING, buffer, 0, sizeof(InstanceData));
+}
 
-	glEnableVertexAttribArray(INSTANCE_TRANSFORM_BUFFER);
-	glVertexAttribPointer(INSTANCE_TRANSFORM_BUFFER, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-	glVertexAttribDivisor(INSTANCE_TRANSFORM_BUFFER, 1); 
+void Mesh::DrawIndirect(GLuint instanceBuffer, GLuint commandBuffer, int firstDraw, int drawCount) {
+	if (!bufferObject[INDEX_BUFFER] || drawCount < 1) {
+		return;
+	}
+	GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
+	BindInstances(instanceBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glMultiDrawElementsIndirect(type, GetIndexType(), (const GLvoid*)(firstDraw * sizeof(DrawElementsIndirectCommand)), drawCount, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-    glObjectLabel(GL_BUFFER, bufferObject[INSTANCE_TRANSFORM_BUFFER], -1, "Instance transforms");
+//Each batch picks out its own instances with the draw's base instance
+void Mesh::DrawSubMeshBatched(int i, int lod, GLuint instanceBuffer, GLuint firstInstance, GLuint instanceCount) {
+	const SubMesh* range = GetDrawRange(i, lod);
+	if (!range || instanceCount == 0) {
+		return;
+	}
+	SubMesh m = *range;
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+	GLStateCache::GetSharedCache().BindVertexArray(arrayObject);
+	BindInstances(instanceBuffer);
+	if (bufferObject[INDEX_BUFFER]) {
+		const GLvoid* offset = (const GLvoid*)(size_t)(m.start * GetIndexSize());
+		glDrawElementsInstancedBaseInstance(type, m.count, GetIndexType(), offset, instanceCount, firstInstance);
+	}
+	else {
+		glDrawArraysInstancedBaseInstance(type, m.start, m.count, instanceCount, firstInstance);
+	}
 }
 
 bool Mesh::GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int& b, unsigned int& c) const {
@@ -246,73 +752,219 @@ bool Mesh::GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int&
 	return true;
 }
 
-void Mesh::GenerateNormals() {
-	if (!normals) {
-		normals = new Vector3[numVertices];
-	}
-
-	for (GLuint i = 0; i < numVertices; ++i) {
-		normals[i] = Vector3();
+/*
+Normals and tangents are summed per vertex by splitting the triangles into a
+chunk per thread. Neighbouring triangles mostly share vertices, especially
+once a mesh has been through Optimise, so each chunk only touches a narrow
+range of vertices, and most of that range is touched by no other chunk. Those
+vertices belong to the chunk, which sums straight into the output array; the
+few it shares with other chunks are summed into a small array of its own,
+and added together once every chunk is done.
+
+Within a chunk, sums happen in the same order as the old single threaded loop,
+and the SSE maths does exactly what Vector3's operators do, so every vertex
+bar the shared ones gets a bit-identical result. The shared ones can be out in
+the last bit or so, from adding in a different order.
+*/
+static const unsigned int GENERATE_BLOCK_SIZE = 4096;
+
+struct VertexChunk {
+	unsigned int	firstTri;
+	unsigned int	lastTri;
+	GLuint			firstVertex;	//Every vertex the chunk's triangles use...
+	GLuint			lastVertex;
+	GLuint			firstOwned;		//...and those no other chunk uses
+	GLuint			lastOwned;
+	std::vector<Vector4> shared;	//Sums for the rest of the range
+
+	bool	Uses(GLuint v) const { return v >= firstVertex && v < lastVertex; }
+	bool	Owns(GLuint v) const { return v >= firstOwned && v < lastOwned; }
+
+	Vector4& SharedSum(GLuint v) {
+		return shared[v < firstOwned ? v - firstVertex : (firstOwned - firstVertex) + (v - lastOwned)];
 	}
+};
 
-	int triCount = GetTriCount();
-
-	for (int i = 0; i < triCount; ++i) {
-		unsigned int a = 0;
-		unsigned int b = 0;
-		unsigned int c = 0;
-		GetVertexIndicesForTri(i, a, b, c);
+static inline __m128 LoadSum(const Vector3& v)			{ return _mm_setr_ps(v.x, v.y, v.z, 0.0f); }
+static inline __m128 LoadSum(const Vector4& v)			{ return _mm_loadu_ps(&v.x); }
+static inline void	 StoreSum(Vector4& v, __m128 m)	{ _mm_storeu_ps(&v.x, m); }
+static inline void	 StoreSum(Vector3& v, __m128 m) {
+	float f[4];
+	_mm_storeu_ps(f, m);
+	v = Vector3(f[0], f[1], f[2]);
+}
 
-		Vector3 normal = Vector3::Cross(
-			(vertices[b] - vertices[a]),
-			(vertices[c] - vertices[a])
-		);
+static inline __m128 CrossSSE(__m128 a, __m128 b) {
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 zxy	= _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
 
-		normals[a] += normal;
-		normals[b] += normal;
-		normals[c] += normal;
-	}
+//Scales x, y and z to unit length, as Vector3::Normalise does
+static inline __m128 NormaliseSSE(__m128 v) {
+	__m128 squared	= _mm_mul_ps(v, v);
+	__m128 sum		= _mm_add_ss(_mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1))),
+		_mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 2, 2, 2)));
+	__m128 length	= _mm_sqrt_ss(sum);
 
-	for (GLuint i = 0; i < numVertices; ++i) {
-		normals[i].Normalise();
+	if (_mm_cvtss_f32(length) == 0.0f) {
+		return v;
 	}
+	__m128 scale = _mm_div_ss(_mm_set_ss(1.0f), length);
+	return _mm_mul_ps(v, _mm_shuffle_ps(scale, scale, 0));
 }
 
-void Mesh::GenerateTangents() {
-	if (!textureCoords) {
-		return;
+/*
+Adds triangleValue(i, a, b, c) to each of triangle i's vertices, for every
+triangle, then calls finish(v, total) for every vertex. Until finish is
+called, output is used to hold the sums.
+*/
+template<typename T, typename TriangleValue, typename Finish>
+static void AccumulatePerVertex(unsigned int triCount, GLuint numVertices, const unsigned int* indices, T* output,
+	const TriangleValue& triangleValue, const Finish& finish) {
+	ThreadPool&		pool		= ThreadPool::GetSharedPool();
+	unsigned int	chunkCount	= std::max(1u, std::min(pool.GetThreadCount() + 1, triCount / GENERATE_BLOCK_SIZE));
+	std::vector<VertexChunk> chunks(chunkCount);
+
+	pool.ParallelFor(chunkCount, [&](size_t c) {
+		VertexChunk& chunk	= chunks[c];
+		chunk.firstTri		= (unsigned int)(((uint64_t)triCount * c) / chunkCount);
+		chunk.lastTri		= (unsigned int)(((uint64_t)triCount * (c + 1)) / chunkCount);
+
+		GLuint lowest	= UINT_MAX;
+		GLuint highest	= 0;
+		for (unsigned int i = chunk.firstTri * 3; i < chunk.lastTri * 3; ++i) {
+			GLuint v	= indices ? indices[i] : i;
+			lowest		= std::min(lowest, v);
+			highest		= std::max(highest, v);
+		}
+		chunk.firstVertex	= chunk.firstTri < chunk.lastTri ? lowest : 0;
+		chunk.lastVertex	= chunk.firstTri < chunk.lastTri ? highest + 1 : 0;
+	});
+
+	//Cut every other chunk's range out of each chunk's owned range. Ranges
+	//only ever shrink, so one pass is enough.
+	for (VertexChunk& chunk : chunks) {
+		GLuint lo = chunk.firstVertex;
+		GLuint hi = chunk.lastVertex;
+
+		for (const VertexChunk& other : chunks) {
+			if (&other == &chunk || other.firstVertex >= hi || other.lastVertex <= lo) {
+				continue;
+			}
+			if (other.firstVertex <= lo) {
+				lo = std::min(other.lastVertex, hi);
+			}
+			else if (other.lastVertex >= hi) {
+				hi = other.firstVertex;
+			}
+			else if (other.firstVertex - lo >= hi - other.lastVertex) {	//Inside - keep the bigger side
+				hi = other.firstVertex;
+			}
+			else {
+				lo = other.lastVertex;
+			}
+		}
+		chunk.firstOwned	= lo;
+		chunk.lastOwned		= hi;
 	}
 
-	if (!tangents) {
-		tangents = new Vector4[numVertices];
-	}
+	pool.ParallelFor(chunkCount, [&](size_t c) {
+		VertexChunk& chunk = chunks[c];
 
-	for (GLuint i = 0; i < numVertices; ++i) {
-		tangents[i] = Vector4(0, 0, 0, 0);
-	}
+		for (GLuint v = chunk.firstOwned; v < chunk.lastOwned; ++v) {
+			StoreSum(output[v], _mm_setzero_ps());
+		}
+		chunk.shared.assign((chunk.lastVertex - chunk.firstVertex) - (chunk.lastOwned - chunk.firstOwned), Vector4(0, 0, 0, 0));
+
+		for (unsigned int i = chunk.firstTri; i < chunk.lastTri; ++i) {
+			GLuint tri[3];
+			for (int j = 0; j < 3; ++j) {
+				tri[j] = indices ? indices[(i * 3) + j] : (i * 3) + j;
+			}
+			__m128 value = triangleValue(i, tri[0], tri[1], tri[2]);
+
+			for (int j = 0; j < 3; ++j) {
+				GLuint v = tri[j];
+				if (chunk.Owns(v)) {
+					StoreSum(output[v], _mm_add_ps(LoadSum(output[v]), value));
+				}
+				else {
+					Vector4& sum = chunk.SharedSum(v);
+					StoreSum(sum, _mm_add_ps(LoadSum(sum), value));
+				}
+			}
+		}
+	});
 
-	int triCount = GetTriCount();
+	unsigned int blocks = (numVertices + GENERATE_BLOCK_SIZE - 1) / GENERATE_BLOCK_SIZE;
 
-	for (int i = 0; i < triCount; ++i) {
-		unsigned int a = 0;
-		unsigned int b = 0;
-		unsigned int c = 0;
+	pool.ParallelFor(blocks, [&](size_t block) {
+		GLuint start	= (GLuint)block * GENERATE_BLOCK_SIZE;
+		GLuint end		= std::min(start + GENERATE_BLOCK_SIZE, numVertices);
 
-		GetVertexIndicesForTri(i, a, b, c);
+		std::vector<VertexChunk*> overlapping;
+		for (VertexChunk& chunk : chunks) {
+			if (chunk.firstVertex < end && chunk.lastVertex > start) {
+				overlapping.push_back(&chunk);
+			}
+		}
+		for (GLuint v = start; v < end; ++v) {
+			__m128	total	= _mm_setzero_ps();
+			bool	owned	= false;
+
+			for (VertexChunk* chunk : overlapping) {
+				if (chunk->Owns(v)) {
+					total = LoadSum(output[v]);
+					owned = true;
+					break;
+				}
+			}
+			for (size_t c = 0; !owned && c < overlapping.size(); ++c) {
+				if (overlapping[c]->Uses(v)) {
+					total = _mm_add_ps(total, LoadSum(overlapping[c]->SharedSum(v)));
+				}
+			}
+			finish(v, total);
+		}
+	});
+}
 
-		Vector4 tangent = GenerateTangent(a, b, c);
+void Mesh::GenerateNormals() {
+	if (!normals) {
+		normals = new Vector3[numVertices];
+	}
+	AccumulatePerVertex(GetTriCount(), numVertices, indices, normals,
+		[&](unsigned int i, GLuint a, GLuint b, GLuint c) {
+			__m128 va = LoadSum(vertices[a]);
+			return CrossSSE(_mm_sub_ps(LoadSum(vertices[b]), va), _mm_sub_ps(LoadSum(vertices[c]), va));
+		},
+		[&](GLuint v, __m128 total) {
+			StoreSum(normals[v], NormaliseSSE(total));
+		});
+}
 
-		tangents[a] += tangent;
-		tangents[b] += tangent;
-		tangents[c] += tangent;
+void Mesh::GenerateTangents() {
+	if (!textureCoords) {
+		return;
 	}
 
-	for (GLuint i = 0; i < numVertices; ++i) {
-		float handedness = tangents[i].w > 0.0f ? 1.0f : -1.0f;
-		tangents[i].w = 0.0f;
-		tangents[i].Normalise();
-		tangents[i].w = handedness;
+	if (!tangents) {
+		tangents = new Vector4[numVertices];
 	}
+	AccumulatePerVertex(GetTriCount(), numVertices, indices, tangents,
+		[&](unsigned int i, GLuint a, GLuint b, GLuint c) {
+			return LoadSum(GenerateTangent(a, b, c));
+		},
+		[&](GLuint v, __m128 total) {
+			float handedness = _mm_cvtss_f32(_mm_shuffle_ps(total, total, _MM_SHUFFLE(3, 3, 3, 3))) > 0.0f ? 1.0f : -1.0f;
+
+			Vector4 t;
+			StoreSum(t, NormaliseSSE(_mm_and_ps(total, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)))));
+			t.w = handedness;
+			tangents[v] = t;
+		});
 }
 
 Vector4 Mesh::GenerateTangent(int a, int b, int c) {
@@ -400,130 +1052,229 @@ enum class GeometryChunkTypes {
 	SubMeshNames	= 1 << 15
 };
 
-void ReadTextFloats(std::ifstream& file, vector<Vector2>& element, int numVertices) {
+//Empty chunks leave their attribute null, so BufferData skips them
+template<typename T> T* NewChunkArray(int count) {
+	return count > 0 ? new T[count] : nullptr;
+}
+
+bool ReadTextFloats(TextScanner& file, Vector2* element, int numVertices) {
 	for (int i = 0; i < numVertices; ++i) {
-		Vector2 temp;
-		file >> temp.x;
-		file >> temp.y;
-		element.emplace_back(temp);
+		if (!file.ReadFloat(element[i].x) || !file.ReadFloat(element[i].y)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadTextFloats(std::ifstream& file, vector<Vector3>& element, int numVertices) {
+bool ReadTextFloats(TextScanner& file, Vector3* element, int numVertices) {
 	for (int i = 0; i < numVertices; ++i) {
-		Vector3 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		element.emplace_back(temp);
+		if (!file.ReadFloat(element[i].x) || !file.ReadFloat(element[i].y) || !file.ReadFloat(element[i].z)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadTextFloats(std::ifstream& file, vector<Vector4>& element, int numVertices) {
+bool ReadTextFloats(TextScanner& file, Vector4* element, int numVertices) {
 	for (int i = 0; i < numVertices; ++i) {
-		Vector4 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		file >> temp.w;
-		element.emplace_back(temp);
+		if (!file.ReadFloat(element[i].x) || !file.ReadFloat(element[i].y) || 
+			!file.ReadFloat(element[i].z) || !file.ReadFloat(element[i].w)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadTextVertexIndices(std::ifstream& file, vector<int>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		int indices[4];
-		file >> indices[0];
-		file >> indices[1];
-		file >> indices[2];
-		file >> indices[3];
-		element.emplace_back(indices[0]);
-		element.emplace_back(indices[1]);
-		element.emplace_back(indices[2]);
-		element.emplace_back(indices[3]);
+bool ReadTextVertexIndices(TextScanner& file, int* element, int numVertices) {
+	for (int i = 0; i < numVertices * 4; ++i) {
+		if (!file.ReadInt(element[i])) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadIndices(std::ifstream& file, vector<unsigned int>& elements, int numIndices) {
+bool ReadIndices(TextScanner& file, unsigned int* elements, int numIndices) {
 	for (int i = 0; i < numIndices; ++i) {
-		unsigned int temp;
-		file >> temp;
-		elements.emplace_back(temp);
+		if (!file.ReadUInt(elements[i])) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadJointParents(std::ifstream& file, vector<int>& dest) {
+bool ReadJointParents(TextScanner& file, vector<int>& dest) {
 	int jointCount = 0;
-	file >> jointCount;
+	if (!file.ReadInt(jointCount)) {
+		return false;
+	}
+	dest.resize(std::max(jointCount, 0), -1);
 
-	for (int i = 0; i < jointCount; ++i) {
-		int id = -1;
-		file >> id;
-		dest.emplace_back(id);
+	for (int& id : dest) {
+		if (!file.ReadInt(id)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadJointNames(std::ifstream& file, vector<string>& dest) {
+bool ReadJointNames(TextScanner& file, vector<string>& dest) {
 	int jointCount = 0;
-	file >> jointCount;
-	for (int i = 0; i < jointCount; ++i) {
-		std::string jointName;
-		file >> jointName;
-		dest.emplace_back(jointName);
+	if (!file.ReadInt(jointCount)) {
+		return false;
+	}
+	dest.resize(std::max(jointCount, 0));
+
+	for (string& jointName : dest) {
+		if (!file.ReadWord(jointName)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadRigPose(std::ifstream& file, Matrix4** into) {
+bool ReadRigPose(TextScanner& file, Matrix4** into) {
 	int matCount = 0;
-	file >> matCount;
-
-	*into = new Matrix4[matCount];
+	if (!file.ReadInt(matCount)) {
+		return false;
+	}
+	*into = new Matrix4[std::max(matCount, 0)];
 
 	for (int i = 0; i < matCount; ++i) {
-		Matrix4 mat;
-		for (int i = 0; i < 16; ++i) {
-			file >> mat.values[i];
+		for (int j = 0; j < 16; ++j) {
+			if (!file.ReadFloat((*into)[i].values[j])) {
+				return false;
+			}
 		}
-		(*into)[i] = mat;
 	}
+	return true;
 }
 
-void ReadSubMeshes(std::ifstream& file, int count, vector<Mesh::SubMesh> & subMeshes) {
-	for (int i = 0; i < count; ++i) {
-		Mesh::SubMesh m;
-		file >> m.start;
-		file >> m.count;
-		subMeshes.emplace_back(m);
+bool ReadSubMeshes(TextScanner& file, int count, vector<Mesh::SubMesh> & subMeshes) {
+	subMeshes.resize(count);
+
+	for (Mesh::SubMesh& m : subMeshes) {
+		if (!file.ReadInt(m.start) || !file.ReadInt(m.count)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-void ReadSubMeshNames(std::ifstream& file, int count, vector<string>& names) {
+bool ReadSubMeshNames(TextScanner& file, int count, vector<string>& names) {
 	std::string scrap;
-	std::getline(file, scrap);
+	file.ReadLine(scrap);
 
-	for (int i = 0; i < count; ++i) {
-		std::string meshName;
-		std::getline(file, meshName);
-		names.emplace_back(meshName);
+	names.resize(count);
+
+	for (string& meshName : names) {
+		if (!file.ReadLine(meshName)) {
+			return false;
+		}
 	}
+	return true;
 }
 
-Mesh* Mesh::LoadFromMeshFile(const string& name) {
-	Mesh* mesh = new Mesh();
+Mesh* Mesh::LoadFromMeshFile(const string& name, int loadFlags) {
+	Mesh* mesh = LoadMeshData(name, loadFlags);
+
+	if (mesh) {
+		mesh->Optimise();
+		if (loadFlags & MESH_LOAD_GENERATE_LODS) {
+			mesh->GenerateLods();
+		}
+		mesh->BufferData();
+	}
+	return mesh;
+}
+
+/*
+Generated normals and tangents are saved before Optimise gets to the mesh, so
+the binary copy keeps the same vertex order as the text file it came from.
+*/
+Mesh* Mesh::LoadMeshData(const string& name, int loadFlags) {
+	string binaryName = GetBinaryFileName(name);
+
+	uint64_t textTime	= MappedFile::GetModifiedTime(MESHDIR + name);
+	uint64_t binaryTime = MappedFile::GetModifiedTime(MESHDIR + binaryName);
+
+	Mesh* mesh = nullptr;
+
+	//Only trust the binary copy if it was converted after the last text edit
+	if (binaryTime && binaryTime >= textTime) {
+		mesh = LoadBinaryMeshData(binaryName);
+	}
+	if (!mesh) {
+		mesh = LoadTextMeshData(name);
+	}
+	if (mesh && mesh->GenerateMissingFrames(loadFlags) && (loadFlags & MESH_LOAD_CACHE_GENERATED)) {
+		mesh->ReleaseMappedFile();	//Which may well be the file about to be replaced
+		mesh->SaveToBinaryFile(binaryName);
+	}
+	return mesh;
+}
+
+//Files smaller than this aren't worth handing out to the thread pool
+static const size_t PARALLEL_DECODE_THRESHOLD = 256 * 1024;
+
+//A per-vertex or index chunk, found by the boundary pass and decoded later
+struct TextChunk {
+	GeometryChunkTypes	type;
+	const char*			begin;
+	const char*			end;
+};
+
+//Number of whitespace separated values in each of the bulk chunk types
+static size_t GetChunkTokenCount(GeometryChunkTypes type, size_t numVertices, size_t numIndices) {
+	switch (type) {
+	case GeometryChunkTypes::VPositions:		return numVertices * 3;
+	case GeometryChunkTypes::VNormals:			return numVertices * 3;
+	case GeometryChunkTypes::VColors:			return numVertices * 4;
+	case GeometryChunkTypes::VTangents:			return numVertices * 4;
+	case GeometryChunkTypes::VTex0:				return numVertices * 2;
+	case GeometryChunkTypes::VWeightValues:		return numVertices * 4;
+	case GeometryChunkTypes::VWeightIndices:	return numVertices * 4;
+	case GeometryChunkTypes::Indices:			return numIndices;
+	}
+	return 0;
+}
+
+//Everything after loading indexes the vertex arrays with these, unchecked
+static bool IndicesInRange(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices) {
+	for (unsigned int i = 0; indices && i < numIndices; ++i) {
+		if (indices[i] >= numVertices) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+The whole file is read into memory and scanned in place, with each attribute
+array allocated up front from the header's counts and parsed straight into.
 
-	std::ifstream file(MESHDIR + name);
+Large files are loaded in two passes. The first just skips over the bulk
+vertex and index chunks to find where each one starts and ends (reading the
+small skeleton and submesh chunks as it goes), then the bulk chunks are
+decoded concurrently on the shared ThreadPool.
+*/
+Mesh* Mesh::LoadTextMeshData(const string& name, bool parallelDecode) {
+	vector<char> fileData;
+	TextScanner::LoadFile(MESHDIR + name, fileData);
+
+	TextScanner file(fileData.data(), fileData.data() + fileData.size());
 
 	std::string filetype;
-	int fileVersion;
+	int fileVersion = 0;
 
-	file >> filetype;
+	file.ReadWord(filetype);
 
 	if (filetype != "MeshGeometry") {
 		std::cout << "File is not a MeshGeometry file!" << std::endl;
 		return nullptr;
 	}
 
-	file >> fileVersion;
+	file.ReadInt(fileVersion);
 
 	if (fileVersion != 1) {
 		std::cout << "MeshGeometry file has incompatible version!" << std::endl;
@@ -535,93 +1286,434 @@ Mesh* Mesh::LoadFromMeshFile(const string& name) {
 	int numIndices	= 0; //read
 	int numChunks	= 0; //read
 
-	file >> numMeshes;
-	file >> numVertices;
-	file >> numIndices;
-	file >> numChunks;
+	if (!file.ReadInt(numMeshes) || !file.ReadInt(numVertices) || !file.ReadInt(numIndices) || !file.ReadInt(numChunks) ||
+		numMeshes < 0 || numVertices < 0 || numIndices < 0) {
+		std::cout << "MeshGeometry file " << name << " has a malformed header!" << std::endl;
+		return nullptr;
+	}
+
+	Mesh* mesh = new Mesh();
+
+	mesh->numVertices	= numVertices;
+	mesh->numIndices	= numIndices;
 
-	vector<Vector3> readPositions;
-	vector<Vector4> readColours;
-	vector<Vector3> readNormals;
-	vector<Vector4> readTangents;
-	vector<Vector2> readUVs;
-	vector<Vector4> readWeights;
-	vector<int> readWeightIndices;
+	//Small files are decoded in the same pass that finds the chunks
+	bool decodeInline = !parallelDecode || fileData.size() < PARALLEL_DECODE_THRESHOLD;
+
+	auto DecodeChunk = [&](TextScanner& chunk, GeometryChunkTypes type) {
+		switch (type) {
+		case GeometryChunkTypes::VPositions:		return ReadTextFloats(chunk, mesh->vertices, numVertices);
+		case GeometryChunkTypes::VColors:			return ReadTextFloats(chunk, mesh->colours, numVertices);
+		case GeometryChunkTypes::VNormals:			return ReadTextFloats(chunk, mesh->normals, numVertices);
+		case GeometryChunkTypes::VTangents:			return ReadTextFloats(chunk, mesh->tangents, numVertices);
+		case GeometryChunkTypes::VTex0:				return ReadTextFloats(chunk, mesh->textureCoords, numVertices);
+		case GeometryChunkTypes::Indices:			return ReadIndices(chunk, mesh->indices, numIndices);
+		case GeometryChunkTypes::VWeightValues:		return ReadTextFloats(chunk, mesh->weights, numVertices);
+		case GeometryChunkTypes::VWeightIndices:	return ReadTextVertexIndices(chunk, mesh->weightIndices, numVertices);
+		}
+		return true;
+	};
 
-	vector<unsigned int>		readIndices;
+	vector<TextChunk> bulkChunks;
+	bool read = true;
 
-	for (int i = 0; i < numChunks; ++i) {
+	for (int i = 0; i < numChunks && read; ++i) {
 		int chunkType = (int)GeometryChunkTypes::VPositions;
+		read = file.ReadInt(chunkType);
+
+		GeometryChunkTypes type = (GeometryChunkTypes)chunkType;
+		size_t tokenCount = GetChunkTokenCount(type, numVertices, numIndices);
+
+		//Arrays are allocated here, so any later decoding only ever writes to them
+		switch (type) {
+		case GeometryChunkTypes::VPositions:		mesh->vertices		= NewChunkArray<Vector3>(numVertices); break;
+		case GeometryChunkTypes::VColors:			mesh->colours		= NewChunkArray<Vector4>(numVertices); break;
+		case GeometryChunkTypes::VNormals:			mesh->normals		= NewChunkArray<Vector3>(numVertices); break;
+		case GeometryChunkTypes::VTangents:			mesh->tangents		= NewChunkArray<Vector4>(numVertices); break;
+		case GeometryChunkTypes::VTex0:				mesh->textureCoords = NewChunkArray<Vector2>(numVertices); break;
+		case GeometryChunkTypes::Indices:			mesh->indices		= NewChunkArray<unsigned int>(numIndices); break;
+		case GeometryChunkTypes::VWeightValues:		mesh->weights		= NewChunkArray<Vector4>(numVertices); break;
+		case GeometryChunkTypes::VWeightIndices:	mesh->weightIndices = NewChunkArray<int>(numVertices * 4); break;
+
+		case GeometryChunkTypes::JointNames:		read = read && ReadJointNames(file, mesh->jointNames);  break;
+		case GeometryChunkTypes::JointParents:		read = read && ReadJointParents(file, mesh->jointParents);  break;
+		case GeometryChunkTypes::BindPose:			read = read && ReadRigPose(file, &mesh->bindPose);  break;
+		case GeometryChunkTypes::BindPoseInv:		read = read && ReadRigPose(file, &mesh->inverseBindPose);  break;
+		case GeometryChunkTypes::SubMeshes: 		read = read && ReadSubMeshes(file, numMeshes, mesh->meshLayers); break;
+		case GeometryChunkTypes::SubMeshNames: 		read = read && ReadSubMeshNames(file, numMeshes, mesh->layerNames); break;
+		}
+
+		if (read && tokenCount > 0) {
+			if (decodeInline) {
+				read = DecodeChunk(file, type);
+			}
+			else {
+				const char* begin = file.GetPosition();
+				read = file.SkipTokens(tokenCount);
+				bulkChunks.push_back({ type, begin, file.GetPosition() });
+			}
+		}
+	}
+
+	std::atomic<bool> decoded(read);
+
+	if (read && !bulkChunks.empty()) {
+		ThreadPool::GetSharedPool().ParallelFor(bulkChunks.size(), [&](size_t i) {
+			TextScanner chunk(bulkChunks[i].begin, bulkChunks[i].end);
+			if (!DecodeChunk(chunk, bulkChunks[i].type)) {
+				decoded = false;
+			}
+		});
+	}
 
-		file >> chunkType;
+	if (!decoded) {
+		std::cout << "MeshGeometry file " << name << " is truncated or malformed!" << std::endl;
+		delete mesh;
+		return nullptr;
+	}
+	if (!IndicesInRange(mesh->indices, mesh->numIndices, mesh->numVertices)) {
+		std::cout << "MeshGeometry file " << name << " has an index past its vertices!" << std::endl;
+		delete mesh;
+		return nullptr;
+	}
+	return mesh;
+}
 
-		switch ((GeometryChunkTypes)chunkType) {
-		case GeometryChunkTypes::VPositions:ReadTextFloats(file, readPositions, numVertices);  break;
-		case GeometryChunkTypes::VColors:	ReadTextFloats(file, readColours, numVertices);  break;
-		case GeometryChunkTypes::VNormals:	ReadTextFloats(file, readNormals, numVertices);  break;
-		case GeometryChunkTypes::VTangents:	ReadTextFloats(file, readTangents, numVertices);  break;
-		case GeometryChunkTypes::VTex0:		ReadTextFloats(file, readUVs, numVertices);  break;
-		case GeometryChunkTypes::Indices:	ReadIndices(file, readIndices, numIndices); break;
+/*
+*
+* Binary MeshGeometry files. These hold the same chunks as the text files, but
+* as raw arrays laid out exactly as the Mesh stores them, so a file can be
+* memory mapped and its attribute arrays passed straight to BufferData.
+*
+* Layout: BinaryMeshHeader, then numChunks BinaryMeshChunk entries, then the
+* chunk data itself, each chunk starting on a BINARY_MESH_ALIGNMENT boundary.
+* Joint and submesh names are stored as consecutive null-terminated strings.
+*
+* */
 
-		case GeometryChunkTypes::VWeightValues:		ReadTextFloats(file, readWeights, numVertices);  break;
-		case GeometryChunkTypes::VWeightIndices:	ReadTextVertexIndices(file, readWeightIndices, numVertices);  break;
-		case GeometryChunkTypes::JointNames:		ReadJointNames(file, mesh->jointNames);  break;
-		case GeometryChunkTypes::JointParents:		ReadJointParents(file, mesh->jointParents);  break;
-		case GeometryChunkTypes::BindPose:			ReadRigPose(file, &mesh->bindPose);  break;
-		case GeometryChunkTypes::BindPoseInv:		ReadRigPose(file, &mesh->inverseBindPose);  break;
-		case GeometryChunkTypes::SubMeshes: 		ReadSubMeshes(file, numMeshes, mesh->meshLayers); break;
-		case GeometryChunkTypes::SubMeshNames: 		ReadSubMeshNames(file, numMeshes, mesh->layerNames); break;
+static const char		BINARY_MESH_MAGIC[4]	= { 'M', 'S', 'H', 'B' };
+static const uint32_t	BINARY_MESH_VERSION		= 1;
+static const uint64_t	BINARY_MESH_ALIGNMENT	= 16;
+
+struct BinaryMeshHeader {
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	numMeshes;
+	uint32_t	numVertices;
+	uint32_t	numIndices;
+	uint32_t	numChunks;
+	uint32_t	padding[2];
+};
+
+struct BinaryMeshChunk {
+	uint32_t	type;	//GeometryChunkTypes
+	uint32_t	count;	//Number of elements in the chunk
+	uint64_t	offset;	//From the start of the file
+	uint64_t	bytes;
+};
+
+struct BinaryChunkSource {
+	GeometryChunkTypes	type;
+	uint32_t			count;
+	const void*			data;
+	uint64_t			bytes;
+};
+
+static string PackStrings(const vector<string>& strings) {
+	string packed;
+	for (const string& s : strings) {
+		packed += s;
+		packed += '\0';
+	}
+	return packed;
+}
+
+static bool UnpackStrings(const char* data, uint64_t bytes, uint32_t count, vector<string>& into) {
+	const char* end = data + bytes;
+	for (uint32_t i = 0; i < count; ++i) {
+		const char* terminator = (const char*)memchr(data, '\0', end - data);
+		if (!terminator) {
+			return false;
 		}
+		into.emplace_back(data, terminator);
+		data = terminator + 1;
 	}
-	//Now that the data has been read, we can shove it into the actual Mesh object
+	return true;
+}
 
-	mesh->numVertices	= numVertices;
-	mesh->numIndices	= numIndices;
+//How many bytes each element of a chunk takes, or 0 for the packed name chunks
+static uint64_t GetBinaryElementSize(GeometryChunkTypes type) {
+	switch (type) {
+	case GeometryChunkTypes::VPositions:		return sizeof(Vector3);
+	case GeometryChunkTypes::VNormals:			return sizeof(Vector3);
+	case GeometryChunkTypes::VColors:			return sizeof(Vector4);
+	case GeometryChunkTypes::VTangents:			return sizeof(Vector4);
+	case GeometryChunkTypes::VTex0:				return sizeof(Vector2);
+	case GeometryChunkTypes::VWeightValues:		return sizeof(Vector4);
+	case GeometryChunkTypes::VWeightIndices:	return sizeof(int) * 4;
+	case GeometryChunkTypes::Indices:			return sizeof(unsigned int);
+	case GeometryChunkTypes::JointParents:		return sizeof(int);
+	case GeometryChunkTypes::BindPose:			return sizeof(Matrix4);
+	case GeometryChunkTypes::BindPoseInv:		return sizeof(Matrix4);
+	case GeometryChunkTypes::SubMeshes:			return sizeof(Mesh::SubMesh);
+	}
+	return 0;
+}
+
+string Mesh::GetBinaryFileName(const string& name) {
+	return name + "b";	//Foo.msh -> Foo.mshb
+}
+
+bool Mesh::SaveToBinaryFile(const string& name) const {
+	string jointNameData	= PackStrings(jointNames);
+	string layerNameData	= PackStrings(layerNames);
+	uint32_t jointCount		= (uint32_t)jointNames.size();
 
-	if (!readPositions.empty()) {
-		mesh->vertices = new Vector3[numVertices];
-		memcpy(mesh->vertices, readPositions.data(), numVertices * sizeof(Vector3));
+	vector<BinaryChunkSource> chunks;
+
+	auto AddChunk = [&](GeometryChunkTypes type, uint32_t count, const void* data, uint64_t elementSize) {
+		if (data && count > 0) {
+			chunks.push_back({ type, count, data, count * elementSize });
+		}
+	};
+
+	AddChunk(GeometryChunkTypes::VPositions,	numVertices, vertices,		sizeof(Vector3));
+	AddChunk(GeometryChunkTypes::VColors,		numVertices, colours,		sizeof(Vector4));
+	AddChunk(GeometryChunkTypes::VNormals,		numVertices, normals,		sizeof(Vector3));
+	AddChunk(GeometryChunkTypes::VTangents,		numVertices, tangents,		sizeof(Vector4));
+	AddChunk(GeometryChunkTypes::VTex0,			numVertices, textureCoords,	sizeof(Vector2));
+	AddChunk(GeometryChunkTypes::VWeightValues,	numVertices, weights,		sizeof(Vector4));
+	AddChunk(GeometryChunkTypes::VWeightIndices,numVertices, weightIndices,	sizeof(int) * 4);
+	AddChunk(GeometryChunkTypes::Indices,		numIndices,	 indices,		sizeof(unsigned int));
+
+	AddChunk(GeometryChunkTypes::JointNames,	jointCount, jointNameData.data(), 0);
+	AddChunk(GeometryChunkTypes::JointParents,	(uint32_t)jointParents.size(), jointParents.data(), sizeof(int));
+	AddChunk(GeometryChunkTypes::BindPose,		jointCount, bindPose,			sizeof(Matrix4));
+	AddChunk(GeometryChunkTypes::BindPoseInv,	jointCount, inverseBindPose,	sizeof(Matrix4));
+	AddChunk(GeometryChunkTypes::SubMeshes,		(uint32_t)meshLayers.size(), meshLayers.data(), sizeof(SubMesh));
+	AddChunk(GeometryChunkTypes::SubMeshNames,	(uint32_t)layerNames.size(), layerNameData.data(), 0);
+
+	for (BinaryChunkSource& c : chunks) {	//Name chunks are sized by their packed strings
+		if (c.type == GeometryChunkTypes::JointNames) {
+			c.bytes = jointNameData.size();
+		}
+		else if (c.type == GeometryChunkTypes::SubMeshNames) {
+			c.bytes = layerNameData.size();
+		}
 	}
 
-	if (!readColours.empty()) {
-		mesh->colours = new Vector4[numVertices];
-		memcpy(mesh->colours, readColours.data(), numVertices * sizeof(Vector4));
+	BinaryMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+	header.version		= BINARY_MESH_VERSION;
+	header.numMeshes	= (uint32_t)meshLayers.size();
+	header.numVertices	= numVertices;
+	header.numIndices	= numIndices;
+	header.numChunks	= (uint32_t)chunks.size();
+
+	vector<BinaryMeshChunk> table;
+	uint64_t offset = sizeof(BinaryMeshHeader) + chunks.size() * sizeof(BinaryMeshChunk);
+
+	for (const BinaryChunkSource& c : chunks) {
+		offset = (offset + BINARY_MESH_ALIGNMENT - 1) & ~(BINARY_MESH_ALIGNMENT - 1);
+		table.push_back({ (uint32_t)c.type, c.count, offset, c.bytes });
+		offset += c.bytes;
 	}
 
-	if (!readNormals.empty()) {
-		mesh->normals = new Vector3[numVertices];
-		memcpy(mesh->normals, readNormals.data(), numVertices * sizeof(Vector3));
+	//Written to a temporary file first, so nothing can load a half written
+	//copy, and a mesh still mapping the old one isn't truncated underneath it
+	static std::atomic<unsigned int> tempCount(0);
+	string finalPath	= MESHDIR + name;
+	string tempPath		= finalPath + ".tmp" + std::to_string(tempCount++);
+
+	std::ofstream file(tempPath, std::ios::binary);
+	if (!file) {
+		std::cout << "Can't write binary mesh file " << name << "!" << std::endl;
+		return false;
 	}
 
-	if (!readTangents.empty()) {
-		mesh->tangents = new Vector4[numVertices];
-		memcpy(mesh->tangents, readTangents.data(), numVertices * sizeof(Vector4));
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)table.data(), table.size() * sizeof(BinaryMeshChunk));
+
+	const char padding[BINARY_MESH_ALIGNMENT] = { 0 };
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		uint64_t position = (uint64_t)file.tellp();
+		file.write(padding, table[i].offset - position);
+		file.write((const char*)chunks[i].data, chunks[i].bytes);
 	}
+	file.close();
 
-	if (!readUVs.empty()) {
-		mesh->textureCoords = new Vector2[numVertices];
-		memcpy(mesh->textureCoords, readUVs.data(), numVertices * sizeof(Vector2));
+	if (!file.good()) {
+		std::cout << "Can't write binary mesh file " << name << "!" << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
 	}
-	if (!readIndices.empty()) {
-		mesh->indices = new unsigned int[numIndices];
-		memcpy(mesh->indices, readIndices.data(), numIndices * sizeof(unsigned int));
+	std::remove(finalPath.c_str());	//Windows won't rename over an existing file
+	if (std::rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+		std::cout << "Can't replace binary mesh file " << name << ", is it still in use?" << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
 	}
+	return true;
+}
+
+Mesh* Mesh::LoadBinaryMeshData(const string& name) {
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(MESHDIR + name);
 
-	if (!readWeights.empty()) {
-		mesh->weights = new Vector4[numVertices];
-		memcpy(mesh->weights, readWeights.data(), numVertices * sizeof(Vector4));
+	if (!file->IsValid()) {
+		return nullptr;
 	}
 
-	if (!readWeightIndices.empty()) {
-		mesh->weightIndices = new int[numVertices * 4];
-		memcpy(mesh->weightIndices, readWeightIndices.data(), numVertices * sizeof(int) * 4);
+	const char*		fileData = file->GetData();
+	const uint64_t	fileSize = file->GetSize();
+
+	const BinaryMeshHeader* header = (const BinaryMeshHeader*)fileData;
+
+	if (fileSize < sizeof(BinaryMeshHeader) || memcmp(header->magic, BINARY_MESH_MAGIC, sizeof(header->magic)) != 0) {
+		std::cout << "File " << name << " is not a binary MeshGeometry file!" << std::endl;
+		return nullptr;
 	}
 
-	mesh->BufferData();
+	if (header->version != BINARY_MESH_VERSION) {
+		std::cout << "Binary MeshGeometry file " << name << " has incompatible version!" << std::endl;
+		return nullptr;
+	}
+
+	if (sizeof(BinaryMeshHeader) + (uint64_t)header->numChunks * sizeof(BinaryMeshChunk) > fileSize) {
+		std::cout << "Binary MeshGeometry file " << name << " is truncated!" << std::endl;
+		return nullptr;
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->mappedFile	= file;
+	mesh->numVertices	= header->numVertices;
+	mesh->numIndices	= header->numIndices;
+
+	//Anything that doesn't add up means the file can't be trusted, and the
+	//text file it came from gets loaded instead
+	auto Reject = [&](const char* problem) {
+		std::cout << "Binary MeshGeometry file " << name << " " << problem << "!" << std::endl;
+		delete mesh;
+		return nullptr;
+	};
+
+	const BinaryMeshChunk* table = (const BinaryMeshChunk*)(fileData + sizeof(BinaryMeshHeader));
+
+	uint32_t jointChunkCounts[3] = { 0, 0, 0 };	//Parents, bind pose and inverse bind pose
+
+	for (uint32_t i = 0; i < header->numChunks; ++i) {
+		const BinaryMeshChunk& chunk = table[i];
 
+		if (chunk.offset > fileSize || chunk.bytes > fileSize - chunk.offset) {
+			return Reject("has a chunk outside of the file");
+		}
+		if (chunk.offset % BINARY_MESH_ALIGNMENT != 0) {
+			return Reject("has a misaligned chunk");
+		}
+		GeometryChunkTypes	type		= (GeometryChunkTypes)chunk.type;
+		uint64_t			elementSize	= GetBinaryElementSize(type);
+		if (elementSize && chunk.bytes != chunk.count * elementSize) {
+			return Reject("has a chunk whose size doesn't match its count");
+		}
+		bool isVertexChunk = elementSize && (uint32_t)type < (uint32_t)GeometryChunkTypes::Indices;
+		if ((isVertexChunk && chunk.count != header->numVertices) ||
+			(type == GeometryChunkTypes::Indices && chunk.count != header->numIndices)) {
+			return Reject("has a chunk whose count doesn't match its header");
+		}
+		char* data = file->GetData() + chunk.offset;
+
+		switch ((GeometryChunkTypes)chunk.type) {
+		case GeometryChunkTypes::VPositions:	mesh->vertices		= (Vector3*)data;	break;
+		case GeometryChunkTypes::VColors:		mesh->colours		= (Vector4*)data;	break;
+		case GeometryChunkTypes::VNormals:		mesh->normals		= (Vector3*)data;	break;
+		case GeometryChunkTypes::VTangents:		mesh->tangents		= (Vector4*)data;	break;
+		case GeometryChunkTypes::VTex0:			mesh->textureCoords = (Vector2*)data;	break;
+		case GeometryChunkTypes::Indices:		mesh->indices		= (unsigned int*)data; break;
+
+		case GeometryChunkTypes::VWeightValues:		mesh->weights		= (Vector4*)data;	break;
+		case GeometryChunkTypes::VWeightIndices:	mesh->weightIndices	= (int*)data;		break;
+		case GeometryChunkTypes::BindPose: {
+			mesh->bindPose		= (Matrix4*)data;
+			jointChunkCounts[1]	= chunk.count;
+		}break;
+		case GeometryChunkTypes::BindPoseInv: {
+			mesh->inverseBindPose	= (Matrix4*)data;
+			jointChunkCounts[2]		= chunk.count;
+		}break;
+
+		case GeometryChunkTypes::JointParents: {
+			const int* parents = (const int*)data;
+			mesh->jointParents.assign(parents, parents + chunk.count);
+			jointChunkCounts[0] = chunk.count;
+		}break;
+		case GeometryChunkTypes::SubMeshes: {
+			const SubMesh* layers = (const SubMesh*)data;
+			mesh->meshLayers.assign(layers, layers + chunk.count);
+		}break;
+		case GeometryChunkTypes::JointNames: {
+			if (!UnpackStrings(data, chunk.bytes, chunk.count, mesh->jointNames)) {
+				return Reject("has malformed joint names");
+			}
+		}break;
+		case GeometryChunkTypes::SubMeshNames: {
+			if (!UnpackStrings(data, chunk.bytes, chunk.count, mesh->layerNames)) {
+				return Reject("has malformed submesh names");
+			}
+		}break;
+		}
+	}
+	if ((mesh->numVertices && !mesh->vertices) || (mesh->numIndices && !mesh->indices)) {
+		return Reject("is missing its positions or indices");
+	}
+	if (!IndicesInRange(mesh->indices, mesh->numIndices, mesh->numVertices)) {
+		return Reject("has an index past its vertices");
+	}
+	//Joint arrays are read as long as there are joint names, so must all match them
+	for (uint32_t count : jointChunkCounts) {
+		if (count != 0 && count != mesh->jointNames.size()) {
+			return Reject("has joint chunks that don't match its joint names");
+		}
+	}
+	//Submeshes are ranges of indices, or of vertices if there aren't any
+	uint64_t drawable = mesh->numIndices ? mesh->numIndices : mesh->numVertices;
+	for (const SubMesh& m : mesh->meshLayers) {
+		if (m.start < 0 || m.count < 0 || (uint64_t)m.start + m.count > drawable) {
+			return Reject("has a submesh outside of its indices");
+		}
+	}
 	return mesh;
 }
 
+template<typename T> bool SameArray(const T* a, const T* b, size_t count) {
+	if (!a || !b) {
+		return a == b;
+	}
+	return memcmp(a, b, count * sizeof(T)) == 0;
+}
+
+bool Mesh::HasSameData(const Mesh& other) const {
+	if (numVertices != other.numVertices || numIndices != other.numIndices || type != other.type) {
+		return false;
+	}
+	if (jointNames != other.jointNames || jointParents != other.jointParents || layerNames != other.layerNames) {
+		return false;
+	}
+	if (meshLayers.size() != other.meshLayers.size() || !SameArray(meshLayers.data(), other.meshLayers.data(), meshLayers.size())) {
+		return false;
+	}
+	return	SameArray(vertices,			other.vertices,			numVertices) &&
+			SameArray(colours,			other.colours,			numVertices) &&
+			SameArray(textureCoords,	other.textureCoords,	numVertices) &&
+			SameArray(normals,			other.normals,			numVertices) &&
+			SameArray(tangents,			other.tangents,			numVertices) &&
+			SameArray(weights,			other.weights,			numVertices) &&
+			SameArray(weightIndices,	other.weightIndices,	numVertices * 4) &&
+			SameArray(indices,			other.indices,			numIndices) &&
+			SameArray(bindPose,			other.bindPose,			jointNames.size()) &&
+			SameArray(inverseBindPose,	other.inverseBindPose,	jointNames.size());
+}
+
 int Mesh::GetIndexForJoint(const std::string& name) const {
 	for (unsigned int i = 0; i < jointNames.size(); ++i) {
 		if (jointNames[i] == name) {
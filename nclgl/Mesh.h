@@ -21,6 +21,10 @@ _-_-_-_-_-_-_-""  ""
 #include "OGLRenderer.h"
 #include <vector>
 #include <string>
+#include <memory>
+
+class MappedFile;
+class InstanceBuffer;
 
 //A handy enumerator, to determine which member of the bufferObject array
 //holds which data
@@ -35,11 +39,50 @@ enum MeshBuffer {
 	WEIGHTINDEX_BUFFER,	//new this year, indices of weights
 
 	INDEX_BUFFER,
-	INSTANCE_TRANSFORM_BUFFER,
 
 	MAX_BUFFER
 };
 
+//Attribute slots for the per-instance data instanced draws read, after those
+//of the mesh's own buffers. The matrix takes up four slots, one per column.
+//They all come from the one vertex buffer binding, INSTANCE_BINDING.
+enum InstanceAttribute {
+	INSTANCE_MATRIX_ATTRIBUTE	= MAX_BUFFER,
+	INSTANCE_COLOUR_ATTRIBUTE	= INSTANCE_MATRIX_ATTRIBUTE + 4,
+	INSTANCE_BINDING			= INSTANCE_COLOUR_ATTRIBUTE + 1
+};
+
+//What instanced draws read for each instance. A mesh's own instances go through
+//the node's model matrix after their own, while batched nodes' instances hold
+//the whole of each node's model matrix.
+struct InstanceData {
+	Matrix4	modelMatrix;
+	Vector4	colour;
+};
+
+//How BufferData lays out vertex attributes on the GPU. Shaders see the same
+//attribute slots and types either way, as the packed formats are turned back
+//into floats (or ints, for joint indices) as the vertices are fetched.
+enum VertexLayout {
+	VERTEX_LAYOUT_SEPARATE,	//A VBO per attribute, all 32-bit values
+	VERTEX_LAYOUT_PACKED	//One interleaved VBO: 10-10-10-2 SNORM normals and
+							//tangents, half float UVs, UNORM8 colours, UNORM16
+							//weights and byte joint indices
+};
+
+//Options for LoadMeshData and LoadFromMeshFile. Normals and tangents stored in
+//the file are always used as they are - these only fill in missing ones.
+enum MeshLoadFlags {
+	MESH_LOAD_DEFAULT			= 0,
+	MESH_LOAD_GENERATE_NORMALS	= 1 << 0,
+	MESH_LOAD_GENERATE_TANGENTS	= 1 << 1,	//Needs texture coordinates
+	MESH_LOAD_CACHE_GENERATED	= 1 << 2,	//Save anything generated into the binary copy,
+											//so the next load reads it instead
+	MESH_LOAD_GENERATE_LODS		= 1 << 3,	//GenerateLods, once the mesh is optimised - so
+											//not by LoadMeshData, which doesn't optimise
+	MESH_LOAD_TANGENT_FRAMES	= MESH_LOAD_GENERATE_NORMALS | MESH_LOAD_GENERATE_TANGENTS | MESH_LOAD_CACHE_GENERATED
+};
+
 class Mesh	{
 public:	
 	struct SubMesh {
@@ -47,16 +90,45 @@ public:
 		int count;
 	};
 
+	//A lower detail version of every submesh, drawn from the same vertices
+	struct LodLevel {
+		std::vector<SubMesh>	layers;
+		unsigned int			triCount;
+		float					error;	//How far the surface may have moved, as a
+										//fraction of the mesh's radius
+	};
+
+	static const int DEFAULT_LOD_LEVELS = 4;
+
 	Mesh(void);
 	~Mesh(void);
 
 	void Draw();
-	void DrawSubMesh(int i);
-	void DrawSubMeshInstanced(int i);
+	void DrawSubMesh(int i, int lod = 0);
+	void DrawSubMeshInstanced(int i, int lod = 0);
+	//Draws a submesh once for each of instanceCount InstanceData entries in
+	//instanceBuffer, starting from firstInstance
+	void DrawSubMeshBatched(int i, int lod, GLuint instanceBuffer, GLuint firstInstance, GLuint instanceCount);
 
 	void DrawInstanced();
+	//Draws drawCount DrawElementsIndirectCommands from commandBuffer, starting
+	//from firstDraw, with their instances coming from instanceBuffer
+	void DrawIndirect(GLuint instanceBuffer, GLuint commandBuffer, int firstDraw, int drawCount);
+
+	static Mesh* LoadFromMeshFile(const std::string& name, int loadFlags = MESH_LOAD_DEFAULT);
 
-	static Mesh* LoadFromMeshFile(const std::string& name);
+	//Loading without touching OpenGL - call BufferData on the result once
+	//there's a context to upload to. LoadMeshData prefers an up to date
+	//binary copy of the file (see GetBinaryFileName) over the text version.
+	static Mesh* LoadMeshData(const std::string& name, int loadFlags = MESH_LOAD_DEFAULT);
+	static Mesh* LoadTextMeshData(const std::string& name, bool parallelDecode = true);
+	static Mesh* LoadBinaryMeshData(const std::string& name);
+
+	bool SaveToBinaryFile(const std::string& name) const;
+
+	//True if both meshes hold bit-identical geometry, skeletons and submeshes
+	bool HasSameData(const Mesh& other) const;
+	static std::string GetBinaryFileName(const std::string& name);
 
 	static Mesh* GeneratePoint();
 	static Mesh* GenerateTriangle();
@@ -88,10 +160,18 @@ public:
 		return (int)meshLayers.size(); 
 	}
 
-	void SetInstances(Vector3* instanceTransforms, int instances);
+	//Instances are drawn every time the mesh is, and can be set again every
+	//frame - each call writes to a fresh part of a persistently mapped buffer.
+	//Setting them before BufferData holds on to them until it's called.
+	void SetInstances(const InstanceData* instances, int count);
+	void SetInstances(const Vector3* instanceOffsets, int count);
+	unsigned int GetInstanceCount() const { return numInstances; }
+	const InstanceBuffer* GetInstanceBuffer() const { return instances; }
 
 
 	void GenerateNormals();
+	bool HasNormals() const		{ return normals != nullptr; }
+	bool HasTangents() const	{ return tangents != nullptr; }
 	bool GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int& b, unsigned int& c) const;
 	void GenerateTangents();
 	Vector4 GenerateTangent(int a, int b, int c);
@@ -100,10 +180,82 @@ public:
 	bool GetSubMesh(int i, const SubMesh* s) const;
 	bool GetSubMesh(const std::string& name, const SubMesh* s) const;
 
-protected:
+	unsigned int GetVertexCount() const { return numVertices; }
+	unsigned int GetIndexCount()  const { return numIndices; }
+
+	void			SetVertexLayout(VertexLayout l) { layout = l; }
+	VertexLayout	GetVertexLayout() const { return layout; }
+
+	//Bytes a single vertex takes up on the GPU in the given layout
+	unsigned int	GetVertexSize(VertexLayout l) const;
+
+	//Bytes BufferData will upload to the GPU
+	size_t	GetBufferDataSize() const;
+
+	//Reorders triangles (within each submesh) for the post-transform vertex
+	//cache, then vertices into the order they're drawn. Call before
+	//BufferData; meshes from LoadFromMeshFile have already had it done.
+	void	Optimise();
+
+	//Builds up to maxLevels LODs, each with about reduction times the
+	//triangles of the last, stopping early if the surface would move by more
+	//than maxError (as a fraction of the mesh's radius), or if simplifying
+	//stops getting anywhere. Call before BufferData.
+	void	GenerateLods(int maxLevels = DEFAULT_LOD_LEVELS, float reduction = 0.5f, float maxError = 0.05f);
+
+	//LOD 0 is the mesh itself, so there is always at least one
+	int				GetLodCount() const { return (int)lodLevels.size() + 1; }
+	unsigned int	GetLodTriCount(int lod) const;
+	float			GetLodError(int lod) const { return lod > 0 && lod < GetLodCount() ? lodLevels[lod - 1].error : 0.0f; }
+	//Every index of a LOD, across all of its submeshes, for anything that
+	//needs its triangles on the CPU. Sets count, and returns nullptr if the
+	//mesh has no indices.
+	const unsigned int*	GetLodIndexData(int lod, unsigned int& count) const;
+	//The indices submesh i draws at a LOD, or nullptr if there's no such submesh
+	const SubMesh*		GetDrawRange(int i, int lod) const;
+
+	//The lowest detail LOD whose error covers no more than maxPixelError
+	//pixels, when the mesh's radius covers screenRadius pixels
+	int		SelectLod(float screenRadius, float maxPixelError) const;
+
+	//Indices are uploaded as 16 bits wherever the vertex count allows
+	GLenum	GetIndexType() const { return UseShortIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+	GLuint	GetIndexSize() const { return UseShortIndices() ? sizeof(GLushort) : sizeof(GLuint); }
+
+	//Builds the interleaved vertices uploaded by the packed layout. This
+	//doesn't touch OpenGL, so a loading thread can do it ahead of BufferData.
+	void	PackVertexData();
+
+	const Vector3*		GetPositionData()	const { return vertices; }
+	const unsigned int*	GetIndexData()		const { return indices; }
+	bool				HasIndexBuffer()	const { return bufferObject[INDEX_BUFFER] != 0; }
+
+	//A sphere around every vertex, worked out by BufferData
+	const Vector3&	GetBoundingCentre() const { return boundingCentre; }
+	float			GetBoundingRadius() const { return boundingRadius; }
+
 	void	BufferData();
 
+protected:
+	//Arrays pointing into a memory-mapped binary file belong to the mapping
+	bool	OwnsData(const void* p) const;
+	//Copies anything still in the mapped file into arrays of our own, and
+	//lets go of the file, so that it can be overwritten
+	void	ReleaseMappedFile();
+	//Generates whatever the flags ask for that the file didn't have,
+	//returning whether anything was
+	bool	GenerateMissingFrames(int loadFlags);
+
+	void	BufferPackedData();
+	//Offsets of each attribute within a packed vertex, returning its stride
+	GLuint	GetPackedOffsets(GLuint offsets[MAX_BUFFER]) const;
+	bool	UseShortJointIndices() const { return GetJointCount() > 256; }
+	bool	UseShortIndices() const { return numVertices <= 65536; }
+	void	BindInstances(GLuint buffer);
+	void	GetBounds(Vector3& minBounds, Vector3& maxBounds) const;
+
 	GLuint	arrayObject;
+	bool	instanceFormatSet;	//Whether the VAO knows the InstanceData layout yet
 
 	GLuint	bufferObject[MAX_BUFFER];
 
@@ -124,7 +276,11 @@ protected:
 
 	unsigned int*	indices;
 
-	Vector3* instanceOffsets;
+	InstanceBuffer*	instances;
+	std::vector<InstanceData>	pendingInstances;	//Set before there was a VAO to draw them with
+
+	Vector3	boundingCentre;
+	float	boundingRadius;
 
 	Matrix4* bindPose;
 	Matrix4* inverseBindPose;
@@ -133,5 +289,15 @@ protected:
 	std::vector<int>			jointParents;
 	std::vector< SubMesh>		meshLayers;
 	std::vector<std::string>	layerNames;
+
+	std::shared_ptr<MappedFile>	mappedFile;
+
+	VertexLayout				layout;
+	std::vector<unsigned char>	packedVertices;
+
+	//Indices of every LOD, uploaded after the mesh's own, so LodLevel ranges
+	//start at numIndices
+	std::vector<LodLevel>		lodLevels;
+	std::vector<unsigned int>	lodIndices;
 };
 
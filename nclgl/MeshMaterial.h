@@ -9,6 +9,8 @@ using std::map;
 using std::string;
 using std::vector;
 
+class CachedTexture;
+
 class MeshMaterialEntry {
 public:
 	std::map<string, string> entries;
@@ -34,6 +36,9 @@ public:
 	std::vector<MeshMaterialEntry>	materialLayers;
 	std::vector<MeshMaterialEntry*> meshLayers;
 
+	//Keeps shared textures alive for as long as this material uses them
+	std::vector<std::shared_ptr<CachedTexture>> cachedTextures;
+
 protected:
 	
 };
@@ -0,0 +1,227 @@
+#include "MeshOptimiser.h"
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+/*
+Scoring from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Vertices
+score highly if they're near the front of a simulated LRU cache, or have few
+triangles left to draw - getting those out of the way early stops lone
+triangles being left behind, to be drawn later with no cache reuse. Each step
+draws the highest scoring triangle of those using a vertex in the cache.
+*/
+static const int	FORSYTH_CACHE_SIZE	= 32;
+static const float	CACHE_DECAY_POWER	= 1.5f;
+static const float	LAST_TRI_SCORE		= 0.75f;
+static const float	VALENCE_BOOST_SCALE	= 2.0f;
+static const float	VALENCE_BOOST_POWER	= 0.5f;
+static const int	MAX_VALENCE_TABLE	= 64;
+
+struct ScoreTables {
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[MAX_VALENCE_TABLE];
+
+	ScoreTables() {
+		for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+			if (i < 3) {
+				cache[i] = LAST_TRI_SCORE;	//Same score for all of the last triangle's vertices
+			}
+			else {
+				float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				cache[i] = powf(1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+		for (int i = 0; i < MAX_VALENCE_TABLE; ++i) {
+			valence[i] = i == 0 ? 0.0f : VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+		}
+	}
+
+	float VertexScore(int cachePosition, unsigned int remaining) const {
+		if (remaining == 0) {
+			return -1.0f;	//Nothing left to draw with it
+		}
+		float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+
+		if (remaining < MAX_VALENCE_TABLE) {
+			return score + valence[remaining];
+		}
+		return score + VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+	}
+};
+
+void MeshOptimiser::OptimiseVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount) {
+	static const ScoreTables tables;
+
+	unsigned int triCount = indexCount / 3;
+	if (triCount < 2) {
+		return;
+	}
+
+	//Triangles using each vertex, packed into one array. The first
+	//remaining[v] entries of a vertex's list are those not yet drawn.
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	std::vector<unsigned int> firstTri(vertexCount + 1, 0);
+	std::vector<unsigned int> vertexTris(triCount * 3);
+
+	for (unsigned int i = 0; i < triCount * 3; ++i) {
+		remaining[indices[i]]++;
+	}
+	for (unsigned int v = 0; v < vertexCount; ++v) {
+		firstTri[v + 1] = firstTri[v] + remaining[v];
+	}
+	{
+		std::vector<unsigned int> filled(vertexCount, 0);
+		for (unsigned int i = 0; i < triCount * 3; ++i) {
+			unsigned int v = indices[i];
+			vertexTris[firstTri[v] + filled[v]++] = i / 3;
+		}
+	}
+
+	std::vector<float>	vertexScore(vertexCount);
+	std::vector<float>	triScore(triCount, 0.0f);
+	std::vector<bool>	triDrawn(triCount, false);
+
+	for (unsigned int v = 0; v < vertexCount; ++v) {
+		vertexScore[v] = tables.VertexScore(-1, remaining[v]);
+	}
+	for (unsigned int i = 0; i < triCount * 3; ++i) {
+		triScore[i / 3] += vertexScore[indices[i]];
+	}
+
+	unsigned int bestTri = 0;
+	for (unsigned int t = 1; t < triCount; ++t) {
+		if (triScore[t] > triScore[bestTri]) {
+			bestTri = t;
+		}
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(triCount * 3);
+
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	unsigned int nextUndrawn = 0;	//Fallback when nothing in the cache has triangles left
+
+	for (unsigned int drawn = 0; drawn < triCount; ++drawn) {
+		if (bestTri == UINT_MAX) {
+			while (triDrawn[nextUndrawn]) {
+				nextUndrawn++;
+			}
+			bestTri = nextUndrawn;
+		}
+		const unsigned int* tri = &indices[bestTri * 3];
+		triDrawn[bestTri] = true;
+
+		newCache.clear();
+		for (int i = 0; i < 3; ++i) {
+			unsigned int v = tri[i];
+			output.push_back(v);
+
+			unsigned int* list = &vertexTris[firstTri[v]];
+			for (unsigned int j = 0; j < remaining[v]; ++j) {
+				if (list[j] == bestTri) {
+					list[j] = list[remaining[v] - 1];
+					list[remaining[v] - 1] = bestTri;
+					break;
+				}
+			}
+			remaining[v]--;
+
+			if (i == 0 || (v != tri[0] && (i == 1 || v != tri[1]))) {
+				newCache.push_back(v);
+			}
+		}
+		for (unsigned int v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		//Rescore everything that was or is now in the cache, and find the
+		//best triangle that uses any of them
+		bestTri = UINT_MAX;
+		float bestScore = -1.0f;
+
+		for (size_t i = 0; i < newCache.size(); ++i) {
+			unsigned int v = newCache[i];
+			int position = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+
+			float score = tables.VertexScore(position, remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			const unsigned int* list = &vertexTris[firstTri[v]];
+			for (unsigned int j = 0; j < remaining[v]; ++j) {
+				unsigned int t = list[j];
+				triScore[t] += delta;
+
+				if (triScore[t] > bestScore) {
+					bestScore	= triScore[t];
+					bestTri		= t;
+				}
+			}
+		}
+		if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+	}
+
+	//The scoring models an LRU cache, which on meshes that were already well
+	//ordered can come out slightly worse on a real FIFO one
+	CacheStats before	= SimulateVertexCache(indices, triCount * 3, vertexCount);
+	CacheStats after	= SimulateVertexCache(output.data(), triCount * 3, vertexCount);
+
+	if (after.acmr < before.acmr) {
+		std::copy(output.begin(), output.end(), indices);
+	}
+}
+
+void MeshOptimiser::OptimiseVertexFetch(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, std::vector<unsigned int>& remap) {
+	remap.assign(vertexCount, UINT_MAX);
+	unsigned int next = 0;
+
+	for (unsigned int i = 0; i < indexCount; ++i) {
+		unsigned int& v = indices[i];
+		if (remap[v] == UINT_MAX) {
+			remap[v] = next++;
+		}
+		v = remap[v];
+	}
+	for (unsigned int v = 0; v < vertexCount; ++v) {
+		if (remap[v] == UINT_MAX) {
+			remap[v] = next++;
+		}
+	}
+}
+
+/*
+A FIFO cache, as GPUs use in practice. Each vertex remembers the miss count
+at which it was last transformed, so it's still cached if fewer than
+cacheSize misses have happened since.
+*/
+MeshOptimiser::CacheStats MeshOptimiser::SimulateVertexCache(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+	unsigned int cacheSize) {
+	std::vector<unsigned int> transformedAt(vertexCount, 0);
+	unsigned int misses	= 0;
+	unsigned int used	= 0;
+
+	for (unsigned int i = 0; i < indexCount; ++i) {
+		unsigned int v = indices[i];
+
+		if (transformedAt[v] == 0) {
+			used++;
+		}
+		if (transformedAt[v] == 0 || misses - transformedAt[v] + 1 > cacheSize) {
+			misses++;
+			transformedAt[v] = misses;
+		}
+	}
+	CacheStats stats;
+	stats.acmr = indexCount >= 3 ? (float)misses / (indexCount / 3) : 0.0f;
+	stats.atvr = used > 0 ? (float)misses / used : 0.0f;
+	return stats;
+}
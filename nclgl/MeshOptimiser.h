@@ -0,0 +1,55 @@
+/******************************************************************************
+Class:MeshOptimiser
+Implements:
+Description:Reorders indexed triangle lists so the GPU does less work drawing
+them. Triangles are sorted so that vertices are reused while still in the
+post-transform cache (Tom Forsyth's linear-speed vertex cache optimisation),
+then vertices are renumbered in the order they're first used, so fetching them
+walks through memory rather than jumping about.
+
+SimulateVertexCache models a FIFO post-transform cache, to measure the result:
+ACMR is vertices transformed per triangle (0.5 is ideal for a regular grid, 3
+is the worst case), and ATVR is vertices transformed per vertex in the mesh
+(1 is ideal).
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <vector>
+#include <cstddef>
+
+class MeshOptimiser {
+public:
+	struct CacheStats {
+		float acmr;
+		float atvr;
+	};
+
+	static const unsigned int DEFAULT_CACHE_SIZE = 32;
+
+	//Reorders the triangles of indices[0..indexCount) in place, unless that
+	//wouldn't improve the simulated ACMR
+	static void OptimiseVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount);
+
+	//Fills remap with the new position of every vertex, in order of first use
+	//by the indices, which are rewritten to match. Vertices that are never
+	//used go on the end, in their original order.
+	static void OptimiseVertexFetch(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, std::vector<unsigned int>& remap);
+
+	static CacheStats SimulateVertexCache(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+		unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+	//Moves every element of an attribute array to its remapped position
+	template<typename T>
+	static void RemapVertices(T* data, const std::vector<unsigned int>& remap, unsigned int elementsPerVertex = 1) {
+		if (!data) {
+			return;
+		}
+		std::vector<T> original(data, data + remap.size() * elementsPerVertex);
+
+		for (std::size_t i = 0; i < remap.size(); ++i) {
+			for (unsigned int j = 0; j < elementsPerVertex; ++j) {
+				data[remap[i] * elementsPerVertex + j] = original[i * elementsPerVertex + j];
+			}
+		}
+	}
+};
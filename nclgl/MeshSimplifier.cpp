@@ -0,0 +1,323 @@
+#include "MeshSimplifier.h"
+#include "Vector3.h"
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <cstdint>
+#include <climits>
+
+/*
+The sum of squared distances to a set of planes, each weighted by the area of
+the triangle it came from. Dividing by the total weight gives the mean squared
+distance, so the error doesn't grow just because a vertex has many triangles.
+*/
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	void AddPlane(double nx, double ny, double nz, double d, double w) {
+		a00 += w * nx * nx;	a01 += w * nx * ny;	a02 += w * nx * nz;
+		a11 += w * ny * ny;	a12 += w * ny * nz;	a22 += w * nz * nz;
+		b0	+= w * nx * d;	b1	+= w * ny * d;	b2	+= w * nz * d;
+		c	+= w * d * d;
+		weight += w;
+	}
+
+	void Add(const Quadric& q) {
+		a00 += q.a00;	a01 += q.a01;	a02 += q.a02;
+		a11 += q.a11;	a12 += q.a12;	a22 += q.a22;
+		b0	+= q.b0;	b1	+= q.b1;	b2	+= q.b2;
+		c	+= q.c;
+		weight += q.weight;
+	}
+
+	double MeanSquaredError(const Vector3& p) const {
+		double x = p.x;
+		double y = p.y;
+		double z = p.z;
+		double e = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+struct Collapse {
+	double			cost;
+	unsigned int	from;
+	unsigned int	to;
+
+	bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+//Collapses that turn a triangle further than this (about 85 degrees) are
+//taken to have folded it over, and aren't made
+static const double MIN_NORMAL_COSINE = 0.1;
+
+static Vector3 TriangleNormal(const Vector3& a, const Vector3& b, const Vector3& c) {
+	return Vector3::Cross(b - a, c - a);
+}
+
+/*
+Vertices at the same position (split by a texture seam, or by a change in
+normal) are treated as one point of the surface: they share a quadric, and
+move together - a seam vertex can only be collapsed if every copy of it has an
+edge to a copy of the target, which keeps the seam joined up.
+*/
+float MeshSimplifier::Simplify(const Vector3* positions, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount,
+	unsigned int targetIndexCount, float maxError, std::vector<unsigned int>& result) {
+	unsigned int triCount = indexCount / 3;
+	result.assign(indices, indices + triCount * 3);
+
+	if (triCount * 3 <= targetIndexCount) {
+		return 0.0f;
+	}
+	std::vector<unsigned int>& tris = result;
+
+	//Each used vertex's position, as the lowest numbered vertex there, and a
+	//ring through every vertex at the same position
+	std::vector<unsigned int> used;
+	{
+		std::vector<bool> isUsed(vertexCount, false);
+		for (unsigned int v : tris) {
+			if (!isUsed[v]) {
+				isUsed[v] = true;
+				used.push_back(v);
+			}
+		}
+	}
+	std::sort(used.begin(), used.end(), [&](unsigned int a, unsigned int b) {
+		const Vector3& pa = positions[a];
+		const Vector3& pb = positions[b];
+		if (pa.x != pb.x) { return pa.x < pb.x; }
+		if (pa.y != pb.y) { return pa.y < pb.y; }
+		if (pa.z != pb.z) { return pa.z < pb.z; }
+		return a < b;
+	});
+	std::vector<unsigned int> point(vertexCount);
+	std::vector<unsigned int> nextCopy(vertexCount);
+
+	for (size_t i = 0; i < used.size();) {
+		size_t j = i;
+		while (j < used.size() && positions[used[j]] == positions[used[i]]) {
+			++j;
+		}
+		for (size_t k = i; k < j; ++k) {
+			point[used[k]]		= used[i];
+			nextCopy[used[k]]	= used[k + 1 < j ? k + 1 : i];
+		}
+		i = j;
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);	//By point
+	std::vector<std::vector<unsigned int>> vertexTris(vertexCount);
+
+	for (unsigned int t = 0; t < triCount; ++t) {
+		const unsigned int* tri = &tris[t * 3];
+		Vector3 normal	= TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+		float	area	= normal.Length();	//Twice the area really, but only the ratios matter
+
+		if (area > 0.0f) {
+			normal = normal / area;
+			double d = -Vector3::Dot(normal, positions[tri[0]]);
+
+			for (int i = 0; i < 3; ++i) {
+				quadrics[point[tri[i]]].AddPlane(normal.x, normal.y, normal.z, d, area);
+			}
+		}
+		for (int i = 0; i < 3; ++i) {
+			vertexTris[tri[i]].push_back(t);
+		}
+	}
+
+	//Every edge between two points, smaller first. Anything that isn't used by
+	//exactly two triangles is an outline (or worse), so stays where it is.
+	std::vector<uint64_t> edges;
+	edges.reserve(triCount * 3);
+	for (unsigned int t = 0; t < triCount; ++t) {
+		for (int i = 0; i < 3; ++i) {
+			uint64_t a = point[tris[t * 3 + i]];
+			uint64_t b = point[tris[t * 3 + (i + 1) % 3]];
+			if (a != b) {
+				edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+			}
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> locked(vertexCount, false);	//By point
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i]) {
+			++j;
+		}
+		if (j - i != 2) {
+			locked[(unsigned int)(edges[i] >> 32)]			= true;
+			locked[(unsigned int)(edges[i] & 0xFFFFFFFF)]	= true;
+		}
+		i = j;
+	}
+	edges.clear();
+	edges.shrink_to_fit();
+
+	auto CollapseCost = [&](unsigned int from, unsigned int to) {
+		Quadric q = quadrics[point[from]];
+		q.Add(quadrics[point[to]]);
+		return q.MeanSquaredError(positions[to]);
+	};
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	auto PushCollapse = [&](unsigned int from, unsigned int to) {
+		if (!locked[point[from]] && point[from] != point[to]) {
+			queue.push({ CollapseCost(from, to), from, to });
+		}
+	};
+
+	for (unsigned int t = 0; t < triCount; ++t) {
+		for (int i = 0; i < 3; ++i) {
+			PushCollapse(tris[t * 3 + i], tris[t * 3 + (i + 1) % 3]);
+			PushCollapse(tris[t * 3 + (i + 1) % 3], tris[t * 3 + i]);
+		}
+	}
+
+	std::vector<bool>	removedVertex(vertexCount, false);
+	std::vector<bool>	removedTri(triCount, false);
+	unsigned int		liveTris	= triCount;
+	double				maxCost		= (double)maxError * maxError;
+	double				reached		= 0.0;
+
+	//Each copy of the point being collapsed, paired with the copy of the
+	//target it shares an edge with
+	std::vector<std::pair<unsigned int, unsigned int>> moves;
+
+	//A collapse is only made if every copy of from has an edge to a copy of
+	//to, and none of the triangles that move would be flipped over by it
+	auto CanCollapse = [&](unsigned int from, unsigned int to) {
+		moves.clear();
+		unsigned int target = point[to];
+		unsigned int copy	= from;
+
+		do {
+			unsigned int joinedTo = UINT_MAX;
+
+			for (unsigned int t : vertexTris[copy]) {
+				if (removedTri[t]) {
+					continue;
+				}
+				const unsigned int* tri = &tris[t * 3];
+				int shared = -1;
+				for (int i = 0; i < 3; ++i) {
+					if (point[tri[i]] == target) {
+						shared = i;
+					}
+				}
+				if (shared >= 0) {
+					joinedTo = tri[shared];
+					continue;
+				}
+				Vector3 moved[3];
+				for (int i = 0; i < 3; ++i) {
+					moved[i] = positions[tri[i] == copy ? to : tri[i]];
+				}
+				Vector3 before	= TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+				Vector3 after	= TriangleNormal(moved[0], moved[1], moved[2]);
+
+				if (Vector3::Dot(before, after) <= MIN_NORMAL_COSINE * before.Length() * after.Length()) {
+					return false;
+				}
+			}
+			if (joinedTo == UINT_MAX) {
+				return false;
+			}
+			moves.push_back(std::make_pair(copy, joinedTo));
+			copy = nextCopy[copy];
+		} while (copy != from);
+
+		return true;
+	};
+
+	while (liveTris * 3 > targetIndexCount && !queue.empty()) {
+		Collapse c = queue.top();
+		queue.pop();
+
+		if (removedVertex[c.from] || removedVertex[c.to]) {
+			continue;
+		}
+		//Quadrics only grow as vertices merge, so a queued cost may be out of
+		//date - if it has gone up, requeue it rather than jump the queue
+		double cost = CollapseCost(c.from, c.to);
+		if (cost > c.cost * 1.0001) {
+			queue.push({ cost, c.from, c.to });
+			continue;
+		}
+		if (cost > maxCost) {
+			break;
+		}
+		if (!CanCollapse(c.from, c.to)) {
+			continue;
+		}
+		reached = std::max(reached, cost);
+
+		unsigned int target = point[c.to];
+		quadrics[target].Add(quadrics[point[c.from]]);
+
+		for (const auto& move : moves) {
+			unsigned int from	= move.first;
+			unsigned int to		= move.second;
+			removedVertex[from]	= true;
+
+			std::vector<unsigned int>& toTris = vertexTris[to];
+			for (unsigned int t : vertexTris[from]) {
+				if (removedTri[t]) {
+					continue;
+				}
+				unsigned int* tri = &tris[t * 3];
+				if (point[tri[0]] == target || point[tri[1]] == target || point[tri[2]] == target) {
+					removedTri[t] = true;
+					liveTris--;
+					continue;
+				}
+				for (int i = 0; i < 3; ++i) {
+					if (tri[i] == from) {
+						tri[i] = to;
+					}
+				}
+				toTris.push_back(t);
+			}
+			vertexTris[from].clear();
+			vertexTris[from].shrink_to_fit();
+		}
+
+		//Everything around the merged point now costs something different
+		unsigned int copy = c.to;
+		do {
+			std::vector<unsigned int>& copyTris = vertexTris[copy];
+			copyTris.erase(std::remove_if(copyTris.begin(), copyTris.end(), [&](unsigned int t) { return removedTri[t]; }), copyTris.end());
+
+			for (unsigned int t : copyTris) {
+				for (int i = 0; i < 3; ++i) {
+					unsigned int v = tris[t * 3 + i];
+					if (v != copy) {
+						PushCollapse(v, copy);
+						PushCollapse(copy, v);
+					}
+				}
+			}
+			copy = nextCopy[copy];
+		} while (copy != c.to);
+	}
+
+	unsigned int out = 0;
+	for (unsigned int t = 0; t < triCount; ++t) {
+		if (!removedTri[t]) {
+			for (int i = 0; i < 3; ++i) {
+				tris[out++] = tris[t * 3 + i];
+			}
+		}
+	}
+	tris.resize(out);
+	return (float)sqrt(reached);
+}
@@ -0,0 +1,30 @@
+/******************************************************************************
+Class:MeshSimplifier
+Implements:
+Description:Cuts down the triangle count of indexed triangle lists, for
+building lower detail versions of meshes. Edges are collapsed cheapest first,
+with the cost of each measured by Garland and Heckbert's quadric error metric
+- roughly, the squared distance the surface moves by when the edge's first
+vertex is merged into its second.
+
+A vertex is only ever merged into another that already exists, so the result
+is a new list of indices into the same vertex array, and can be drawn from the
+same vertex buffer as the original. Vertices on an open edge are never moved,
+which keeps the outline of each list intact - including where a texture seam
+or a submesh boundary has split the vertices.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <vector>
+
+class Vector3;
+
+class MeshSimplifier {
+public:
+	//Collapses edges of indices[0..indexCount) until there are no more than
+	//targetIndexCount indices left, or the next collapse would move the
+	//surface further than maxError. Returns how far it has moved, in the same
+	//units as the positions.
+	static float Simplify(const Vector3* positions, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount,
+		unsigned int targetIndexCount, float maxError, std::vector<unsigned int>& result);
+};
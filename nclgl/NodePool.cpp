@@ -0,0 +1,97 @@
+#include "NodePool.h"
+#include <algorithm>
+#include <new>
+
+NodePool::NodePool(size_t objectSize, size_t blocksPerChunk) {
+	this->objectSize		= objectSize;
+	this->blocksPerChunk	= std::max(blocksPerChunk, (size_t)1);
+	//Keeps every header, and so every object after it, 16 byte aligned
+	blockSize	= sizeof(BlockHeader) + (objectSize + 15) / 16 * 16;
+	freeList	= nullptr;
+	count		= 0;
+}
+
+NodePool::~NodePool(void) {
+	for (char* c : chunks) {
+		::operator delete(c);
+	}
+}
+
+NodePool::BlockHeader* NodePool::GetBlock(size_t index) const {
+	return (BlockHeader*)(chunks[index / blocksPerChunk] + (index % blocksPerChunk) * blockSize);
+}
+
+//Blocks go on the free list backwards, so they're handed out in order
+void NodePool::AddChunk() {
+	if ((chunks.size() + 1) * blocksPerChunk > INDEX_MASK) {
+		throw std::bad_alloc();
+	}
+	chunks.push_back((char*)::operator new(blockSize * blocksPerChunk));
+
+	size_t first = (chunks.size() - 1) * blocksPerChunk;
+	for (size_t i = blocksPerChunk; i-- > 0;) {
+		BlockHeader* b	= GetBlock(first + i);
+		b->index		= (uint32_t)(first + i);
+		b->generation	= 0;
+		b->inUse		= false;
+		b->nextFree		= freeList;
+		freeList		= b;
+	}
+}
+
+void* NodePool::Allocate() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!freeList) {
+		AddChunk();
+	}
+	BlockHeader* b	= freeList;
+	freeList		= b->nextFree;
+	b->inUse		= true;
+	count++;
+	return b + 1;
+}
+
+void NodePool::Free(void* object) {
+	if (!object) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	BlockHeader* b	= (BlockHeader*)object - 1;
+	b->inUse		= false;
+	b->generation	= (b->generation + 1) & (0xFFFFFFFF >> INDEX_BITS);
+	b->nextFree		= freeList;
+	freeList		= b;
+	count--;
+}
+
+bool NodePool::Owns(const void* object) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	const char* p = (const char*)object;
+	for (const char* c : chunks) {
+		if (p >= c && p < c + blockSize * blocksPerChunk) {
+			return true;
+		}
+	}
+	return false;
+}
+
+NodePool::Handle NodePool::GetHandle(const void* object) const {
+	if (!object || !Owns(object)) {
+		return INVALID_HANDLE;
+	}
+	const BlockHeader* b = (const BlockHeader*)object - 1;
+	return b->generation << INDEX_BITS | b->index;
+}
+
+void* NodePool::Get(Handle h) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t index = h & INDEX_MASK;
+	if (h == INVALID_HANDLE || index >= chunks.size() * blocksPerChunk) {
+		return nullptr;
+	}
+	BlockHeader* b = GetBlock(index);
+	if (!b->inUse || b->generation != h >> INDEX_BITS) {
+		return nullptr;
+	}
+	return b + 1;
+}
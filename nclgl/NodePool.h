@@ -0,0 +1,72 @@
+/******************************************************************************
+Class:NodePool
+Implements:
+Description:Hands out fixed size blocks of memory for objects that are made and
+destroyed one at a time, like SceneNodes, from chunks of many blocks at once -
+so they're packed together in memory, rather than scattered over the heap, and
+making one is just taking a block off a free list.
+
+Chunks are never moved or given back while the pool lives, so every object
+stays where it was made. Each block is also known by a Handle, which goes stale
+once the object in it is freed: Get returns nullptr for it from then on, even
+after the block is reused, as each reuse bumps a generation count kept in the
+handle's top bits.
+
+Any thread can allocate and free at once.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+class NodePool {
+public:
+	typedef uint32_t Handle;
+
+	static const Handle	INVALID_HANDLE		= 0xFFFFFFFF;
+	static const size_t	DEFAULT_CHUNK_SIZE	= 256;	//Blocks per chunk
+
+	NodePool(size_t objectSize, size_t blocksPerChunk = DEFAULT_CHUNK_SIZE);
+	~NodePool(void);
+
+	//Memory for one object, of no more than GetObjectSize bytes
+	void*	Allocate();
+	void	Free(void* object);
+
+	//Whether an object's memory came from this pool at all
+	bool	Owns(const void* object) const;
+
+	Handle	GetHandle(const void* object) const;
+	//The object a handle refers to, or nullptr if it has been freed
+	void*	Get(Handle h) const;
+
+	size_t	GetObjectSize() const	{ return objectSize; }
+	size_t	GetCount() const		{ return count; }
+	size_t	GetCapacity() const		{ return chunks.size() * blocksPerChunk; }
+	size_t	GetChunkCount() const	{ return chunks.size(); }
+
+protected:
+	static const int		INDEX_BITS	= 24;
+	static const uint32_t	INDEX_MASK	= (1u << INDEX_BITS) - 1;
+
+	//Comes before each object, keeping it 16 byte aligned
+	struct alignas(16) BlockHeader {
+		uint32_t	index;
+		uint32_t	generation;
+		bool		inUse;
+		BlockHeader* nextFree;
+	};
+
+	BlockHeader*	GetBlock(size_t index) const;
+	void			AddChunk();
+
+	size_t					objectSize;
+	size_t					blockSize;
+	size_t					blocksPerChunk;
+	std::vector<char*>		chunks;
+	BlockHeader*			freeList;
+	size_t					count;
+	mutable std::mutex		mutex;
+};
@@ -15,7 +15,9 @@ _-_-_-_-_-_-_-""  ""
 #include "OGLRenderer.h"
 #include "Shader.h"
 #include "Light.h"
+#include "UniformRing.h"
 #include <algorithm>
+#include <cstring>
 
 using std::string;
 
@@ -34,8 +36,12 @@ Creates an OpenGL 3.2 CORE PROFILE rendering context. Sets itself
 as the current renderer of the passed 'parent' Window. Not the best
 way to do it - but it kept the Tutorial code down to a minimum!
 */
-OGLRenderer::OGLRenderer(Window &window)	{
+OGLRenderer::OGLRenderer(Window &window) : glState(GLStateCache::GetSharedCache())	{
 	init					= false;
+	uniformRing				= nullptr;
+	currentShader			= nullptr;
+	frameUniformBuffer		= 0;
+	memset(&frameUniforms, 0, sizeof(frameUniforms));
 	HWND windowHandle = window.GetHandle();
 
 	// Did We Get A Device Context?
@@ -158,28 +164,23 @@ void OGLRenderer::SetTextureRepeating(GLuint target, bool repeating) {
 }
 
 void OGLRenderer::SetShaderLight(const Light& l) {
-	glUniform3fv(
-		glGetUniformLocation(currentShader->GetProgram(), "lightPos"),
-		1,
-		(float*)&l.GetPosition()
-	);
-
-	glUniform4fv(
-		glGetUniformLocation(currentShader->GetProgram(), "lightColour"),
-		1,
-		(float*)&l.GetColour()
-	);
-
-	glUniform1f(
-		glGetUniformLocation(currentShader->GetProgram(), "lightRadius"),
-		l.GetRadius()
-	);
+	if (currentShader->UsesFrameUniforms()) {
+		frameUniforms.lightPos		= l.GetPosition();
+		frameUniforms.lightColour	= l.GetColour();
+		frameUniforms.lightRadius	= l.GetRadius();
+		UpdateFrameUniforms();
+		return;
+	}
+	currentShader->SetUniform("lightPos", l.GetPosition());
+	currentShader->SetUniform("lightColour", l.GetColour());
+	currentShader->SetUniform("lightRadius", l.GetRadius());
 }
 
 /*
 Destructor. Deletes the default shader, and the OpenGL rendering context.
 */
 OGLRenderer::~OGLRenderer(void)	{
+	delete uniformRing;
 	wglDeleteContext(renderContext);
 }
 
@@ -211,6 +212,14 @@ void OGLRenderer::SwapBuffers() {
 	//We call the windows OS SwapBuffers on win32. Wrapping it in this 
 	//function keeps all the tutorial code 100% cross-platform (kinda).
 	::SwapBuffers(deviceContext);
+
+	//The next region doesn't have this frame's blocks in it
+	if (uniformRing) {
+		uniformRing->NextFrame();
+		frameUniformBuffer = 0;
+	}
+	//Hot reloaded shaders take over once the driver has finished with them
+	Shader::UpdateReloads();
 }
 /*
 Used by some later tutorials when we want to have framerate-independent
@@ -234,18 +243,64 @@ matrix data. Sanity checks currentShader, so is always safe to
 call.
 */
 void OGLRenderer::UpdateShaderMatrices()	{
-	if(currentShader) {
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "modelMatrix")   ,	1,false, modelMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "viewMatrix")    ,	1,false, viewMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "projMatrix")    ,	1,false, projMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "textureMatrix") , 1,false, textureMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "shadowMatrix")  , 1,false, shadowMatrix.values);
+	if(!currentShader) {
+		return;
+	}
+	//The object block goes first, as writing it might grow the ring, which
+	//would need the frame block writing again
+	if (currentShader->UsesObjectUniforms()) {
+		ObjectUniforms object = { modelMatrix, textureMatrix };
+		GetUniformRing().Write(OBJECT_UNIFORM_BINDING, &object, sizeof(object));
+	}
+	if (currentShader->UsesFrameUniforms()) {
+		UpdateFrameUniforms();
+	}
+	if (!currentShader->UsesFrameUniforms() || !currentShader->UsesObjectUniforms()) {
+		currentShader->SetUniform("modelMatrix",	modelMatrix);
+		currentShader->SetUniform("viewMatrix",		viewMatrix);
+		currentShader->SetUniform("projMatrix",		projMatrix);
+		currentShader->SetUniform("textureMatrix",	textureMatrix);
+		currentShader->SetUniform("shadowMatrix",	shadowMatrix);
+	}
+}
+
+/*
+The view and projection usually only change between passes, and the light
+once a frame, so most draws find nothing to write - unless the ring has moved
+on to another region or grown, taking the last write with it. The camera's
+position comes from the view matrix, which is only ever a rotation and a
+translation, so its inverse is just the transposed rotation applied to the
+negated translation.
+*/
+void OGLRenderer::UpdateFrameUniforms() {
+	const float* v = viewMatrix.values;
+	frameUniforms.viewMatrix		= viewMatrix;
+	frameUniforms.projMatrix		= projMatrix;
+	frameUniforms.shadowMatrix		= shadowMatrix;
+	frameUniforms.cameraPosition	= Vector3(
+		-(v[0] * v[12] + v[1] * v[13] + v[2] * v[14]),
+		-(v[4] * v[12] + v[5] * v[13] + v[6] * v[14]),
+		-(v[8] * v[12] + v[9] * v[13] + v[10] * v[14]));
+
+	if (frameUniformBuffer == GetUniformRing().GetBuffer() &&
+		memcmp(&frameUniforms, &writtenFrameUniforms, sizeof(FrameUniforms)) == 0) {
+		return;
+	}
+	uniformRing->Write(FRAME_UNIFORM_BINDING, &frameUniforms, sizeof(FrameUniforms));
+	writtenFrameUniforms	= frameUniforms;
+	frameUniformBuffer		= uniformRing->GetBuffer();
+}
+
+UniformRing& OGLRenderer::GetUniformRing() {
+	if (!uniformRing) {
+		uniformRing = new UniformRing();
 	}
+	return *uniformRing;
 }
 
 void OGLRenderer::BindShader(Shader*s) {
 	currentShader = s;
-	glUseProgram(s->GetProgram());
+	glState.UseProgram(s->GetProgram());
 }
 
 #ifdef OPENGL_DEBUGGING
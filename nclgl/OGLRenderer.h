@@ -35,6 +35,7 @@ _-_-_-_-_-_-_-""  ""
 #include "Window.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
 
 using std::vector;
 
@@ -44,6 +45,26 @@ extern const Matrix4 biasMatrix;
 
 class Shader;
 class Light;
+class UniformRing;
+
+//The same as the blocks in UniformBlocks.glsl, laid out as std140 has them
+struct FrameUniforms {
+	Matrix4	viewMatrix;
+	Matrix4	projMatrix;
+	Matrix4	shadowMatrix;
+	Vector3	cameraPosition;
+	float	lightRadius;
+	Vector3	lightPos;
+	float	padding;
+	Vector4	lightColour;
+};
+
+struct ObjectUniforms {
+	Matrix4	modelMatrix;
+	Matrix4	textureMatrix;
+};
+
+static_assert(sizeof(FrameUniforms) == 240 && sizeof(ObjectUniforms) == 128, "Uniform blocks must match their std140 layout");
 
 class OGLRenderer	{
 public:
@@ -77,12 +98,27 @@ protected:
 	Matrix4 textureMatrix;	//Texture matrix
 	Matrix4 shadowMatrix;
 
+	//Shaders that #include UniformBlocks.glsl get their matrices, camera and
+	//light from here, rather than from uniforms of their own. It's only made
+	//once such a shader is drawn with, so stays null in renderers that don't.
+	UniformRing*	uniformRing;
+
+	//Binds and toggles go through here, so the ones that change nothing are left out
+	GLStateCache&	glState;
+
 	int		width;			//Render area width (not quite the same as window width)
 	int		height;			//Render area height (not quite the same as window height)
 	bool	init;			//Did the renderer initialise properly?
 
 private:
+	//Writes the frame block again, if anything in it has changed
+	void	UpdateFrameUniforms();
+	UniformRing&	GetUniformRing();
+
 	Shader* currentShader;	
+	FrameUniforms	frameUniforms;		//As the next write will have them
+	FrameUniforms	writtenFrameUniforms;
+	GLuint			frameUniformBuffer;	//What they were written to, or 0 if they need writing again
 	HDC		deviceContext;	//...Device context?
 	HGLRC	renderContext;	//Permanent Rendering Context
 #ifdef _DEBUG
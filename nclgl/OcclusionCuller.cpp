@@ -0,0 +1,282 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+const int OcclusionCuller::DEFAULT_WIDTH;
+const int OcclusionCuller::DEFAULT_HEIGHT;
+
+OcclusionCuller::OcclusionCuller(int width, int height) {
+	this->width		= std::max((width + 3) & ~3, 4);
+	this->height	= std::max(height, 1);
+	trianglesDrawn	= 0;
+
+	//Each level is half the size of the last, rounding up, down to a single texel
+	int w = this->width;
+	int h = this->height;
+	while (true) {
+		Level l;
+		l.width		= w;
+		l.height	= h;
+		l.depths.assign((size_t)w * h, 0.0f);
+		levels.push_back(l);
+		if (w == 1 && h == 1) {
+			break;
+		}
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+void OcclusionCuller::BeginFrame(const Matrix4& viewProj) {
+	this->viewProj = viewProj;
+	std::fill(levels[0].depths.begin(), levels[0].depths.end(), 0.0f);
+	trianglesDrawn = 0;
+}
+
+void OcclusionCuller::AddOccluder(const Matrix4& modelMatrix, const Vector3* positions, size_t vertexCount,
+	const unsigned int* indices, size_t indexCount) {
+	Matrix4 mvp = viewProj * modelMatrix;
+
+	clipPositions.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		clipPositions[i] = mvp * Vector4(positions[i].x, positions[i].y, positions[i].z, 1.0f);
+	}
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount) {
+			continue;
+		}
+		const Vector4& a = clipPositions[indices[i]];
+		const Vector4& b = clipPositions[indices[i + 1]];
+		const Vector4& c = clipPositions[indices[i + 2]];
+
+		//Entirely off one side of the screen
+		if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+			(a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w)) {
+			continue;
+		}
+		DrawClippedTriangle(a, b, c);
+	}
+}
+
+/*
+Only the near plane needs clipping against - everything else is handled by
+keeping the rasterizer to the screen. It's the same near plane Frustum uses.
+*/
+void OcclusionCuller::DrawClippedTriangle(const Vector4& a, const Vector4& b, const Vector4& c) {
+	const Vector4* in[3] = { &a, &b, &c };
+	float distance[3];
+	int inside = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		distance[i] = in[i]->z + in[i]->w;
+		inside += distance[i] >= 0.0f ? 1 : 0;
+	}
+	if (inside == 0) {
+		return;
+	}
+	if (inside == 3) {
+		if (a.w > 0.0f && b.w > 0.0f && c.w > 0.0f) {
+			DrawTriangle(ToScreen(a), ToScreen(b), ToScreen(c));
+		}
+		return;
+	}
+	//Cutting a corner off a triangle leaves at most four corners, kept in order
+	Vector4	clipped[4];
+	int		count = 0;
+	for (int i = 0; i < 3; ++i) {
+		int next = (i + 1) % 3;
+		if (distance[i] >= 0.0f) {
+			clipped[count++] = *in[i];
+		}
+		if ((distance[i] >= 0.0f) != (distance[next] >= 0.0f)) {
+			float t = distance[i] / (distance[i] - distance[next]);
+			clipped[count++] = *in[i] + (*in[next] - *in[i]) * t;
+		}
+	}
+	ScreenVertex screen[4];
+	for (int i = 0; i < count; ++i) {
+		if (clipped[i].w <= 0.0f) {
+			return;
+		}
+		screen[i] = ToScreen(clipped[i]);
+	}
+	for (int i = 2; i < count; ++i) {
+		DrawTriangle(screen[0], screen[i - 1], screen[i]);
+	}
+}
+
+OcclusionCuller::ScreenVertex OcclusionCuller::ToScreen(const Vector4& clip) const {
+	ScreenVertex s;
+	s.invW	= 1.0f / clip.w;
+	s.x		= (clip.x * s.invW * 0.5f + 0.5f) * width;
+	s.y		= (clip.y * s.invW * 0.5f + 0.5f) * height;
+	return s;
+}
+
+/*
+Each edge function is positive on the inside of its edge, so a pixel centre is
+inside the triangle when all three are - and 1 / w is a plane across the
+screen, so it steps along with them. Rows are walked a block of four pixels at
+a time, each block being written back with the nearest of the old and new
+depths, wherever the triangle covers it.
+*/
+void OcclusionCuller::DrawTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c) {
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (!(area > 0.0f)) {
+		return; //Back facing, or too thin to cover anything
+	}
+	//Pixels whose centres could be inside, kept to the screen
+	float minX = std::max(std::min(a.x, std::min(b.x, c.x)) - 0.5f, 0.0f);
+	float maxX = std::min(std::max(a.x, std::max(b.x, c.x)) - 0.5f, (float)(width - 1));
+	float minY = std::max(std::min(a.y, std::min(b.y, c.y)) - 0.5f, 0.0f);
+	float maxY = std::min(std::max(a.y, std::max(b.y, c.y)) - 0.5f, (float)(height - 1));
+	if (minX > maxX || minY > maxY) {
+		return;
+	}
+	int startX	= (int)ceilf(minX) & ~3;
+	int endX	= (int)floorf(maxX);
+	int startY	= (int)ceilf(minY);
+	int endY	= (int)floorf(maxY);
+
+	//Edge functions E = A * x + B * y + C, for the edges opposite a, b and c
+	const ScreenVertex* v[3] = { &a, &b, &c };
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int e = 0; e < 3; ++e) {
+		const ScreenVertex& from	= *v[(e + 1) % 3];
+		const ScreenVertex& to		= *v[(e + 2) % 3];
+		edgeA[e] = from.y - to.y;
+		edgeB[e] = to.x - from.x;
+		edgeC[e] = -(edgeA[e] * from.x + edgeB[e] * from.y);
+	}
+	//Each edge function over the area is how much of its opposite corner to take
+	float invArea	= 1.0f / area;
+	float depthA	= (a.invW * edgeA[0] + b.invW * edgeA[1] + c.invW * edgeA[2]) * invArea;
+	float depthB	= (a.invW * edgeB[0] + b.invW * edgeB[1] + c.invW * edgeB[2]) * invArea;
+	float depthC	= (a.invW * edgeC[0] + b.invW * edgeC[1] + c.invW * edgeC[2]) * invArea;
+
+	__m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 zero			= _mm_setzero_ps();
+	__m128 columnX		= _mm_add_ps(_mm_set1_ps((float)startX), pixelOffsets);
+
+	__m128 stepA[3];
+	__m128 rowStart[3];
+	for (int e = 0; e < 3; ++e) {
+		stepA[e] = _mm_set1_ps(edgeA[e] * 4.0f);
+	}
+	__m128 depthStep = _mm_set1_ps(depthA * 4.0f);
+
+	float* depths = levels[0].depths.data();
+
+	for (int y = startY; y <= endY; ++y) {
+		float centreY = y + 0.5f;
+		for (int e = 0; e < 3; ++e) {
+			rowStart[e] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[e]), columnX), _mm_set1_ps(edgeB[e] * centreY + edgeC[e]));
+		}
+		__m128 e0		= rowStart[0];
+		__m128 e1		= rowStart[1];
+		__m128 e2		= rowStart[2];
+		__m128 depth	= _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), columnX), _mm_set1_ps(depthB * centreY + depthC));
+		float* row		= depths + (size_t)y * width;
+
+		for (int x = startX; x <= endX; x += 4) {
+			__m128 covered = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(covered)) {
+				__m128 old		= _mm_loadu_ps(row + x);
+				__m128 nearest	= _mm_max_ps(old, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearest), _mm_andnot_ps(covered, old)));
+			}
+			e0		= _mm_add_ps(e0, stepA[0]);
+			e1		= _mm_add_ps(e1, stepA[1]);
+			e2		= _mm_add_ps(e2, stepA[2]);
+			depth	= _mm_add_ps(depth, depthStep);
+		}
+	}
+	trianglesDrawn++;
+}
+
+void OcclusionCuller::EndFrame() {
+	for (size_t l = 1; l < levels.size(); ++l) {
+		const Level&	below	= levels[l - 1];
+		Level&			level	= levels[l];
+
+		for (int y = 0; y < level.height; ++y) {
+			const float* row0 = &below.depths[(size_t)(y * 2) * below.width];
+			const float* row1 = &below.depths[(size_t)std::min(y * 2 + 1, below.height - 1) * below.width];
+			float* out = &level.depths[(size_t)y * level.width];
+
+			for (int x = 0; x < level.width; ++x) {
+				int x0 = x * 2;
+				int x1 = std::min(x * 2 + 1, below.width - 1);
+				out[x] = std::min(std::min(row0[x0], row0[x1]), std::min(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+/*
+The nearest point of the sphere is found from how w changes across it, and its
+screen rectangle from the corners of the box around it. Then the level is
+picked where that rectangle covers no more than 2 by 2 texels, each of which
+already holds the farthest depth of all the pixels beneath it.
+*/
+bool OcclusionCuller::IsVisible(const Vector3& centre, float radius) const {
+	const float* m = viewProj.values;
+
+	Vector3 nearNormal(m[2] + m[3], m[6] + m[7], m[10] + m[11]);
+	if (Vector3::Dot(nearNormal, centre) + m[14] + m[15] - radius * nearNormal.Length() <= 0.0f) {
+		return true;
+	}
+	Vector3 wNormal(m[3], m[7], m[11]);
+	float nearestW = Vector3::Dot(wNormal, centre) + m[15] - radius * wNormal.Length();
+	if (nearestW <= 0.0f) {
+		return true;
+	}
+	float nearestDepth = 1.0f / nearestW;
+
+	float minX = (float)width;
+	float maxX = 0.0f;
+	float minY = (float)height;
+	float maxY = 0.0f;
+	//Moving along an axis moves the clip position along a column of the matrix
+	Vector4 clipCentre = viewProj * Vector4(centre.x, centre.y, centre.z, 1.0f);
+	Vector4 axes[3];
+	for (int a = 0; a < 3; ++a) {
+		axes[a] = Vector4(m[a * 4], m[a * 4 + 1], m[a * 4 + 2], m[a * 4 + 3]) * radius;
+	}
+	for (int i = 0; i < 8; ++i) {
+		Vector4 clip = clipCentre;
+		for (int a = 0; a < 3; ++a) {
+			clip = (i & (1 << a)) ? clip + axes[a] : clip - axes[a];
+		}
+		if (clip.w <= 0.0f) {
+			return true;
+		}
+		ScreenVertex s = ToScreen(clip);
+		minX = std::min(minX, s.x);
+		maxX = std::max(maxX, s.x);
+		minY = std::min(minY, s.y);
+		maxY = std::max(maxY, s.y);
+	}
+	if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) {
+		return true;
+	}
+	int x0 = (int)std::max(minX, 0.0f);
+	int x1 = (int)std::min(maxX, (float)(width - 1));
+	int y0 = (int)std::max(minY, 0.0f);
+	int y1 = (int)std::min(maxY, (float)(height - 1));
+
+	int l = 0;
+	while (l + 1 < (int)levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) {
+		l++;
+	}
+	const Level& level = levels[l];
+	for (int y = y0 >> l; y <= y1 >> l; ++y) {
+		for (int x = x0 >> l; x <= x1 >> l; ++x) {
+			if (level.depths[(size_t)y * level.width + x] <= nearestDepth) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+Class:OcclusionCuller
+Implements:
+Description:Software occlusion culling, done entirely on the CPU. A handful of
+big occluders are rasterized into a small depth buffer, four pixels at a time
+with SSE, and a hierarchical depth buffer is built from it - each level half
+the size of the one below, keeping the farthest depth of the texels it covers.
+A bounding sphere can then be tested against a few texels of whichever level
+its screen rectangle fits, rather than every pixel it covers.
+
+Depths are kept as 1 / w, which interpolates linearly across the screen and
+doesn't depend on the projection's depth range, so nearer is bigger and an
+empty buffer is 0. A sphere is only ever said to be hidden if every texel it
+could cover holds an occluder nearer than the nearest point of the sphere.
+
+Coverage is sampled at pixel centres, as the GPU does, so at the edges of an
+occluder the answer is only as good as the buffer's resolution.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Matrix4.h"
+#include "Vector3.h"
+#include "Vector4.h"
+#include <vector>
+
+class OcclusionCuller {
+public:
+	static const int DEFAULT_WIDTH	= 256;
+	static const int DEFAULT_HEIGHT	= 128;
+
+	//The width is rounded up to a whole number of 4 pixel blocks
+	OcclusionCuller(int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT);
+	~OcclusionCuller(void) {}
+
+	//Clears the depth buffer, ready for this frame's occluders
+	void	BeginFrame(const Matrix4& viewProj);
+
+	//Rasterizes the triangles of an occluder, culling back faces the same way
+	//as the GPU does - counter clockwise is the front
+	void	AddOccluder(const Matrix4& modelMatrix, const Vector3* positions, size_t vertexCount,
+				const unsigned int* indices, size_t indexCount);
+
+	//Builds the hierarchical depth buffer from the occluders. Call it once
+	//they've all been added, and before any tests.
+	void	EndFrame();
+
+	//False only if the sphere is definitely hidden behind the occluders.
+	//Spheres crossing the near plane, or off the screen, are always visible.
+	//Only reads the buffers, so any number of threads can test at once.
+	bool	IsVisible(const Vector3& centre, float radius) const;
+
+	int		GetWidth() const	{ return width; }
+	int		GetHeight() const	{ return height; }
+	int		GetLevelCount() const { return (int)levels.size(); }
+	const Matrix4&	GetViewProj() const { return viewProj; }
+
+	//Width and height of a level, and its depths - row by row, bottom first
+	int				GetLevelWidth(int level) const	{ return levels[level].width; }
+	int				GetLevelHeight(int level) const	{ return levels[level].height; }
+	const float*	GetDepths(int level) const		{ return levels[level].depths.data(); }
+
+	size_t	GetTrianglesDrawn() const { return trianglesDrawn; }
+
+protected:
+	struct Level {
+		int					width;
+		int					height;
+		std::vector<float>	depths;
+	};
+
+	//Screen position in pixels, and 1 / w
+	struct ScreenVertex {
+		float x;
+		float y;
+		float invW;
+	};
+
+	void	DrawClippedTriangle(const Vector4& a, const Vector4& b, const Vector4& c);
+	void	DrawTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c);
+	ScreenVertex ToScreen(const Vector4& clip) const;
+
+	int					width;
+	int					height;
+	Matrix4				viewProj;
+	std::vector<Level>	levels;	//levels[0] is the depth buffer itself
+	std::vector<Vector4> clipPositions;
+	size_t				trianglesDrawn;
+};
@@ -0,0 +1,152 @@
+#include "ProgramCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <windows.h>
+
+static const char		PROGRAM_BINARY_MAGIC[4]	= { 'G', 'L', 'P', 'B' };
+static const uint32_t	PROGRAM_BINARY_VERSION	= 1;
+
+struct ProgramBinaryHeader {
+	char		magic[4];
+	uint32_t	version;
+	uint64_t	key;
+	uint32_t	format;		//As glGetProgramBinary gave it
+	uint32_t	length;		//Bytes of binary following the header
+};
+
+//FNV-1a, 64 bit
+static uint64_t HashBytes(const char* data, size_t length, uint64_t hash = 14695981039346656037ull) {
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+ProgramCache& ProgramCache::GetSharedCache() {
+	static ProgramCache sharedCache;
+	return sharedCache;
+}
+
+ProgramCache::ProgramCache(const std::string& folder) {
+	this->folder		= folder;
+	driverQueried		= false;
+	hasBinaryFormats	= false;
+	enabled				= true;
+	stats				= {};
+}
+
+void ProgramCache::QueryDriver() {
+	if (driverQueried) {
+		return;
+	}
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum n : names) {
+		const char* s = (const char*)glGetString(n);
+		driver += s ? s : "";
+		driver += '\n';
+	}
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	hasBinaryFormats	= formats > 0;
+	driverQueried		= true;
+}
+
+bool ProgramCache::IsAvailable() {
+	QueryDriver();
+	return enabled && hasBinaryFormats;
+}
+
+//Each source ends with a 0 that source text can't have, so moving text from
+//the end of one stage to the start of the next still changes the key
+uint64_t ProgramCache::MakeKey(const std::string* sources, int count) {
+	QueryDriver();
+	uint64_t key = HashBytes(driver.c_str(), driver.size() + 1);
+	for (int i = 0; i < count; ++i) {
+		key = HashBytes(sources[i].c_str(), sources[i].size() + 1, key);
+	}
+	return key;
+}
+
+std::string ProgramCache::GetFileName(const std::string& name) const {
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)HashBytes(name.c_str(), name.size()));
+	return folder + hex + ".glprog";
+}
+
+bool ProgramCache::Load(GLuint program, const std::string& name, uint64_t key) {
+	if (!IsAvailable()) {
+		return false;
+	}
+	std::ifstream file(GetFileName(name), std::ios::binary);
+
+	ProgramBinaryHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header)) ||
+		memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != PROGRAM_BINARY_VERSION || header.key != key) {
+		stats.misses++;
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), header.length)) {
+		stats.misses++;
+		return false;
+	}
+	glProgramBinary(program, header.format, binary.data(), (GLsizei)header.length);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		stats.rejected++;
+		return false;
+	}
+	stats.hits++;
+	return true;
+}
+
+//Written to a temporary file first, so nothing can load a half written copy
+void ProgramCache::Save(GLuint program, const std::string& name, uint64_t key) {
+	if (!IsAvailable()) {
+		return;
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char>	binary(length);
+	GLenum				format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramBinaryHeader header;
+	memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+	header.version	= PROGRAM_BINARY_VERSION;
+	header.key		= key;
+	header.format	= format;
+	header.length	= (uint32_t)length;
+
+	CreateDirectoryA(folder.c_str(), NULL);	//Fails harmlessly if it's already there
+	std::string finalPath	= GetFileName(name);
+	std::string tempPath	= finalPath + ".tmp";
+
+	std::ofstream file(tempPath, std::ios::binary);
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), length);
+	file.close();
+
+	if (!file.good()) {
+		std::cout << "Can't write program binary for " << name << "!" << std::endl;
+		std::remove(tempPath.c_str());
+		return;
+	}
+	std::remove(finalPath.c_str());	//Windows won't rename over an existing file
+	if (std::rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+		std::cout << "Can't replace program binary for " << name << "!" << std::endl;
+		std::remove(tempPath.c_str());
+		return;
+	}
+	stats.saved++;
+}
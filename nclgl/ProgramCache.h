@@ -0,0 +1,66 @@
+/******************************************************************************
+Class:ProgramCache
+Implements:
+Description:Keeps linked shader programs on disk, as glGetProgramBinary gives
+them, so a later run can hand them straight back to GL with glProgramBinary
+rather than compiling and linking every stage from source again.
+
+Each program has a file of its own under the cache folder, named after the
+shader files it was made from. The file is only used if its key matches the
+one made from the program's source text and the GL vendor, renderer and
+version strings - so editing a shader, or updating the driver, means it's
+compiled again and the file overwritten. The driver can also turn a binary down
+even when the key matches, in which case it's compiled as well.
+
+Render thread only, as it needs the GL context.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "common.h"
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+
+class ProgramCache {
+public:
+	struct Stats {
+		size_t hits;		//Programs loaded from a binary
+		size_t misses;		//No file, or one made from other source or another driver
+		size_t rejected;	//Binaries the driver wouldn't take, despite the key matching
+		size_t saved;
+	};
+
+	static ProgramCache& GetSharedCache();
+
+	ProgramCache(const std::string& folder = SHADERDIR "ProgramCache/");
+	~ProgramCache(void) {}
+
+	//Made from the source of every stage, in stage order, and the driver
+	uint64_t	MakeKey(const std::string* sources, int count);
+
+	//Loads the binary saved for name into program, if there is one with this
+	//key. Returns whether program is now linked - if not, compile it as usual.
+	bool		Load(GLuint program, const std::string& name, uint64_t key);
+	//Program must be linked, with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	void		Save(GLuint program, const std::string& name, uint64_t key);
+
+	//While disabled, Load always misses and Save does nothing
+	void		SetEnabled(bool enabled)	{ this->enabled = enabled; }
+	//Whether it's enabled, and the driver has any binary formats at all
+	bool		IsAvailable();
+
+	const Stats&	GetStats() const	{ return stats; }
+	void			ResetStats()		{ stats = {}; }
+
+protected:
+	std::string	GetFileName(const std::string& name) const;
+	//Asks GL for the driver strings and binary formats, the first time only
+	void		QueryDriver();
+
+	std::string	folder;
+	std::string	driver;
+	bool		driverQueried;
+	bool		hasBinaryFormats;
+	bool		enabled;
+	Stats		stats;
+};
@@ -0,0 +1,137 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+
+static const int	SHADER_BITS		= 8;
+static const int	MATERIAL_BITS	= 14;
+static const int	MESH_BITS		= 16;
+static const int	DEPTH_BITS		= 24;
+static const RenderQueue::Key DEPTH_MASK	= (1u << DEPTH_BITS) - 1;
+
+//Below this many items, clearing the histograms and going over the items
+//8 times takes longer than an ordinary sort
+static const size_t	SMALL_SORT		= 512;
+//Runs this short are insertion sorted before merging
+static const size_t	INSERTION_RUN	= 32;
+
+//Mixes up the bits of an address, so neighbouring allocations don't end up
+//sharing the top few bits - the same finaliser MurmurHash3 uses
+static RenderQueue::Key HashPointer(const void* p, int bits) {
+	RenderQueue::Key h = (RenderQueue::Key)(uintptr_t)p;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h >> (64 - bits);
+}
+
+//The bits of a positive float go up as it does, so dropping the sign bit and
+//the bottom of the mantissa leaves 24 bits that still sort the same way
+static RenderQueue::Key QuantiseDepth(float depth) {
+	if (!(depth > 0.0f)) {
+		return 0;
+	}
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return (bits >> (31 - DEPTH_BITS)) & DEPTH_MASK;
+}
+
+RenderQueue::Key RenderQueue::MakeKey(Pass pass, unsigned int shader, const void* material, const void* mesh, float depth) {
+	Key key = (Key)pass << 62 | (Key)(shader & ((1u << SHADER_BITS) - 1)) << 54;
+
+	if (pass == PASS_TRANSPARENT) {
+		return key | (DEPTH_MASK - QuantiseDepth(depth)) << (MATERIAL_BITS + MESH_BITS) |
+			HashPointer(material, MATERIAL_BITS) << MESH_BITS | HashPointer(mesh, MESH_BITS);
+	}
+	return key | HashPointer(material, MATERIAL_BITS) << (MESH_BITS + DEPTH_BITS) |
+		HashPointer(mesh, MESH_BITS) << DEPTH_BITS | QuantiseDepth(depth);
+}
+
+void RenderQueue::Sort() {
+	//Grown along with items, rather than to exactly fit, so it isn't
+	//reallocated every time a few more nodes are drawn than ever before
+	if (scratch.size() < items.size()) {
+		scratch.resize(items.capacity());
+	}
+	RadixSort(items.data(), scratch.data(), items.size());
+}
+
+static bool KeyLess(const RenderQueue::Item& a, const RenderQueue::Item& b) {
+	return a.key < b.key;
+}
+
+/*
+A stable merge sort that merges back and forth through scratch, as
+std::stable_sort would need a buffer from the heap for it every frame.
+*/
+static void MergeSort(RenderQueue::Item* items, RenderQueue::Item* scratch, size_t count) {
+	for (size_t run = 0; run < count; run += INSERTION_RUN) {
+		RenderQueue::Item* end = items + std::min(count, run + INSERTION_RUN);
+		for (RenderQueue::Item* i = items + run + 1; i < end; ++i) {
+			RenderQueue::Item item	= *i;
+			RenderQueue::Item* j	= i;
+			for (; j > items + run && item.key < (j - 1)->key; --j) {
+				*j = *(j - 1);
+			}
+			*j = item;
+		}
+	}
+	RenderQueue::Item* from	= items;
+	RenderQueue::Item* to	= scratch;
+	for (size_t width = INSERTION_RUN; width < count; width *= 2) {
+		for (size_t left = 0; left < count; left += width * 2) {
+			size_t middle	= std::min(count, left + width);
+			size_t right	= std::min(count, left + width * 2);
+			std::merge(from + left, from + middle, from + middle, from + right, to + left, KeyLess);
+		}
+		std::swap(from, to);
+	}
+	if (from != items) {
+		std::copy(from, from + count, items);
+	}
+}
+
+/*
+All 8 byte histograms are counted in one go over the keys. Each pass then moves
+every item to its place by one byte of the key, starting from the lowest, and
+keeps items with the same byte in the order they were in - so by the top byte
+they're in order by all of them. Bytes that every key shares (like the pass, if
+there's only one) would leave the order as it was, so they're skipped.
+*/
+void RenderQueue::RadixSort(Item* items, Item* scratch, size_t count) {
+	if (count < SMALL_SORT) {
+		MergeSort(items, scratch, count);
+		return;
+	}
+	static const int BYTES = sizeof(Key);
+	size_t histograms[BYTES][256] = {};
+
+	for (size_t i = 0; i < count; ++i) {
+		Key key = items[i].key;
+		for (int b = 0; b < BYTES; ++b) {
+			histograms[b][(key >> (b * 8)) & 0xFF]++;
+		}
+	}
+	Item* from	= items;
+	Item* to	= scratch;
+
+	for (int b = 0; b < BYTES; ++b) {
+		size_t* histogram	= histograms[b];
+		int shift			= b * 8;
+		if (histogram[(from[0].key >> shift) & 0xFF] == count) {
+			continue;
+		}
+		size_t offset = 0;
+		for (int d = 0; d < 256; ++d) {
+			size_t c		= histogram[d];
+			histogram[d]	= offset;
+			offset			+= c;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			to[histogram[(from[i].key >> shift) & 0xFF]++] = from[i];
+		}
+		std::swap(from, to);
+	}
+	if (from != items) {
+		std::copy(from, from + count, items);
+	}
+}
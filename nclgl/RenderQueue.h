@@ -0,0 +1,67 @@
+/******************************************************************************
+Class:RenderQueue
+Implements:
+Description:A list of draws to be made, each with a 64 bit key saying where it
+goes in the order, so sorting them is just sorting integers - done with an LSD
+radix sort, a byte at a time, over one contiguous array of keys and indices
+(or, for the few hundred draws that isn't worth it for, a stable merge sort of
+insertion sorted runs, which reuses the same scratch array rather than having
+std::stable_sort get a buffer from the heap every frame).
+
+Keys are made by MakeKey. From the top bit down, opaque draws are ordered by
+
+	pass (2 bits) | shader (8) | material (14) | mesh (16) | depth (24)
+
+so they're grouped by state, and drawn front to back within each group, while
+transparent draws are ordered by
+
+	pass (2 bits) | shader (8) | depth, inverted (24) | material (14) | mesh (16)
+
+so they're drawn back to front within each shader. Materials and meshes go in
+as a hash of their address, which keeps the same ones together; depth goes in
+as the top bits of the float itself, which sort the same way as the floats do
+as long as they aren't negative.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class RenderQueue {
+public:
+	typedef uint64_t Key;
+
+	enum Pass {
+		PASS_OPAQUE,
+		PASS_TRANSPARENT
+	};
+
+	struct Item {
+		Key				key;
+		unsigned int	index;	//Whatever the caller wants it to be
+	};
+
+	RenderQueue(void) {}
+	~RenderQueue(void) {}
+
+	static Key	MakeKey(Pass pass, unsigned int shader, const void* material, const void* mesh, float depth);
+	static Pass	GetPass(Key key) { return (Pass)(key >> 62); }
+
+	void	Clear() { items.clear(); }
+	void	Add(Key key, unsigned int index) { items.push_back({ key, index }); }
+
+	//Sorts by key. Draws with the same key stay in the order they were added.
+	void	Sort();
+
+	size_t		GetCount() const { return items.size(); }
+	const Item*	GetItems() const { return items.data(); }
+	const Item&	operator[](size_t i) const { return items[i]; }
+
+	//The sort itself, for any array of items - scratch must be as big as items
+	static void	RadixSort(Item* items, Item* scratch, size_t count);
+
+protected:
+	std::vector<Item>	items;
+	std::vector<Item>	scratch;
+};
@@ -0,0 +1,267 @@
+#include "ResourceCache.h"
+#include "Mesh.h"
+#include "MeshMaterial.h"
+#include "MeshAnimation.h"
+#include "GLStateCache.h"
+#include "common.h"
+
+#include <iostream>
+#include <vector>
+#include <cctype>
+
+CachedTexture::~CachedTexture(void) {
+	GLStateCache::GetSharedCache().Forget(GL_TEXTURE, id);
+	glDeleteTextures(1, &id);
+}
+
+ResourceCache& ResourceCache::GetSharedCache() {
+	static ResourceCache sharedCache;
+	return sharedCache;
+}
+
+std::string ResourceCache::CanonicalPath(const std::string& path) {
+	std::vector<std::string> segments;
+	std::string segment;
+
+	for (size_t i = 0; i <= path.size(); ++i) {
+		char c = i < path.size() ? path[i] : '/';
+
+		if (c != '/' && c != '\\') {
+			segment += (char)tolower((unsigned char)c);
+			continue;
+		}
+		if (segment == "..") {
+			if (!segments.empty() && segments.back() != "..") {
+				segments.pop_back();
+			}
+			else {
+				segments.push_back(segment);
+			}
+		}
+		else if (!segment.empty() && segment != ".") {
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	std::string canonical = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ? "/" : "";
+	for (size_t i = 0; i < segments.size(); ++i) {
+		canonical += (i > 0 ? "/" : "") + segments[i];
+	}
+	return canonical;
+}
+
+template<typename T>
+std::shared_ptr<T> ResourceCache::Find(Table<T>& table, const std::string& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto i = table.entries.find(key);
+	if (i == table.entries.end()) {
+		return nullptr;
+	}
+	table.stats.hits++;
+	return i->second;
+}
+
+/*
+Misses are counted here rather than in Find, as the background loader looks
+things up more than once before it commits to a load - this way, a miss is
+one copy of a file actually being kept.
+*/
+template<typename T>
+std::shared_ptr<T> ResourceCache::Add(Table<T>& table, const std::string& key, std::shared_ptr<T> resource) {
+	if (!resource) {
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto i = table.entries.find(key);
+	if (i != table.entries.end()) {
+		table.stats.hits++;
+		return i->second;
+	}
+	table.entries.insert(std::make_pair(key, resource));
+	table.stats.misses++;
+	table.stats.count++;
+	table.stats.bytes += GetResourceBytes(*resource);
+	return resource;
+}
+
+template<typename T>
+void ResourceCache::ReleaseUnused(Table<T>& table) {
+	std::vector<std::shared_ptr<T>> released;	//Destroyed once unlocked
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto i = table.entries.begin(); i != table.entries.end();) {
+			if (i->second.use_count() > 1) {
+				++i;
+				continue;
+			}
+			table.stats.count--;
+			table.stats.bytes -= GetResourceBytes(*i->second);
+			released.push_back(i->second);
+			i = table.entries.erase(i);
+		}
+	}
+}
+
+size_t ResourceCache::GetResourceBytes(const Mesh& mesh) {
+	return mesh.GetBufferDataSize();
+}
+
+size_t ResourceCache::GetResourceBytes(const MeshAnimation& animation) {
+	return (size_t)animation.GetFrameCount() * animation.GetJointCount() * sizeof(Matrix4);
+}
+
+std::shared_ptr<Mesh> ResourceCache::FindMesh(const std::string& name) {
+	return Find(meshes, CanonicalPath(name));
+}
+
+std::shared_ptr<MeshMaterial> ResourceCache::FindMaterial(const std::string& name) {
+	return Find(materials, CanonicalPath(name));
+}
+
+std::shared_ptr<MeshAnimation> ResourceCache::FindAnimation(const std::string& name) {
+	return Find(animations, CanonicalPath(name));
+}
+
+std::shared_ptr<CachedTexture> ResourceCache::FindTexture(const std::string& path) {
+	return Find(textures, CanonicalPath(path));
+}
+
+std::shared_ptr<Mesh> ResourceCache::AddMesh(const std::string& name, std::shared_ptr<Mesh> mesh) {
+	return Add(meshes, CanonicalPath(name), mesh);
+}
+
+std::shared_ptr<MeshMaterial> ResourceCache::AddMaterial(const std::string& name, std::shared_ptr<MeshMaterial> material) {
+	return Add(materials, CanonicalPath(name), material);
+}
+
+std::shared_ptr<MeshAnimation> ResourceCache::AddAnimation(const std::string& name, std::shared_ptr<MeshAnimation> animation) {
+	return Add(animations, CanonicalPath(name), animation);
+}
+
+std::shared_ptr<CachedTexture> ResourceCache::AddTexture(const std::string& path, std::shared_ptr<CachedTexture> texture) {
+	return Add(textures, CanonicalPath(path), texture);
+}
+
+std::shared_ptr<Mesh> ResourceCache::GetMesh(const std::string& name) {
+	std::shared_ptr<Mesh> mesh = FindMesh(name);
+	if (mesh) {
+		return mesh;
+	}
+	mesh = std::shared_ptr<Mesh>(Mesh::LoadFromMeshFile(name));
+	if (!mesh) {
+		std::cerr << "Failed to load mesh: " << name << std::endl;
+		return nullptr;
+	}
+	return AddMesh(name, mesh);
+}
+
+std::shared_ptr<MeshMaterial> ResourceCache::GetMaterial(const std::string& name) {
+	std::shared_ptr<MeshMaterial> material = FindMaterial(name);
+	if (material) {
+		return material;
+	}
+	material = std::make_shared<MeshMaterial>(name);
+	LoadMaterialTextures(*material);
+	return AddMaterial(name, material);
+}
+
+std::shared_ptr<CachedTexture> ResourceCache::GetTexture(const std::string& path) {
+	std::shared_ptr<CachedTexture> texture = FindTexture(path);
+	if (texture) {
+		return texture;
+	}
+	GLuint texID = SOIL_load_OGL_texture(path.c_str(), SOIL_LOAD_AUTO,
+		SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
+
+	if (texID == 0) {
+		return nullptr;
+	}
+	GLint width		= 0;
+	GLint height	= 0;
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	//SOIL and the binds above went around the state cache
+	GLStateCache::GetSharedCache().Invalidate();
+
+	return AddTexture(path, std::make_shared<CachedTexture>(texID, CachedTexture::EstimateBytes(width, height)));
+}
+
+void ResourceCache::LoadMaterialTextures(MeshMaterial& material) {
+	for (MeshMaterialEntry& entry : material.materialLayers) {
+		for (const auto& file : entry.entries) {
+			//Every channel starts out with a texture of 0, until it's loaded
+			auto loaded = entry.textures.find(file.first);
+			if (loaded != entry.textures.end() && loaded->second != 0) {
+				continue;
+			}
+			std::string texturePath = TEXTUREDIR + file.second;
+			std::shared_ptr<CachedTexture> texture = GetTexture(texturePath);
+
+			if (texture) {
+				entry.textures[file.first] = texture->GetID();
+				material.cachedTextures.push_back(texture);
+			}
+			else {
+				std::cerr << "Failed to load texture: " << texturePath << std::endl;
+			}
+		}
+	}
+}
+
+/*
+Materials go first, as they are what keep textures referenced.
+*/
+void ResourceCache::ReleaseUnused() {
+	ReleaseUnused(materials);
+	ReleaseUnused(textures);
+	ReleaseUnused(meshes);
+	ReleaseUnused(animations);
+}
+
+void ResourceCache::Clear() {
+	Table<Mesh>				oldMeshes;
+	Table<MeshMaterial>		oldMaterials;
+	Table<MeshAnimation>	oldAnimations;
+	Table<CachedTexture>	oldTextures;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::swap(oldMeshes.entries, meshes.entries);
+		std::swap(oldMaterials.entries, materials.entries);
+		std::swap(oldAnimations.entries, animations.entries);
+		std::swap(oldTextures.entries, textures.entries);
+
+		meshes.stats.count		= materials.stats.count		= animations.stats.count	= textures.stats.count	= 0;
+		meshes.stats.bytes		= materials.stats.bytes		= animations.stats.bytes	= textures.stats.bytes	= 0;
+	}
+}
+
+ResourceCache::Stats ResourceCache::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Stats stats;
+	stats.meshes	= meshes.stats;
+	stats.materials	= materials.stats;
+	stats.animations	= animations.stats;
+	stats.textures	= textures.stats;
+	return stats;
+}
+
+void ResourceCache::PrintStats() const {
+	Stats stats = GetStats();
+
+	auto print = [](const char* name, const TableStats& t) {
+		std::cout << "  " << name << ": " << t.count << " resident ("
+			<< t.bytes / 1024 << "KB), " << t.hits << " hits, " << t.misses << " misses\n";
+	};
+	std::cout << "Resource cache:\n";
+	print("Meshes   ", stats.meshes);
+	print("Materials", stats.materials);
+	print("Anims    ", stats.animations);
+	print("Textures ", stats.textures);
+}
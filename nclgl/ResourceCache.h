@@ -0,0 +1,126 @@
+/******************************************************************************
+Class:ResourceCache
+Implements:
+Description:Keeps hold of the meshes, materials, animations and textures that
+have been loaded, keyed by their canonical path, so that asking for the same file twice
+hands back the same shared_ptr rather than another copy - and for textures,
+another GL object.
+
+Entries stay resident until ReleaseUnused is called, which drops anything no
+longer referenced from outside the cache. Lookups are thread safe, but the
+synchronous Get functions create GL objects, so only call those (and anything
+that might destroy a resource) on the render thread.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <glad/glad.h>
+
+class Mesh;
+class MeshMaterial;
+class MeshAnimation;
+
+//A GL texture shared between materials. Deletes the texture once unused.
+class CachedTexture {
+public:
+	CachedTexture(GLuint id, size_t bytes) {
+		this->id	= id;
+		this->bytes	= bytes;
+	}
+	~CachedTexture(void);
+
+	GLuint	GetID() const		{ return id; }
+	size_t	GetBytes() const	{ return bytes; }
+
+	//Rough VRAM use of a width x height texture with mipmaps
+	static size_t EstimateBytes(int width, int height) {
+		return (size_t)width * height * 4 * 4 / 3;
+	}
+
+protected:
+	GLuint	id;
+	size_t	bytes;
+};
+
+class ResourceCache {
+public:
+	struct TableStats {
+		int		hits	= 0;
+		int		misses	= 0;
+		int		count	= 0;
+		size_t	bytes	= 0;
+	};
+
+	struct Stats {
+		TableStats meshes;
+		TableStats materials;
+		TableStats animations;
+		TableStats textures;
+	};
+
+	ResourceCache(void) {}
+	~ResourceCache(void) {}
+
+	static ResourceCache& GetSharedCache();
+
+	//Lowercased, forward slashes, with any . and .. segments resolved
+	static std::string CanonicalPath(const std::string& path);
+
+	//Load on a miss; render thread only. Names are relative to MESHDIR,
+	//and textures are given as full paths.
+	std::shared_ptr<Mesh>			GetMesh(const std::string& name);
+	std::shared_ptr<MeshMaterial>	GetMaterial(const std::string& name);
+	std::shared_ptr<CachedTexture>	GetTexture(const std::string& path);
+
+	//Lookup only - these never load anything, so are safe on any thread
+	std::shared_ptr<Mesh>			FindMesh(const std::string& name);
+	std::shared_ptr<MeshMaterial>	FindMaterial(const std::string& name);
+	std::shared_ptr<MeshAnimation>	FindAnimation(const std::string& name);
+	std::shared_ptr<CachedTexture>	FindTexture(const std::string& path);
+
+	//Add something loaded elsewhere. If another copy got there first, that
+	//one is returned instead, and the new one should be thrown away.
+	std::shared_ptr<Mesh>			AddMesh(const std::string& name, std::shared_ptr<Mesh> mesh);
+	std::shared_ptr<MeshMaterial>	AddMaterial(const std::string& name, std::shared_ptr<MeshMaterial> material);
+	std::shared_ptr<MeshAnimation>	AddAnimation(const std::string& name, std::shared_ptr<MeshAnimation> animation);
+	std::shared_ptr<CachedTexture>	AddTexture(const std::string& path, std::shared_ptr<CachedTexture> texture);
+
+	//Fills in every texture of a material that hasn't got one yet
+	void	LoadMaterialTextures(MeshMaterial& material);
+
+	//Drops everything that only the cache is still holding on to
+	void	ReleaseUnused();
+	//Drops everything. Call before the GL context goes away!
+	void	Clear();
+
+	Stats	GetStats() const;
+	void	PrintStats() const;
+
+protected:
+	template<typename T>
+	struct Table {
+		std::map<std::string, std::shared_ptr<T>>	entries;
+		TableStats									stats;
+	};
+
+	template<typename T>
+	std::shared_ptr<T>	Find(Table<T>& table, const std::string& key);
+	template<typename T>
+	std::shared_ptr<T>	Add(Table<T>& table, const std::string& key, std::shared_ptr<T> resource);
+	template<typename T>
+	void				ReleaseUnused(Table<T>& table);
+
+	static size_t		GetResourceBytes(const Mesh& mesh);
+	static size_t		GetResourceBytes(const MeshMaterial& material) { return 0; }
+	static size_t		GetResourceBytes(const MeshAnimation& animation);
+	static size_t		GetResourceBytes(const CachedTexture& texture) { return texture.GetBytes(); }
+
+	mutable std::mutex				mutex;
+	Table<Mesh>						meshes;
+	Table<MeshMaterial>				materials;
+	Table<MeshAnimation>			animations;
+	Table<CachedTexture>			textures;
+};
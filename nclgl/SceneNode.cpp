@@ -1,14 +1,38 @@
 #include "SceneNode.h"
 #include "MeshAnimation.h"
 #include "MeshMaterial.h"
+#include "ResourceCache.h"
+#include "JobSystem.h"
+
+NodePool& SceneNode::GetPool() {
+    static NodePool pool(sizeof(SceneNode));
+    return pool;
+}
+
+void* SceneNode::operator new(size_t size) {
+    return size <= GetPool().GetObjectSize() ? GetPool().Allocate() : ::operator new(size);
+}
+
+void SceneNode::operator delete(void* p) {
+    if (GetPool().Owns(p)) {
+        GetPool().Free(p);
+    }
+    else {
+        ::operator delete(p);
+    }
+}
 
 SceneNode::SceneNode(Mesh* mesh, Vector4 colour) {
     this->mesh = std::shared_ptr<Mesh>(mesh);
     this->colour = colour;
     parent = nullptr;
+    hierarchy = &TransformHierarchy::GetSharedHierarchy();
+    transformHandle = hierarchy->Create();
     boundingRadius = 1.0f;
     distanceFromCamera = 0.0f;
     texture = 0;
+    lod = 0;
+    occluder = false;
     modelScale = Vector3(1, 1, 1);
     modelRotation = Matrix4::Rotation(0, Vector3(0, 0, 0));
 }
@@ -17,11 +41,13 @@ SceneNode::~SceneNode() {
     for (unsigned int i = 0; i < children.size(); ++i) {
         delete children[i];
     }
+    hierarchy->Destroy(transformHandle);
 }
 
 void SceneNode::AddChild(SceneNode* s) {
     children.push_back(s);
     s->parent = this;
+    hierarchy->SetParent(s->transformHandle, transformHandle);
 }
 
 void SceneNode::Draw(const OGLRenderer& r) {
@@ -30,39 +56,42 @@ void SceneNode::Draw(const OGLRenderer& r) {
     }
 }
 
+/*
+Children are still visited, so subclasses can move themselves about, but the
+world transforms are then worked out all in one go by the hierarchy - and only
+for what has moved.
+
+The root's children have nothing to do with each other, so their subtrees are
+updated at the same time on the shared job system. A node's Update can move
+nodes in its own subtree, but mustn't add, remove or reparent anything.
+*/
 void SceneNode::Update(float dt) {
-    if (parent) { // This node has a parent
-        worldTransform = parent->worldTransform * transform;
-    }
-    else { // Root node, world transform is local transform
-        worldTransform = transform;
+    if (parent) {
+        for (auto i = children.begin(); i != children.end(); ++i) {
+            (*i)->Update(dt);
+        }
+        return;
     }
+    JobSystem& jobs = JobSystem::GetSharedJobSystem();
+    jobs.ParallelFor(children.size(), [&](size_t i) { children[i]->Update(dt); });
+    hierarchy->Update(jobs);
+}
 
-    for (auto i = children.begin(); i != children.end(); ++i) {
-        (*i)->Update(dt);
+void SceneNode::SelectLod(const Vector3& cameraPosition, float pixelScale, float maxPixelError) {
+    lod = 0;
+    if (!mesh || mesh->GetLodCount() < 2) {
+        return;
     }
+    float distance = (GetWorldTransform().GetPositionVector() - cameraPosition).Length();
+    if (distance <= boundingRadius) { // Camera is inside it, so it could cover the whole screen
+        return;
+    }
+    lod = mesh->SelectLod(boundingRadius * pixelScale / distance, maxPixelError);
 }
 
 void SceneNode::SetMaterial(std::shared_ptr<MeshMaterial> m, bool l) {
     material = m;
-    if (l) {
-        for (int i = 0; i < material->materialLayers.size(); ++i) {
-            MeshMaterialEntry* matEntry = &material->materialLayers[i];
-            for (const auto& entry : matEntry->entries) {
-                const std::string& textureName = entry.first;
-                const std::string& filename = entry.second;
-
-                std::string texturePath = TEXTUREDIR + filename;
-                GLuint texID = SOIL_load_OGL_texture(texturePath.c_str(), SOIL_LOAD_AUTO,
-                    SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
-
-                if (texID != 0) {
-                    matEntry->textures[textureName] = texID;
-                }
-                else {
-                    std::cerr << "Failed to load texture: " << texturePath << std::endl;
-                }
-            }
-        }
+    if (l && material) {
+        ResourceCache::GetSharedCache().LoadMaterialTextures(*material);
     }
 }
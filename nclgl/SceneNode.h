@@ -3,6 +3,8 @@
 #include "Vector3.h"
 #include "Vector4.h"
 #include "Mesh.h"
+#include "TransformHierarchy.h"
+#include "NodePool.h"
 #include <vector>
 
 class MeshAnimation;
@@ -12,11 +14,25 @@ class SceneNode {
 public:
     SceneNode(Mesh* m = nullptr, Vector4 colour = Vector4(0, 0, 0, 1));
     //SceneNode(std::shared_ptr<Mesh>, Vector4 colour = Vector4(1, 1, 1, 1));
-    ~SceneNode();
-
-    void SetTransform(const Matrix4& matrix) { transform = matrix; }
-    const Matrix4& GetTransform() const { return transform; }
-    Matrix4 GetWorldTransform() const { return worldTransform; }
+    virtual ~SceneNode();
+
+    // Nodes are made in the shared NodePool, unless they're a subclass too big
+    // for its blocks - those come from the heap as usual
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+    static NodePool& GetPool();
+
+    // Stays the same for as long as the node lives, and FromHandle gives back
+    // nullptr for it after that. Nodes that aren't in the pool don't have one.
+    NodePool::Handle GetHandle() const { return GetPool().GetHandle(this); }
+    static SceneNode* FromHandle(NodePool::Handle h) { return static_cast<SceneNode*>(GetPool().Get(h)); }
+
+    // Transforms live in the shared TransformHierarchy, which works out world
+    // transforms once the root node has been updated
+    void SetTransform(const Matrix4& matrix) { hierarchy->SetLocalTransform(transformHandle, matrix); }
+    Matrix4 GetTransform() const { return hierarchy->GetLocalTransform(transformHandle); }
+    Matrix4 GetWorldTransform() const { return hierarchy->GetWorldTransform(transformHandle); }
+    TransformHierarchy::Handle GetTransformHandle() const { return transformHandle; }
 
     void SetRotation(const Matrix4& matrix) { modelRotation = matrix; }
     const Matrix4& GetRotation() const { return modelRotation; }
@@ -42,11 +58,24 @@ public:
     void SetMaterial(std::shared_ptr<MeshMaterial> m, bool l = false);
 
     float GetBoundingRadius() const { return boundingRadius; }
-    void SetBoundingRadius(float f) { boundingRadius = f; }
+    // Counts as moving it, so anything keeping track of where it is will notice
+    void SetBoundingRadius(float f) { boundingRadius = f; hierarchy->Touch(transformHandle); }
 
     float GetCameraDistance() const { return distanceFromCamera; }
     void SetCameraDistance(float f) { distanceFromCamera = f; }
 
+    //Picks the lowest detail LOD of the mesh that keeps its error under
+    //maxPixelError pixels, with the bounding radius standing in for the
+    //mesh's size. pixelScale is how many pixels one unit covers at a
+    //distance of one unit from the camera.
+    void SelectLod(const Vector3& cameraPosition, float pixelScale, float maxPixelError = 1.0f);
+    int GetLod() const { return lod; }
+
+    // Occluders are drawn into the occlusion culler's depth buffer, to hide
+    // whatever's behind them - so they should be big, solid and not animated
+    bool IsOccluder() const { return occluder; }
+    void SetOccluder(bool o) { occluder = o; }
+
     void SetTexture(GLuint tex) { texture = tex; }
     GLuint GetTexture() const { return texture; }
 
@@ -70,14 +99,16 @@ protected:
     SceneNode* parent;
     std::shared_ptr<Mesh> mesh;
     int shader;
-    Matrix4 worldTransform;
-    Matrix4 transform;
+    TransformHierarchy* hierarchy;
+    TransformHierarchy::Handle transformHandle;
     Vector3 modelScale;
     Matrix4 modelRotation;
     Vector4 colour;
     float distanceFromCamera;
     float boundingRadius;
     GLuint texture;
+    int lod;
+    bool occluder;
 
     MeshAnimation* anim = nullptr;
     std::shared_ptr<MeshMaterial> material;
@@ -1,12 +1,17 @@
 #include "Shader.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
+#include "ProgramCache.h"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 using std::string;
 using std::cout;
 using std::ifstream;
 
 vector<Shader*> Shader::allShaders;
+Shader::UniformStats Shader::uniformStats = {};
 
 GLuint shaderTypes[SHADER_MAX] = {
 	GL_VERTEX_SHADER,
@@ -31,103 +36,415 @@ Shader::Shader(const string& vertex, const string& fragment, const string& geome
 	shaderFiles[SHADER_DOMAIN]		= domain;
 	shaderFiles[SHADER_HULL]		= hull;
 
-	Reload(false);
+	programID			= 0;
+	programValid		= GL_FALSE;
+	usesFrameUniforms	= false;
+	usesObjectUniforms	= false;
+	pending.program		= 0;
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		objectIDs[i]	= 0;
+		shaderValid[i]	= 0;
+	}
+	BeginReload();
 	allShaders.emplace_back(this);
 }
 
 Shader::~Shader(void)	{
+	allShaders.erase(std::remove(allShaders.begin(), allShaders.end(), this), allShaders.end());
+	DeletePending();
 	DeleteIDs();
 }
 
-void	Shader::Reload(bool deleteOld) {
-	if(deleteOld) {
-		DeleteIDs();
+void	Shader::Reload() {
+	BeginReload();
+	FinishReload();
+}
+
+//Lets the driver compile on as many threads as it likes, if it can compile in
+//the background at all
+static bool UseParallelCompile() {
+	static bool checked		= false;
+	static bool supported	= false;
+	if (!checked) {
+		if (GLAD_GL_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			supported = true;
+		}
+		else if (GLAD_GL_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			supported = true;
+		}
+		checked = true;
 	}
+	return supported;
+}
 
-	programID		= glCreateProgram();
+/*
+Nothing here asks GL how the compile went, as that would wait for it to finish
+- that's left to FinishReload. A program in the ProgramCache is loaded straight
+away, as there's nothing to wait for.
+*/
+void	Shader::BeginReload() {
+	DeletePending();
+	UseParallelCompile();
 
+	string	sources[SHADER_MAX];
+	bool	loaded[SHADER_MAX];
+	pending.cacheable = true;
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		pending.objectIDs[i]	= 0;
+		loaded[i]				= shaderFiles[i].empty() || LoadShaderFile(shaderFiles[i], sources[i]);
+		pending.cacheable		= pending.cacheable && loaded[i];
+	}
+	pending.program = glCreateProgram();
+
+	ProgramCache& cache	= ProgramCache::GetSharedCache();
+	pending.key			= pending.cacheable ? cache.MakeKey(sources, SHADER_MAX) : 0;
+	pending.fromCache	= pending.cacheable && cache.Load(pending.program, GetCacheName(), pending.key);
+	if (pending.fromCache) {
+		return;
+	}
 	for (int i = 0; i < SHADER_MAX; ++i) {
 		if (!shaderFiles[i].empty()) {
-			GenerateShaderObject(i);
+			GenerateShaderObject(i, sources[i], loaded[i]);
+		}
+	}
+	SetDefaultAttributes(pending.program);
+	glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(pending.program);
+}
+
+//Without the extension there's no asking, so it's always ready - and finishing
+//it waits for the driver, as reloading always used to
+bool	Shader::IsReloadReady() const {
+	if (!pending.program) {
+		return true;
+	}
+	if (!UseParallelCompile()) {
+		return true;
+	}
+	GLint done = GL_FALSE;
+	glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+/*
+Logs are only gathered here, once the driver is done - and only for what
+failed. If a program that was working fails to reload, it's kept, so a typo
+during a hot reload doesn't leave anything undrawable.
+*/
+void	Shader::FinishReload() {
+	if (!pending.program) {
+		return;
+	}
+	GLint linked		= GL_FALSE;
+	GLint valid[SHADER_MAX];
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		valid[i] = pending.fromCache && !shaderFiles[i].empty() ? GL_TRUE : GL_FALSE;
+		if (pending.objectIDs[i]) {
+			glGetShaderiv(pending.objectIDs[i], GL_COMPILE_STATUS, &valid[i]);
+			if (!valid[i]) {
+				cout << "Compiling " << shaderFiles[i] << " failed!\n";
+				PrintCompileLog(pending.objectIDs[i]);
+			}
 		}
-		else {
-			objectIDs[i]	= 0;
-			shaderValid[i]	= 0;
+	}
+	if (!linked) {
+		PrintLinkLog(pending.program);
+		if (programValid) {
+			cout << "Keeping the last working version of " << shaderFiles[SHADER_VERTEX] << "'s program\n";
+			DeletePending();
+			return;
 		}
 	}
-	SetDefaultAttributes();
-	LinkProgram();
-	PrintLinkLog(programID);
+	DeleteIDs();
+	programID		= pending.program;
+	programValid	= linked;
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		objectIDs[i]	= pending.objectIDs[i];
+		shaderValid[i]	= valid[i];
+	}
+	pending.program = 0;
+
+	FindUniforms();
+	BindUniformBlocks();
+	if (linked && pending.cacheable && !pending.fromCache) {
+		ProgramCache::GetSharedCache().Save(programID, GetCacheName(), pending.key);
+	}
+}
+
+//A program still on its first compile has nothing to fall back on, so using it
+//has to wait for it
+void	Shader::WaitForProgram() {
+	if (!programID && pending.program) {
+		FinishReload();
+	}
+}
+
+//Which shader files it's made of, in stage order
+string	Shader::GetCacheName() const {
+	string name;
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		name += shaderFiles[i] + "|";
+	}
+	return name;
 }
 
-bool	Shader::LoadShaderFile(const string& filename, string &into)	{
+//Deep enough for any sensible nesting, but stops a file including itself forever
+static const int MAX_INCLUDE_DEPTH = 16;
+
+//The file named by an #include "file" line, or an empty string if it isn't one
+static string GetIncludedFile(const string& line) {
+	size_t start = line.find_first_not_of(" \t");
+	if (start == string::npos || line.compare(start, 8, "#include") != 0) {
+		return "";
+	}
+	size_t open		= line.find('"', start + 8);
+	size_t close	= open == string::npos ? string::npos : line.find('"', open + 1);
+	if (close == string::npos) {
+		return "";
+	}
+	return line.substr(open + 1, close - open - 1);
+}
+
+bool	Shader::LoadShaderFile(const string& filename, string &into, int includeDepth)	{
 	ifstream	file(SHADERDIR + filename);
 	string		textLine;
 
-	cout << "Loading shader text from " << filename << "\n\n";
-
 	if(!file.is_open()){
-		cout << "ERROR ERROR ERROR ERROR: File does not exist!\n";
+		cout << "ERROR ERROR ERROR ERROR: " << filename << " does not exist!\n";
 		return false;
 	}
-	int lineNum = 1; 
 	while(!file.eof()){
 		getline(file,textLine);
+		string included = GetIncludedFile(textLine);
+		if (!included.empty()) {
+			if (includeDepth >= MAX_INCLUDE_DEPTH) {
+				cout << "Too many nested includes in " << filename << "!\n";
+				return false;
+			}
+			if (!LoadShaderFile(included, into, includeDepth + 1)) {
+				return false;
+			}
+			continue;
+		}
 		textLine += "\n";
 		into += textLine;
-		cout << "(" << lineNum << ") :" << textLine;
-		++lineNum;
 	}
-	cout << "\nLoaded shader text!\n\n";
 	return true;
 }
 
-void	Shader::GenerateShaderObject(unsigned int i)	{
-	cout << "Compiling Shader...\n";
+void	Shader::GenerateShaderObject(unsigned int i, const string& shaderText, bool loaded)	{
+	cout << "Compiling " << shaderFiles[i] << "...\n";
 
-	string shaderText;
-	if(!LoadShaderFile(shaderFiles[i],shaderText)) {
+	if(!loaded) {
 		cout << "Loading failed!\n";
-		shaderValid[i] = false;
 		return;
 	}
 
-	objectIDs[i] = glCreateShader(shaderTypes[i]);
+	GLuint object = glCreateShader(shaderTypes[i]);
+	pending.objectIDs[i] = object;
 
 	const char *chars	= shaderText.c_str();
 	int textLength		= (int)shaderText.length();
-	glShaderSource(objectIDs[i], 1, &chars, &textLength);
-	glCompileShader(objectIDs[i]);
+	glShaderSource(object, 1, &chars, &textLength);
+	glCompileShader(object);
+
+	glObjectLabel(GL_SHADER, object, -1, shaderFiles[i].c_str());
+	glAttachShader(pending.program, object);
+}
 
-	glGetShaderiv(objectIDs[i], GL_COMPILE_STATUS, &shaderValid[i]);
+//GLSL 3.3 can't give blocks a binding itself, so they're bound here by name
+void Shader::BindUniformBlocks() {
+	GLuint frameBlock	= programValid ? glGetUniformBlockIndex(programID, "FrameUniforms") : GL_INVALID_INDEX;
+	GLuint objectBlock	= programValid ? glGetUniformBlockIndex(programID, "ObjectUniforms") : GL_INVALID_INDEX;
 
-	if (!shaderValid[i]) {
-		cout << "Compiling failed!\n";
-		PrintCompileLog(objectIDs[i]);
+	usesFrameUniforms	= frameBlock != GL_INVALID_INDEX;
+	usesObjectUniforms	= objectBlock != GL_INVALID_INDEX;
+	if (usesFrameUniforms) {
+		glUniformBlockBinding(programID, frameBlock, FRAME_UNIFORM_BINDING);
 	}
-	else {
-		cout << "Compiling success!\n\n";
+	if (usesObjectUniforms) {
+		glUniformBlockBinding(programID, objectBlock, OBJECT_UNIFORM_BINDING);
 	}
+}
 
-	glObjectLabel(GL_SHADER, objectIDs[i], -1, shaderFiles[i].c_str());
-	glAttachShader(programID, objectIDs[i]);
+//FNV-1a
+static uint32_t HashName(const char* name) {
+	uint32_t hash = 2166136261u;
+	for (; *name; ++name) {
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+	}
+	return hash;
 }
 
-void Shader::LinkProgram()	{
-	glLinkProgram(programID);
-	glGetProgramiv(programID, GL_LINK_STATUS, &programValid);
+//Bytes taken up by one of each type SetUniform can upload
+static size_t UniformSize(GLenum type) {
+	switch (type) {
+		case GL_FLOAT_VEC2:	return sizeof(float) * 2;
+		case GL_FLOAT_VEC3:	return sizeof(float) * 3;
+		case GL_FLOAT_VEC4:	return sizeof(float) * 4;
+		case GL_FLOAT_MAT4:	return sizeof(float) * 16;
+		default:			return sizeof(float);	//Scalars, bools and samplers
+	}
 }
 
-void	Shader::SetDefaultAttributes()	{
-	glBindAttribLocation(programID, VERTEX_BUFFER,  "position");
-	glBindAttribLocation(programID, COLOUR_BUFFER,  "colour");
-	glBindAttribLocation(programID, NORMAL_BUFFER,  "normal");
-	glBindAttribLocation(programID, TANGENT_BUFFER, "tangent");
-	glBindAttribLocation(programID, TEXTURE_BUFFER, "texCoord");
+/*
+Uniforms in blocks don't have locations, so they're left out. The table is
+kept no more than half full, so a lookup rarely has to probe far.
+*/
+void Shader::FindUniforms() {
+	uniforms.clear();
+	uniformTable.clear();
+	if (!programValid) {
+		return;
+	}
+	GLint count		= 0;
+	GLint maxLength	= 0;
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei	length	= 0;
+		GLint	size	= 0;
+		GLenum	type	= 0;
+		glGetActiveUniform(programID, i, maxLength + 1, &length, &size, &type, name.data());
 
-	glBindAttribLocation(programID, WEIGHTVALUE_BUFFER, "jointWeights");
-	glBindAttribLocation(programID, WEIGHTINDEX_BUFFER, "jointIndices");
-	glBindAttribLocation(programID, INSTANCE_TRANSFORM_BUFFER, "instanceOffset");
+		GLint location = glGetUniformLocation(programID, name.data());
+		uniformStats.glLookups++;
+		if (location < 0) {
+			continue;
+		}
+		string n(name.data(), length);
+		if (n.size() > 3 && n.compare(n.size() - 3, 3, "[0]") == 0) {
+			n.resize(n.size() - 3);
+		}
+		Uniform u;
+		u.name		= n;
+		u.hash		= HashName(n.c_str());
+		u.location	= location;
+		u.uploaded	= false;
+		u.value.resize(UniformSize(type) * size);
+		uniforms.push_back(std::move(u));
+	}
+	size_t tableSize = 8;
+	while (tableSize < uniforms.size() * 2) {
+		tableSize *= 2;
+	}
+	uniformTable.assign(tableSize, -1);
+	for (size_t i = 0; i < uniforms.size(); ++i) {
+		size_t slot = uniforms[i].hash & (tableSize - 1);
+		while (uniformTable[slot] != -1) {
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		uniformTable[slot] = (int)i;
+	}
+}
+
+Shader::Uniform* Shader::FindUniform(const char* name) {
+	WaitForProgram();
+	uniformStats.lookups++;
+	if (uniformTable.empty()) {
+		return nullptr;
+	}
+	uint32_t	hash = HashName(name);
+	size_t		mask = uniformTable.size() - 1;
+	for (size_t slot = hash & mask; uniformTable[slot] != -1; slot = (slot + 1) & mask) {
+		Uniform& u = uniforms[uniformTable[slot]];
+		if (u.hash == hash && u.name == name) {
+			return &u;
+		}
+	}
+	return nullptr;
+}
+
+bool Shader::NeedsUpload(Uniform& u, const void* value, size_t size) {
+	if (u.value.size() < size) {
+		u.value.resize(size);
+	}
+	if (u.uploaded && memcmp(u.value.data(), value, size) == 0) {
+		uniformStats.skipped++;
+		return false;
+	}
+	memcpy(u.value.data(), value, size);
+	u.uploaded = true;
+	uniformStats.uploads++;
+	return true;
+}
+
+GLint Shader::GetUniformLocation(const char* name) {
+	Uniform* u = FindUniform(name);
+	return u ? u->location : -1;
+}
+
+void Shader::SetUniform(const char* name, int i) {
+	Uniform* u = FindUniform(name);
+	if (u && NeedsUpload(*u, &i, sizeof(i))) {
+		glProgramUniform1i(programID, u->location, i);
+	}
+}
+
+void Shader::SetUniform(const char* name, float f) {
+	Uniform* u = FindUniform(name);
+	if (u && NeedsUpload(*u, &f, sizeof(f))) {
+		glProgramUniform1f(programID, u->location, f);
+	}
+}
+
+void Shader::SetUniform(const char* name, const Vector2& v) {
+	Uniform* u = FindUniform(name);
+	if (u && NeedsUpload(*u, &v, sizeof(float) * 2)) {
+		glProgramUniform2fv(programID, u->location, 1, (float*)&v);
+	}
+}
+
+void Shader::SetUniform(const char* name, const Vector3& v) {
+	Uniform* u = FindUniform(name);
+	if (u && NeedsUpload(*u, &v, sizeof(float) * 3)) {
+		glProgramUniform3fv(programID, u->location, 1, (float*)&v);
+	}
+}
+
+void Shader::SetUniform(const char* name, const Vector4& v) {
+	Uniform* u = FindUniform(name);
+	if (u && NeedsUpload(*u, &v, sizeof(float) * 4)) {
+		glProgramUniform4fv(programID, u->location, 1, (float*)&v);
+	}
+}
+
+void Shader::SetUniform(const char* name, const Matrix4& m) {
+	SetUniform(name, &m, 1);
+}
+
+void Shader::SetUniform(const char* name, const Matrix4* m, int count) {
+	Uniform* u = FindUniform(name);
+	if (u && count > 0 && NeedsUpload(*u, m, sizeof(Matrix4) * count)) {
+		glProgramUniformMatrix4fv(programID, u->location, count, GL_FALSE, (float*)m);
+	}
+}
+
+void Shader::ResetUniformStats() {
+	uniformStats = {};
+}
+
+/*
+Slots match the MeshBuffer enum, whichever VertexLayout a mesh was uploaded
+with - packed attributes are converted back to the same types on the way in,
+so shaders don't need to know which one they're drawing.
+*/
+void	Shader::SetDefaultAttributes(GLuint program)	{
+	glBindAttribLocation(program, VERTEX_BUFFER,  "position");
+	glBindAttribLocation(program, COLOUR_BUFFER,  "colour");
+	glBindAttribLocation(program, NORMAL_BUFFER,  "normal");
+	glBindAttribLocation(program, TANGENT_BUFFER, "tangent");
+	glBindAttribLocation(program, TEXTURE_BUFFER, "texCoord");
+
+	glBindAttribLocation(program, WEIGHTVALUE_BUFFER, "jointWeights");
+	glBindAttribLocation(program, WEIGHTINDEX_BUFFER, "jointIndices");
+	glBindAttribLocation(program, INSTANCE_MATRIX_ATTRIBUTE, "instanceModel");
+	glBindAttribLocation(program, INSTANCE_COLOUR_ATTRIBUTE, "instanceColour");
 }
 
 void	Shader::DeleteIDs() {
@@ -140,10 +457,25 @@ void	Shader::DeleteIDs() {
 			glDeleteShader(objectIDs[i]);
 		}
 	}
+	GLStateCache::GetSharedCache().Forget(GL_PROGRAM, programID);
 	glDeleteProgram(programID);
 	programID = 0;
 }
 
+void	Shader::DeletePending() {
+	if (!pending.program) {
+		return;
+	}
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		if (pending.objectIDs[i]) {
+			glDetachShader(pending.program, pending.objectIDs[i]);
+			glDeleteShader(pending.objectIDs[i]);
+		}
+	}
+	glDeleteProgram(pending.program);
+	pending.program = 0;
+}
+
 void	Shader::PrintCompileLog(GLuint object) {
 	int logLength = 0;
 	glGetShaderiv(object, GL_INFO_LOG_LENGTH, &logLength);
@@ -168,7 +500,21 @@ void	Shader::PrintLinkLog(GLuint program) {
 }
 
 void Shader::ReloadAllShaders() {
-	for (auto& i : allShaders) {
-		i->Reload();
+	for (Shader* s : allShaders) {
+		s->BeginReload();
+	}
+}
+
+void Shader::UpdateReloads() {
+	for (Shader* s : allShaders) {
+		if (s->pending.program && s->IsReloadReady()) {
+			s->FinishReload();
+		}
+	}
+}
+
+void Shader::FinishAllReloads() {
+	for (Shader* s : allShaders) {
+		s->FinishReload();
 	}
 }
\ No newline at end of file
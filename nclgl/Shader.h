@@ -3,9 +3,29 @@ Class:Shader
 Implements:
 Author:Rich Davison	 <richard-gordon.davison@newcastle.ac.uk>
 Description:VERY simple class to encapsulate GLSL shader loading, linking,
-and binding. Useful additions to this class would be overloaded functions to
-replace the glUniformxx functions in external code, and possibly a map to store
-uniform names and their resulting bindings. 
+and binding.
+
+Once linked, the program's active uniforms are looked up once and kept in a
+small hash table by name, so SetUniform never has to ask GL where a uniform
+is. It also remembers the last value it uploaded to each one, and skips the
+upload if it's being set to the same thing again - so every change to a
+uniform must go through SetUniform, or it'll lose track of what's there. Names
+of arrays are given without the [0]. Setting a uniform the program doesn't
+have (or that the compiler optimised out) does nothing, as with a location of
+-1 in GL.
+
+Linked programs are kept in the ProgramCache, and loaded from there rather
+than compiled when none of their source has changed since.
+
+Compiling is only started when a shader is made, so making a batch of them
+and then checking LoadSuccess on each lets a driver with
+KHR_parallel_shader_compile work on them all at once. Anything that needs the
+program waits for it. Reloads run alongside the old program, which is used
+until the new one is ready.
+
+Shaders can #include "file" from the shaders directory, on a line of its own.
+UniformBlocks.glsl declares the FrameUniforms and ObjectUniforms blocks that
+OGLRenderer fills in, which are bound to the bindings below on linking.
 
 -_-_-_-_-_-_-_,------,   
 _-_-_-_-_-_-_-|   /\_/\   NYANYANYAN
@@ -16,6 +36,8 @@ _-_-_-_-_-_-_-""  ""
 
 #pragma once
 #include "OGLRenderer.h"
+#include <vector>
+#include <cstdint>
 
 enum ShaderStage {
 	SHADER_VERTEX,
@@ -26,30 +48,103 @@ enum ShaderStage {
 	SHADER_MAX
 };
 
+enum UniformBlockBinding {
+	FRAME_UNIFORM_BINDING,	//View, projection, camera and light - once a frame
+	OBJECT_UNIFORM_BINDING	//Model and texture matrices - once a draw
+};
+
 class Shader	{
 public:
+	//Running totals across every shader, until ResetUniformStats
+	struct UniformStats {
+		size_t lookups;			//Uniforms found by name in the hash tables
+		size_t glLookups;		//Locations asked of GL, which only happens on linking
+		size_t uploads;
+		size_t skipped;			//Uploads left out as the value hadn't changed
+	};
+
 	Shader(const std::string& vertex, const std::string& fragment, const std::string& geometry = "", const std::string& domain = "", const std::string& hull = "");
 	~Shader(void);
 
-	GLuint  GetProgram() { return programID;}
-	
-	void	Reload(bool deleteOld = true);
+	GLuint  GetProgram() { WaitForProgram(); return programID;}
+
+	//Compiles and links again, waiting for it to finish
+	void	Reload();
+
+	//Submits the sources to the driver, without waiting on the compile
+	void	BeginReload();
+	//Whether FinishReload would have to wait for the driver
+	bool	IsReloadReady() const;
+	//Waits for the compile, if it's not done, and swaps the new program in
+	void	FinishReload();
+	bool	IsReloading() const { return pending.program != 0; }
 
 	bool	LoadSuccess() {
+		WaitForProgram();
 		return shaderValid[0] == GL_TRUE && programValid == GL_TRUE;
 	}
 
+	//Starts every shader reloading. Each one keeps drawing with its old program
+	//until UpdateReloads finds its new one is ready.
 	static void ReloadAllShaders();
+	//Swaps in any reloaded programs the driver has finished; once a frame
+	static void	UpdateReloads();
+	static void	FinishAllReloads();
 	static void	PrintCompileLog(GLuint object);
 	static void	PrintLinkLog(GLuint program);
 
+	bool	UsesFrameUniforms() const	{ return usesFrameUniforms; }
+	bool	UsesObjectUniforms() const	{ return usesObjectUniforms; }
+
+	//-1 if the program has no such active uniform
+	GLint	GetUniformLocation(const char* name);
+
+	//Uploads straight to the program, whether it's bound or not
+	void	SetUniform(const char* name, int i);
+	void	SetUniform(const char* name, float f);
+	void	SetUniform(const char* name, const Vector2& v);
+	void	SetUniform(const char* name, const Vector3& v);
+	void	SetUniform(const char* name, const Vector4& v);
+	void	SetUniform(const char* name, const Matrix4& m);
+	void	SetUniform(const char* name, const Matrix4* m, int count);
+
+	static const UniformStats&	GetUniformStats() { return uniformStats; }
+	static void					ResetUniformStats();
+
 protected:
+	struct Uniform {
+		std::string			name;
+		uint32_t			hash;
+		GLint				location;
+		bool				uploaded;
+		std::vector<char>	value;	//As last uploaded
+	};
+
+	//A program being compiled and linked, which takes the place of the one
+	//above once it's done
+	struct Build {
+		GLuint		program;
+		GLuint		objectIDs[SHADER_MAX];
+		bool		cacheable;	//Every file was read, so it can go in the ProgramCache
+		bool		fromCache;
+		uint64_t	key;
+	};
+
 	void	DeleteIDs();
+	void	DeletePending();
+	void	WaitForProgram();
 
-	bool	LoadShaderFile(const  std::string& from, std::string &into);
-	void	GenerateShaderObject(unsigned int i);
-	void	SetDefaultAttributes();
-	void	LinkProgram();
+	bool	LoadShaderFile(const  std::string& from, std::string &into, int includeDepth = 0);
+	void	GenerateShaderObject(unsigned int i, const std::string& shaderText, bool loaded);
+	void	SetDefaultAttributes(GLuint program);
+	void	FindUniforms();
+	void	BindUniformBlocks();
+	std::string	GetCacheName() const;
+
+	Uniform*	FindUniform(const char* name);
+	//Whether value differs from what was last uploaded, noting it as
+	//uploaded if it does
+	bool		NeedsUpload(Uniform& u, const void* value, size_t size);
 
 	GLuint	programID;
 	GLuint	objectIDs[SHADER_MAX];
@@ -57,7 +152,14 @@ protected:
 	GLint	shaderValid[SHADER_MAX];
 
 	std::string  shaderFiles[SHADER_MAX];
+	Build	pending;	//Program is 0 if there's nothing being built
+
+	std::vector<Uniform>	uniforms;
+	std::vector<int>		uniformTable;	//Open addressed, indices into uniforms or -1
+	bool					usesFrameUniforms;
+	bool					usesObjectUniforms;
 
 	static std::vector<Shader*> allShaders;
+	static UniformStats			uniformStats;
 };
 
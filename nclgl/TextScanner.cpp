@@ -0,0 +1,257 @@
+#include "TextScanner.h"
+
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+//Every power of ten up to here is exactly representable as a double
+static const int MAX_EXACT_POWER = 22;
+
+static const double powersOfTen[MAX_EXACT_POWER + 1] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+//Same characters as isspace in the C locale - tab, newline, vtab, formfeed and return are contiguous
+static inline bool IsSpace(char c) {
+	return c == ' ' || (unsigned char)(c - '\t') <= (unsigned char)('\r' - '\t');
+}
+
+static inline bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+TextScanner::TextScanner(const char* begin, const char* end) {
+	this->current	= begin;
+	this->end		= end;
+}
+
+bool TextScanner::LoadFile(const std::string& filename, std::vector<char>& into) {
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+
+	if (!file) {
+		return false;
+	}
+	std::streamoff size = file.tellg();
+	file.seekg(0);
+
+	into.resize((size_t)size);
+	return size == 0 || (bool)file.read(into.data(), size);
+}
+
+void TextScanner::SkipWhitespace() {
+	while (current < end && IsSpace(*current)) {
+		++current;
+	}
+}
+
+/*
+Fast path for the plain decimals the asset exporters write: when the digits
+fit in a double's 53 bit mantissa and the power of ten is exact, one double
+multiply or divide gives the correctly rounded double. Rounding that again
+to float can only differ from a direct conversion when the double lands
+exactly halfway between two floats, so those cases (and anything unusual,
+like very long or tiny numbers, infinities or hex floats) go to strtof.
+*/
+bool TextScanner::ReadFloat(float& f) {
+	SkipWhitespace();
+
+	const char* start = current;
+	bool negative = false;
+
+	if (current < end && (*current == '-' || *current == '+')) {
+		negative = (*current == '-');
+		++current;
+	}
+
+	unsigned long long mantissa = 0;
+	int  significantDigits	= 0;
+	int  exponent			= 0;
+	bool exact				= true;
+	bool hasDigits			= false;
+
+	for (; current < end && IsDigit(*current); ++current) {
+		hasDigits = true;
+		if (mantissa == 0 && *current == '0') {
+			continue;	//Leading zeros
+		}
+		if (significantDigits < 19) {
+			mantissa = mantissa * 10 + (*current - '0');
+			++significantDigits;
+		}
+		else {
+			++exponent;
+			exact = false;
+		}
+	}
+
+	if (current < end && *current == '.') {
+		for (++current; current < end && IsDigit(*current); ++current) {
+			hasDigits = true;
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + (*current - '0');
+				significantDigits += (mantissa != 0);
+				--exponent;
+			}
+			else {
+				exact = false;
+			}
+		}
+	}
+
+	if (!hasDigits) {
+		current = start;
+		return ReadFloatSlow(f);	//inf, nan etc
+	}
+
+	if (current < end && (*current == 'e' || *current == 'E')) {
+		const char* exponentStart = current++;
+		bool negativeExponent = false;
+
+		if (current < end && (*current == '-' || *current == '+')) {
+			negativeExponent = (*current == '-');
+			++current;
+		}
+		if (current < end && IsDigit(*current)) {
+			int explicitExponent = 0;
+			for (; current < end && IsDigit(*current); ++current) {
+				explicitExponent = std::min(explicitExponent * 10 + (*current - '0'), 100000);
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+		}
+		else {
+			current = exponentStart;	//Not an exponent after all, same as strtof
+		}
+	}
+
+	if (current < end && !IsSpace(*current)) {
+		current = start;
+		return ReadFloatSlow(f);	//Something we don't handle, like a hex float
+	}
+
+	if (mantissa == 0) {
+		f = negative ? -0.0f : 0.0f;
+		return true;
+	}
+
+	if (exact && mantissa <= (1ull << 53) && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+		double d = (double)mantissa;
+		d = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+
+		unsigned long long bits;
+		memcpy(&bits, &d, sizeof(bits));
+
+		//The low 29 bits of a double's mantissa are the ones dropped going to float
+		bool halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+
+		if (!halfway && d >= FLT_MIN && d <= FLT_MAX) {
+			f = (float)(negative ? -d : d);
+			return true;
+		}
+	}
+	current = start;
+	return ReadFloatSlow(f);
+}
+
+bool TextScanner::ReadFloatSlow(float& f) {
+	char token[64];
+	size_t length = 0;
+
+	while (current + length < end && !IsSpace(current[length]) && length < sizeof(token) - 1) {
+		token[length] = current[length];
+		++length;
+	}
+	token[length] = '\0';
+
+	char* tokenEnd = nullptr;
+	float value = strtof(token, &tokenEnd);
+
+	if (tokenEnd == token) {
+		return false;
+	}
+	current += tokenEnd - token;
+	f = value;
+	return true;
+}
+
+bool TextScanner::ReadInt(int& i) {
+	SkipWhitespace();
+
+	const char* start = current;
+	bool negative = false;
+
+	if (current < end && (*current == '-' || *current == '+')) {
+		negative = (*current == '-');
+		++current;
+	}
+	long long value = 0;
+	const char* digitStart = current;
+
+	for (; current < end && IsDigit(*current); ++current) {
+		value = std::min(value * 10 + (*current - '0'), 1ll << 32);
+	}
+	if (current == digitStart) {
+		current = start;
+		return false;
+	}
+	i = (int)(negative ? -value : value);
+	return true;
+}
+
+bool TextScanner::ReadUInt(unsigned int& i) {
+	int value;
+	if (!ReadInt(value)) {
+		return false;
+	}
+	i = (unsigned int)value;
+	return true;
+}
+
+bool TextScanner::ReadWord(std::string& word) {
+	SkipWhitespace();
+
+	const char* start = current;
+	while (current < end && !IsSpace(*current)) {
+		++current;
+	}
+	if (current == start) {
+		return false;
+	}
+	word.assign(start, current);
+	return true;
+}
+
+bool TextScanner::SkipTokens(size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		SkipWhitespace();
+		if (current >= end) {
+			return false;
+		}
+		while (current < end && ((unsigned char)*current > ' ' || !IsSpace(*current))) {
+			++current;
+		}
+	}
+	return true;
+}
+
+bool TextScanner::ReadLine(std::string& line) {
+	if (current >= end) {
+		return false;
+	}
+	const char* start = current;
+	const char* lineEnd = (const char*)memchr(current, '\n', end - current);
+
+	if (!lineEnd) {
+		lineEnd = end;
+	}
+	current = (lineEnd < end) ? lineEnd + 1 : end;
+
+	if (lineEnd > start && lineEnd[-1] == '\r') {
+		--lineEnd;	//Text mode streams would have dropped this
+	}
+	line.assign(start, lineEnd);
+	return true;
+}
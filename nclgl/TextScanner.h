@@ -0,0 +1,44 @@
+/******************************************************************************
+Class:TextScanner
+Implements:
+Description:Whitespace separated token reader over an in-memory copy of a text
+file, used in place of std::ifstream extraction for large asset files. Numbers
+are parsed directly out of the buffer without going through the locale, and
+floats are rounded exactly as strtof would round them.
+
+Every Read function returns false (leaving its output alone) if there's no
+valid token of that type left, so a truncated file can be detected.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <string>
+#include <vector>
+
+class TextScanner {
+public:
+	TextScanner(const char* begin, const char* end);
+	~TextScanner(void) {}
+
+	//Reads an entire file into memory, returning false if it couldn't be opened
+	static bool LoadFile(const std::string& filename, std::vector<char>& into);
+
+	bool	ReadFloat(float& f);
+	bool	ReadInt(int& i);
+	bool	ReadUInt(unsigned int& i);
+	bool	ReadWord(std::string& word);
+	//Reads up to the next line break, which is then skipped
+	bool	ReadLine(std::string& line);
+
+	//Moves past count tokens without parsing them, false if the file ends first
+	bool	SkipTokens(size_t count);
+
+	bool		AtEnd()			const { return current >= end; }
+	const char*	GetPosition()	const { return current; }
+
+protected:
+	void	SkipWhitespace();
+	bool	ReadFloatSlow(float& f);
+
+	const char* current;
+	const char* end;
+};
@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	stopping = false;
+
+	if (threadCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		workers.emplace_back(&ThreadPool::WorkerThread, this);
+	}
+}
+
+ThreadPool::~ThreadPool(void) {
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		stopping = true;
+	}
+	taskReady.notify_all();
+
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetSharedPool() {
+	static ThreadPool sharedPool;
+	return sharedPool;
+}
+
+void ThreadPool::Enqueue(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		tasks.push(std::move(task));
+	}
+	taskReady.notify_one();
+}
+
+void ThreadPool::WorkerThread() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(taskMutex);
+			taskReady.wait(lock, [&]() { return stopping || !tasks.empty(); });
+
+			if (tasks.empty()) {
+				return;	//Only reached once stopping, after the queue drains
+			}
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+/*
+Work is handed out an index at a time from a shared counter, and the caller
+only waits for indices that have actually been claimed, not for the helper
+tasks themselves. Helpers that only get to run after the loop is done find
+nothing left to claim, which is why the loop state is reference counted
+rather than living on the caller's stack.
+*/
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& function) {
+	struct LoopState {
+		std::function<void(size_t)> function;
+		size_t						count;
+		std::atomic<size_t>			next;
+		std::atomic<size_t>			finished;
+		std::mutex					mutex;
+		std::condition_variable		allFinished;
+
+		void Run() {
+			size_t i;
+			while ((i = next++) < count) {
+				function(i);
+				if (++finished == count) {
+					std::lock_guard<std::mutex> lock(mutex);
+					allFinished.notify_all();
+				}
+			}
+		}
+	};
+
+	if (count == 0) {
+		return;
+	}
+	auto state = std::make_shared<LoopState>();
+	state->function = function;
+	state->count	= count;
+	state->next		= 0;
+	state->finished = 0;
+
+	size_t helpers = std::min(count - 1, workers.size());
+
+	for (size_t i = 0; i < helpers; ++i) {
+		Enqueue([state]() { state->Run(); });
+	}
+	state->Run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->allFinished.wait(lock, [&]() { return state->finished == count; });
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+Class:ThreadPool
+Implements:
+Description:A fixed set of worker threads pulling tasks off a shared queue.
+Submit hands back a std::future for a single task, while ParallelFor splits
+a loop across the workers and the calling thread.
+
+Most code should use the shared pool from GetSharedPool, rather than
+spinning up threads of its own.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+class ThreadPool {
+public:
+	//0 threads means one per hardware thread, less one for the caller
+	ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool(void);
+
+	static ThreadPool& GetSharedPool();
+
+	unsigned int GetThreadCount() const { return (unsigned int)workers.size(); }
+
+	template<typename F>
+	std::future<typename std::result_of<F()>::type> Submit(F function) {
+		typedef typename std::result_of<F()>::type Result;
+
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+		std::future<Result> result = task->get_future();
+		Enqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	//Calls function(i) for every i in [0, count), returning once they've all
+	//finished. The caller works through the loop too, so this is safe to use
+	//from inside a pool task without deadlocking the pool.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+protected:
+	void Enqueue(std::function<void()> task);
+	void WorkerThread();
+
+	std::vector<std::thread>			workers;
+	std::queue<std::function<void()>>	tasks;
+	std::mutex							taskMutex;
+	std::condition_variable				taskReady;
+	bool								stopping;
+};
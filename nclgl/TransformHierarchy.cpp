@@ -0,0 +1,289 @@
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+const TransformHierarchy::Handle	TransformHierarchy::INVALID_HANDLE;
+const unsigned int					TransformHierarchy::NO_PARENT;
+const size_t						TransformHierarchy::PARALLEL_GRAIN;
+
+TransformHierarchy::TransformHierarchy(void) {
+	firstDirty			= 0;
+	needsReorder		= false;
+	structureVersion	= 0;
+}
+
+TransformHierarchy& TransformHierarchy::GetSharedHierarchy() {
+	static TransformHierarchy sharedHierarchy;
+	return sharedHierarchy;
+}
+
+/*
+New nodes go on the end, which is always after their parent - but outside the
+run of slots the parent's subtree is in, so that has to be put right.
+*/
+TransformHierarchy::Handle TransformHierarchy::Create(Handle parent) {
+	Handle h;
+	if (!freeHandles.empty()) {
+		h = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		h = (Handle)slots.size();
+		slots.push_back(0);
+	}
+	unsigned int slot = (unsigned int)parents.size();
+	slots[h] = slot;
+
+	local.push_back(Matrix4());
+	world.push_back(Matrix4());
+	parents.push_back(parent == INVALID_HANDLE ? NO_PARENT : slots[parent]);
+	dirty.push_back(0);
+	slotHandles.push_back(h);
+	subtreeEnds.push_back(slot + 1);
+
+	MarkDirty(slot);
+	if (parent != INVALID_HANDLE) {
+		needsReorder = true;
+	}
+	structureVersion++;
+	return h;
+}
+
+/*
+The slot is left empty until the next Update closes the gap, so nothing else
+has to move just yet.
+*/
+void TransformHierarchy::Destroy(Handle h) {
+	slotHandles[slots[h]] = INVALID_HANDLE;
+	freeHandles.push_back(h);
+	needsReorder = true;
+	structureVersion++;
+}
+
+void TransformHierarchy::SetParent(Handle h, Handle parent) {
+	unsigned int slot		= slots[h];
+	unsigned int parentSlot	= parent == INVALID_HANDLE ? NO_PARENT : slots[parent];
+
+	if (parents[slot] != parentSlot) {
+		parents[slot]	= parentSlot;
+		needsReorder	= true;	//Its subtree has moved into someone else's
+		structureVersion++;
+	}
+	MarkDirty(slot);
+}
+
+TransformHierarchy::Handle TransformHierarchy::GetParent(Handle h) const {
+	unsigned int parentSlot = parents[slots[h]];
+	return parentSlot == NO_PARENT ? INVALID_HANDLE : slotHandles[parentSlot];
+}
+
+void TransformHierarchy::SetLocalTransform(Handle h, const Matrix4& m) {
+	unsigned int slot = slots[h];
+	local[slot] = m;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::Touch(Handle h) {
+	MarkDirty(slots[h]);
+}
+
+/*
+Each node has a dirty flag to itself, so only firstDirty is shared between
+threads moving different nodes.
+*/
+void TransformHierarchy::MarkDirty(unsigned int slot) {
+	dirty[slot] = 1;
+
+	size_t first = firstDirty.load(std::memory_order_relaxed);
+	while (slot < first && !firstDirty.compare_exchange_weak(first, slot, std::memory_order_relaxed)) {}
+}
+
+/*
+Depth first from each root, so every subtree ends up in one run of slots,
+parent first. Anything not reached from a root is part of a loop of parents,
+which is broken by making the first node found in it a root.
+*/
+void TransformHierarchy::Reorder() {
+	size_t count = parents.size();
+
+	std::vector<unsigned int> childStart(count + 1, 0);
+	for (size_t i = 0; i < count; ++i) {
+		if (slotHandles[i] == INVALID_HANDLE) {
+			continue;
+		}
+		if (parents[i] != NO_PARENT && slotHandles[parents[i]] == INVALID_HANDLE) {
+			parents[i]	= NO_PARENT;	//Its parent has been destroyed
+			dirty[i]	= 1;
+		}
+		if (parents[i] != NO_PARENT) {
+			childStart[parents[i] + 1]++;
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		childStart[i + 1] += childStart[i];
+	}
+	std::vector<unsigned int> children(childStart[count]);
+	{
+		std::vector<unsigned int> filled(childStart.begin(), childStart.end() - 1);
+		for (size_t i = 0; i < count; ++i) {
+			if (slotHandles[i] != INVALID_HANDLE && parents[i] != NO_PARENT) {
+				children[filled[parents[i]]++] = (unsigned int)i;
+			}
+		}
+	}
+
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> newSlots(count, NO_PARENT);
+	std::vector<unsigned int> stack;
+	order.reserve(count);
+
+	auto Visit = [&](unsigned int root) {
+		stack.push_back(root);
+		while (!stack.empty()) {
+			unsigned int s = stack.back();
+			stack.pop_back();
+			newSlots[s] = (unsigned int)order.size();
+			order.push_back(s);
+
+			for (unsigned int c = childStart[s + 1]; c > childStart[s]; --c) {
+				stack.push_back(children[c - 1]);	//Backwards, so the first child comes out first
+			}
+		}
+	};
+	for (size_t i = 0; i < count; ++i) {
+		if (slotHandles[i] != INVALID_HANDLE && parents[i] == NO_PARENT) {
+			Visit((unsigned int)i);
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (slotHandles[i] != INVALID_HANDLE && newSlots[i] == NO_PARENT) {
+			parents[i]	= NO_PARENT;
+			dirty[i]	= 1;
+			Visit((unsigned int)i);
+		}
+	}
+
+	std::vector<Matrix4>		newLocal(order.size());
+	std::vector<Matrix4>		newWorld(order.size());
+	std::vector<unsigned int>	newParents(order.size());
+	std::vector<uint8_t>		newDirty(order.size());
+	std::vector<Handle>			newSlotHandles(order.size());
+	std::vector<unsigned int>	newSubtreeEnds(order.size());
+
+	for (size_t n = 0; n < order.size(); ++n) {
+		unsigned int s = order[n];
+		newLocal[n]			= local[s];
+		newWorld[n]			= world[s];
+		newParents[n]		= parents[s] == NO_PARENT ? NO_PARENT : newSlots[parents[s]];
+		newDirty[n]			= dirty[s];
+		newSlotHandles[n]	= slotHandles[s];
+		newSubtreeEnds[n]	= (unsigned int)n + 1;
+		slots[slotHandles[s]] = (unsigned int)n;
+	}
+	//Children come after their parent, so going backwards each subtree's end
+	//is known before it's passed up to the parent
+	for (size_t n = order.size(); n-- > 0;) {
+		if (newParents[n] != NO_PARENT) {
+			newSubtreeEnds[newParents[n]] = std::max(newSubtreeEnds[newParents[n]], newSubtreeEnds[n]);
+		}
+	}
+	local.swap(newLocal);
+	world.swap(newWorld);
+	parents.swap(newParents);
+	dirty.swap(newDirty);
+	slotHandles.swap(newSlotHandles);
+	subtreeEnds.swap(newSubtreeEnds);
+
+	firstDirty		= 0;
+	needsReorder	= false;
+}
+
+/*
+A node needs a new world transform if its own local transform has changed, or
+its parent's world transform has - and as the parent comes first, that's
+already known by the time the node is reached.
+*/
+void TransformHierarchy::UpdateSlot(size_t slot) {
+	unsigned int parent = parents[slot];
+
+	if (parent != NO_PARENT && dirty[parent]) {
+		dirty[slot] = 1;
+	}
+	if (dirty[slot]) {
+		world[slot] = parent == NO_PARENT ? local[slot] : world[parent] * local[slot];
+	}
+}
+
+/*
+Dirty flags are only cleared once everything is done, as a node's flag is what
+tells its children they've moved too.
+*/
+void TransformHierarchy::FinishUpdate(size_t first) {
+	size_t count = parents.size();
+	lastUpdated.clear();
+
+	for (size_t i = first; i < count; ++i) {
+		if (dirty[i]) {
+			lastUpdated.push_back(slotHandles[i]);
+			dirty[i] = 0;
+		}
+	}
+	firstDirty = count;
+}
+
+void TransformHierarchy::Update() {
+	if (needsReorder) {
+		Reorder();
+	}
+	size_t count = parents.size();
+	size_t first = firstDirty;
+
+	for (size_t i = first; i < count; ++i) {
+		UpdateSlot(i);
+	}
+	FinishUpdate(first);
+}
+
+/*
+Everything before firstDirty is already up to date, so each subtree from there
+on can be done by itself once the nodes above it have been. Walking forwards,
+a subtree small enough to hand out is skipped over whole, while a bigger one
+has its top node done here and now, and is then split up beneath it. Runs of
+small neighbouring subtrees are handed out together.
+*/
+void TransformHierarchy::Update(JobSystem& jobs) {
+	if (needsReorder) {
+		Reorder();
+	}
+	size_t count = parents.size();
+	size_t first = firstDirty;
+
+	if (count - std::min(first, count) < PARALLEL_GRAIN * 2 || jobs.GetWorkerCount() == 0) {
+		Update();
+		return;
+	}
+	std::vector<std::pair<size_t, size_t>>& ranges = updateRanges;
+	ranges.clear();
+	for (size_t i = first; i < count;) {
+		size_t end = subtreeEnds[i];
+
+		if (end - i > PARALLEL_GRAIN) {
+			UpdateSlot(i);
+			++i;
+			continue;
+		}
+		if (!ranges.empty() && ranges.back().second == i && end - ranges.back().first <= PARALLEL_GRAIN) {
+			ranges.back().second = end;
+		}
+		else {
+			ranges.push_back(std::make_pair(i, end));
+		}
+		i = end;
+	}
+	jobs.ParallelFor(ranges.size(), [&](size_t r) {
+		for (size_t i = ranges[r].first; i < ranges[r].second; ++i) {
+			UpdateSlot(i);
+		}
+	});
+	FinishUpdate(first);
+}
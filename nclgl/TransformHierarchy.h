@@ -0,0 +1,103 @@
+/******************************************************************************
+Class:TransformHierarchy
+Implements:
+Description:Local and world transforms of every node in a scene graph, kept in
+flat arrays rather than in the nodes themselves. Parents are always stored
+before their children, so a single pass from front to back computes every world
+transform, each from a parent that has already been done.
+
+Only transforms that have changed since the last Update are recomputed, along
+with everything beneath them - a scene standing still costs next to nothing.
+
+Nodes are referred to by Handle, which stays the same while the arrays behind
+it are reordered (when a node is given a new parent, or deleted).
+
+Every subtree is kept in one run of slots, so separate subtrees can be updated
+on separate threads. While that goes on, SetLocalTransform can be called on
+different nodes from several threads at once - but nothing else can.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "Matrix4.h"
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <utility>
+
+class JobSystem;
+
+class TransformHierarchy {
+public:
+	typedef unsigned int Handle;
+
+	static const Handle INVALID_HANDLE = 0xFFFFFFFF;
+
+	TransformHierarchy(void);
+	~TransformHierarchy(void) {}
+
+	//The hierarchy SceneNodes keep their transforms in
+	static TransformHierarchy& GetSharedHierarchy();
+
+	Handle	Create(Handle parent = INVALID_HANDLE);
+	//Children of a destroyed node become roots
+	void	Destroy(Handle h);
+
+	void	SetParent(Handle h, Handle parent);
+	Handle	GetParent(Handle h) const;
+
+	void			SetLocalTransform(Handle h, const Matrix4& m);
+	//Counts a node as having moved in the next Update without changing its
+	//transform, for when something else about where it is has changed
+	void			Touch(Handle h);
+	const Matrix4&	GetLocalTransform(Handle h) const { return local[slots[h]]; }
+
+	//As of the last Update
+	const Matrix4&	GetWorldTransform(Handle h) const { return world[slots[h]]; }
+
+	void	Update();
+	//Hands out subtrees of a few thousand nodes or so to the job system's
+	//threads, leaving just the nodes above them to do in order
+	void	Update(JobSystem& jobs);
+
+	size_t	GetCount() const			{ return slots.size() - freeHandles.size(); }
+	//Every node whose world transform the last Update had to compute
+	const std::vector<Handle>&	GetLastUpdated() const		{ return lastUpdated; }
+	size_t						GetLastUpdateCount() const	{ return lastUpdated.size(); }
+
+	//Goes up whenever a node is created, destroyed or given a new parent
+	unsigned int	GetStructureVersion() const { return structureVersion; }
+
+protected:
+	static const unsigned int NO_PARENT = 0xFFFFFFFF;
+	//Subtrees smaller than this aren't worth splitting up any further
+	static const size_t PARALLEL_GRAIN = 2048;
+
+	void	MarkDirty(unsigned int slot);
+	//Brings slot up to date, given its parent already is
+	void	UpdateSlot(size_t slot);
+	//Clears the dirty flags from first on, noting which nodes they were for
+	void	FinishUpdate(size_t first);
+
+	//Puts parents back in front of their children, and closes up the gaps
+	//left by destroyed nodes
+	void	Reorder();
+
+	//By slot, in update order
+	std::vector<Matrix4>		local;
+	std::vector<Matrix4>		world;
+	std::vector<unsigned int>	parents;	//Slot of the parent, or NO_PARENT
+	std::vector<uint8_t>		dirty;
+	std::vector<Handle>			slotHandles;
+	std::vector<unsigned int>	subtreeEnds;	//One past the slot of the last node beneath
+
+	//By handle
+	std::vector<unsigned int>	slots;
+	std::vector<Handle>			freeHandles;
+
+	std::atomic<size_t>	firstDirty;	//Nothing before this slot needs updating
+	bool				needsReorder;
+	unsigned int		structureVersion;
+	std::vector<Handle>	lastUpdated;
+	//The runs of slots Update last handed out, kept to save reallocating them
+	std::vector<std::pair<size_t, size_t>>	updateRanges;
+};
@@ -0,0 +1,125 @@
+#include "UniformRing.h"
+#include <algorithm>
+#include <cstring>
+
+static const GLuint64 WAIT_TIMEOUT = 1000000;	//1ms, in ns
+
+UniformRing::UniformRing(GLsizeiptr regionSize) {
+	buffer			= 0;
+	persistent		= GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+	mapped			= nullptr;
+	used			= 0;
+	region			= 0;
+	writes			= 0;
+	lastFrameWrites	= 0;
+	stalls			= 0;
+	alignment		= 256;
+	for (int i = 0; i < FRAMES; ++i) {
+		fences[i] = 0;
+	}
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	Allocate(std::max(regionSize, (GLsizeiptr)alignment));
+}
+
+UniformRing::~UniformRing(void) {
+	Release();
+}
+
+void UniformRing::Allocate(GLsizeiptr newRegionSize) {
+	Release();
+	regionSize = (newRegionSize + alignment - 1) / alignment * alignment;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = regionSize * FRAMES;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	if (persistent) {
+		glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+		mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glObjectLabel(GL_BUFFER, buffer, -1, "Uniform Ring");
+
+	if (persistent && !mapped) {
+		std::cout << "UniformRing: Couldn't map " << size << " bytes!" << std::endl;
+	}
+}
+
+//Any draws still to come from the old buffer keep it alive until they're done
+void UniformRing::Release() {
+	for (int i = 0; i < FRAMES; ++i) {
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	if (mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	if (buffer) {
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer	= 0;
+	mapped	= nullptr;
+	used	= 0;
+	region	= 0;
+}
+
+void UniformRing::Write(GLuint binding, const void* data, GLsizeiptr size) {
+	GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+	if (start + size > regionSize) {
+		Allocate(std::max(regionSize * 2, size));
+		start = 0;
+	}
+	GLintptr offset = (GLintptr)region * regionSize + start;
+	if (mapped) {
+		memcpy(mapped + offset, data, size);
+	}
+	else if (!persistent) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	else {
+		return;
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+
+	used = start + size;
+	writes++;
+}
+
+/*
+The region just written has had all of its draws submitted, so that's where
+the fence goes - and the next one was fenced FRAMES - 1 frames ago, which
+should have long since passed.
+*/
+void UniformRing::NextFrame() {
+	if (used > 0) {
+		if (persistent) {	//glBufferSubData waits for the GPU by itself
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		region = (region + 1) % FRAMES;
+	}
+	if (fences[region]) {
+		GLenum result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			stalls++;
+			do {
+				result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fences[region]);
+		fences[region] = 0;
+	}
+	used			= 0;
+	lastFrameWrites	= writes;
+	writes			= 0;
+}
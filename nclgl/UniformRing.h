@@ -0,0 +1,58 @@
+/******************************************************************************
+Class:UniformRing
+Implements:
+Description:A uniform buffer that blocks of uniforms are written into one after
+another, and bound a range at a time - so per object uniforms can be given to
+each draw without a glBufferSubData, or a glUniform call per value. Like the
+InstanceBuffer, it's allocated once with glBufferStorage and left mapped, and
+split into FRAMES regions: NextFrame moves on to the next one, so the GPU can
+still be reading the last couple while this one is written.
+
+If a frame writes more than a region holds, the buffer is made again twice the
+size, and anything bound from the old one has to be written again - GetBuffer
+changes when that happens.
+
+Without glBufferStorage (GL 4.4, or ARB_buffer_storage) the buffer is an
+ordinary one instead, and each block goes in with a glBufferSubData - slower,
+but the shaders reading it work just the same.
+
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "OGLRenderer.h"
+
+class UniformRing {
+public:
+	static const int FRAMES = 3;
+
+	UniformRing(GLsizeiptr regionSize = 1024 * 1024);
+	~UniformRing(void);
+
+	//Copies a block in, and binds it to the given uniform block binding
+	void	Write(GLuint binding, const void* data, GLsizeiptr size);
+
+	//Starts writing the next region, once the GPU is done with it
+	void	NextFrame();
+
+	GLuint		GetBuffer() const		{ return buffer; }
+	GLsizeiptr	GetRegionSize() const	{ return regionSize; }
+	//Blocks written between the last two NextFrames
+	GLuint		GetLastFrameWrites() const	{ return lastFrameWrites; }
+	//How many times NextFrame has had to wait for the GPU to finish with a region
+	GLuint		GetStalls() const		{ return stalls; }
+
+protected:
+	void	Allocate(GLsizeiptr newRegionSize);
+	void	Release();
+
+	GLuint		buffer;
+	bool		persistent;	//Mapped once, or written with glBufferSubData
+	char*		mapped;
+	GLsync		fences[FRAMES];
+	GLsizeiptr	regionSize;
+	GLsizeiptr	used;		//Bytes of this region written so far
+	GLint		alignment;	//Of each block's offset, as GL requires
+	int			region;
+	GLuint		writes;
+	GLuint		lastFrameWrites;
+	GLuint		stalls;
+};